@@ -2,10 +2,33 @@
 #extension GL_ARB_separate_shader_objects : enable
 #extension GL_ARB_shading_language_420pack : enable
 
+// Compiled three times, the variants decode the chunk vertices of VmcModel::VERTEX_FORMAT_VOXEL and place the
+// instances of a SplineCrowd:
+// glslc simple_shader.vert -o simple_shader.vert.spv
+// glslc -DVOXEL_VERTEX simple_shader.vert -o simple_shader_voxel.vert.spv
+// glslc -DCROWD_INSTANCE simple_shader.vert -o simple_shader_crowd.vert.spv
+// The project runs these as a custom build step of this file, compile.bat runs them as well.
+#ifdef VOXEL_VERTEX
+// VmcModel::VoxelVertex: x 6 bits, y 9 bits, z 6 bits, BlockFace 3 bits, BlockType 6 bits, ambient occlusion 2 bits
+layout(location = 0) in uint voxel;
+#else
 layout(location = 0) in vec3 position;
 layout(location = 1) in vec3 color;
 layout(location = 2) in vec3 normal;
 layout(location = 3) in vec2 uv;
+#endif
+#ifdef CROWD_INSTANCE
+// SplineCrowd::Stream, one float per instance from every stream
+layout(location = 4) in float agentPositionX;
+layout(location = 5) in float agentPositionY;
+layout(location = 6) in float agentPositionZ;
+layout(location = 7) in float agentForwardX;
+layout(location = 8) in float agentForwardY;
+layout(location = 9) in float agentForwardZ;
+layout(location = 10) in float agentNormalX;
+layout(location = 11) in float agentNormalY;
+layout(location = 12) in float agentNormalZ;
+#endif
 
 layout(location = 0) out vec3 fragColor;
 layout(location = 1) out vec2 fragTexCoord;
@@ -25,15 +48,54 @@ layout(push_constant) uniform Push {
 
 const float AMBIENT = 0.02;
 
+#ifdef VOXEL_VERTEX
+// Indexed by BlockFace, y grows downwards in chunks
+const vec3 FACE_NORMALS[6] = vec3[](
+  vec3(0.0, -1.0, 0.0), vec3(0.0, 1.0, 0.0),
+  vec3(-1.0, 0.0, 0.0), vec3(1.0, 0.0, 0.0),
+  vec3(0.0, 0.0, -1.0), vec3(0.0, 0.0, 1.0));
+// Indexed by BlockType, air has no faces
+const vec3 BLOCK_COLORS[4] = vec3[](
+  vec3(0.45, 0.31, 0.19),  // dirt
+  vec3(0.33, 0.62, 0.22),  // grass
+  vec3(0.5, 0.5, 0.5),     // stone
+  vec3(0.86, 0.8, 0.56));  // sand
+// From 3 solid blocks around the corner to none
+const float OCCLUSION_BRIGHTNESS[4] = float[](0.35, 0.55, 0.77, 1.0);
+#endif
+
 
 
 void main() {
+#ifdef VOXEL_VERTEX
+  // Block corners, the vertices are half a block before them
+  vec3 position = vec3(uvec3(voxel, voxel >> 6, voxel >> 15) & uvec3(0x3f, 0x1ff, 0x3f)) - 0.5;
+  uint face = (voxel >> 21) & 0x7;
+  uint type = (voxel >> 24) & 0x3f;
+  vec3 normal = FACE_NORMALS[face];
+  // UVs repeat once per block along the two axes of the face
+  vec2 uv = face < 2 ? position.xz : (face < 4 ? position.zy : position.xy);
+  vec3 blockColor = BLOCK_COLORS[type] * OCCLUSION_BRIGHTNESS[voxel >> 30];
+#endif
+#ifdef CROWD_INSTANCE
+  // The model matrix scales the model, the frame of the agent turns it: local x = normal x forward, y = normal, z = forward
+  vec3 agentForward = vec3(agentForwardX, agentForwardY, agentForwardZ);
+  vec3 agentNormal = vec3(agentNormalX, agentNormalY, agentNormalZ);
+  mat3 agentBasis = mat3(cross(agentNormal, agentForward), agentNormal, agentForward);
+  vec3 worldPosition = agentBasis * (push.modelMatrix * vec4(position, 1.0)).xyz + vec3(agentPositionX, agentPositionY, agentPositionZ);
+  gl_Position = ubo.projectionMatrix * ubo.view * vec4(worldPosition, 1.0);
+  vec3 normalWorldSpace = normalize(agentBasis * (mat3(push.normalMatrix) * normal));
+#else
   gl_Position = ubo.projectionMatrix * ubo.view * push.modelMatrix * vec4(position, 1.0);
   vec3 normalWorldSpace =  normalize(mat3(push.normalMatrix) * normal);
+#endif
 
   // If light intensity is negative(surface isn't facing light), the intensity should be 0
   float lightIntensity = AMBIENT + max(dot(normalWorldSpace, ubo.directionToLight), 0);
 
   fragColor = lightIntensity * push.colorPush;
+#ifdef VOXEL_VERTEX
+  fragColor *= blockColor;
+#endif
   fragTexCoord = uv;
 }
\ No newline at end of file
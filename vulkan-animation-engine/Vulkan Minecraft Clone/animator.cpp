@@ -119,35 +119,9 @@ namespace vae {
 		std::cout << "=============================================================" << std::endl;
 	}
 
-	// Calculates the traversed distance (arc length fraction) based on the time that has passed 
-	float Animator::distanceTimeFuncSine()
+	float Animator::timeFraction() const
 	{
-		// 1/2 sin(3x + (pi/2)) + 1/2
-		float distanceFraction = 1 - (0.5f * glm::sin(3 * (timePassed / duration) + (glm::pi<float>() / 2)) + 0.5f);
-		// Reset if we've reached the end of the animation loop
-		if (timePassed > duration) {
-			timePassed = 0.0f;
-		}
-		return distanceFraction;
-	}
-
-	float Animator::distanceTimeFuncLinear()
-	{
-		// Linear relation between distance and time passed
-		float distanceFraction = timePassed / duration;
-
-		// Reset if we've reached the end of the animation loop
-		if (timePassed > duration) {
-			timePassed = 0.0f;
-		}
-		return distanceFraction;
-	}
-
-	float Animator::distanceTimeFuncParabolic()
-	{
-		// y = x^2
-		float distanceFraction = pow(timePassed / duration, 2);
-		return distanceFraction;
+		return duration > 0.0f ? std::clamp(timePassed / duration, 0.0f, 1.0f) : 1.0f;
 	}
 
 
@@ -2,6 +2,7 @@
 #include "vmc_game_object.hpp"
 #include "spline.hpp"
 #include "animatable.hpp"
+#include "speed_curve.hpp"
 
 // glm
 #include <glm/glm.hpp>
@@ -13,12 +14,6 @@
 
 // Abstract Animator class
 namespace vae {
-	enum SPEED_CONTROL_FUNCTION {
-		SINE,
-		LINEAR,
-		PARABOLIC
-	};
-
 	class Animator : public Animatable
 	{
 	public:
@@ -48,18 +43,23 @@ namespace vae {
 
 		void addAnimatedObject(VmcGameObject* gameObject);
 		void removeAnimatedObject();
-		void buildForwardDifferencingTable();
-		void printForwardDifferencingTable();
+		// The preset of speedControl, or customSpeedCurve for CUSTOM
+		const SpeedCurve& getSpeedCurve() const { return speedControl == CUSTOM ? customSpeedCurve : SpeedCurve::preset(speedControl); };
+
+		// (parameter, normalized arc length) pairs of the curve points, summed chord lengths
+		virtual void buildForwardDifferencingTable();
+		virtual void printForwardDifferencingTable();
 
 		std::string currentObjSelected = "None";
 		int speedControl = SINE;
+		// Eases in and out until keys are edited
+		SpeedCurve customSpeedCurve{ std::vector<SpeedCurve::Key>{ { 0.0f, 0.0f, 0.0f }, { 1.0f, 1.0f, 0.0f } } };
 	private:
 		void normalizeForwardDifferencingTable();
 
 	protected:
-		float distanceTimeFuncSine();
-		float distanceTimeFuncLinear();
-		float distanceTimeFuncParabolic();
+		// Fraction [0, 1] of the animation that has passed
+		float timeFraction() const;
 
 		int findUpperIndexOfArcLength(float arcLength);
 		int findLowerIndexOfArcLength(float arcLength);
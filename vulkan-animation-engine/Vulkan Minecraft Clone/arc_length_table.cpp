@@ -0,0 +1,318 @@
+#include "arc_length_table.hpp"
+
+// std
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define VAE_ARC_LENGTH_SSE
+#include <emmintrin.h>
+#endif
+
+namespace vae {
+	static constexpr int MAX_SUBDIVISIONS = 12;
+
+	// 5 point Gauss-Legendre rule on [-1, 1], exact for polynomials up to degree 9
+	static constexpr float GAUSS_NODES[5] = { 0.0f, -0.5384693101f, 0.5384693101f, -0.9061798459f, 0.9061798459f };
+	static constexpr float GAUSS_WEIGHTS[5] = { 0.5688888889f, 0.4786286705f, 0.4786286705f, 0.2369268851f, 0.2369268851f };
+
+	static float gaussLegendre(const ArcLengthTable::Derivative& derivative, int segment, float u0, float u1)
+	{
+		float halfWidth = 0.5f * (u1 - u0);
+		float center = 0.5f * (u0 + u1);
+		float sum = 0.0f;
+		for (int i = 0; i < 5; i++)
+		{
+			sum += GAUSS_WEIGHTS[i] * glm::length(derivative(segment, center + halfWidth * GAUSS_NODES[i]));
+		}
+		return halfWidth * sum;
+	}
+
+	static float integrateAdaptive(const ArcLengthTable::Derivative& derivative, int segment, float u0, float u1, float whole, float tolerance, int depth)
+	{
+		float middle = 0.5f * (u0 + u1);
+		float left = gaussLegendre(derivative, segment, u0, middle);
+		float right = gaussLegendre(derivative, segment, middle, u1);
+		if (depth >= MAX_SUBDIVISIONS || std::abs(left + right - whole) <= tolerance * std::max(left + right, 1e-6f))
+			return left + right;
+		return integrateAdaptive(derivative, segment, u0, middle, left, tolerance, depth + 1)
+			+ integrateAdaptive(derivative, segment, middle, u1, right, tolerance, depth + 1);
+	}
+
+	float ArcLengthTable::integrate(const Derivative& derivative, int segment, float u0, float u1, float tolerance)
+	{
+		if (u1 <= u0) return 0.0f;
+		return integrateAdaptive(derivative, segment, u0, u1, gaussLegendre(derivative, segment, u0, u1), tolerance, 0);
+	}
+
+	void ArcLengthTable::build(int segmentCount, const Derivative& derivative)
+	{
+		this->segmentCount = std::max(segmentCount, 0);
+		sampleLengths.assign(static_cast<size_t>(this->segmentCount) * SAMPLES_PER_SEGMENT, 0.0f);
+		segmentStarts.assign(static_cast<size_t>(this->segmentCount) + 1, 0.0f);
+		frames.resize(this->segmentCount == 0 ? 0 : static_cast<size_t>(this->segmentCount) * SAMPLES_PER_SEGMENT + 1);
+		validFrames = 0;
+		inverseValid = false;
+		if (this->segmentCount == 0) return;
+
+		updateSegments(0, this->segmentCount - 1, derivative);
+	}
+
+	void ArcLengthTable::updateSegments(int first, int last, const Derivative& derivative)
+	{
+		first = std::max(first, 0);
+		last = std::min(last, segmentCount - 1);
+		if (first > last) return;
+
+		for (int segment = first; segment <= last; segment++)
+		{
+			integrateSegment(segment, derivative);
+		}
+		validFrames = std::min(validFrames, first * SAMPLES_PER_SEGMENT);
+		inverseValid = false;
+		// Only the starts after the first changed segment move
+		for (int segment = first; segment < segmentCount; segment++)
+		{
+			segmentStarts[segment + 1] = segmentStarts[segment] + sampleLengths[(segment + 1) * SAMPLES_PER_SEGMENT - 1];
+		}
+	}
+
+	void ArcLengthTable::integrateSegment(int segment, const Derivative& derivative)
+	{
+		float* samples = &sampleLengths[static_cast<size_t>(segment) * SAMPLES_PER_SEGMENT];
+		float length = 0.0f;
+		for (int i = 0; i < SAMPLES_PER_SEGMENT; i++)
+		{
+			float u0 = static_cast<float>(i) / SAMPLES_PER_SEGMENT;
+			float u1 = static_cast<float>(i + 1) / SAMPLES_PER_SEGMENT;
+			length += integrate(derivative, segment, u0, u1);
+			samples[i] = length;
+		}
+	}
+
+	float ArcLengthTable::getSampleLength(int segment, int sample) const
+	{
+		assert(segment >= 0 && segment < segmentCount && sample >= 0 && sample <= SAMPLES_PER_SEGMENT);
+		return segmentStarts[segment] + (sample == 0 ? 0.0f : sampleLengths[segment * SAMPLES_PER_SEGMENT + sample - 1]);
+	}
+
+	float ArcLengthTable::parameterAtLength(float s, const Derivative& derivative) const
+	{
+		if (segmentCount == 0) return 0.0f;
+		s = std::clamp(s, 0.0f, getLength());
+
+		// Segment whose [start, end] contains s, then the interval of its samples that contains it
+		int segment = static_cast<int>(std::upper_bound(segmentStarts.begin(), segmentStarts.end(), s) - segmentStarts.begin()) - 1;
+		segment = std::clamp(segment, 0, segmentCount - 1);
+		float local = s - segmentStarts[segment];
+		const float* samples = &sampleLengths[static_cast<size_t>(segment) * SAMPLES_PER_SEGMENT];
+		int interval = static_cast<int>(std::upper_bound(samples, samples + SAMPLES_PER_SEGMENT, local) - samples);
+		interval = std::min(interval, SAMPLES_PER_SEGMENT - 1);
+
+		float uMin = static_cast<float>(interval) / SAMPLES_PER_SEGMENT;
+		float uMax = uMin + 1.0f / SAMPLES_PER_SEGMENT;
+		float sMin = interval == 0 ? 0.0f : samples[interval - 1];
+		float intervalLength = samples[interval] - sMin;
+		if (intervalLength <= 0.0f) return segment + uMin;	// The curve stands still here
+
+		// Newton's method on f(u) = s(u) - s starting at the linear interpolation, f'(u) is the speed. The interval is
+		// short enough for a single Gauss-Legendre rule to be as exact as the table.
+		float u = uMin + (local - sMin) / intervalLength * (uMax - uMin);
+		float low = uMin;
+		float high = uMax;
+		for (int i = 0; i < NEWTON_ITERATIONS; i++)
+		{
+			float error = sMin + gaussLegendre(derivative, segment, uMin, u) - local;
+			if (std::abs(error) <= TOLERANCE * intervalLength) break;
+			if (error > 0.0f) high = u;
+			else low = u;
+
+			float speed = glm::length(derivative(segment, u));
+			float next = speed > 0.0f ? u - error / speed : 0.5f * (low + high);
+			u = next >= low && next <= high ? next : 0.5f * (low + high);
+		}
+		return segment + u;
+	}
+
+	float ArcLengthTable::lengthAtParameter(float t, const Derivative& derivative) const
+	{
+		if (segmentCount == 0) return 0.0f;
+		t = std::clamp(t, 0.0f, static_cast<float>(segmentCount));
+		int segment = std::min(static_cast<int>(t), segmentCount - 1);
+		float u = t - segment;
+
+		int sample = std::min(static_cast<int>(u * SAMPLES_PER_SEGMENT), SAMPLES_PER_SEGMENT - 1);
+		float uSample = static_cast<float>(sample) / SAMPLES_PER_SEGMENT;
+		return getSampleLength(segment, sample) + gaussLegendre(derivative, segment, uSample, u);
+	}
+
+	glm::quat ArcLengthTable::frameAtParameter(float t, const Point& point, const Derivative& derivative, const glm::vec3& initialNormal)
+	{
+		if (segmentCount == 0) return glm::quat{ 1.0f, 0.0f, 0.0f, 0.0f };
+		float sample = std::clamp(t, 0.0f, static_cast<float>(segmentCount)) * SAMPLES_PER_SEGMENT;
+		int before = std::min(static_cast<int>(sample), segmentCount * SAMPLES_PER_SEGMENT - 1);
+		computeFrames(before + 1, point, derivative, initialNormal);
+		return glm::slerp(frames[before].rotation, frames[before + 1].rotation, sample - before);
+	}
+
+	void ArcLengthTable::prepareBatches(const Point& point, const Derivative& derivative, const glm::vec3& initialNormal)
+	{
+		if (segmentCount == 0)
+		{
+			inverseValid = true;
+			return;
+		}
+		computeFrames(static_cast<int>(frames.size()) - 1, point, derivative, initialNormal);
+		if (inverseValid) return;
+
+		int inverseSamples = segmentCount * INVERSE_SAMPLES_PER_SEGMENT;
+		inverseParameters.resize(static_cast<size_t>(inverseSamples) + 1);
+		inverseSlopes.resize(static_cast<size_t>(inverseSamples) + 1);
+		for (int i = 0; i < inverseSamples; i++)
+		{
+			inverseParameters[i] = parameterAtLength(getLength() * i / inverseSamples, derivative);
+		}
+		inverseParameters[inverseSamples] = static_cast<float>(segmentCount);
+
+		// dt/ds = 1 / speed, limited to 3 times the secants next to the sample so the cubic stays monotonic
+		// (Fritsch and Carlson), which also keeps it finite where the curve stands still
+		const float spacing = getLength() / inverseSamples;
+		for (int i = 0; i <= inverseSamples; i++)
+		{
+			float t = inverseParameters[i];
+			int segment = std::min(static_cast<int>(t), segmentCount - 1);
+			float limit = std::numeric_limits<float>::max();
+			if (i > 0) limit = std::min(limit, 3.0f * (t - inverseParameters[i - 1]));
+			if (i < inverseSamples) limit = std::min(limit, 3.0f * (inverseParameters[i + 1] - t));
+			float speed = glm::length(derivative(segment, t - segment));
+			inverseSlopes[i] = speed * limit > spacing ? spacing / speed : limit;
+		}
+		inverseValid = true;
+	}
+
+	void ArcLengthTable::parametersAtLengths(const float* s, float* t, size_t count) const
+	{
+		assert((isPreparedForBatches() || count == 0) && "prepareBatches() has to be called after the curve changed");
+		if (segmentCount == 0)
+		{
+			std::fill(t, t + count, 0.0f);
+			return;
+		}
+
+		const int last = static_cast<int>(inverseParameters.size()) - 2;
+		const float samplesPerLength = getLength() > 0.0f ? (inverseParameters.size() - 1) / getLength() : 0.0f;
+		size_t i = 0;
+#ifdef VAE_ARC_LENGTH_SSE
+		// 4 lengths at once with the same operations as below, only the table entries are loaded one by one
+		for (; i + 4 <= count; i += 4)
+		{
+			__m128 sample = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(s + i), _mm_set1_ps(samplesPerLength)), _mm_setzero_ps()), _mm_set1_ps(static_cast<float>(last + 1)));
+			__m128i before = _mm_cvttps_epi32(_mm_min_ps(_mm_cvtepi32_ps(_mm_cvttps_epi32(sample)), _mm_set1_ps(static_cast<float>(last))));
+			__m128 fraction = _mm_sub_ps(sample, _mm_cvtepi32_ps(before));
+			alignas(16) int entries[4];
+			_mm_store_si128(reinterpret_cast<__m128i*>(entries), before);
+			__m128 t0 = _mm_setr_ps(inverseParameters[entries[0]], inverseParameters[entries[1]], inverseParameters[entries[2]], inverseParameters[entries[3]]);
+			__m128 t1 = _mm_setr_ps(inverseParameters[entries[0] + 1], inverseParameters[entries[1] + 1], inverseParameters[entries[2] + 1], inverseParameters[entries[3] + 1]);
+			__m128 m0 = _mm_setr_ps(inverseSlopes[entries[0]], inverseSlopes[entries[1]], inverseSlopes[entries[2]], inverseSlopes[entries[3]]);
+			__m128 m1 = _mm_setr_ps(inverseSlopes[entries[0] + 1], inverseSlopes[entries[1] + 1], inverseSlopes[entries[2] + 1], inverseSlopes[entries[3] + 1]);
+			__m128 difference = _mm_sub_ps(t1, t0);
+			__m128 two = _mm_set1_ps(2.0f);
+			__m128 cubic = _mm_sub_ps(_mm_add_ps(m0, m1), _mm_mul_ps(two, difference));
+			__m128 quadratic = _mm_sub_ps(_mm_sub_ps(_mm_mul_ps(_mm_set1_ps(3.0f), difference), _mm_mul_ps(two, m0)), m1);
+			__m128 result = _mm_add_ps(quadratic, _mm_mul_ps(fraction, cubic));
+			result = _mm_add_ps(m0, _mm_mul_ps(fraction, result));
+			_mm_storeu_ps(t + i, _mm_add_ps(t0, _mm_mul_ps(fraction, result)));
+		}
+#endif
+		for (; i < count; i++)
+		{
+			float sample = std::min(std::max(s[i] * samplesPerLength, 0.0f), static_cast<float>(last + 1));
+			int before = std::min(static_cast<int>(sample), last);
+			float fraction = sample - before;
+			// Cubic Hermite between the samples, in Horner form
+			float t0 = inverseParameters[before];
+			float difference = inverseParameters[before + 1] - t0;
+			float m0 = inverseSlopes[before];
+			float m1 = inverseSlopes[before + 1];
+			t[i] = t0 + fraction * (m0 + fraction * ((3.0f * difference - 2.0f * m0 - m1) + fraction * (m0 + m1 - 2.0f * difference)));
+		}
+	}
+
+	void ArcLengthTable::normalsAtParameters(const float* t, float* x, float* y, float* z, size_t count) const
+	{
+		assert((isPreparedForBatches() || count == 0) && "prepareBatches() has to be called after the curve changed");
+		if (segmentCount == 0)
+		{
+			std::fill(x, x + count, 0.0f);
+			std::fill(y, y + count, 1.0f);
+			std::fill(z, z + count, 0.0f);
+			return;
+		}
+
+		const int last = segmentCount * SAMPLES_PER_SEGMENT - 1;
+		for (size_t i = 0; i < count; i++)
+		{
+			float sample = std::min(std::max(t[i], 0.0f), static_cast<float>(segmentCount)) * SAMPLES_PER_SEGMENT;
+			int before = std::min(static_cast<int>(sample), last);
+			float fraction = sample - before;
+			const glm::vec3& a = frames[before].normal;
+			const glm::vec3& b = frames[before + 1].normal;
+			x[i] = a.x + fraction * (b.x - a.x);
+			y[i] = a.y + fraction * (b.y - a.y);
+			z[i] = a.z + fraction * (b.z - a.z);
+		}
+	}
+
+	void ArcLengthTable::computeFrames(int sample, const Point& point, const Derivative& derivative, const glm::vec3& initialNormal)
+	{
+		for (; validFrames <= sample; validFrames++)
+		{
+			int segment = std::min(validFrames / SAMPLES_PER_SEGMENT, segmentCount - 1);
+			float u = static_cast<float>(validFrames - segment * SAMPLES_PER_SEGMENT) / SAMPLES_PER_SEGMENT;
+			Frame& frame = frames[validFrames];
+			frame.point = point(segment, u);
+			glm::vec3 tangent = derivative(segment, u);
+			float speed = glm::length(tangent);
+
+			if (validFrames == 0)
+			{
+				// The curve stands still at the start, it doesn't matter which way the frame looks
+				frame.tangent = speed > 0.0f ? tangent / speed : glm::vec3{ 0.0f, 0.0f, 1.0f };
+				glm::vec3 normal = initialNormal - glm::dot(initialNormal, frame.tangent) * frame.tangent;
+				if (glm::length(normal) < 1e-4f)
+				{
+					glm::vec3 side = std::abs(frame.tangent.x) < 0.9f ? glm::vec3{ 1.0f, 0.0f, 0.0f } : glm::vec3{ 0.0f, 0.0f, 1.0f };
+					normal = side - glm::dot(side, frame.tangent) * frame.tangent;
+				}
+				frame.normal = glm::normalize(normal);
+			}
+			else
+			{
+				const Frame& previous = frames[validFrames - 1];
+				frame.tangent = speed > 0.0f ? tangent / speed : previous.tangent;
+
+				// Reflect the previous frame on the plane between the two points, then on the plane between the reflected
+				// tangent and the new one
+				glm::vec3 normal = previous.normal;
+				glm::vec3 v1 = frame.point - previous.point;
+				float c1 = glm::dot(v1, v1);
+				if (c1 > 0.0f)
+				{
+					glm::vec3 reflectedNormal = normal - (2.0f / c1) * glm::dot(v1, normal) * v1;
+					glm::vec3 reflectedTangent = previous.tangent - (2.0f / c1) * glm::dot(v1, previous.tangent) * v1;
+					glm::vec3 v2 = frame.tangent - reflectedTangent;
+					float c2 = glm::dot(v2, v2);
+					normal = c2 > 0.0f ? reflectedNormal - (2.0f / c2) * glm::dot(v2, reflectedNormal) * v2 : reflectedNormal;
+				}
+				// Keep the frame orthonormal against the rounding errors piling up along the curve
+				normal -= glm::dot(normal, frame.tangent) * frame.tangent;
+				frame.normal = glm::length(normal) > 0.0f ? glm::normalize(normal) : previous.normal;
+			}
+
+			glm::mat3 axes{ glm::cross(frame.normal, frame.tangent), frame.normal, frame.tangent };
+			frame.rotation = glm::quat_cast(axes);
+		}
+	}
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+// glm
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+// std
+#include <functional>
+#include <vector>
+
+namespace vae {
+	/*
+		Arc length parameterization of a curve made of segments, every segment is parameterized by u in [0, 1] and the
+		curve by t = segment + u. Arc lengths are integrals of the speed |dP/du|, computed with 5 point Gauss-Legendre
+		quadrature that is split in halves until the halves add up to the whole, so the table is exact to the tolerance
+		however unevenly the curve is parameterized.
+		The table keeps the arc length at SAMPLES_PER_SEGMENT evenly spaced u of every segment, measured from the start of
+		the segment, and the prefix sums of the segment lengths. Changing a few segments only integrates those again and
+		adds the following prefix sums up again. Mapping an arc length back to t binary searches the prefix sums for the
+		segment and the samples of the segment for the interval around it, then refines u inside of that interval with
+		Newton's method on s(u) - s, whose derivative is the speed, falling back to bisection when a step leaves it.
+		At the same samples the table keeps rotation minimizing frames as quaternions, local z along the tangent. They are
+		propagated from the start with the double reflection method of Wang et al. ("Computation of Rotation Minimizing
+		Frames", 2008), which approximates parallel transport: the frame never twists around the tangent more than the
+		curve forces it to. Frames depend on everything before them, so they are computed on first use and every changed
+		segment invalidates the frames from its start on.
+		Batches of lookups (crowds of agents on one curve) go through prepareBatches() first, which computes all frames
+		and t and dt/ds at INVERSE_SAMPLES_PER_SEGMENT evenly spaced arc lengths per segment. The batch functions only
+		interpolate between those, so they are const and can run on many threads at once.
+	*/
+	class ArcLengthTable
+	{
+	public:
+		// dP/du of the segment at u
+		using Derivative = std::function<glm::vec3(int segment, float u)>;
+		using Point = std::function<glm::vec3(int segment, float u)>;
+
+		static constexpr int SAMPLES_PER_SEGMENT = 8;
+		static constexpr float TOLERANCE = 1e-6f;	// Relative error of the quadrature of one table interval
+		static constexpr int NEWTON_ITERATIONS = 4;
+		static constexpr int INVERSE_SAMPLES_PER_SEGMENT = 16;	// Of the arc length to t table of the batches
+
+		void build(int segmentCount, const Derivative& derivative);
+		// Integrates the segments from first to last (inclusive) again, the segment count stays the same
+		void updateSegments(int first, int last, const Derivative& derivative);
+
+		bool isEmpty() const { return segmentCount == 0; };
+		int getSegmentCount() const { return segmentCount; };
+		float getLength() const { return segmentStarts.empty() ? 0.0f : segmentStarts.back(); };
+		// Arc length from the start of the curve at u = sample / SAMPLES_PER_SEGMENT of the segment
+		float getSampleLength(int segment, int sample) const;
+
+		// Curve parameter t at arc length s from the start, s is clamped to the curve
+		float parameterAtLength(float s, const Derivative& derivative) const;
+		float lengthAtParameter(float t, const Derivative& derivative) const;
+		// Frame at curve parameter t, slerped between the samples around it. The first frame has its local y as close to
+		// initialNormal as the tangent allows.
+		glm::quat frameAtParameter(float t, const Point& point, const Derivative& derivative, const glm::vec3& initialNormal = { 0.0f, 1.0f, 0.0f });
+
+		// Has to be called after the curve changed, before the batch functions
+		void prepareBatches(const Point& point, const Derivative& derivative, const glm::vec3& initialNormal = { 0.0f, 1.0f, 0.0f });
+		bool isPreparedForBatches() const { return inverseValid && validFrames == static_cast<int>(frames.size()); };
+		// t at count arc lengths, a cubic Hermite interpolation of the inverse table. s and t can be the same array.
+		void parametersAtLengths(const float* s, float* t, size_t count) const;
+		// Local y of the frames at count curve parameters, interpolated linearly and not normalized
+		void normalsAtParameters(const float* t, float* x, float* y, float* z, size_t count) const;
+
+		static float integrate(const Derivative& derivative, int segment, float u0, float u1, float tolerance = TOLERANCE);
+
+	private:
+		struct Frame {
+			glm::vec3 point;
+			glm::vec3 tangent;	// Normalized
+			glm::vec3 normal;	// Local y
+			glm::quat rotation;
+		};
+
+		// Arc lengths of one segment at u = 1 / SAMPLES_PER_SEGMENT up to u = 1, from the start of the segment
+		void integrateSegment(int segment, const Derivative& derivative);
+		// Propagates the frames up to and including the sample
+		void computeFrames(int sample, const Point& point, const Derivative& derivative, const glm::vec3& initialNormal);
+
+		int segmentCount = 0;
+		std::vector<float> sampleLengths;	// SAMPLES_PER_SEGMENT entries per segment
+		std::vector<float> segmentStarts;	// segmentCount + 1 entries, starting at 0 and ending at the length
+		std::vector<Frame> frames;			// segmentCount * SAMPLES_PER_SEGMENT + 1 entries, the first validFrames are current
+		int validFrames = 0;
+		std::vector<float> inverseParameters;	// t at INVERSE_SAMPLES_PER_SEGMENT evenly spaced arc lengths per segment, and the end
+		std::vector<float> inverseSlopes;		// dt per spacing of the inverse table at the same arc lengths
+		bool inverseValid = false;
+	};
+}
@@ -62,22 +62,15 @@ namespace vae {
 
 
 
-	void Bone::render(VkCommandBuffer& commandBuffer, VkPipelineLayout& pipelineLayout, std::shared_ptr<VmcModel> boneModel)
+	void Bone::collectDrawCalls(std::vector<DrawCall>& drawCalls, std::shared_ptr<VmcModel> boneModel)
 	{
-		TestPushConstant pushBone{};
-		pushBone.modelMatrix = globalTransformationMatrix;
-		pushBone.normalMatrix = glm::mat4(1.0f);
-		pushBone.color = { 1.0f, 1.0f, 1.0f };
-		
-		vkCmdPushConstants(commandBuffer,
-			pipelineLayout,
-			VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
-			0,
-			sizeof(TestPushConstant),
-			&pushBone);
-
-		boneModel->bind(commandBuffer);
-		boneModel->draw(commandBuffer);
+		DrawCall drawBone{};
+		drawBone.model = boneModel.get();
+		drawBone.push.modelMatrix = globalTransformationMatrix;
+		drawBone.push.normalMatrix = glm::mat4(1.0f);
+		drawBone.push.color = { 1.0f, 1.0f, 1.0f };
+
+		drawCalls.push_back(drawBone);
 	}
 
 	void Bone::updateAnimatable(float kfIndex, float kfFraction)
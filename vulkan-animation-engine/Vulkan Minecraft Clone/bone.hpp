@@ -10,6 +10,8 @@
 #include <vector>
 
 namespace vae {
+	struct DrawCall;
+
 	class Bone
 	{
 	public:
@@ -25,7 +27,7 @@ namespace vae {
 		
 		void applyMatrix(glm::mat4 transformMatrix);
 
-		void render(VkCommandBuffer& commandBuffer, VkPipelineLayout& pipelineLayout, std::shared_ptr<VmcModel> boneModel);
+		void collectDrawCalls(std::vector<DrawCall>& drawCalls, std::shared_ptr<VmcModel> boneModel);
 		void updateAnimatable(float kfIndex, float kfFraction);
 		void updateRotation();
 		void setChild(Bone* child);
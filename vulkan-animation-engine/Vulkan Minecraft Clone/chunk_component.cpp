@@ -2,112 +2,175 @@
 #include "vmc_model.hpp"
 #include "block_model.hpp"
 
+#include <algorithm>
+#include <cassert>
 #include <iostream>
 namespace vae {
-	ChunkComponent::ChunkComponent(int width, int height) : width{ width }, height{ height } {
-		blockMap.resize(height);
-
-
+	ChunkComponent::ChunkComponent(int width, int height) : ChunkComponent(width, height, BlockType::air) {
 		for (int i = 0; i < height; i++) {
-			blockMap[i].resize(width);
 			for (int j = 0; j < width; j++) {
-				blockMap[i][j].resize(width);
 				for (int k = 0; k < width; k++) {
 					// Initialize a chunk with dirt blocks, except for the second layer, which is air
-					i == 1 ? blockMap[i][j][k] = BlockType::air : blockMap[i][j][k] = BlockType::dirt;
+					setBlock(k, i, j, i == 1 ? BlockType::air : BlockType::dirt);
 				}
 			}
 		}
 	}
 
+	ChunkComponent::ChunkComponent(int width, int height, BlockType fill) : width{ width }, height{ height } {
+		assert(width > 0 && width <= MAX_CHUNK_WIDTH && "A row of blocks has to fit in a 64 bit mask");
+		blocks.assign(static_cast<size_t>(height + 2) * (width + 2) * (width + 2), BlockType::air);
+		solidRows.assign(static_cast<size_t>(height + 2) * (width + 2), 0);
 
-	std::vector<BlockFace> ChunkComponent::getVisibleBlockFaces(int x, int y, int z) const
-	{
-		std::vector<BlockFace> visibleFaces(0);
+		sectionCountX = (width + SECTION_SIZE - 1) / SECTION_SIZE;
+		sectionCountY = (height + SECTION_SIZE - 1) / SECTION_SIZE;
+		sectionCountZ = sectionCountX;
+		dirtySections.assign(getSectionCount(), 0);
 
-		// Don't draw any 'air' blocks
-		if (blockMap[y][z][x] == BlockType::air) return visibleFaces;
-		
-		// Down check
-		if (y + 1 >= blockMap.size()) {
-			visibleFaces.push_back(BlockFace::down);
-		}
-		else if (blockMap[y + 1][z][x] == BlockType::air) {
-			visibleFaces.push_back(BlockFace::down);
+		if (fill == BlockType::air) return;
+		for (int y = 0; y < height; y++) {
+			for (int z = 0; z < width; z++) {
+				for (int x = 0; x < width; x++) {
+					setBlock(x, y, z, fill);
+				}
+			}
 		}
+	}
 
-		// Up check
-		if (y - 1 < 0) {
-			visibleFaces.push_back(BlockFace::up);
-		}
-		else if (blockMap[y - 1][z][x] == BlockType::air) {
-			visibleFaces.push_back(BlockFace::up);
-		}
+	void ChunkComponent::setBlock(int x, int y, int z, BlockType type)
+	{
+		assert(x >= 0 && x < width && y >= 0 && y < height && z >= 0 && z < width && "Block outside of the chunk");
+		blocks[blockIndex(x, y, z)] = type;
 
-		// Back check
-		if (z + 1 >= blockMap[0].size()) {
-			visibleFaces.push_back(BlockFace::back);
-		}
-		else if (blockMap[y][z + 1][x] == BlockType::air) {
-			visibleFaces.push_back(BlockFace::back);
-		}
+		uint64_t bit = uint64_t{ 1 } << (x + 1);
+		if (type == BlockType::air) solidRows[rowIndex(y, z)] &= ~bit;
+		else solidRows[rowIndex(y, z)] |= bit;
+	}
 
-		// Front check
-		if (z - 1 < 0) {
-			visibleFaces.push_back(BlockFace::front);
-		}
-		else if (blockMap[y][z - 1][x] == BlockType::air) {
-			visibleFaces.push_back(BlockFace::front);
+	void ChunkComponent::setRow(int y, int z, const BlockType* row)
+	{
+		assert(y >= 0 && y < height && z >= 0 && z < width && "Row outside of the chunk");
+		std::copy(row, row + width, blocks.begin() + blockIndex(0, y, z));
+
+		uint64_t solid = 0;
+		for (int x = 0; x < width; x++)
+		{
+			if (row[x] != BlockType::air) solid |= uint64_t{ 1 } << (x + 1);
 		}
+		solidRows[rowIndex(y, z)] = solid;
+	}
 
-		// Right check
-		if (x + 1 >= blockMap[0][0].size()) {
-			visibleFaces.push_back(BlockFace::right);
+	void ChunkComponent::editBlock(int x, int y, int z, BlockType type)
+	{
+		if (getBlock(x, y, z) == type) return;
+		setBlock(x, y, z, type);
+
+		// The faces of the neighbours across a section border belong to the neighbouring section. Ambient occlusion
+		// also samples the diagonal neighbours, so every section that touches the 3 x 3 x 3 blocks around it changes.
+		for (int sy = std::max(y - 1, 0) / SECTION_SIZE; sy <= std::min(y + 1, height - 1) / SECTION_SIZE; sy++) {
+			for (int sz = std::max(z - 1, 0) / SECTION_SIZE; sz <= std::min(z + 1, width - 1) / SECTION_SIZE; sz++) {
+				for (int sx = std::max(x - 1, 0) / SECTION_SIZE; sx <= std::min(x + 1, width - 1) / SECTION_SIZE; sx++) {
+					markSectionDirty((sy * sectionCountZ + sz) * sectionCountX + sx);
+				}
+			}
 		}
-		else if (blockMap[y][z][x + 1] == BlockType::air) {
-			visibleFaces.push_back(BlockFace::right);
+	}
+
+	ChunkBox ChunkComponent::getSectionBox(int section) const
+	{
+		assert(section >= 0 && section < getSectionCount() && "Section outside of the chunk");
+		ChunkBox box{};
+		box.firstX = (section % sectionCountX) * SECTION_SIZE;
+		box.firstZ = (section / sectionCountX % sectionCountZ) * SECTION_SIZE;
+		box.firstY = (section / (sectionCountX * sectionCountZ)) * SECTION_SIZE;
+		box.sizeX = std::min(SECTION_SIZE, width - box.firstX);
+		box.sizeY = std::min(SECTION_SIZE, height - box.firstY);
+		box.sizeZ = std::min(SECTION_SIZE, width - box.firstZ);
+		return box;
+	}
+
+	void ChunkComponent::takeDirtySections(std::vector<int>& sections)
+	{
+		for (int section = 0; dirtySectionCount > 0; section++) {
+			if (dirtySections[section]) {
+				dirtySections[section] = 0;
+				dirtySectionCount--;
+				sections.push_back(section);
+			}
 		}
+	}
 
-		// Left check
-		if (x - 1 < 0) {
-			visibleFaces.push_back(BlockFace::left);
+	void ChunkComponent::markSectionDirty(int section)
+	{
+		if (!dirtySections[section]) {
+			dirtySections[section] = 1;
+			dirtySectionCount++;
 		}
-		else if (blockMap[y][z][x - 1] == BlockType::air) {
-			visibleFaces.push_back(BlockFace::left);
+	}
+
+	void ChunkComponent::computeVisibleFaces(ChunkFaceMasks& faces) const
+	{
+		computeVisibleFaces(faces, getBox());
+	}
+
+	void ChunkComponent::computeVisibleFaces(ChunkFaceMasks& faces, const ChunkBox& box) const
+	{
+		assert(box.firstX >= 0 && box.firstX + box.sizeX <= width && box.firstY >= 0 && box.firstY + box.sizeY <= height
+			&& box.firstZ >= 0 && box.firstZ + box.sizeZ <= width && "Box outside of the chunk");
+		const size_t rowCount = static_cast<size_t>(box.sizeY) * box.sizeZ;
+		for (auto& face : faces) face.resize(rowCount);
+
+		// A face is visible when the block is solid and its neighbour on that side is not, the padding counts as air.
+		// Neighbours along x are the neighbouring bits of the same row, the other neighbours are neighbouring rows.
+		// Blocks outside of the box still count as neighbours, only their faces are left out.
+		const size_t rowStride = width + 2;
+		const int shift = box.firstX + 1;
+		const uint64_t boxBits = ((uint64_t{ 1 } << box.sizeX) - 1) << shift;
+		for (int y = 0; y < box.sizeY; y++) {
+			for (int z = 0; z < box.sizeZ; z++) {
+				const size_t row = rowIndex(box.firstY + y, box.firstZ + z);
+				const uint64_t solid = solidRows[row];
+				const uint64_t boxSolid = solid & boxBits;
+				const size_t out = static_cast<size_t>(y) * box.sizeZ + z;
+
+				faces[static_cast<int>(BlockFace::up)][out] = (boxSolid & ~solidRows[row - rowStride]) >> shift;
+				faces[static_cast<int>(BlockFace::down)][out] = (boxSolid & ~solidRows[row + rowStride]) >> shift;
+				faces[static_cast<int>(BlockFace::front)][out] = (boxSolid & ~solidRows[row - 1]) >> shift;
+				faces[static_cast<int>(BlockFace::back)][out] = (boxSolid & ~solidRows[row + 1]) >> shift;
+				faces[static_cast<int>(BlockFace::left)][out] = (boxSolid & ~(solid << 1)) >> shift;
+				faces[static_cast<int>(BlockFace::right)][out] = (boxSolid & ~(solid >> 1)) >> shift;
+			}
 		}
+	}
 
+	uint8_t ChunkComponent::getVisibleBlockFaces(int x, int y, int z) const
+	{
+		// Don't draw any 'air' blocks
+		if (!isSolid(x, y, z)) return 0;
+
+		const size_t row = rowIndex(y, z);
+		const size_t rowStride = width + 2;
+		const uint64_t bit = uint64_t{ 1 } << (x + 1);
+		uint8_t visibleFaces = 0;
+		if (!(solidRows[row - rowStride] & bit)) visibleFaces |= 1 << static_cast<int>(BlockFace::up);
+		if (!(solidRows[row + rowStride] & bit)) visibleFaces |= 1 << static_cast<int>(BlockFace::down);
+		if (!(solidRows[row - 1] & bit)) visibleFaces |= 1 << static_cast<int>(BlockFace::front);
+		if (!(solidRows[row + 1] & bit)) visibleFaces |= 1 << static_cast<int>(BlockFace::back);
+		if (!(solidRows[row] & (bit >> 1))) visibleFaces |= 1 << static_cast<int>(BlockFace::left);
+		if (!(solidRows[row] & (bit << 1))) visibleFaces |= 1 << static_cast<int>(BlockFace::right);
 		return visibleFaces;
 	}
 
 	void ChunkComponent::visibleBlockFacesTest() {
+		const char faceNames[] = { 'U', 'D', 'L', 'R', 'F', 'B' };
 		for (int i = 0; i < height; i++) {
 			for (int j = 0; j < width; j++) {
 				for (int z = 0; z < width; z++) {
-					std::vector<BlockFace> visibleFaces = getVisibleBlockFaces(z, i, j);
-
-					for (BlockFace face : visibleFaces) {
-						switch (face)
-						{
-						case vae::BlockFace::up:
-							std::cout << " U ";
-							break;
-						case vae::BlockFace::down:
-							std::cout << " D ";
-							break;
-						case vae::BlockFace::left:
-							std::cout << " L ";
-							break;
-						case vae::BlockFace::right:
-							std::cout << " R ";
-							break;
-						case vae::BlockFace::front:
-							std::cout << " F ";
-							break;
-						case vae::BlockFace::back:
-							std::cout << " B ";
-							break;
-						default:
-							break;
+					uint8_t visibleFaces = getVisibleBlockFaces(z, i, j);
+
+					for (int face = 0; face < 6; face++) {
+						if (visibleFaces & (1 << face)) {
+							std::cout << " " << faceNames[face] << " ";
 						}
 					}
 					std::cout << " || ";
@@ -117,4 +180,4 @@ namespace vae {
 			std::cout << "---------------------------------------------------------------------------\n";
 		}
 	}
-}
\ No newline at end of file
+}
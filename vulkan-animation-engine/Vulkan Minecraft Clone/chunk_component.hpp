@@ -3,31 +3,89 @@
 #include "enums.hpp"
 
 // std
+#include <array>
+#include <cstddef>
+#include <cstdint>
 #include <vector>
 
 namespace vae {
 
 	const int MAX_CHUNK_HEIGHT = 16;
+	const int MAX_CHUNK_WIDTH = 62;		// A row of blocks along x plus the padding on both sides fits in 64 bits
 	const int BLOCK_X_OFFSET = 1;
 	const int BLOCK_Y_OFFSET = 1;
 	const int BLOCK_Z_OFFSET = 1;
 
+	// Visible faces of a whole chunk, indexed by BlockFace. One word per row of blocks along x (index y * width + z),
+	// bit x is set when that face of block x is visible.
+	using ChunkFaceMasks = std::array<std::vector<uint64_t>, 6>;
+
+	// Box of blocks inside a chunk, from the first block on each axis with size blocks along it
+	struct ChunkBox {
+		int firstX;
+		int firstY;
+		int firstZ;
+		int sizeX;
+		int sizeY;
+		int sizeZ;
+	};
+
+	/*
+		Blocks are stored in one flat array that is padded with a layer of air on every side, so neighbours never need
+		bounds checks. Next to it every row of blocks along x keeps its solidity as a bit mask (bit x + 1 for block x),
+		which lets the visible faces of a whole chunk be computed with a few shifts and ANDs per row.
+		For incremental remeshing the chunk is split into sections of SECTION_SIZE^3 blocks (clipped at the chunk border).
+		editBlock() marks the sections whose mesh it changes as dirty, the mesh of a section only depends on its own
+		blocks and the ones directly around it (ambient occlusion includes the diagonal neighbours).
+	*/
 	class ChunkComponent
 	{
 	public:
+		static constexpr int SECTION_SIZE = 16;
+
 		ChunkComponent(int width, int height = MAX_CHUNK_HEIGHT);
+		// Every block of the chunk is fill, for chunks that are generated afterwards
+		ChunkComponent(int width, int height, BlockType fill);
 
 		int getWidth() const{ return width; }
 		int getHeight() const{ return height; }
-	
-		std::vector<BlockFace> getVisibleBlockFaces(int x, int y, int z) const;
+
+		BlockType getBlock(int x, int y, int z) const { return blocks[blockIndex(x, y, z)]; }
+		// Doesn't track dirty sections, for filling a chunk before it is meshed
+		void setBlock(int x, int y, int z, BlockType type);
+		// All width blocks of the row along x at once, doesn't track dirty sections either
+		void setRow(int y, int z, const BlockType* row);
+		// Marks the section of the block dirty, and the neighbouring sections for blocks on a section border
+		void editBlock(int x, int y, int z, BlockType type);
+		bool isSolid(int x, int y, int z) const { return (solidRows[rowIndex(y, z)] >> (x + 1)) & 1; }
+
+		int getSectionCount() const { return sectionCountX * sectionCountY * sectionCountZ; }
+		ChunkBox getSectionBox(int section) const;
+		ChunkBox getBox() const { return { 0, 0, 0, width, height, width }; }
+		bool hasDirtySections() const { return dirtySectionCount > 0; }
+		// Appends the dirty sections to sections and marks them clean
+		void takeDirtySections(std::vector<int>& sections);
+
+		void computeVisibleFaces(ChunkFaceMasks& faces) const;
+		// Visible faces of the blocks inside box, rows are indexed (y - firstY) * sizeZ + (z - firstZ) and bit x - firstX
+		void computeVisibleFaces(ChunkFaceMasks& faces, const ChunkBox& box) const;
+		// Bit (1 << BlockFace) is set for every visible face of the block
+		uint8_t getVisibleBlockFaces(int x, int y, int z) const;
 		void visibleBlockFacesTest();
 	private:
-		
+		size_t blockIndex(int x, int y, int z) const { return (rowIndex(y, z) * (width + 2)) + (x + 1); }
+		size_t rowIndex(int y, int z) const { return static_cast<size_t>(y + 1) * (width + 2) + (z + 1); }
+		void markSectionDirty(int section);
 
 		int height;
 		int width;
-		std::vector<std::vector<std::vector<BlockType>>>blockMap;
+		std::vector<BlockType> blocks;		// (height + 2) * (width + 2) * (width + 2), x is the fastest changing axis
+		std::vector<uint64_t> solidRows;	// (height + 2) * (width + 2), padding rows are empty
+
+		int sectionCountX;
+		int sectionCountY;
+		int sectionCountZ;
+		std::vector<uint8_t> dirtySections;	// x is the fastest changing axis, then z, then y
+		int dirtySectionCount = 0;
 	};
 }
-
@@ -1,6 +1,6 @@
 #pragma once
 namespace vae{
-	enum class BlockType{dirt, grass, stone, air};
+	enum class BlockType{dirt, grass, stone, sand, air};	// Every type before air is solid
 
 	enum class BlockFace{up, down, left, right, front, back};
 
@@ -53,31 +53,24 @@ namespace vae {
 		transformation = newTransformation;
 	}
 
-	void FFD::render(VkCommandBuffer& commandBuffer, VkPipelineLayout& pipelineLayout, std::shared_ptr<VmcModel> pointModel)
+	void FFD::collectDrawCalls(std::vector<DrawCall>& drawCalls, std::shared_ptr<VmcModel> pointModel)
 	{
 		int idx = 0;
-		TestPushConstant pushFFD{};
+		DrawCall drawFFD{};
+		drawFFD.model = pointModel.get();
 		for (auto& ffdControlPoint : grid)
 		{
-			pushFFD.modelMatrix = transformation * ffdControlPoint.mat4();
-			pushFFD.normalMatrix = ffdControlPoint.normalMatrix();
+			drawFFD.push.modelMatrix = transformation * ffdControlPoint.mat4();
+			drawFFD.push.normalMatrix = ffdControlPoint.normalMatrix();
 			if (idx == getCurrentCPIndex())
 			{
-				pushFFD.color = { 1.0f, 1.0f, 1.0f };
+				drawFFD.push.color = { 1.0f, 1.0f, 1.0f };
 			}
 			else {
-				pushFFD.color = { .0f, 1.0f, 1.0f };
+				drawFFD.push.color = { .0f, 1.0f, 1.0f };
 			}
 
-			vkCmdPushConstants(commandBuffer,
-				pipelineLayout,
-				VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
-				0,
-				sizeof(TestPushConstant),
-				&pushFFD);
-
-			pointModel->bind(commandBuffer);
-			pointModel->draw(commandBuffer);
+			drawCalls.push_back(drawFFD);
 			idx++;
 		}
 	}
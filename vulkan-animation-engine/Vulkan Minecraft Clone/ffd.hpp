@@ -11,6 +11,7 @@
 
 namespace vae {
 	struct TransformComponent;
+	struct DrawCall;
 
 	struct FFDInitializer {
 		// Grid dimensions
@@ -47,7 +48,7 @@ namespace vae {
 		int getCurrentCPIndex() { return selectedControlPoint; };
 		void updateTransformation(glm::mat4 newTransformation);
 
-		void render(VkCommandBuffer& commandBuffer, VkPipelineLayout& pipelineLayout, std::shared_ptr<VmcModel> pointModel);
+		void collectDrawCalls(std::vector<DrawCall>& drawCalls, std::shared_ptr<VmcModel> pointModel);
 		void moveCurrentControlPoint(MoveDirection dir, float dt);
 		void resetControlPoints();
 		void selectNextControlPoint();
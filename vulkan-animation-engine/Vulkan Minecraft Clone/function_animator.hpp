@@ -19,6 +19,7 @@ namespace vae {
 		glm::vec3 calculateNextPositionLinearInterp(float deltaTime);
 		glm::vec3 calculateNextPositionSpeedControlled();
 
+		// Not an override: FunctionAnimator doesn't derive from Animator, its table is built from the control points
 		void buildForwardDifferencingTable();
 		void printForwardDifferencingTable();
 
@@ -1,17 +1,648 @@
 #include "vmc_app.hpp"
+#include "vmc_region_file.hpp"
+#include "vmc_voxel_collider.hpp"
+#include "spline.hpp"
+#include "spline_crowd.hpp"
+#include "speed_curve.hpp"
+#include "vmc_random.hpp"
 // std
 #include <stdlib.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <functional>
 #include <iostream>
 #include <stdexcept>
+#include <string>
+#include <memory>
+#include <unordered_map>
+#include <vector>
 
-int main()
+/*
+	Headless usage (no window, frames are written to disk):
+	--headless [--scene file.vaescene] [--frames N] [--fps N] [--size W H] [--out directory] [--raw] [--camera mode]
+*/
+static bool parseHeadlessSettings(int argc, char* argv[], vae::HeadlessSettings& settings)
 {
-	vae::VmcApp app{};
-	try 
+	bool headless = false;
+	for (int i = 1; i < argc; i++)
 	{
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+
+		if (arg == "--headless") headless = true;
+		else if (arg == "--raw") settings.imageFormat = vae::IMAGE_RAW;
+		else if (arg == "--scene" && hasValue) settings.sceneFile = argv[++i];
+		else if (arg == "--out" && hasValue) settings.outputDirectory = argv[++i];
+		else if (arg == "--frames" && hasValue) settings.frameCount = std::stoi(argv[++i]);
+		else if (arg == "--fps" && hasValue) settings.framesPerSecond = std::stof(argv[++i]);
+		else if (arg == "--camera" && hasValue) settings.cameraMode = std::stoi(argv[++i]);
+		else if (arg == "--size" && i + 2 < argc)
+		{
+			settings.width = static_cast<uint32_t>(std::stoul(argv[++i]));
+			settings.height = static_cast<uint32_t>(std::stoul(argv[++i]));
+		}
+		else throw std::runtime_error("Unknown or incomplete argument: " + arg);
+	}
+	return headless;
+}
+
+// Wall clock time of the work in milliseconds, benchmarks that repeat the work divide by the runs
+static float timeMilliseconds(const std::function<void()>& work)
+{
+	auto begin = std::chrono::high_resolution_clock::now();
+	work();
+	return std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - begin).count();
+}
+
+/*
+	OBJ import benchmark, compares the sequential and the parallel import of the same file:
+	--benchmark-import [file.obj]
+	Without a file a grid of about one million triangles is generated in ../Cache/.
+*/
+static std::string writeBenchmarkGrid()
+{
+	const int size = 708;	// 708 x 708 vertices, 2 * 707 * 707 triangles
+	std::string path = "../Cache/benchmark_grid.obj";
+	if (std::filesystem::exists(path)) return path;
+
+	std::filesystem::create_directories("../Cache");
+	std::ofstream out{ path };
+	for (int z = 0; z < size; z++)
+		for (int x = 0; x < size; x++)
+			out << "v " << x * 0.01f << " " << 0.1f * ((x * 7 + z * 13) % 17) << " " << z * 0.01f << "\n";
+	for (int z = 0; z < size; z++)
+		for (int x = 0; x < size; x++)
+			out << "vt " << x / float(size - 1) << " " << z / float(size - 1) << "\n";
+	out << "vn 0 1 0\n";
+	for (int z = 0; z < size - 1; z++)
+	{
+		for (int x = 0; x < size - 1; x++)
+		{
+			int a = z * size + x + 1;
+			int b = a + 1;
+			int c = a + size;
+			int d = c + 1;
+			out << "f " << a << "/" << a << "/1 " << c << "/" << c << "/1 " << b << "/" << b << "/1\n";
+			out << "f " << b << "/" << b << "/1 " << c << "/" << c << "/1 " << d << "/" << d << "/1\n";
+		}
+	}
+	return path;
+}
+
+static void benchmarkImport(std::string objPath)
+{
+	if (objPath.empty()) objPath = writeBenchmarkGrid();
+
+	vae::VmcModel::Builder sequential{};
+	vae::VmcModel::Builder parallel{};
+	float sequentialTime = timeMilliseconds([&]() { sequential.loadModel(objPath, vae::VmcModel::IMPORT_SEQUENTIAL); });
+	float parallelTime = timeMilliseconds([&]() { parallel.loadModel(objPath, vae::VmcModel::IMPORT_PARALLEL); });
+	bool identical = sequential.vertices == parallel.vertices && sequential.indices == parallel.indices
+		&& sequential.minX == parallel.minX && sequential.maxX == parallel.maxX
+		&& sequential.minY == parallel.minY && sequential.maxY == parallel.maxY
+		&& sequential.minZ == parallel.minZ && sequential.maxZ == parallel.maxZ;
+
+	std::cout << objPath << ": " << sequential.indices.size() / 3 << " triangles, " << sequential.vertices.size() << " unique vertices" << std::endl;
+	std::cout << "Sequential import: " << sequentialTime << " ms" << std::endl;
+	std::cout << "Parallel import:   " << parallelTime << " ms (" << sequentialTime / parallelTime << "x)" << std::endl;
+	std::cout << "Results " << (identical ? "are identical" : "DIFFER") << std::endl;
+	if (!identical) throw std::runtime_error("Parallel import does not match the sequential import");
+}
+
+/*
+	Chunk meshing benchmark on 32 x 32 x 256 chunks, compares one quad per face with greedy meshing, full vertices with
+	voxel vertices, and measures single block edits that only remesh the dirty sections:
+	--benchmark-meshing
+*/
+static void fillBenchmarkTerrain(vae::ChunkComponent& chunk)
+{
+	// Rolling hills, y grows downwards: grass on top, a few layers of dirt, stone below
+	for (int z = 0; z < chunk.getWidth(); z++)
+		for (int x = 0; x < chunk.getWidth(); x++)
+		{
+			int surface = chunk.getHeight() / 2 + static_cast<int>(8.0f * std::sin(x * 0.3f) + 6.0f * std::cos(z * 0.25f));
+			for (int y = 0; y < chunk.getHeight(); y++)
+			{
+				vae::BlockType type = y < surface ? vae::BlockType::air : y == surface ? vae::BlockType::grass : y < surface + 4 ? vae::BlockType::dirt : vae::BlockType::stone;
+				chunk.setBlock(x, y, z, type);
+			}
+		}
+}
+
+static void benchmarkMeshing()
+{
+	const int width = 32;
+	const int height = 256;
+	const int runs = 100;
+
+	auto timeMeshing = [&](const vae::ChunkComponent& chunk, vae::VmcModel::ChunkMeshMode mode, vae::VmcModel::Builder& builder,
+		vae::VmcModel::VertexFormat format = vae::VmcModel::VERTEX_FORMAT_FULL) {
+		builder.updateChunkMesh(&chunk, mode, format);	// Warm up, the builder keeps its memory between runs
+		return timeMilliseconds([&]() {
+			for (int run = 0; run < runs; run++)
+				builder.updateChunkMesh(&chunk, mode, format);
+		}) / runs;
+	};
+
+	auto compare = [&](const char* name, const vae::ChunkComponent& chunk) {
+		vae::ChunkFaceMasks faces;
+		float cullingTime = timeMilliseconds([&]() {
+			for (int run = 0; run < runs; run++)
+				chunk.computeVisibleFaces(faces);
+		}) / runs;
+
+		vae::VmcModel::Builder facesBuilder{};
+		vae::VmcModel::Builder greedyBuilder{};
+		vae::VmcModel::Builder voxelBuilder{};
+		float facesTime = timeMeshing(chunk, vae::VmcModel::CHUNK_MESH_FACES, facesBuilder);
+		float greedyTime = timeMeshing(chunk, vae::VmcModel::CHUNK_MESH_GREEDY, greedyBuilder);
+		float voxelTime = timeMeshing(chunk, vae::VmcModel::CHUNK_MESH_GREEDY, voxelBuilder, vae::VmcModel::VERTEX_FORMAT_VOXEL);
+		auto kib = [](size_t vertexCount, size_t vertexSize) { return vertexCount * vertexSize / 1024; };
+		std::cout << name << " (face culling " << cullingTime << " ms)" << std::endl;
+		std::cout << "  Faces:  " << facesBuilder.vertices.size() << " vertices (" << kib(facesBuilder.vertices.size(), sizeof(vae::VmcModel::Vertex))
+			<< " KiB), " << facesTime << " ms per chunk" << std::endl;
+		std::cout << "  Greedy: " << greedyBuilder.vertices.size() << " vertices (" << kib(greedyBuilder.vertices.size(), sizeof(vae::VmcModel::Vertex))
+			<< " KiB), " << greedyTime << " ms per chunk" << std::endl;
+		std::cout << "  Greedy with voxel vertices and ambient occlusion: " << voxelBuilder.voxelVertices.size() << " vertices ("
+			<< kib(voxelBuilder.voxelVertices.size(), sizeof(vae::VmcModel::VoxelVertex)) << " KiB), " << voxelTime << " ms per chunk" << std::endl;
+	};
+
+	vae::ChunkComponent layered{ width, height };
+	compare("Layered chunk", layered);
+
+	vae::ChunkComponent terrain{ width, height };
+	fillBenchmarkTerrain(terrain);
+	compare("Terrain chunk", terrain);
+
+	// Alternately digs and refills blocks along the surface, every edit remeshes its dirty sections
+	{
+		const int edits = 1000;
+		vae::VmcModel::Builder sectionBuilder{};
+		std::vector<int> dirtySections;
+		size_t remeshedSections = 0;
+		float editTime = 1000.0f * timeMilliseconds([&]() {
+			for (int edit = 0; edit < edits; edit++)
+			{
+				int x = (edit * 7) % width;
+				int z = (edit * 13) % width;
+				int y = height / 2 + static_cast<int>(8.0f * std::sin(x * 0.3f) + 6.0f * std::cos(z * 0.25f));
+				terrain.editBlock(x, y, z, edit % 2 == 0 ? vae::BlockType::air : vae::BlockType::grass);
+
+				dirtySections.clear();
+				terrain.takeDirtySections(dirtySections);
+				for (int section : dirtySections)
+					sectionBuilder.updateChunkMesh(&terrain, terrain.getSectionBox(section));
+				remeshedSections += dirtySections.size();
+			}
+		}) / edits;
+		std::cout << "Block edits: " << editTime << " us per edit, " << static_cast<float>(remeshedSections) / edits << " sections remeshed per edit" << std::endl;
+	}
+
+	vae::ChunkComponent random{ width, height };
+	vae::VmcRandom generator{ 12345 };
+	for (int y = 0; y < height; y++)
+		for (int z = 0; z < width; z++)
+			for (int x = 0; x < width; x++)
+				random.setBlock(x, y, z, (generator.nextUint() >> 31) ? vae::BlockType::stone : vae::BlockType::air);
+	compare("Random chunk", random);
+}
+
+/*
+	Terrain generation benchmark on the chunks of VmcChunkManager, compares the scalar noise with the AVX2 noise and
+	measures how long the chunk worker threads take to generate (and mesh) the area around the camera:
+	--benchmark-terrain [seed]
+*/
+static void benchmarkTerrain(uint32_t seed)
+{
+	const int width = vae::VmcChunkManager::CHUNK_WIDTH;
+	const int height = vae::VmcChunkManager::CHUNK_HEIGHT;
+	const int gridSize = 8;	// 8 x 8 chunks per run
+	const int chunkCount = gridSize * gridSize;
+
+	auto coordOf = [&](int chunk) { return vae::VmcChunkCoord{ chunk % gridSize - gridSize / 2, chunk / gridSize - gridSize / 2 }; };
+	auto timeSingleThreaded = [&](const vae::VmcTerrainGenerator& generator, std::vector<vae::BlockType>& blocks) {
+		vae::ChunkComponent chunk{ width, height, vae::BlockType::air };
+		blocks.clear();
+		return timeMilliseconds([&]() {
+			for (int i = 0; i < chunkCount; i++)
+			{
+				generator.generate(chunk, coordOf(i));
+				for (int y = 0; y < height; y++)
+					for (int z = 0; z < width; z++)
+						for (int x = 0; x < width; x++)
+							blocks.push_back(chunk.getBlock(x, y, z));
+			}
+		}) / 1000.0f;
+	};
+
+	std::cout << chunkCount << " chunks of " << width << " x " << height << " x " << width << " blocks, seed " << seed << std::endl;
+	vae::VmcTerrainGenerator scalar{ seed, vae::VmcTerrainGenerator::NOISE_SCALAR };
+	std::vector<vae::BlockType> scalarBlocks;
+	float scalarTime = timeSingleThreaded(scalar, scalarBlocks);
+	std::cout << "Scalar noise: " << chunkCount / scalarTime << " chunks/s" << std::endl;
+
+	vae::VmcTerrainGenerator automatic{ seed };
+	if (automatic.usesAvx2())
+	{
+		vae::VmcTerrainGenerator avx2{ seed, vae::VmcTerrainGenerator::NOISE_AVX2 };
+		std::vector<vae::BlockType> avx2Blocks;
+		float avx2Time = timeSingleThreaded(avx2, avx2Blocks);
+		bool identical = scalarBlocks == avx2Blocks;
+		std::cout << "AVX2 noise:   " << chunkCount / avx2Time << " chunks/s (" << scalarTime / avx2Time << "x)" << std::endl;
+		std::cout << "Results " << (identical ? "are identical" : "DIFFER") << std::endl;
+		if (!identical) throw std::runtime_error("AVX2 terrain does not match the scalar terrain");
+	}
+	else std::cout << "AVX2 noise:   not supported by this CPU" << std::endl;
+
+	size_t air = std::count(scalarBlocks.begin(), scalarBlocks.end(), vae::BlockType::air);
+	std::cout << "Air: " << 100.0f * air / scalarBlocks.size() << "% of the blocks" << std::endl;
+
+	// Same as the chunk jobs of VmcChunkManager, every chunk is one job
+	vae::VmcThreadPool workers{};
+	auto timeWorkers = [&](bool mesh) {
+		float seconds = timeMilliseconds([&]() {
+			for (int i = 0; i < chunkCount; i++)
+			{
+				workers.addJob([&, i]() {
+					vae::ChunkComponent chunk{ width, height, vae::BlockType::air };
+					automatic.generate(chunk, coordOf(i));
+					if (mesh) vae::VmcChunkMesh::meshSections(chunk);
+				});
+			}
+			workers.wait();
+		}) / 1000.0f;
+		return chunkCount / seconds;
+	};
+	float generated = timeWorkers(false);
+	float meshed = timeWorkers(true);
+	std::cout << workers.getThreadCount() << " worker threads: " << generated << " chunks/s generated, " << meshed << " chunks/s generated and meshed" << std::endl;
+
+	for (int radius : { 4, 8, 16 })
+	{
+		int chunks = 0;
+		for (int dz = -radius; dz <= radius; dz++)
+			for (int dx = -radius; dx <= radius; dx++)
+				if (dx * dx + dz * dz <= radius * radius) chunks++;
+		std::cout << "Radius " << radius << ": " << chunks << " chunks, streamed in " << chunks / meshed << " s" << std::endl;
+	}
+}
+
+/*
+	Region file benchmark: saves generated chunks into region files in ../Cache/, then compares the size with one byte per
+	block and reading the chunks back (from a freshly opened storage, so through new mappings) with generating them:
+	--benchmark-regions [seed]
+*/
+static void benchmarkRegions(uint32_t seed)
+{
+	const int width = vae::VmcChunkManager::CHUNK_WIDTH;
+	const int height = vae::VmcChunkManager::CHUNK_HEIGHT;
+	const int gridSize = 8;	// 8 x 8 chunks, spread over 4 regions
+	const int chunkCount = gridSize * gridSize;
+	const std::string directory = "../Cache/benchmark_regions";
+	auto coordOf = [&](int chunk) { return vae::VmcChunkCoord{ chunk % gridSize - gridSize / 2, chunk / gridSize - gridSize / 2 }; };
+
+	std::error_code error;
+	std::filesystem::remove_all(directory, error);
+
+	vae::VmcTerrainGenerator generator{ seed };
+	std::vector<std::unique_ptr<vae::ChunkComponent>> generated;
+	float generateTime = timeMilliseconds([&]() {
+		for (int i = 0; i < chunkCount; i++)
+		{
+			generated.push_back(std::make_unique<vae::ChunkComponent>(width, height, vae::BlockType::air));
+			generator.generate(*generated.back(), coordOf(i));
+		}
+	}) / 1000.0f;
+
+	{
+		vae::VmcChunkStorage storage{ directory, width, height };
+		float saveTime = timeMilliseconds([&]() {
+			for (int i = 0; i < chunkCount; i++)
+			{
+				storage.save(coordOf(i), *generated[i]);
+			}
+			storage.flush();
+		});
+		std::cout << "Saved " << chunkCount << " chunks in " << saveTime << " ms" << std::endl;
+	}
+
+	uintmax_t fileSize = 0;
+	for (auto& entry : std::filesystem::directory_iterator(directory))
+	{
+		fileSize += entry.file_size();
+	}
+	size_t rawSize = static_cast<size_t>(chunkCount) * width * width * height;
+	std::cout << "Region files: " << fileSize / 1024.0f << " KiB, " << rawSize / 1024.0f << " KiB at one byte per block ("
+		<< static_cast<float>(rawSize) / fileSize << "x smaller)" << std::endl;
+
+	vae::VmcChunkStorage storage{ directory, width, height };
+	vae::ChunkComponent chunk{ width, height, vae::BlockType::air };
+	bool identical = true;
+	float loadTime = timeMilliseconds([&]() {
+		for (int i = 0; i < chunkCount; i++)
+		{
+			if (!storage.load(coordOf(i), chunk)) throw std::runtime_error("Saved chunk could not be loaded");
+			for (int y = 0; y < height && identical; y++)
+				for (int z = 0; z < width; z++)
+					for (int x = 0; x < width; x++)
+						identical = identical && chunk.getBlock(x, y, z) == generated[i]->getBlock(x, y, z);
+		}
+	}) / 1000.0f;
+	std::cout << "Generating: " << chunkCount / generateTime << " chunks/s" << std::endl;
+	std::cout << "Loading:    " << chunkCount / loadTime << " chunks/s (" << generateTime / loadTime << "x, including the comparison)" << std::endl;
+	std::cout << "Results " << (identical ? "are identical" : "DIFFER") << std::endl;
+	if (!identical) throw std::runtime_error("Loaded chunks do not match the generated chunks");
+}
+
+/*
+	Voxel collision benchmark: 100k particles rain onto generated terrain and bounce off the blocks for 5 seconds,
+	single threaded and split over worker threads (one collider per job), then picking rays are cast in random directions:
+	--benchmark-voxel-collision [seed]
+*/
+static void benchmarkVoxelCollision(uint32_t seed)
+{
+	const int width = vae::VmcChunkManager::CHUNK_WIDTH;
+	const int height = vae::VmcChunkManager::CHUNK_HEIGHT;
+	const int gridSize = 8;	// 8 x 8 chunks around the origin
+	const size_t particleCount = 100000;
+	const int steps = 300;
+	const float dt = 1.0f / 60.0f;
+
+	vae::VmcTerrainGenerator generator{ seed };
+	std::unordered_map<vae::VmcChunkCoord, std::unique_ptr<vae::ChunkComponent>, vae::VmcChunkCoordHash> chunks;
+	for (int z = -gridSize / 2; z < gridSize / 2; z++)
+	{
+		for (int x = -gridSize / 2; x < gridSize / 2; x++)
+		{
+			auto chunk = std::make_unique<vae::ChunkComponent>(width, height, vae::BlockType::air);
+			generator.generate(*chunk, { x, z });
+			chunks[{ x, z }] = std::move(chunk);
+		}
+	}
+	auto lookup = [&](vae::VmcChunkCoord coord) -> const vae::ChunkComponent* {
+		auto it = chunks.find(coord);
+		return it != chunks.end() ? it->second.get() : nullptr;
+	};
+
+	// Spawned above the chunks (+y points down), drifting sideways a little
+	const float extent = static_cast<float>(gridSize * width / 2);
+	vae::VmcRandom random{ seed };
+	std::vector<glm::vec3> spawnPositions(particleCount);
+	std::vector<glm::vec3> spawnVelocities(particleCount);
+	for (size_t i = 0; i < particleCount; i++)
+	{
+		spawnPositions[i] = { (2.0f * random.nextFloat() - 1.0f) * extent, -vae::VmcChunkManager::SURFACE_LEVEL - 1.0f - 20.0f * random.nextFloat(), (2.0f * random.nextFloat() - 1.0f) * extent };
+		spawnVelocities[i] = { random.nextFloat() - 0.5f, 0.0f, random.nextFloat() - 0.5f };
+	}
+
+	vae::VmcThreadPool workers{};
+	auto simulate = [&](bool threaded, std::vector<glm::vec3>& positions) {
+		positions = spawnPositions;
+		std::vector<glm::vec3> velocities = spawnVelocities;
+		const size_t jobCount = threaded ? workers.getThreadCount() * 4 : 1;
+		const size_t particlesPerJob = (particleCount + jobCount - 1) / jobCount;
+		std::atomic<size_t> hits{ 0 };
+
+		float stepTime = timeMilliseconds([&]() {
+			for (int step = 0; step < steps; step++)
+			{
+				for (size_t job = 0; job < jobCount; job++)
+				{
+					auto run = [&, job]() {
+						size_t first = job * particlesPerJob;
+						size_t count = std::min(particlesPerJob, particleCount - first);
+						for (size_t i = first; i < first + count; i++) velocities[i].y += 9.81f * dt;
+						vae::VmcVoxelCollider voxels{ lookup };
+						hits += voxels.moveParticles(positions.data() + first, velocities.data() + first, count, dt, 0.3f);
+					};
+					if (threaded) workers.addJob(run);
+					else run();
+				}
+				if (threaded) workers.wait();
+			}
+		}) / steps;
+		std::cout << (threaded ? std::to_string(workers.getThreadCount()) + " worker threads: " : "Single threaded: ") << stepTime << " ms per step, "
+			<< hits.load() / steps << " bounces per step" << std::endl;
+	};
+
+	std::cout << particleCount << " particles on " << gridSize * gridSize << " chunks, " << steps << " steps" << std::endl;
+	std::vector<glm::vec3> singlePositions;
+	std::vector<glm::vec3> threadedPositions;
+	simulate(false, singlePositions);
+	simulate(true, threadedPositions);
+
+	// Every particle is simulated the same way in both runs, none of them may end up inside of a block
+	vae::VmcVoxelCollider voxels{ lookup };
+	size_t buried = 0;
+	size_t resting = 0;
+	for (const glm::vec3& position : threadedPositions)
+	{
+		glm::ivec3 block = glm::ivec3(glm::floor(position + 0.5f));
+		if (voxels.isSolid(block)) buried++;
+		if (voxels.isSolid(block + glm::ivec3{ 0, 1, 0 })) resting++;
+	}
+	bool identical = singlePositions == threadedPositions;
+	std::cout << resting << " particles resting on a block, " << buried << " inside of one" << std::endl;
+	std::cout << "Results " << (identical ? "are identical" : "DIFFER") << std::endl;
+	if (buried > 0 || !identical) throw std::runtime_error("Particles tunneled into the terrain");
+
+	const int rayCount = 1000000;
+	size_t rayHits = 0;
+	float rayTime = timeMilliseconds([&]() {
+		for (int i = 0; i < rayCount; i++)
+		{
+			glm::vec3 origin{ (2.0f * random.nextFloat() - 1.0f) * extent, -vae::VmcChunkManager::SURFACE_LEVEL - 2.0f, (2.0f * random.nextFloat() - 1.0f) * extent };
+			glm::vec3 direction{ random.nextFloat() - 0.5f, random.nextFloat(), random.nextFloat() - 0.5f };
+			vae::VoxelRayHit hit;
+			if (voxels.raycast(origin, direction, 64.0f, hit)) rayHits++;
+		}
+	}) / 1000.0f;
+	std::cout << "Picking: " << rayCount / rayTime / 1e6f << " million rays/s, " << 100.0f * rayHits / rayCount << "% hit a block" << std::endl;
+}
+
+/*
+	Spline evaluation benchmark on a spline through 1024 random control points, compares evaluating 1M points and tangents
+	one at a time with the SSE batches, for random curve parameters and for sorted ones (like the drawn curve points):
+	--benchmark-spline
+*/
+static void benchmarkSpline()
+{
+	const int controlPointCount = 1024;
+	const size_t sampleCount = 1 << 20;
+
+	vae::VmcRandom random{ 1 };
+
+	vae::Spline spline{};
+	for (int i = 0; i < controlPointCount; i++)
+	{
+		spline.addControlPoint({ random.nextFloat() * 100.0f, random.nextFloat() * 100.0f, random.nextFloat() * 100.0f }, { 0.0f, 0.0f, 1.0f }, nullptr, { 0.0f, 0.0f, 0.0f });
+	}
+	spline.generateSplineSegments();
+	const vae::SplineCoefficients& coefficients = spline.getCoefficients();
+	const int segmentCount = coefficients.getSegmentCount();
+
+	std::vector<float> randomT(sampleCount);
+	std::vector<float> sortedT(sampleCount);
+	for (size_t i = 0; i < sampleCount; i++)
+	{
+		randomT[i] = random.nextFloat() * segmentCount;
+		sortedT[i] = static_cast<float>(i) / sampleCount * segmentCount;
+	}
+
+	std::vector<float> x(sampleCount), y(sampleCount), z(sampleCount);
+	std::vector<glm::vec3> single(sampleCount);
+	bool identical = true;
+	auto measure = [&](const char* name, const std::vector<float>& t, bool tangents) {
+		float singleTime = timeMilliseconds([&]() {
+			for (size_t i = 0; i < sampleCount; i++)
+			{
+				int segment = std::min(static_cast<int>(t[i]), segmentCount - 1);
+				single[i] = tangents ? coefficients.tangent(segment, t[i] - segment) : coefficients.point(segment, t[i] - segment);
+			}
+		}) / 1000.0f;
+		float batchTime = timeMilliseconds([&]() {
+			if (tangents) coefficients.evaluateTangents(t.data(), x.data(), y.data(), z.data(), sampleCount);
+			else coefficients.evaluatePoints(t.data(), x.data(), y.data(), z.data(), sampleCount);
+		}) / 1000.0f;
+
+		for (size_t i = 0; i < sampleCount; i++)
+		{
+			if (single[i] != glm::vec3{ x[i], y[i], z[i] }) identical = false;
+		}
+		std::cout << name << ": " << sampleCount / singleTime / 1e6f << " million/s one at a time, "
+			<< sampleCount / batchTime / 1e6f << " million/s batched (" << singleTime / batchTime << "x)" << std::endl;
+	};
+
+	std::cout << segmentCount << " segments, " << sampleCount << " samples" << std::endl;
+	measure("Points, random t  ", randomT, false);
+	measure("Points, sorted t  ", sortedT, false);
+	measure("Tangents, random t", randomT, true);
+	measure("Tangents, sorted t", sortedT, true);
+	std::cout << "Results " << (identical ? "are identical" : "DIFFER") << std::endl;
+	if (!identical) throw std::runtime_error("Batched spline evaluation does not match single points");
+}
+
+/*
+	Crowd benchmark: agents with random time offsets and all speed control functions on a spline through 64 control
+	points, compares evaluating the crowd on one thread with the thread pool and checks the positions and frames against
+	evaluating the agents one at a time:
+	--benchmark-crowd [agents]
+*/
+static void benchmarkCrowd(size_t agentCount)
+{
+	const int controlPointCount = 64;
+	const float duration = 20.0f;
+	const int frameCount = 20;
+
+	vae::VmcRandom random{ 1 };
+
+	// Loop winding in and out and up and down around the origin
+	vae::Spline spline{};
+	for (int i = 0; i < controlPointCount; i++)
+	{
+		float angle = 6.2831853f * i / controlPointCount;
+		float radius = 50.0f + 10.0f * std::sin(3.0f * angle);
+		spline.addControlPoint({ radius * std::cos(angle), 5.0f * std::sin(5.0f * angle), radius * std::sin(angle) }, { 0.0f, 0.0f, 1.0f }, nullptr, { 0.0f, 0.0f, 0.0f });
+	}
+	spline.generateSplineSegments();
+
+	vae::SplineCrowd crowd{};
+	std::vector<float> timeOffsets(agentCount);
+	std::vector<int> speedControls(agentCount);
+	for (size_t i = 0; i < agentCount; i++)
+	{
+		timeOffsets[i] = random.nextFloat() * duration;
+		speedControls[i] = static_cast<int>(i % 3);
+		crowd.addAgent(timeOffsets[i], speedControls[i], { 0.0f, 0.0f });
+	}
+
+	std::vector<float> streams(vae::SplineCrowd::STREAM_COUNT * agentCount);
+	vae::SplineCrowd::Streams out{};
+	for (int k = 0; k < vae::SplineCrowd::STREAM_COUNT; k++) out[k] = streams.data() + k * agentCount;
+
+	float prepareTime = timeMilliseconds([&]() { spline.prepareBatches(); });
+
+	vae::VmcThreadPool workers{};
+	auto measure = [&](vae::VmcThreadPool* pool) {
+		return timeMilliseconds([&]() {
+			for (int frame = 0; frame < frameCount; frame++)
+			{
+				crowd.evaluate(spline, frame * 0.016f, duration, out, pool);
+			}
+		}) / frameCount;
+	};
+	float singleTime = measure(nullptr);
+	float poolTime = measure(&workers);
+
+	// Against evaluating every 7th agent on its own, with Newton's method on the arc length and the slerped frames
+	const float time = (frameCount - 1) * 0.016f;
+	float maxPositionError = 0.0f;
+	float maxFrameError = 0.0f;
+	for (size_t i = 0; i < agentCount; i += 7)
+	{
+		float lapTime = std::fmod(time + timeOffsets[i], duration);
+		float t = spline.parameterAtArcLength(vae::SpeedCurve::preset(speedControls[i]).distanceAt(lapTime / duration));
+		glm::vec3 position = spline.calculatePointAtParameter(t);
+		int segment = std::min(static_cast<int>(t), spline.getSegmentCount() - 1);
+		glm::vec3 forward = glm::normalize(spline.getCoefficients().tangent(segment, t - segment));
+		glm::vec3 normal = spline.frameAtParameter(t) * glm::vec3{ 0.0f, 1.0f, 0.0f };
+
+		auto streamVector = [&](int first) { return glm::vec3{ out[first][i], out[first + 1][i], out[first + 2][i] }; };
+		maxPositionError = std::max(maxPositionError, glm::length(position - streamVector(vae::SplineCrowd::POSITION_X)));
+		maxFrameError = std::max(maxFrameError, glm::length(forward - streamVector(vae::SplineCrowd::FORWARD_X)));
+		maxFrameError = std::max(maxFrameError, glm::length(normal - streamVector(vae::SplineCrowd::NORMAL_X)));
+	}
+
+	std::cout << agentCount << " agents on " << spline.getSegmentCount() << " segments (length " << spline.getArcLengthTable().getLength() << ")" << std::endl;
+	std::cout << "Preparing the batches: " << prepareTime << " ms" << std::endl;
+	std::cout << "One thread: " << singleTime << " ms per frame, " << workers.getThreadCount() << " workers: " << poolTime << " ms per frame" << std::endl;
+	std::cout << "Max error against exact evaluation: position " << maxPositionError << ", frame " << maxFrameError << std::endl;
+	if (maxPositionError > 1e-2f || maxFrameError > 1e-2f) throw std::runtime_error("Crowd evaluation is too far off the exact path");
+}
+
+int main(int argc, char* argv[])
+{
+	try
+	{
+		// Benchmarks by flag, the argument after the flag is passed on (empty without one)
+		auto seedOf = [](const std::string& argument) { return argument.empty() ? 1u : static_cast<uint32_t>(std::stoul(argument)); };
+		const std::unordered_map<std::string, std::function<void(const std::string&)>> benchmarks{
+			{ "--benchmark-import", [](const std::string& argument) { benchmarkImport(argument); } },
+			{ "--benchmark-meshing", [](const std::string&) { benchmarkMeshing(); } },
+			{ "--benchmark-terrain", [&](const std::string& argument) { benchmarkTerrain(seedOf(argument)); } },
+			{ "--benchmark-regions", [&](const std::string& argument) { benchmarkRegions(seedOf(argument)); } },
+			{ "--benchmark-voxel-collision", [&](const std::string& argument) { benchmarkVoxelCollision(seedOf(argument)); } },
+			{ "--benchmark-spline", [](const std::string&) { benchmarkSpline(); } },
+			{ "--benchmark-crowd", [](const std::string& argument) { benchmarkCrowd(argument.empty() ? 100000 : std::stoul(argument)); } },
+		};
+		if (argc > 1)
+		{
+			auto benchmark = benchmarks.find(argv[1]);
+			if (benchmark != benchmarks.end())
+			{
+				benchmark->second(argc > 2 ? argv[2] : "");
+				return EXIT_SUCCESS;
+			}
+		}
+
+		vae::HeadlessSettings headlessSettings{};
+		std::unique_ptr<vae::VmcApp> app;
+		if (parseHeadlessSettings(argc, argv, headlessSettings))
+		{
+			app = std::make_unique<vae::VmcApp>(headlessSettings);
+		}
+		else
+		{
+			app = std::make_unique<vae::VmcApp>();
+		}
+
 		//vmc::ChunkComponent testchunk{ 16 };
 		//testchunk.visibleBlockFacesTest();
-		app.run();
+		app->run();
 	}
 	catch (const std::exception& e)
 	{
@@ -19,4 +650,4 @@ int main()
 		return EXIT_FAILURE;
 	}
 	return EXIT_SUCCESS;
-}
\ No newline at end of file
+}
@@ -1,4 +1,5 @@
 #include "rigid_body.hpp"
+#include "vmc_voxel_collider.hpp"
 
 
 namespace vae {
@@ -31,6 +32,7 @@ namespace vae {
 		}
 
 		S.pos = positionSummed / mass;
+		previousPos = S.pos;
 
 		// Inertia tensor object
 		float I_xx = .0f;
@@ -94,6 +96,7 @@ namespace vae {
 	{
 		// LINEAR MOVEMENT
 		// x(t_i) = x(t_i-1) + v*dt 
+		previousPos = S.pos;
 		S.pos = S.pos + dt * getTranslationalSpeed();
 		// v(t_i) = v(t_i-1) + a*dt 
 		glm::vec3 newLinearSpeed = getTranslationalSpeed() + dt * resultingForce / mass;
@@ -136,4 +139,24 @@ namespace vae {
 		return false;
 	}
 
+	bool RigidBody::detectCollision(VmcVoxelCollider& voxels, CollisionInfo& info)
+	{
+		glm::vec3 boundMin = { bound.props.minX, bound.props.minY, bound.props.minZ };
+		glm::vec3 boundMax = { bound.props.maxX, bound.props.maxY, bound.props.maxZ };
+		VoxelSweepResult sweep = voxels.sweepBox(previousPos + boundMin, previousPos + boundMax, S.pos - previousPos);
+		if (!sweep.blocked.x && !sweep.blocked.y && !sweep.blocked.z) return false;
+
+		// Stops at the blocks and bounces off their faces, losing momentum like with the other collidables
+		S.pos = previousPos + sweep.displacement;
+		glm::vec3 reflected = S.linearImpulse;
+		for (int axis = 0; axis < 3; axis++)
+		{
+			if (sweep.blocked[axis]) reflected[axis] = -reflected[axis];
+		}
+		float impulse = glm::length(reflected);
+		if (impulse > 0.0f)
+			S.linearImpulse = (glm::max(0.0f, impulse - MOMENTUM_DAMPING_FACTOR) / impulse) * reflected;
+		return true;
+	}
+
 }
\ No newline at end of file
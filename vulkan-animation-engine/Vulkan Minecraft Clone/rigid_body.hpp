@@ -15,6 +15,7 @@
 #define MOMENTUM_DAMPING_FACTOR 15.0f
 
 namespace vae {
+	class VmcVoxelCollider;
 
 	struct ObjectState {
 		glm::vec3 pos;
@@ -49,6 +50,8 @@ namespace vae {
 		glm::vec3 getPosition() { return S.pos; };
 
 		bool detectCollision(RigidBody& collidable, CollisionInfo& info);
+		// Sweeps the bounding box through the blocks along the motion of the last updateState()
+		bool detectCollision(VmcVoxelCollider& voxels, CollisionInfo& info);
 
 		BoundingBox bound;
 		ObjectState S;
@@ -64,6 +67,7 @@ namespace vae {
 		glm::vec3 resultingTorque;
 		std::vector<std::pair<glm::vec3, float>> massPts;
 		float currRotationAngle;
+		glm::vec3 previousPos;	// Before the last updateState()
 	};
 }
 
@@ -1,10 +1,12 @@
 #include "simple_render_system.hpp"
 
 // std
+#include <algorithm>
 #include <cassert>
 #include <stdexcept>
 #include <array>
 #include <chrono>
+#include <cmath>
 #include <math.h>
 
 
@@ -13,9 +15,33 @@
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
 #include <glm/glm.hpp>
 #include<glm/gtc/constants.hpp>
+#include <glm/gtc/matrix_transform.hpp>
 
 namespace vae {
 
+	namespace {
+		// One instance rate binding per stream of SplineCrowd after the binding of the model, read as single floats at
+		// locations 4 and up by the CROWD_INSTANCE vertex shader
+		void addCrowdInstanceInputs(PipelineConfigInfo& configInfo)
+		{
+			for (uint32_t stream = 0; stream < SplineCrowd::STREAM_COUNT; stream++)
+			{
+				VkVertexInputBindingDescription binding{};
+				binding.binding = 1 + stream;
+				binding.stride = sizeof(float);
+				binding.inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
+				configInfo.bindingDescriptions.push_back(binding);
+
+				VkVertexInputAttributeDescription attribute{};
+				attribute.binding = 1 + stream;
+				attribute.location = 4 + stream;
+				attribute.format = VK_FORMAT_R32_SFLOAT;
+				attribute.offset = 0;
+				configInfo.attributeDescriptions.push_back(attribute);
+			}
+		}
+	}
+
 	SimpleRenderSystem::SimpleRenderSystem(VmcDevice &device, VkRenderPass sceneRenderPass,  VkRenderPass skyboxRenderPass, VkDescriptorSetLayout globalSetLayout) : vmcDevice{device}
 	{
 		createPipelineLayout(globalSetLayout);
@@ -60,6 +86,24 @@ namespace vae {
 		pipelineConfig.renderPass = renderPass;
 		pipelineConfig.pipelineLayout = pipelineLayout;
 		vmcPipeline = std::make_unique<VmcPipeline>(vmcDevice, "../Shaders/simple_shader.vert.spv", "../Shaders/simple_shader.frag.spv", pipelineConfig);
+
+		pipelineConfig.bindingDescriptions = VmcModel::PackedVertex::getBindingDescriptions();
+		pipelineConfig.attributeDescriptions = VmcModel::PackedVertex::getAttributeDescriptions();
+		packedPipeline = std::make_unique<VmcPipeline>(vmcDevice, "../Shaders/simple_shader.vert.spv", "../Shaders/simple_shader.frag.spv", pipelineConfig);
+
+		pipelineConfig.bindingDescriptions = VmcModel::VoxelVertex::getBindingDescriptions();
+		pipelineConfig.attributeDescriptions = VmcModel::VoxelVertex::getAttributeDescriptions();
+		voxelPipeline = std::make_unique<VmcPipeline>(vmcDevice, "../Shaders/simple_shader_voxel.vert.spv", "../Shaders/simple_shader.frag.spv", pipelineConfig);
+
+		pipelineConfig.bindingDescriptions = VmcModel::Vertex::getBindingDescriptions();
+		pipelineConfig.attributeDescriptions = VmcModel::Vertex::getAttributeDescriptions();
+		addCrowdInstanceInputs(pipelineConfig);
+		crowdPipeline = std::make_unique<VmcPipeline>(vmcDevice, "../Shaders/simple_shader_crowd.vert.spv", "../Shaders/simple_shader.frag.spv", pipelineConfig);
+
+		pipelineConfig.bindingDescriptions = VmcModel::PackedVertex::getBindingDescriptions();
+		pipelineConfig.attributeDescriptions = VmcModel::PackedVertex::getAttributeDescriptions();
+		addCrowdInstanceInputs(pipelineConfig);
+		packedCrowdPipeline = std::make_unique<VmcPipeline>(vmcDevice, "../Shaders/simple_shader_crowd.vert.spv", "../Shaders/simple_shader.frag.spv", pipelineConfig);
 	}
 
 	void SimpleRenderSystem::createSkyBoxPipeline(VkRenderPass renderPass)
@@ -74,203 +118,376 @@ namespace vae {
 	}
 
 
-	// TODO: State update of objects should be handled somewhere else!
 	// Render loop
-	void SimpleRenderSystem::renderGameObjects(VkCommandBuffer commandBuffer, VkDescriptorSet globalDescriptorSet, VkDescriptorSet skyboxDescriptorSet, std::vector<VmcGameObject>& skyBoxes, std::vector<VmcGameObject> &gameObjects, std::vector<SplineAnimator>& animators, std::vector<LSystem>& lsystems, std::vector<Skeleton2>& skeletons, std::vector<RigidBody>& rigids, std::vector<RigidBody>& collidables, const VmcCamera& camera, const float frameDeltaTime, std::shared_ptr<VmcModel> pointModel, VmcGameObject* viewerObj)
+	// The draw list is built on the calling thread. When the render pass was begun with secondary command buffer contents,
+	// it is split into contiguous slices that are recorded in parallel and executed in order, so the result matches inline recording.
+	void SimpleRenderSystem::renderGameObjects(VmcRenderer& renderer, VkCommandBuffer commandBuffer, VkDescriptorSet globalDescriptorSet, VkDescriptorSet skyboxDescriptorSet, std::vector<VmcGameObject>& skyBoxes, std::vector<VmcGameObject> &gameObjects, std::vector<SplineAnimator>& animators, std::vector<LSystem>& lsystems, std::vector<Skeleton2>& skeletons, std::vector<RigidBody>& rigids, std::vector<RigidBody>& collidables, const VmcChunkManager* world, const VmcCamera& camera, const float frameDeltaTime, std::shared_ptr<VmcModel> pointModel, VmcGameObject* viewerObj)
 	{
-		if (renderSkybox)
-		{
-			// ============
-			// Draw skybox
-			// ============
-			vkCmdBindDescriptorSets(
-				commandBuffer,
-				VK_PIPELINE_BIND_POINT_GRAPHICS,
-				pipelineLayout,
-				0, 1,
-				&skyboxDescriptorSet, 0,
-				nullptr);
+		collectDrawCalls(gameObjects, animators, lsystems, skeletons, rigids, collidables, world, pointModel, camera, renderer.getExtent());
+		evaluateCrowds(renderer, animators);
+		bool drawSkybox = renderSkybox && skyBoxes[0].model->isReady();
 
-			skyBoxes[0].model->bind(commandBuffer);
-			skyboxPipeline->bind(commandBuffer);
-			skyBoxes[0].model->draw(commandBuffer);
+		if (renderer.getSubpassContents() == VK_SUBPASS_CONTENTS_INLINE)
+		{
+			if (drawSkybox)
+			{
+				recordSkybox(commandBuffer, skyboxDescriptorSet, skyBoxes[0]);
+			}
+			recordDrawCalls(commandBuffer, globalDescriptorSet, 0, drawCalls.size());
+			recordCrowds(commandBuffer, globalDescriptorSet);
+			return;
 		}
 
-		// ===========
-		// Draw scene
-		// ===========
-		vmcPipeline->bind(commandBuffer);
-		// Global descriptor set (index 0), can be reused by all game objects
-		vkCmdBindDescriptorSets(
-			commandBuffer,
-			VK_PIPELINE_BIND_POINT_GRAPHICS,
-			pipelineLayout,
-			0, 1,
-			&globalDescriptorSet, 0,
-			nullptr);
+		size_t sliceCount = (drawCalls.size() + MIN_DRAW_CALLS_PER_SLICE - 1) / MIN_DRAW_CALLS_PER_SLICE;
+		sliceCount = std::clamp<size_t>(sliceCount, 1, renderer.getMaxSecondaryCommandBuffers());
+		size_t drawCallsPerSlice = (drawCalls.size() + sliceCount - 1) / sliceCount;
+
+		renderer.recordSecondaryCommandBuffers(commandBuffer, static_cast<uint32_t>(sliceCount), [&](VkCommandBuffer secondary, uint32_t slice) {
+			// The skybox goes first so it stays behind the scene, as with inline recording
+			if (slice == 0 && drawSkybox)
+			{
+				recordSkybox(secondary, skyboxDescriptorSet, skyBoxes[0]);
+			}
 
-		glm::vec3 nextPosition{ 0.0f, 0.0f, 0.0f };
-		glm::vec3 nextRotation{ 0.0f, 0.0f, 0.0f };
+			size_t first = std::min(slice * drawCallsPerSlice, drawCalls.size());
+			size_t last = std::min(first + drawCallsPerSlice, drawCalls.size());
+			recordDrawCalls(secondary, globalDescriptorSet, first, last);
+			// Crowds go last, as with inline recording
+			if (slice == sliceCount - 1)
+			{
+				recordCrowds(secondary, globalDescriptorSet);
+			}
+		});
+	}
+
+	void SimpleRenderSystem::collectDrawCalls(std::vector<VmcGameObject>& gameObjects, std::vector<SplineAnimator>& animators, std::vector<LSystem>& lsystems, std::vector<Skeleton2>& skeletons, std::vector<RigidBody>& rigids, std::vector<RigidBody>& collidables, const VmcChunkManager* world, std::shared_ptr<VmcModel> pointModel, const VmcCamera& camera, VkExtent2D extent)
+	{
+		drawCalls.clear();
+		DrawCall drawCall{};
 
 		for (int i = 0; i < animators.size(); i++)
 		{
 			if (animators[i].drawCurve)
 			{
 				// Draw spline control points
-				TestPushConstant pushSpline{};
 				for (auto& cpspline : animators[i].getControlPoints())
 				{
-					pushSpline.modelMatrix = cpspline.transform.mat4();
-					pushSpline.normalMatrix = cpspline.transform.normalMatrix();
-					pushSpline.color = cpspline.color;
-
-					vkCmdPushConstants(commandBuffer,
-						pipelineLayout,
-						VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
-						0,
-						sizeof(TestPushConstant),
-						&pushSpline);
-
-					cpspline.model->bind(commandBuffer);
-					cpspline.model->draw(commandBuffer);
+					drawCall.model = cpspline.model.get();
+					drawCall.push.modelMatrix = cpspline.transform.mat4();
+					drawCall.push.normalMatrix = cpspline.transform.normalMatrix();
+					drawCall.push.color = cpspline.color;
+					drawCalls.push_back(drawCall);
 				}
 
 				// Draw spline curve points
-				pushSpline.color = { 1.0f, 1.0f, 1.0f };
+				drawCall.model = pointModel.get();
+				drawCall.push.color = { 1.0f, 1.0f, 1.0f };
 				for (auto& curvePoint : animators[i].getCurvePoints())
 				{
-					pushSpline.modelMatrix = curvePoint.mat4();
-					pushSpline.normalMatrix = curvePoint.normalMatrix();
-					pushSpline.color = { 1.0f, 1.0f, 1.0f };
-
-					vkCmdPushConstants(commandBuffer,
-						pipelineLayout,
-						VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
-						0,
-						sizeof(TestPushConstant),
-						&pushSpline);
-
-					pointModel->bind(commandBuffer);
-					pointModel->draw(commandBuffer);
+					drawCall.push.modelMatrix = curvePoint.mat4();
+					drawCall.push.normalMatrix = curvePoint.normalMatrix();
+					drawCalls.push_back(drawCall);
 				}
 			}
 		}
 
 		// Draw gameobjects
 		for (auto& obj : gameObjects) {
-
-			// Update object deformation
-			if (obj.deformationEnabled)
-			{
-				obj.deformObject();
-			}
-
-			TestPushConstant push{};
-			push.modelMatrix = obj.transform.mat4();
-			push.normalMatrix = obj.transform.normalMatrix();
-			push.color = obj.color;
-			
-			vkCmdPushConstants(
-				commandBuffer,
-				pipelineLayout,
-				VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
-				0,
-				sizeof(TestPushConstant),
-				&push);
-
-			obj.model->bind(commandBuffer);
-			obj.model->draw(commandBuffer);
+			drawCall.model = obj.model.get();
+			drawCall.push.modelMatrix = obj.transform.mat4();
+			drawCall.push.normalMatrix = obj.transform.normalMatrix();
+			drawCall.push.color = obj.color;
+			drawCalls.push_back(drawCall);
 
 			// Draw children
 			for (auto& child : obj.getChildren()) {
-
-				TestPushConstant pushChild{};
-				pushChild.modelMatrix = child.transform.mat4();
-				pushChild.normalMatrix = child.transform.normalMatrix();
-				pushChild.color = obj.color;
-
-				vkCmdPushConstants(
-					commandBuffer,
-					pipelineLayout,
-					VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
-					0,
-					sizeof(TestPushConstant),
-					&pushChild);
-
-				child.model->bind(commandBuffer);
-				child.model->draw(commandBuffer);
+				drawCall.model = child.model.get();
+				drawCall.push.modelMatrix = child.transform.mat4();
+				drawCall.push.normalMatrix = child.transform.normalMatrix();
+				drawCall.push.color = obj.color;
+				drawCalls.push_back(drawCall);
 			}
 
 			// Draw deformation grid
-			obj.deformationSystem.render(commandBuffer, pipelineLayout, pointModel);
+			obj.deformationSystem.collectDrawCalls(drawCalls, pointModel);
 		}
 
-
 		// Draw L-Systems
-		TestPushConstant pushL{};
+		drawCall.model = pointModel.get();
 		for (auto& lsystem : lsystems)
 		{
 			for (auto& lrenderpoint : lsystem.getRenderPoints())
 			{
-				pushL.modelMatrix = lrenderpoint.mat4();
-				pushL.normalMatrix = lrenderpoint.normalMatrix();
-				pushL.color = lsystem.renderColor;
-
-				vkCmdPushConstants(commandBuffer,
-					pipelineLayout,
-					VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
-					0,
-					sizeof(TestPushConstant),
-					&pushL);
-
-				pointModel->bind(commandBuffer);
-				pointModel->draw(commandBuffer);
+				drawCall.push.modelMatrix = lrenderpoint.mat4();
+				drawCall.push.normalMatrix = lrenderpoint.normalMatrix();
+				drawCall.push.color = lsystem.renderColor;
+				drawCalls.push_back(drawCall);
 			}
 		}
 
-
 		// Draw skeleton
 		for (auto& skel : skeletons)
 		{
-			skel.render(commandBuffer, pipelineLayout, pointModel);
+			skel.collectDrawCalls(drawCalls, pointModel);
 		}
 
 		// Draw rigid bodies
-		TestPushConstant pushRigid{};
-
 		for (auto& rigid : rigids)
 		{
-			pushRigid.modelMatrix = rigid.S.mat4();
-			pushRigid.normalMatrix = rigid.S.normalMatrix();
-			pushRigid.color = { 0.0f, 0.45f, 0.97f };
+			drawCall.model = rigid.model.get();
+			drawCall.push.modelMatrix = rigid.S.mat4();
+			drawCall.push.normalMatrix = rigid.S.normalMatrix();
+			drawCall.push.color = { 0.0f, 0.45f, 0.97f };
+			drawCalls.push_back(drawCall);
+		}
+
+		// Draw collidables
+		for (auto& col : collidables)
+		{
+			drawCall.model = col.model.get();
+			drawCall.push.modelMatrix = col.S.mat4();
+			drawCall.push.normalMatrix = col.S.normalMatrix();
+			drawCall.push.color = { 0.04f, 0.22f, 0.08f };
+			drawCalls.push_back(drawCall);
+		}
+
+		if (world)
+		{
+			world->collectDrawCalls(drawCalls);
+		}
+
+		// Models whose buffers are still being uploaded show up in a later frame
+		drawCalls.erase(std::remove_if(drawCalls.begin(), drawCalls.end(), [](const DrawCall& drawCall) { return !drawCall.model->isReady(); }), drawCalls.end());
+
+		selectLods(camera, extent);
+
+		// Packed positions are relative to the bounding box of the model, the normal matrix is unaffected
+		for (auto& call : drawCalls)
+		{
+			if (call.model->getVertexFormat() == VmcModel::VERTEX_FORMAT_PACKED)
+				call.push.modelMatrix = call.push.modelMatrix * call.model->getPositionDequantization();
+		}
+	}
+
+	void SimpleRenderSystem::selectLods(const VmcCamera& camera, VkExtent2D extent)
+	{
+		const glm::mat4& projection = camera.getProjection();
+		const glm::mat4& view = camera.getView();
+		const bool orthographic = projection[3][3] == 1.0f;
+		// Pixels covered by one unit at a view depth of one (perspective) or at any depth (orthographic)
+		const float pixelsPerUnit = std::abs(projection[1][1]) * 0.5f * static_cast<float>(extent.height);
+
+		triangleCount = 0;
+		fullDetailTriangleCount = 0;
+		for (auto& call : drawCalls)
+		{
+			const std::vector<VmcModel::Lod>& lods = call.model->getLods();
+			call.lod = 0;
+			if (useLods && lods.size() > 1)
+			{
+				// The error is in model space: scale it by the largest axis of the model matrix and measure it at the
+				// point of the bounding sphere closest to the camera
+				const glm::mat4& model = call.push.modelMatrix;
+				float scale = std::sqrt(std::max({ glm::dot(glm::vec3(model[0]), glm::vec3(model[0])),
+					glm::dot(glm::vec3(model[1]), glm::vec3(model[1])), glm::dot(glm::vec3(model[2]), glm::vec3(model[2])) }));
+				float depth = (view * model * glm::vec4(call.model->getBoundingCenter(), 1.0f)).z - call.model->getBoundingRadius() * scale;
+				if (orthographic)
+				{
+					call.lod = call.model->selectLod(pixelsPerUnit * scale);
+				}
+				else if (depth > 0.0f)
+				{
+					call.lod = call.model->selectLod(pixelsPerUnit * scale / depth);
+				}
+			}
+
+			if (!lods.empty())
+			{
+				triangleCount += lods[call.lod].indexCount / 3;
+				fullDetailTriangleCount += lods[0].indexCount / 3;
+			}
+		}
+	}
+
+	void SimpleRenderSystem::recordSkybox(VkCommandBuffer commandBuffer, VkDescriptorSet skyboxDescriptorSet, VmcGameObject& skybox)
+	{
+		vkCmdBindDescriptorSets(
+			commandBuffer,
+			VK_PIPELINE_BIND_POINT_GRAPHICS,
+			pipelineLayout,
+			0, 1,
+			&skyboxDescriptorSet, 0,
+			nullptr);
+
+		skybox.model->bind(commandBuffer);
+		skyboxPipeline->bind(commandBuffer);
+		skybox.model->draw(commandBuffer);
+	}
+
+	void SimpleRenderSystem::recordDrawCalls(VkCommandBuffer commandBuffer, VkDescriptorSet globalDescriptorSet, size_t first, size_t last)
+	{
+		VmcModel::VertexFormat boundFormat = VmcModel::VERTEX_FORMAT_FULL;
+		vmcPipeline->bind(commandBuffer);
+		// Global descriptor set (index 0), can be reused by all game objects
+		vkCmdBindDescriptorSets(
+			commandBuffer,
+			VK_PIPELINE_BIND_POINT_GRAPHICS,
+			pipelineLayout,
+			0, 1,
+			&globalDescriptorSet, 0,
+			nullptr);
+
+		VmcModel* boundModel = nullptr;
+		for (size_t i = first; i < last; i++)
+		{
+			const DrawCall& drawCall = drawCalls[i];
 			vkCmdPushConstants(commandBuffer,
 				pipelineLayout,
 				VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
 				0,
 				sizeof(TestPushConstant),
-				&pushRigid);
+				&drawCall.push);
 
-			rigid.model->bind(commandBuffer);
-			rigid.model->draw(commandBuffer);
+			// Runs of the same model (curve points, particles, ...) only bind their buffers once
+			if (drawCall.model != boundModel)
+			{
+				if (drawCall.model->getVertexFormat() != boundFormat)
+				{
+					boundFormat = drawCall.model->getVertexFormat();
+					pipelineFor(boundFormat).bind(commandBuffer);
+				}
+				drawCall.model->bind(commandBuffer);
+				boundModel = drawCall.model;
+			}
+			drawCall.model->draw(commandBuffer, drawCall.lod);
 		}
+	}
 
-		// Draw collidables
-		TestPushConstant pushCol{};
+	void SimpleRenderSystem::evaluateCrowds(VmcRenderer& renderer, std::vector<SplineAnimator>& animators)
+	{
+		auto begin = std::chrono::high_resolution_clock::now();
+		crowdDraws.clear();
+		crowdAgentCount = 0;
+
+		auto isDrawable = [](SplineAnimator& animator) {
+			const SplineCrowd& crowd = animator.crowd;
+			return crowd.getAgentCount() > 0 && crowd.model && crowd.model->isReady() && crowd.model->getVertexFormat() != VmcModel::VERTEX_FORMAT_VOXEL
+				&& animator.getSpline().getSegmentCount() > 0 && animator.getAnimationDuration() > 0.0f;
+		};
+		size_t agentCount = 0;
+		for (auto& animator : animators)
+		{
+			if (isDrawable(animator)) agentCount += animator.crowd.getAgentCount();
+		}
+		if (agentCount == 0)
+		{
+			crowdEvaluationTime = 0.0f;
+			return;
+		}
 
-		for (auto& col : collidables)
+		// The GPU is done with the buffer of this frame in flight, it is only recreated to grow
+		std::unique_ptr<VmcBuffer>& buffer = crowdBuffers[renderer.getFrameIndex()];
+		size_t capacity = buffer ? buffer->getInstanceCount() / SplineCrowd::STREAM_COUNT : 0;
+		if (capacity < agentCount)
 		{
-			pushCol.modelMatrix = col.S.mat4();
-			pushCol.normalMatrix = col.S.normalMatrix();
-			pushCol.color = { 0.04f, 0.22f, 0.08f };
+			capacity = std::max(agentCount, 2 * capacity);
+			buffer = std::make_unique<VmcBuffer>(
+				vmcDevice,
+				sizeof(float),
+				static_cast<uint32_t>(capacity * SplineCrowd::STREAM_COUNT),
+				VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+			buffer->map();
+		}
+		float* streams = static_cast<float*>(buffer->getMappedMemory());
+
+		size_t firstAgent = 0;
+		for (auto& animator : animators)
+		{
+			if (!isDrawable(animator)) continue;
+			SplineCrowd& crowd = animator.crowd;
+
+			SplineCrowd::Streams out{};
+			for (int stream = 0; stream < SplineCrowd::STREAM_COUNT; stream++)
+			{
+				out[stream] = streams + stream * capacity + firstAgent;
+			}
+			crowd.evaluate(animator.getSpline(), animator.getTimePassed(), animator.getAnimationDuration(), out, &renderer.getWorkerPool());
+
+			CrowdDraw crowdDraw{};
+			crowdDraw.model = crowd.model.get();
+			crowdDraw.push.modelMatrix = glm::scale(glm::mat4{ 1.0f }, glm::vec3{ crowd.scale });
+			crowdDraw.push.color = crowd.color;
+			if (crowdDraw.model->getVertexFormat() == VmcModel::VERTEX_FORMAT_PACKED)
+				crowdDraw.push.modelMatrix = crowdDraw.push.modelMatrix * crowdDraw.model->getPositionDequantization();
+			crowdDraw.firstAgent = static_cast<uint32_t>(firstAgent);
+			crowdDraw.agentCount = static_cast<uint32_t>(crowd.getAgentCount());
+			crowdDraws.push_back(crowdDraw);
+
+			const std::vector<VmcModel::Lod>& lods = crowdDraw.model->getLods();
+			if (!lods.empty())
+			{
+				triangleCount += static_cast<uint64_t>(lods[0].indexCount / 3) * crowdDraw.agentCount;
+				fullDetailTriangleCount += static_cast<uint64_t>(lods[0].indexCount / 3) * crowdDraw.agentCount;
+			}
+			firstAgent += crowd.getAgentCount();
+		}
+		buffer->flush();
+		currentCrowdBuffer = buffer.get();
+		crowdAgentCount = agentCount;
+		crowdEvaluationTime = std::chrono::duration<float, std::chrono::milliseconds::period>(std::chrono::high_resolution_clock::now() - begin).count();
+	}
+
+	void SimpleRenderSystem::recordCrowds(VkCommandBuffer commandBuffer, VkDescriptorSet globalDescriptorSet)
+	{
+		if (crowdDraws.empty()) return;
+
+		vkCmdBindDescriptorSets(
+			commandBuffer,
+			VK_PIPELINE_BIND_POINT_GRAPHICS,
+			pipelineLayout,
+			0, 1,
+			&globalDescriptorSet, 0,
+			nullptr);
+
+		const VkDeviceSize capacity = currentCrowdBuffer->getInstanceCount() / SplineCrowd::STREAM_COUNT;
+		std::array<VkBuffer, SplineCrowd::STREAM_COUNT> buffers;
+		buffers.fill(currentCrowdBuffer->getBuffer());
+		std::array<VkDeviceSize, SplineCrowd::STREAM_COUNT> offsets;
+
+		VmcPipeline* boundPipeline = nullptr;
+		for (const CrowdDraw& crowdDraw : crowdDraws)
+		{
+			VmcPipeline* pipeline = crowdDraw.model->getVertexFormat() == VmcModel::VERTEX_FORMAT_PACKED ? packedCrowdPipeline.get() : crowdPipeline.get();
+			if (pipeline != boundPipeline)
+			{
+				pipeline->bind(commandBuffer);
+				boundPipeline = pipeline;
+			}
 			vkCmdPushConstants(commandBuffer,
 				pipelineLayout,
 				VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
 				0,
 				sizeof(TestPushConstant),
-				&pushCol);
+				&crowdDraw.push);
+
+			crowdDraw.model->bind(commandBuffer);
+			for (int stream = 0; stream < SplineCrowd::STREAM_COUNT; stream++)
+			{
+				offsets[stream] = (stream * capacity + crowdDraw.firstAgent) * sizeof(float);
+			}
+			vkCmdBindVertexBuffers(commandBuffer, 1, SplineCrowd::STREAM_COUNT, buffers.data(), offsets.data());
+			crowdDraw.model->draw(commandBuffer, 0, crowdDraw.agentCount);
+		}
+	}
 
-			col.model->bind(commandBuffer);
-			col.model->draw(commandBuffer);
+	VmcPipeline& SimpleRenderSystem::pipelineFor(VmcModel::VertexFormat format)
+	{
+		switch (format)
+		{
+		case VmcModel::VERTEX_FORMAT_PACKED: return *packedPipeline;
+		case VmcModel::VERTEX_FORMAT_VOXEL: return *voxelPipeline;
+		default: return *vmcPipeline;
 		}
 	}
-}
\ No newline at end of file
+}
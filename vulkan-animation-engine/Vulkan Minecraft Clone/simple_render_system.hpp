@@ -1,6 +1,7 @@
 #pragma once
 
 #include "vmc_camera.hpp"
+#include "vmc_renderer.hpp"
 #include "vmc_pipeline.hpp"
 #include "vmc_device.hpp"
 #include "vmc_game_object.hpp"
@@ -9,8 +10,12 @@
 #include "ffd.hpp"
 #include "skeleton2.hpp"
 #include "rigid_body.hpp"
+#include "vmc_chunk_manager.hpp"
+#include "vmc_buffer.hpp"
+#include "vmc_swap_chain.hpp"
 
 // std 
+#include <array>
 #include <memory>
 #include <vector>
 
@@ -21,6 +26,21 @@ namespace vae {
 		glm::vec3 color{ 1.f };
 	};
 
+	// One draw with the scene pipeline: the model to bind and the push constants to draw it with
+	struct DrawCall {
+		VmcModel* model;
+		TestPushConstant push;
+		uint32_t lod = 0;
+	};
+
+	// The agents of one crowd, drawn as instances of the model with the crowd pipeline
+	struct CrowdDraw {
+		VmcModel* model;
+		TestPushConstant push;	// The model matrix only scales, the agent transforms come from the instance buffer
+		uint32_t firstAgent;	// In the instance buffer
+		uint32_t agentCount;
+	};
+
 	class SimpleRenderSystem
 	{
 	public:
@@ -32,9 +52,15 @@ namespace vae {
 		SimpleRenderSystem& operator=(const SimpleRenderSystem&) = delete;
 
 		bool& shouldRenderSkybox() { return renderSkybox; };
-		void renderGameObjects(VkCommandBuffer commandBuffer, VkDescriptorSet globalDescriptorSet, VkDescriptorSet skyboxDescriptorSet, std::vector<VmcGameObject>& skyBoxes,
+		bool& shouldUseLods() { return useLods; };
+		size_t getDrawCallCount() const { return drawCalls.size(); };
+		uint64_t getTriangleCount() const { return triangleCount; };
+		uint64_t getFullDetailTriangleCount() const { return fullDetailTriangleCount; };
+		size_t getCrowdAgentCount() const { return crowdAgentCount; };
+		float getCrowdEvaluationTime() const { return crowdEvaluationTime; };
+		void renderGameObjects(VmcRenderer& renderer, VkCommandBuffer commandBuffer, VkDescriptorSet globalDescriptorSet, VkDescriptorSet skyboxDescriptorSet, std::vector<VmcGameObject>& skyBoxes,
 								std::vector<VmcGameObject> &gameObjects, std::vector<SplineAnimator>& animators, 
-								std::vector<LSystem>& lsystems, std::vector<Skeleton2>& skeletons, std::vector<RigidBody>& rigids, std::vector<RigidBody>& collidables, const VmcCamera& camera,
+								std::vector<LSystem>& lsystems, std::vector<Skeleton2>& skeletons, std::vector<RigidBody>& rigids, std::vector<RigidBody>& collidables, const VmcChunkManager* world, const VmcCamera& camera,
 								const float frameDeltaTime, std::shared_ptr<VmcModel> pointModel, VmcGameObject* viewerObj);
 
 	private:
@@ -42,11 +68,41 @@ namespace vae {
 		void createPipeline(VkRenderPass renderPass);
 		void createSkyBoxPipeline(VkRenderPass renderPass);
 
+		void collectDrawCalls(std::vector<VmcGameObject>& gameObjects, std::vector<SplineAnimator>& animators, std::vector<LSystem>& lsystems,
+								std::vector<Skeleton2>& skeletons, std::vector<RigidBody>& rigids, std::vector<RigidBody>& collidables, const VmcChunkManager* world,
+								std::shared_ptr<VmcModel> pointModel, const VmcCamera& camera, VkExtent2D extent);
+		// Picks the coarsest LOD of every draw whose simplification error stays below a pixel on screen
+		void selectLods(const VmcCamera& camera, VkExtent2D extent);
+		void recordSkybox(VkCommandBuffer commandBuffer, VkDescriptorSet skyboxDescriptorSet, VmcGameObject& skybox);
+		void recordDrawCalls(VkCommandBuffer commandBuffer, VkDescriptorSet globalDescriptorSet, size_t first, size_t last);
+		// Evaluates the agents of all crowds into the instance buffer of the frame
+		void evaluateCrowds(VmcRenderer& renderer, std::vector<SplineAnimator>& animators);
+		void recordCrowds(VkCommandBuffer commandBuffer, VkDescriptorSet globalDescriptorSet);
+		VmcPipeline& pipelineFor(VmcModel::VertexFormat format);
+
+		// Below this many draws per slice the cost of an extra secondary command buffer outweighs the parallel recording
+		static constexpr size_t MIN_DRAW_CALLS_PER_SLICE = 256;
+
 		VmcDevice& vmcDevice;
 
+		std::vector<DrawCall> drawCalls;
+		std::vector<CrowdDraw> crowdDraws;
+		// One per frame in flight, mapped. Stream k of SplineCrowd::Stream starts at float k * capacity, so every
+		// stream is bound as its own vertex buffer with a stride of one float.
+		std::array<std::unique_ptr<VmcBuffer>, VmcSwapChain::MAX_FRAMES_IN_FLIGHT> crowdBuffers;
+		VmcBuffer* currentCrowdBuffer = nullptr;
+		size_t crowdAgentCount = 0;		// Drawn last frame
+		float crowdEvaluationTime = 0.0f;	// Milliseconds
 		bool renderSkybox = true;
+		bool useLods = true;
+		uint64_t triangleCount = 0;				// Triangles drawn last frame
+		uint64_t fullDetailTriangleCount = 0;	// Triangles the same draws would have had without LODs
 		float clock;
 		std::unique_ptr<VmcPipeline> vmcPipeline;
+		std::unique_ptr<VmcPipeline> packedPipeline;	// Same shaders, for models with VERTEX_FORMAT_PACKED
+		std::unique_ptr<VmcPipeline> voxelPipeline;		// VOXEL_VERTEX variant of the vertex shader, for VERTEX_FORMAT_VOXEL
+		std::unique_ptr<VmcPipeline> crowdPipeline;		// CROWD_INSTANCE variant of the vertex shader, for crowds of full vertex models
+		std::unique_ptr<VmcPipeline> packedCrowdPipeline;	// The same for packed models
 		std::unique_ptr<VmcPipeline> skyboxPipeline;
 		VkPipelineLayout pipelineLayout;
 	};
@@ -58,32 +58,25 @@ namespace vae {
 		boneData[boneData.size() - 2]->setChild(boneData[boneData.size() - 1].get());
 	}
 
-	void Skeleton2::render(VkCommandBuffer& commandBuffer, VkPipelineLayout& pipelineLayout, std::shared_ptr<VmcModel> pointModel)
+	void Skeleton2::collectDrawCalls(std::vector<DrawCall>& drawCalls, std::shared_ptr<VmcModel> pointModel)
 	{
 		Bone * curr = root;
 		while (curr != nullptr)
 		{
-			curr->render(commandBuffer, pipelineLayout, boneModel);
+			curr->collectDrawCalls(drawCalls, boneModel);
 			curr = curr->getChild();
 		}
 
 		if (drawIKTarget)
 		{
 			glm::mat4 targetModelMatrix = glm::translate(glm::mat4(1.0f), focusPoint) * glm::scale(glm::vec3{0.1f, 0.1f, 0.1f});
-			TestPushConstant pushTargetPoint{};
-			pushTargetPoint.modelMatrix = targetModelMatrix;
-			pushTargetPoint.normalMatrix = glm::mat4(1.0f);
-			pushTargetPoint.color = { 1.0f, 0.0f, 0.0f };
-
-			vkCmdPushConstants(commandBuffer,
-				pipelineLayout,
-				VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
-				0,
-				sizeof(TestPushConstant),
-				&pushTargetPoint);
-
-			pointModel->bind(commandBuffer);
-			pointModel->draw(commandBuffer);
+			DrawCall drawTargetPoint{};
+			drawTargetPoint.model = pointModel.get();
+			drawTargetPoint.push.modelMatrix = targetModelMatrix;
+			drawTargetPoint.push.normalMatrix = glm::mat4(1.0f);
+			drawTargetPoint.push.color = { 1.0f, 0.0f, 0.0f };
+
+			drawCalls.push_back(drawTargetPoint);
 		}
 	}
 
@@ -7,6 +7,8 @@
 
 
 namespace vae {
+	struct DrawCall;
+
 	enum KinematicsMode {
 		FORWARD,
 		INVERSE
@@ -30,7 +32,7 @@ namespace vae {
 		void addRoot(glm::vec3 pos, float len, glm::vec3 rot);
 		void addBone(float len, glm::vec3 rot);
 
-		void render(VkCommandBuffer& commandBuffer, VkPipelineLayout& pipelineLayout, std::shared_ptr<VmcModel> pointModel);
+		void collectDrawCalls(std::vector<DrawCall>& drawCalls, std::shared_ptr<VmcModel> pointModel);
 		
 		std::vector<glm::vec3> FK();
 		void solveIK_3D(int maxIterations = 1000, float errorMin = 0.001f);
@@ -0,0 +1,107 @@
+#include "speed_curve.hpp"
+
+// glm
+#include <glm/glm.hpp>
+#include <glm/gtc/constants.hpp>
+
+// std
+#include <algorithm>
+
+namespace vae {
+
+	SpeedCurve::SpeedCurve()
+	{
+		tabulate([](float time) { return time; });
+	}
+
+	SpeedCurve::SpeedCurve(const std::function<float(float)>& distance)
+	{
+		tabulate(distance);
+	}
+
+	SpeedCurve::SpeedCurve(std::vector<Key> keys)
+	{
+		setKeys(std::move(keys));
+	}
+
+	const SpeedCurve& SpeedCurve::preset(int speedControl)
+	{
+		// 1/2 sin(3x + (pi/2)) + 1/2, mirrored
+		static const SpeedCurve sine{ [](float time) { return 1.0f - (0.5f * glm::sin(3.0f * time + glm::pi<float>() / 2.0f) + 0.5f); } };
+		static const SpeedCurve linear{};
+		// y = x^2
+		static const SpeedCurve parabolic{ [](float time) { return time * time; } };
+
+		switch (speedControl)
+		{
+		case SINE: return sine;
+		case PARABOLIC: return parabolic;
+		default: return linear;
+		}
+	}
+
+	void SpeedCurve::setKeys(std::vector<Key> newKeys)
+	{
+		keys = std::move(newKeys);
+		if (keys.empty())
+		{
+			tabulate([](float time) { return time; });
+		}
+		else
+		{
+			std::vector<Key> monotonic = monotonicKeys(keys);
+			tabulate([&monotonic](float time) { return evaluateKeys(monotonic, time); });
+		}
+	}
+
+	std::vector<SpeedCurve::Key> SpeedCurve::monotonicKeys(std::vector<Key> keys)
+	{
+		for (Key& key : keys)
+		{
+			key.time = std::clamp(key.time, 0.0f, 1.0f);
+			key.distance = std::clamp(key.distance, 0.0f, 1.0f);
+		}
+		std::stable_sort(keys.begin(), keys.end(), [](const Key& a, const Key& b) { return a.time < b.time; });
+
+		for (size_t i = 1; i < keys.size(); i++)
+		{
+			keys[i].distance = std::max(keys[i].distance, keys[i - 1].distance);
+		}
+		for (size_t i = 0; i < keys.size(); i++)
+		{
+			float limit = std::max(keys[i].slope, 0.0f);
+			if (i > 0 && keys[i].time > keys[i - 1].time)
+				limit = std::min(limit, 3.0f * (keys[i].distance - keys[i - 1].distance) / (keys[i].time - keys[i - 1].time));
+			if (i + 1 < keys.size() && keys[i + 1].time > keys[i].time)
+				limit = std::min(limit, 3.0f * (keys[i + 1].distance - keys[i].distance) / (keys[i + 1].time - keys[i].time));
+			keys[i].slope = limit;
+		}
+		return keys;
+	}
+
+	float SpeedCurve::evaluateKeys(const std::vector<Key>& keys, float time)
+	{
+		// Flat before the first and after the last key
+		if (time <= keys.front().time) return keys.front().distance;
+		if (time >= keys.back().time) return keys.back().distance;
+
+		size_t after = std::upper_bound(keys.begin(), keys.end(), time, [](float time, const Key& key) { return time < key.time; }) - keys.begin();
+		const Key& a = keys[after - 1];
+		const Key& b = keys[after];
+		float width = b.time - a.time;
+		float u = (time - a.time) / width;
+		float u2 = u * u;
+		float u3 = u2 * u;
+		return (2.0f * u3 - 3.0f * u2 + 1.0f) * a.distance + (u3 - 2.0f * u2 + u) * width * a.slope
+			+ (-2.0f * u3 + 3.0f * u2) * b.distance + (u3 - u2) * width * b.slope;
+	}
+
+	void SpeedCurve::tabulate(const std::function<float(float)>& distance)
+	{
+		for (int i = 0; i <= TABLE_SIZE; i++)
+		{
+			table[i] = std::clamp(distance(static_cast<float>(i) / TABLE_SIZE), 0.0f, 1.0f);
+			if (i > 0) table[i] = std::max(table[i], table[i - 1]);
+		}
+	}
+}
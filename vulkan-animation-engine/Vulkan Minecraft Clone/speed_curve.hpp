@@ -0,0 +1,68 @@
+#pragma once
+
+// std
+#include <array>
+#include <functional>
+#include <vector>
+
+namespace vae {
+	enum SPEED_CONTROL_FUNCTION {
+		SINE,
+		LINEAR,
+		PARABOLIC,
+		CUSTOM		// Keyed curve of the animator
+	};
+
+	/*
+		Distance-time curve of an animation: the fraction of the path covered after a fraction of the animation time,
+		both in [0, 1]. A curve is either one of the SPEED_CONTROL_FUNCTION presets or a piecewise cubic Hermite curve
+		through keys (time, distance, slope). Whatever it is made of, it is tabulated once at TABLE_SIZE + 1 evenly spaced
+		times, so evaluating it is a linear interpolation between two table entries.
+		The table never decreases, objects don't move backwards along their path: for tabulation the keys are sorted,
+		their distances made non decreasing and their slopes limited to 3 times the secants next to them (Fritsch and
+		Carlson), which keeps every Hermite piece monotonic. The keys themselves are kept as they were set.
+	*/
+	class SpeedCurve
+	{
+	public:
+		struct Key {
+			float time;
+			float distance;
+			float slope;	// d distance / d time
+		};
+
+		static constexpr int TABLE_SIZE = 256;
+
+		// Linear
+		SpeedCurve();
+		// Tabulates the distance function of the time fraction
+		explicit SpeedCurve(const std::function<float(float)>& distance);
+		// Keys with times and distances outside of [0, 1] are tabulated clamped
+		explicit SpeedCurve(std::vector<Key> keys);
+
+		// Tabulated SINE, LINEAR or PARABOLIC, anything else is LINEAR
+		static const SpeedCurve& preset(int speedControl);
+
+		float distanceAt(float timeFraction) const
+		{
+			float sample = (timeFraction < 0.0f ? 0.0f : timeFraction > 1.0f ? 1.0f : timeFraction) * TABLE_SIZE;
+			int before = static_cast<int>(sample) < TABLE_SIZE ? static_cast<int>(sample) : TABLE_SIZE - 1;
+			return table[before] + (sample - before) * (table[before + 1] - table[before]);
+		};
+
+		// Empty for curves made from a function, otherwise the keys as they were set
+		const std::vector<Key>& getKeys() const { return keys; };
+		void setKeys(std::vector<Key> newKeys);
+		const float* getTable() const { return table.data(); };
+
+	private:
+		// Sorted, clamped and limited copy of the keys as described above
+		static std::vector<Key> monotonicKeys(std::vector<Key> keys);
+		// Hermite interpolation between monotonic keys, needs at least one
+		static float evaluateKeys(const std::vector<Key>& keys, float time);
+		void tabulate(const std::function<float(float)>& distance);
+
+		std::vector<Key> keys;
+		std::array<float, TABLE_SIZE + 1> table{};
+	};
+}
@@ -53,7 +53,7 @@ namespace vae {
 		default:
 			break;
 		}
-		generateSplineSegments();
+		updateSegmentsAround(selectedControlPoint);
 	}
 
 	void Spline::updateControlPointsAndCurvePointsPositions(glm::vec3 offset)
@@ -80,47 +80,109 @@ namespace vae {
 
 	void Spline::generateSplineSegments()
 	{
-		// Reset curve points
-		curvePoints.clear();
-		
-		// We set controlPoints.size() - 3.0f as upper limit because we do not want to draw segments at the outer 2 control points
-		for (float t = .0f; t < controlPoints.size() - 3.0f; t += 0.01f)
+		int segmentCount = getSegmentCount();
+		coefficients.resize(segmentCount);
+		curvePoints.resize(static_cast<size_t>(segmentCount) * CURVE_POINTS_PER_SEGMENT);
+		updateSegments(0, segmentCount - 1);
+
+		arcLengthTable.build(segmentCount, derivative());
+	}
+
+	void Spline::updateSegmentsAround(int controlPoint)
+	{
+		int segmentCount = getSegmentCount();
+		if (coefficients.getSegmentCount() != segmentCount || arcLengthTable.getSegmentCount() != segmentCount)
+		{
+			generateSplineSegments();
+			return;
+		}
+
+		// Segment i is shaped by control points i to i + 3
+		int first = std::max(controlPoint - 3, 0);
+		int last = std::min(controlPoint, segmentCount - 1);
+		updateSegments(first, last);
+		arcLengthTable.updateSegments(first, last, derivative());
+	}
+
+	void Spline::updateSegments(int first, int last)
+	{
+		if (first > last) return;
+
+		for (int i = first; i <= last; i++)
+		{
+			const glm::vec3& p0 = controlPoints[i].transform.translation;
+			const glm::vec3& p1 = controlPoints[i + 1].transform.translation;
+			const glm::vec3& p2 = controlPoints[i + 2].transform.translation;
+			const glm::vec3& p3 = controlPoints[i + 3].transform.translation;
+
+			// Catmull-Rom basis multiplied out into powers of u
+			coefficients.set(i, p1, 0.5f * (p2 - p0), 0.5f * (2.0f * p0 - 5.0f * p1 + 4.0f * p2 - p3), 0.5f * (-p0 + 3.0f * p1 - 3.0f * p2 + p3));
+		}
+
+		// Curve points of all the segments in one batch
+		size_t count = static_cast<size_t>(last - first + 1) * CURVE_POINTS_PER_SEGMENT;
+		std::vector<float> t(count);
+		std::vector<float> x(count);
+		std::vector<float> y(count);
+		std::vector<float> z(count);
+		for (size_t k = 0; k < count; k++)
 		{
-			TransformComponent transform{};
-			transform.translation = calculateSplinePoint(t);
+			t[k] = first + static_cast<int>(k / CURVE_POINTS_PER_SEGMENT) + static_cast<float>(k % CURVE_POINTS_PER_SEGMENT) / CURVE_POINTS_PER_SEGMENT;
+		}
+		coefficients.evaluatePoints(t.data(), x.data(), y.data(), z.data(), count);
+
+		for (size_t k = 0; k < count; k++)
+		{
+			TransformComponent& transform = curvePoints[static_cast<size_t>(first) * CURVE_POINTS_PER_SEGMENT + k];
+			transform = TransformComponent{};
+			transform.translation = { x[k], y[k], z[k] };
 			transform.scale = { 0.05f, 0.05f, 0.05f };
-			curvePoints.push_back(transform);
 		}
 	}
 
+	glm::vec3 Spline::calculatePointAtArcLength(float lengthFraction)
+	{
+		return calculatePointAtParameter(parameterAtArcLength(lengthFraction));
+	}
 
-	glm::vec3 Spline::calculateSplinePoint(float normalizedDist)
+	glm::vec3 Spline::calculatePointAtParameter(float t)
 	{
-		int p0, p1, p2, p3;
+		if (getSegmentCount() == 0)
+			return controlPoints.empty() ? glm::vec3{ 0.0f } : controlPoints[std::min<size_t>(1, controlPoints.size() - 1)].transform.translation;
+		if (coefficients.getSegmentCount() != getSegmentCount()) generateSplineSegments();
 
-		// 4 control point indices
-		p1 = (int)normalizedDist + 1;
-		p2 = p1 + 1;
-		p3 = p2 + 1;
-		p0 = p1 - 1;
+		t = std::clamp(t, 0.0f, static_cast<float>(getSegmentCount()));
+		int segment = std::min(static_cast<int>(t), getSegmentCount() - 1);
+		return coefficients.point(segment, t - segment);
+	}
 
-		// Map distance to [0;1] range to represent the distance of the current segment we're looking at
-		normalizedDist = normalizedDist - (int)normalizedDist;
+	glm::quat Spline::frameAtParameter(float t)
+	{
+		if (arcLengthTable.getSegmentCount() != getSegmentCount()) generateSplineSegments();
+		return arcLengthTable.frameAtParameter(t, point(), derivative());
+	}
 
-		// Cache square and cube since we'll use it often
-		float dd = pow(normalizedDist, 2);
-		float ddd = pow(normalizedDist, 3);
+	float Spline::parameterAtArcLength(float lengthFraction)
+	{
+		// Built by generateSplineSegments() and kept current by updateSegmentsAround()
+		if (arcLengthTable.getSegmentCount() != getSegmentCount()) generateSplineSegments();
+		return arcLengthTable.parameterAtLength(lengthFraction * arcLengthTable.getLength(), derivative());
+	}
 
-		float q1 = -ddd + 2.0f * dd - normalizedDist;
-		float q2 = 3.0f * ddd - 5.0f * dd + 2.0f;
-		float q3 = -3.0f * ddd + 4.0f * dd + normalizedDist;
-		float q4 = ddd - dd;
+	void Spline::prepareBatches()
+	{
+		if (arcLengthTable.getSegmentCount() != getSegmentCount()) generateSplineSegments();
+		arcLengthTable.prepareBatches(point(), derivative());
+	}
 
-		float x_result = 0.5f * (controlPoints[p0].transform.translation.x * q1 + controlPoints[p1].transform.translation.x * q2 + controlPoints[p2].transform.translation.x * q3 + controlPoints[p3].transform.translation.x * q4);
-		float y_result = 0.5f * (controlPoints[p0].transform.translation.y * q1 + controlPoints[p1].transform.translation.y * q2 + controlPoints[p2].transform.translation.y * q3 + controlPoints[p3].transform.translation.y * q4);
-		float z_result = 0.5f * (controlPoints[p0].transform.translation.z * q1 + controlPoints[p1].transform.translation.z * q2 + controlPoints[p2].transform.translation.z * q3 + controlPoints[p3].transform.translation.z * q4);
+	ArcLengthTable::Point Spline::point() const
+	{
+		return [this](int segment, float u) { return coefficients.point(segment, u); };
+	}
 
-		return { x_result, y_result, z_result };
+	ArcLengthTable::Derivative Spline::derivative() const
+	{
+		return [this](int segment, float u) { return coefficients.tangent(segment, u); };
 	}
 
 }
@@ -1,11 +1,14 @@
 #pragma once
 #include "vmc_game_object.hpp"
 #include "enums.hpp"
+#include "arc_length_table.hpp"
+#include "spline_coefficients.hpp"
 
 // glm
 #include <glm/glm.hpp>
 
 // std
+#include <algorithm>
 #include <vector>
 
 
@@ -21,6 +24,11 @@ namespace vae {
 		int getSelectedCpIndex() { return selectedControlPoint; };
 		std::vector<VmcGameObject>& getControlPoints() { return controlPoints; };
 		std::vector<TransformComponent>& getCurvePoints() { return curvePoints; };
+		const ArcLengthTable& getArcLengthTable() const { return arcLengthTable; };
+		// Polynomials of the segments, for evaluating many points or tangents at once
+		const SplineCoefficients& getCoefficients() const { return coefficients; };
+		// Segments between the 2nd and the 2nd to last control point, the outer ones only shape the ends
+		int getSegmentCount() const { return std::max(static_cast<int>(controlPoints.size()) - 3, 0); };
 
 		void addControlPoint(glm::vec3 pos, glm::vec3 color, std::shared_ptr<VmcModel> model, glm::vec3 offset);
 		void moveCurrentControlPoint(MoveDirection direction, float deltaTime);
@@ -28,14 +36,34 @@ namespace vae {
 		
 		void updateControlPointsAndCurvePointsPositions(glm::vec3 offset);
 		void updateControlPointsRelativePositions();
+		// Also rebuilds the arc length table, call after control points were added, removed or all of them moved
 		void generateSplineSegments();
+		// Recomputes only the (up to 4) segments the control point shapes, call after moving that one control point
+		void updateSegmentsAround(int controlPoint);
+
+		// Point at the fraction [0, 1] of the length of the curve, so evenly spaced fractions are evenly spaced on it
+		glm::vec3 calculatePointAtArcLength(float lengthFraction);
+		// Curve parameter t (segment index + u) at the fraction of the length
+		float parameterAtArcLength(float lengthFraction);
+		glm::vec3 calculatePointAtParameter(float t);
+		// Rotation minimizing frame at t, local z along the curve and local y starting out as close to +y (down) as it can
+		glm::quat frameAtParameter(float t);
+		// Call after the curve changed, before batches go through the arc length table
+		void prepareBatches();
+
+		static constexpr int CURVE_POINTS_PER_SEGMENT = 100;
 
 	private:
-		glm::vec3 calculateSplinePoint(float normalizedDist);
+		// Coefficients and curve points of the segments from first to last (inclusive)
+		void updateSegments(int first, int last);
+		ArcLengthTable::Point point() const;
+		ArcLengthTable::Derivative derivative() const;
 
 		// Control points defining the spline
 		std::vector<VmcGameObject> controlPoints;
-		std::vector<TransformComponent> curvePoints;
+		SplineCoefficients coefficients;
+		std::vector<TransformComponent> curvePoints;	// CURVE_POINTS_PER_SEGMENT per segment, from u = 0 on
+		ArcLengthTable arcLengthTable;
 		int selectedControlPoint = 0;
 		float pointMovementSpeed = 5.0f;
 	};
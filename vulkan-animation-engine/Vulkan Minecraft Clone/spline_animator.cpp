@@ -1,6 +1,7 @@
 #include "spline_animator.hpp"
 
 // std
+#include <algorithm>
 #include <iostream>
 
 namespace vae {
@@ -18,38 +19,44 @@ namespace vae {
 
 	glm::vec3 SplineAnimator::calculateNextPositionSpeedControlled()
 	{
-		float dist_time;
-		switch (speedControl)
-		{
-		case SINE:
-			// Sine speed control function
-			dist_time = distanceTimeFuncSine();
-			break;
-		case LINEAR:
-			// Linear speed control function
-			dist_time = distanceTimeFuncLinear();
-			break;
-		case PARABOLIC:
-			dist_time = distanceTimeFuncParabolic();
-			break;
-		default:
-			break;
-		}
-
-		int index = findUpperIndexOfArcLength(dist_time);
+		// The distance comes from a table lookup, whatever the speed curve is made of
+		float dist_time = getSpeedCurve().distanceAt(timeFraction());
 
-		return splineCurve.getCurvePoints()[index].translation;
+		// The arc length table maps the distance to the curve exactly, curve points are only sampled evenly in t
+		pathParameter = splineCurve.parameterAtArcLength(dist_time);
+		return splineCurve.calculatePointAtParameter(pathParameter);
 	}
 
 	glm::vec3 SplineAnimator::calculateIntermediateRotation()
 	{
+		if (orientAlongPath && splineCurve.getSegmentCount() > 0)
+		{
+			glm::quat frame = splineCurve.frameAtParameter(pathParameter);
+			return TransformComponent::rotationFromQuaternion(frame * TransformComponent::quaternionFromRotation(startOrientation));
+		}
+
 		glm::vec3 diff = endOrientation - startOrientation;
 
-		float timePassedNormalized = distanceTimeFuncParabolic();
+		// Eases in with the square of the time
+		float timePassedNormalized = timeFraction() * timeFraction();
 		return startOrientation + timePassedNormalized * diff;
 	}
 
 
+	void SplineAnimator::printForwardDifferencingTable()
+	{
+		const ArcLengthTable& table = splineCurve.getArcLengthTable();
+		int samples = table.getSegmentCount() * ArcLengthTable::SAMPLES_PER_SEGMENT;
+		std::cout << "================ FORWARD DIFFERENCE TABLE ==================" << std::endl;
+		for (int i = 0; i <= samples && table.getLength() > 0.0f; i++)
+		{
+			int segment = std::min(i / ArcLengthTable::SAMPLES_PER_SEGMENT, table.getSegmentCount() - 1);
+			float length = table.getSampleLength(segment, i - segment * ArcLengthTable::SAMPLES_PER_SEGMENT);
+			std::cout << "index: " << i << "   Param: " << static_cast<float>(i) / samples << "      Arc_length: " << length / table.getLength() << std::endl;
+		}
+		std::cout << "=============================================================" << std::endl;
+	}
+
 	std::vector<TransformComponent>& SplineAnimator::getCurvePoints()
 	{
 		return splineCurve.getCurvePoints();
@@ -64,14 +71,12 @@ namespace vae {
 	{
 		splineCurve.addControlPoint(position + newControlPoint.pos, newControlPoint.col, newControlPoint.model, offset);
 		splineCurve.generateSplineSegments();
-		buildForwardDifferencingTable();
 	}
 
 	void SplineAnimator::removeControlPoint(int index)
 	{
 		splineCurve.getControlPoints().erase(splineCurve.getControlPoints().begin() + index);
 		splineCurve.generateSplineSegments();
-		buildForwardDifferencingTable();
 	}
 
 
@@ -2,6 +2,7 @@
 #include "spline.hpp"
 #include "vmc_game_object.hpp"
 #include "animator.hpp"
+#include "spline_crowd.hpp"
 
 #include <glm/glm.hpp>
 
@@ -24,6 +25,10 @@ namespace vae {
 		glm::vec3 calculateNextPositionSpeedControlled();
 		glm::vec3 calculateIntermediateRotation();
 		void updateControlAndCurvePoints();
+		// Nothing to build, the spline keeps its arc length table current on every edit
+		void buildForwardDifferencingTable() override {};
+		// Prints the arc length table of the spline
+		void printForwardDifferencingTable() override;
 
 		void addControlPoint(ControlPoint newControlPoint, glm::vec3 offset);
 		void removeControlPoint(int index);
@@ -31,7 +36,14 @@ namespace vae {
 		void selectNextControlPoint();
 
 		bool drawCurve = true;
+		// Turn the animated objects along the curve (their local z) instead of blending the start and end orientation,
+		// the start orientation is applied on top in object space then
+		bool orientAlongPath = false;
+		// Agents following the curve on their own, drawn instanced by the render system
+		SplineCrowd crowd;
 	private:
 		Spline splineCurve;
+		float pathParameter = 0.0f;	// Curve parameter of the last position
+
 	};
 }
@@ -0,0 +1,203 @@
+#include "spline_coefficients.hpp"
+
+// std
+#include <algorithm>
+#include <cassert>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define VAE_SPLINE_SSE
+#include <emmintrin.h>
+#endif
+
+namespace vae {
+
+	namespace {
+		// The same operations as the SSE paths below, in the same order
+		inline float horner(float a, float b, float c, float d, float u)
+		{
+			return a + u * (b + u * (c + u * d));
+		}
+
+		inline float hornerDerivative(float b, float c, float d, float u)
+		{
+			return b + u * (2.0f * c + (3.0f * u) * d);
+		}
+	}
+
+	void SplineCoefficients::resize(int segmentCount)
+	{
+		this->segmentCount = std::max(segmentCount, 0);
+		data.resize(static_cast<size_t>(ROW_COUNT) * this->segmentCount);
+	}
+
+	void SplineCoefficients::set(int segment, const glm::vec3& a, const glm::vec3& b, const glm::vec3& c, const glm::vec3& d)
+	{
+		assert(segment >= 0 && segment < segmentCount);
+		const glm::vec3* vectors[4] = { &a, &b, &c, &d };
+		for (int row = 0; row < ROW_COUNT; row++)
+		{
+			data[static_cast<size_t>(row) * segmentCount + segment] = (*vectors[row / 3])[row % 3];
+		}
+	}
+
+	glm::vec3 SplineCoefficients::point(int segment, float u) const
+	{
+		return {
+			horner(coefficient(AX, segment), coefficient(BX, segment), coefficient(CX, segment), coefficient(DX, segment), u),
+			horner(coefficient(AY, segment), coefficient(BY, segment), coefficient(CY, segment), coefficient(DY, segment), u),
+			horner(coefficient(AZ, segment), coefficient(BZ, segment), coefficient(CZ, segment), coefficient(DZ, segment), u) };
+	}
+
+	glm::vec3 SplineCoefficients::tangent(int segment, float u) const
+	{
+		return {
+			hornerDerivative(coefficient(BX, segment), coefficient(CX, segment), coefficient(DX, segment), u),
+			hornerDerivative(coefficient(BY, segment), coefficient(CY, segment), coefficient(DY, segment), u),
+			hornerDerivative(coefficient(BZ, segment), coefficient(CZ, segment), coefficient(DZ, segment), u) };
+	}
+
+	float SplineCoefficients::locate(float t, int& segment) const
+	{
+		t = std::min(std::max(t, 0.0f), static_cast<float>(segmentCount));
+		float start = std::min(static_cast<float>(static_cast<int>(t)), static_cast<float>(segmentCount - 1));
+		segment = static_cast<int>(start);
+		return t - start;
+	}
+
+#ifdef VAE_SPLINE_SSE
+	namespace {
+		// Segments and u of 4 curve parameters, with the same clamping as locate()
+		struct Lanes {
+			alignas(16) int segments[4];
+			__m128 u;
+			bool sameSegment;
+
+			Lanes(const float* t, int segmentCount)
+			{
+				__m128 clamped = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(t), _mm_setzero_ps()), _mm_set1_ps(static_cast<float>(segmentCount)));
+				__m128 start = _mm_min_ps(_mm_cvtepi32_ps(_mm_cvttps_epi32(clamped)), _mm_set1_ps(static_cast<float>(segmentCount - 1)));
+				u = _mm_sub_ps(clamped, start);
+				_mm_store_si128(reinterpret_cast<__m128i*>(segments), _mm_cvttps_epi32(start));
+				sameSegment = segments[0] == segments[1] && segments[0] == segments[2] && segments[0] == segments[3];
+			}
+
+			__m128 load(const float* row) const
+			{
+				if (sameSegment) return _mm_set1_ps(row[segments[0]]);
+				return _mm_setr_ps(row[segments[0]], row[segments[1]], row[segments[2]], row[segments[3]]);
+			}
+		};
+	}
+#endif
+
+	void SplineCoefficients::evaluatePoints(const float* t, float* x, float* y, float* z, size_t count) const
+	{
+		assert(segmentCount > 0 || count == 0);
+		float* out[3] = { x, y, z };
+		size_t i = 0;
+#ifdef VAE_SPLINE_SSE
+		for (; i + 4 <= count; i += 4)
+		{
+			Lanes lanes{ t + i, segmentCount };
+			for (int axis = 0; axis < 3; axis++)
+			{
+				__m128 a = lanes.load(getRow(static_cast<Row>(AX + axis)));
+				__m128 b = lanes.load(getRow(static_cast<Row>(BX + axis)));
+				__m128 c = lanes.load(getRow(static_cast<Row>(CX + axis)));
+				__m128 d = lanes.load(getRow(static_cast<Row>(DX + axis)));
+				__m128 result = _mm_add_ps(c, _mm_mul_ps(lanes.u, d));
+				result = _mm_add_ps(b, _mm_mul_ps(lanes.u, result));
+				result = _mm_add_ps(a, _mm_mul_ps(lanes.u, result));
+				_mm_storeu_ps(out[axis] + i, result);
+			}
+		}
+#endif
+		for (; i < count; i++)
+		{
+			int segment;
+			float u = locate(t[i], segment);
+			glm::vec3 p = point(segment, u);
+			x[i] = p.x;
+			y[i] = p.y;
+			z[i] = p.z;
+		}
+	}
+
+	void SplineCoefficients::evaluateTangents(const float* t, float* x, float* y, float* z, size_t count) const
+	{
+		assert(segmentCount > 0 || count == 0);
+		float* out[3] = { x, y, z };
+		size_t i = 0;
+#ifdef VAE_SPLINE_SSE
+		const __m128 two = _mm_set1_ps(2.0f);
+		const __m128 three = _mm_set1_ps(3.0f);
+		for (; i + 4 <= count; i += 4)
+		{
+			Lanes lanes{ t + i, segmentCount };
+			__m128 threeU = _mm_mul_ps(three, lanes.u);
+			for (int axis = 0; axis < 3; axis++)
+			{
+				__m128 b = lanes.load(getRow(static_cast<Row>(BX + axis)));
+				__m128 c = lanes.load(getRow(static_cast<Row>(CX + axis)));
+				__m128 d = lanes.load(getRow(static_cast<Row>(DX + axis)));
+				__m128 result = _mm_add_ps(_mm_mul_ps(two, c), _mm_mul_ps(threeU, d));
+				result = _mm_add_ps(b, _mm_mul_ps(lanes.u, result));
+				_mm_storeu_ps(out[axis] + i, result);
+			}
+		}
+#endif
+		for (; i < count; i++)
+		{
+			int segment;
+			float u = locate(t[i], segment);
+			glm::vec3 tangent = this->tangent(segment, u);
+			x[i] = tangent.x;
+			y[i] = tangent.y;
+			z[i] = tangent.z;
+		}
+	}
+
+	void SplineCoefficients::evaluatePointsAndTangents(const float* t, float* px, float* py, float* pz, float* tx, float* ty, float* tz, size_t count) const
+	{
+		assert(segmentCount > 0 || count == 0);
+		float* points[3] = { px, py, pz };
+		float* tangents[3] = { tx, ty, tz };
+		size_t i = 0;
+#ifdef VAE_SPLINE_SSE
+		const __m128 two = _mm_set1_ps(2.0f);
+		const __m128 three = _mm_set1_ps(3.0f);
+		for (; i + 4 <= count; i += 4)
+		{
+			Lanes lanes{ t + i, segmentCount };
+			__m128 threeU = _mm_mul_ps(three, lanes.u);
+			for (int axis = 0; axis < 3; axis++)
+			{
+				__m128 a = lanes.load(getRow(static_cast<Row>(AX + axis)));
+				__m128 b = lanes.load(getRow(static_cast<Row>(BX + axis)));
+				__m128 c = lanes.load(getRow(static_cast<Row>(CX + axis)));
+				__m128 d = lanes.load(getRow(static_cast<Row>(DX + axis)));
+				__m128 point = _mm_add_ps(c, _mm_mul_ps(lanes.u, d));
+				point = _mm_add_ps(b, _mm_mul_ps(lanes.u, point));
+				point = _mm_add_ps(a, _mm_mul_ps(lanes.u, point));
+				_mm_storeu_ps(points[axis] + i, point);
+				__m128 tangent = _mm_add_ps(_mm_mul_ps(two, c), _mm_mul_ps(threeU, d));
+				tangent = _mm_add_ps(b, _mm_mul_ps(lanes.u, tangent));
+				_mm_storeu_ps(tangents[axis] + i, tangent);
+			}
+		}
+#endif
+		for (; i < count; i++)
+		{
+			int segment;
+			float u = locate(t[i], segment);
+			glm::vec3 p = point(segment, u);
+			glm::vec3 tangent = this->tangent(segment, u);
+			px[i] = p.x;
+			py[i] = p.y;
+			pz[i] = p.z;
+			tx[i] = tangent.x;
+			ty[i] = tangent.y;
+			tz[i] = tangent.z;
+		}
+	}
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+// glm
+#include <glm/glm.hpp>
+
+// std
+#include <cstddef>
+#include <vector>
+
+namespace vae {
+	/*
+		Cubic polynomials of the segments of a curve, P(u) = a + b u + c u^2 + d u^3 for u in [0, 1] and the curve
+		parameter t = segment + u. They are stored as structure of arrays in one contiguous buffer, a row per coefficient
+		component (a.x of every segment, then a.y and so on), so evaluating the curve never touches the control points.
+		The batch functions evaluate 4 t values at once with Horner's rule in SSE, which every x64 CPU supports. Every
+		lane loads the coefficients of its own segment, with a single broadcast when all 4 fall into the same segment as
+		they do for sorted t. The scalar path executes the same float operations in the same order, so batches return
+		exactly what point() and tangent() return.
+	*/
+	class SplineCoefficients
+	{
+	public:
+		enum Row { AX, AY, AZ, BX, BY, BZ, CX, CY, CZ, DX, DY, DZ, ROW_COUNT };
+
+		// Coefficients are undefined until set() after resizing
+		void resize(int segmentCount);
+		void set(int segment, const glm::vec3& a, const glm::vec3& b, const glm::vec3& c, const glm::vec3& d);
+
+		int getSegmentCount() const { return segmentCount; };
+		const float* getRow(Row row) const { return data.data() + static_cast<size_t>(row) * segmentCount; };
+
+		glm::vec3 point(int segment, float u) const;
+		// dP/du
+		glm::vec3 tangent(int segment, float u) const;
+
+		// Points (or tangents) at count curve parameters, t is clamped to [0, segmentCount]
+		void evaluatePoints(const float* t, float* x, float* y, float* z, size_t count) const;
+		void evaluateTangents(const float* t, float* x, float* y, float* z, size_t count) const;
+		// Both at once, every t is located and every coefficient loaded only once
+		void evaluatePointsAndTangents(const float* t, float* px, float* py, float* pz, float* tx, float* ty, float* tz, size_t count) const;
+
+	private:
+		float coefficient(Row row, int segment) const { return data[static_cast<size_t>(row) * segmentCount + segment]; };
+		// Segment of t and u in it
+		float locate(float t, int& segment) const;
+
+		int segmentCount = 0;
+		std::vector<float> data;	// ROW_COUNT rows of segmentCount floats
+	};
+}
@@ -0,0 +1,231 @@
+#include "spline_crowd.hpp"
+#include "speed_curve.hpp"
+#include "vmc_random.hpp"
+
+// std
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define VAE_CROWD_SSE
+#include <emmintrin.h>
+#endif
+
+namespace vae {
+
+	namespace {
+		// Normalizes the forward vectors, makes the normals orthonormal to them and moves the positions by the lateral
+		// offsets along local x (normal x forward) and y. The same operations as the SSE path below, in the same order.
+		inline void orthonormalize(float& px, float& py, float& pz, float& fx, float& fy, float& fz, float& nx, float& ny, float& nz, float lateralX, float lateralY)
+		{
+			float speed = std::sqrt(fx * fx + fy * fy + fz * fz);
+			if (speed > 0.0f)
+			{
+				float inverse = 1.0f / speed;
+				fx *= inverse;
+				fy *= inverse;
+				fz *= inverse;
+			}
+			else
+			{
+				fx = 0.0f;
+				fy = 0.0f;
+				fz = 1.0f;
+			}
+
+			float along = nx * fx + ny * fy + nz * fz;
+			nx -= along * fx;
+			ny -= along * fy;
+			nz -= along * fz;
+			float normalLength = std::sqrt(nx * nx + ny * ny + nz * nz);
+			if (normalLength > 0.0f)
+			{
+				float inverse = 1.0f / normalLength;
+				nx *= inverse;
+				ny *= inverse;
+				nz *= inverse;
+			}
+			else
+			{
+				nx = 0.0f;
+				ny = 1.0f;
+				nz = 0.0f;
+			}
+
+			px += lateralX * (ny * fz - nz * fy) + lateralY * nx;
+			py += lateralX * (nz * fx - nx * fz) + lateralY * ny;
+			pz += lateralX * (nx * fy - ny * fx) + lateralY * nz;
+		}
+
+#ifdef VAE_CROWD_SSE
+		// Lanes with a length of 0 are replaced by the fallback
+		inline void normalize(__m128& x, __m128& y, __m128& z, __m128 fallbackX, __m128 fallbackY, __m128 fallbackZ)
+		{
+			__m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z)));
+			__m128 valid = _mm_cmpgt_ps(length, _mm_setzero_ps());
+			// One division instead of three, the invalid lanes are masked out
+			__m128 inverse = _mm_div_ps(_mm_set1_ps(1.0f), length);
+			x = _mm_or_ps(_mm_and_ps(valid, _mm_mul_ps(x, inverse)), _mm_andnot_ps(valid, fallbackX));
+			y = _mm_or_ps(_mm_and_ps(valid, _mm_mul_ps(y, inverse)), _mm_andnot_ps(valid, fallbackY));
+			z = _mm_or_ps(_mm_and_ps(valid, _mm_mul_ps(z, inverse)), _mm_andnot_ps(valid, fallbackZ));
+		}
+#endif
+
+		// Transforms of one block of agents, in the same streams as the output
+		using Block = float[SplineCrowd::STREAM_COUNT][SplineCrowd::AGENTS_PER_BLOCK];
+
+		// Orthonormal frames of count agents (the normals were interpolated) and the lateral offsets in them. The block
+		// is only read and the streams only written, once each, which suits mapped memory that isn't cached.
+		void orthonormalizeAgents(const Block& block, const float* offsetX, const float* offsetY, const SplineCrowd::Streams& out, size_t first, size_t count)
+		{
+			using Stream = SplineCrowd::Stream;
+			size_t i = 0;
+#ifdef VAE_CROWD_SSE
+			const __m128 zero = _mm_setzero_ps();
+			const __m128 one = _mm_set1_ps(1.0f);
+			for (; i + 4 <= count; i += 4)
+			{
+				__m128 forwardX = _mm_load_ps(block[Stream::FORWARD_X] + i);
+				__m128 forwardY = _mm_load_ps(block[Stream::FORWARD_Y] + i);
+				__m128 forwardZ = _mm_load_ps(block[Stream::FORWARD_Z] + i);
+				normalize(forwardX, forwardY, forwardZ, zero, zero, one);
+
+				__m128 normalX = _mm_load_ps(block[Stream::NORMAL_X] + i);
+				__m128 normalY = _mm_load_ps(block[Stream::NORMAL_Y] + i);
+				__m128 normalZ = _mm_load_ps(block[Stream::NORMAL_Z] + i);
+				__m128 along = _mm_add_ps(_mm_add_ps(_mm_mul_ps(normalX, forwardX), _mm_mul_ps(normalY, forwardY)), _mm_mul_ps(normalZ, forwardZ));
+				normalX = _mm_sub_ps(normalX, _mm_mul_ps(along, forwardX));
+				normalY = _mm_sub_ps(normalY, _mm_mul_ps(along, forwardY));
+				normalZ = _mm_sub_ps(normalZ, _mm_mul_ps(along, forwardZ));
+				normalize(normalX, normalY, normalZ, zero, one, zero);
+
+				__m128 sideways = _mm_loadu_ps(offsetX + i);
+				__m128 up = _mm_loadu_ps(offsetY + i);
+				__m128 rightX = _mm_sub_ps(_mm_mul_ps(normalY, forwardZ), _mm_mul_ps(normalZ, forwardY));
+				__m128 rightY = _mm_sub_ps(_mm_mul_ps(normalZ, forwardX), _mm_mul_ps(normalX, forwardZ));
+				__m128 rightZ = _mm_sub_ps(_mm_mul_ps(normalX, forwardY), _mm_mul_ps(normalY, forwardX));
+				_mm_storeu_ps(out[Stream::POSITION_X] + first + i, _mm_add_ps(_mm_load_ps(block[Stream::POSITION_X] + i), _mm_add_ps(_mm_mul_ps(sideways, rightX), _mm_mul_ps(up, normalX))));
+				_mm_storeu_ps(out[Stream::POSITION_Y] + first + i, _mm_add_ps(_mm_load_ps(block[Stream::POSITION_Y] + i), _mm_add_ps(_mm_mul_ps(sideways, rightY), _mm_mul_ps(up, normalY))));
+				_mm_storeu_ps(out[Stream::POSITION_Z] + first + i, _mm_add_ps(_mm_load_ps(block[Stream::POSITION_Z] + i), _mm_add_ps(_mm_mul_ps(sideways, rightZ), _mm_mul_ps(up, normalZ))));
+				_mm_storeu_ps(out[Stream::FORWARD_X] + first + i, forwardX);
+				_mm_storeu_ps(out[Stream::FORWARD_Y] + first + i, forwardY);
+				_mm_storeu_ps(out[Stream::FORWARD_Z] + first + i, forwardZ);
+				_mm_storeu_ps(out[Stream::NORMAL_X] + first + i, normalX);
+				_mm_storeu_ps(out[Stream::NORMAL_Y] + first + i, normalY);
+				_mm_storeu_ps(out[Stream::NORMAL_Z] + first + i, normalZ);
+			}
+#endif
+			for (; i < count; i++)
+			{
+				float transform[SplineCrowd::STREAM_COUNT];
+				for (int stream = 0; stream < SplineCrowd::STREAM_COUNT; stream++) transform[stream] = block[stream][i];
+				orthonormalize(transform[Stream::POSITION_X], transform[Stream::POSITION_Y], transform[Stream::POSITION_Z],
+					transform[Stream::FORWARD_X], transform[Stream::FORWARD_Y], transform[Stream::FORWARD_Z],
+					transform[Stream::NORMAL_X], transform[Stream::NORMAL_Y], transform[Stream::NORMAL_Z], offsetX[i], offsetY[i]);
+				for (int stream = 0; stream < SplineCrowd::STREAM_COUNT; stream++) out[stream][first + i] = transform[stream];
+			}
+		}
+	}
+
+	void SplineCrowd::addAgent(float timeOffset, int speedControl, glm::vec2 lateralOffset)
+	{
+		assert(speedControl >= SINE && speedControl <= PARABOLIC && "Agents use the preset speed curves");
+		timeOffsets.push_back(timeOffset);
+		speedControls.push_back(static_cast<uint8_t>(speedControl));
+		lateralX.push_back(lateralOffset.x);
+		lateralY.push_back(lateralOffset.y);
+	}
+
+	void SplineCrowd::spawnAgents(size_t count, float duration, float lateralSpread, uint32_t seed)
+	{
+		VmcRandom random{ seed };
+		for (size_t i = 0; i < count; i++)
+		{
+			float timeOffset = random.nextFloat() * duration;
+			int speedControl = std::min(static_cast<int>(random.nextFloat() * 3.0f), 2);
+			glm::vec2 lateralOffset{ (2.0f * random.nextFloat() - 1.0f) * lateralSpread, (2.0f * random.nextFloat() - 1.0f) * lateralSpread };
+			addAgent(timeOffset, speedControl, lateralOffset);
+		}
+	}
+
+	void SplineCrowd::clear()
+	{
+		timeOffsets.clear();
+		speedControls.clear();
+		lateralX.clear();
+		lateralY.clear();
+	}
+
+	void SplineCrowd::evaluate(Spline& spline, float time, float duration, const Streams& out, VmcThreadPool* workers) const
+	{
+		if (getAgentCount() == 0) return;
+		spline.prepareBatches();
+
+		if (!workers || workers->getThreadCount() < 2 || getAgentCount() <= AGENTS_PER_JOB)
+		{
+			evaluateAgents(spline, time, duration, out, 0, getAgentCount());
+			return;
+		}
+		for (size_t first = 0; first < getAgentCount(); first += AGENTS_PER_JOB)
+		{
+			size_t last = std::min(first + AGENTS_PER_JOB, getAgentCount());
+			workers->addJob([&, first, last]() { evaluateAgents(spline, time, duration, out, first, last); });
+		}
+		workers->wait();
+	}
+
+	void SplineCrowd::evaluateAgents(const Spline& spline, float time, float duration, const Streams& out, size_t first, size_t last) const
+	{
+		const ArcLengthTable& table = spline.getArcLengthTable();
+		const SplineCoefficients& coefficients = spline.getCoefficients();
+
+		const SpeedCurve* speedCurves[] = { &SpeedCurve::preset(SINE), &SpeedCurve::preset(LINEAR), &SpeedCurve::preset(PARABOLIC) };
+		const float* speedTables[] = { speedCurves[SINE]->getTable(), speedCurves[LINEAR]->getTable(), speedCurves[PARABOLIC]->getTable() };
+		const float lapsPerSecond = 1.0f / duration;
+		// Reused by every block, small enough for the stack
+		alignas(16) float parameters[AGENTS_PER_BLOCK];
+		alignas(16) Block transforms;
+		for (size_t block = first; block < last; block += AGENTS_PER_BLOCK)
+		{
+			const size_t count = std::min(AGENTS_PER_BLOCK, last - block);
+
+			// Arc length every agent has covered, then the curve parameter there. Agents are at laps - floor(laps) of
+			// their speed curve, the SSE path interpolates the tables the same way distanceAt() does.
+			size_t i = 0;
+#ifdef VAE_CROWD_SSE
+			for (; i + 4 <= count; i += 4)
+			{
+				__m128 laps = _mm_mul_ps(_mm_add_ps(_mm_set1_ps(time), _mm_loadu_ps(timeOffsets.data() + block + i)), _mm_set1_ps(lapsPerSecond));
+				__m128 lap = _mm_cvtepi32_ps(_mm_cvttps_epi32(laps));
+				lap = _mm_sub_ps(lap, _mm_and_ps(_mm_cmpgt_ps(lap, laps), _mm_set1_ps(1.0f)));
+				__m128 sample = _mm_mul_ps(_mm_sub_ps(laps, lap), _mm_set1_ps(static_cast<float>(SpeedCurve::TABLE_SIZE)));
+				__m128i before = _mm_cvttps_epi32(_mm_min_ps(sample, _mm_set1_ps(SpeedCurve::TABLE_SIZE - 1.0f)));
+				__m128 fraction = _mm_sub_ps(sample, _mm_cvtepi32_ps(before));
+				alignas(16) int entries[4];
+				_mm_store_si128(reinterpret_cast<__m128i*>(entries), before);
+				const float* lanes[4];
+				for (int lane = 0; lane < 4; lane++) lanes[lane] = speedTables[speedControls[block + i + lane]] + entries[lane];
+				__m128 a = _mm_setr_ps(lanes[0][0], lanes[1][0], lanes[2][0], lanes[3][0]);
+				__m128 b = _mm_setr_ps(lanes[0][1], lanes[1][1], lanes[2][1], lanes[3][1]);
+				__m128 distance = _mm_add_ps(a, _mm_mul_ps(fraction, _mm_sub_ps(b, a)));
+				_mm_store_ps(parameters + i, _mm_mul_ps(distance, _mm_set1_ps(table.getLength())));
+			}
+#endif
+			for (; i < count; i++)
+			{
+				// Truncation instead of std::floor, which is a library call without SSE4.1
+				float laps = (time + timeOffsets[block + i]) * lapsPerSecond;
+				float lap = static_cast<float>(static_cast<int>(laps));
+				if (lap > laps) lap -= 1.0f;
+				parameters[i] = speedCurves[speedControls[block + i]]->distanceAt(laps - lap) * table.getLength();
+			}
+			table.parametersAtLengths(parameters, parameters, count);
+
+			coefficients.evaluatePointsAndTangents(parameters, transforms[POSITION_X], transforms[POSITION_Y], transforms[POSITION_Z],
+				transforms[FORWARD_X], transforms[FORWARD_Y], transforms[FORWARD_Z], count);
+			table.normalsAtParameters(parameters, transforms[NORMAL_X], transforms[NORMAL_Y], transforms[NORMAL_Z], count);
+			orthonormalizeAgents(transforms, lateralX.data() + block, lateralY.data() + block, out, block, count);
+		}
+	}
+}
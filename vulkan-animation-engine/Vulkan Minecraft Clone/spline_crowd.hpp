@@ -0,0 +1,66 @@
+#pragma once
+#include "spline.hpp"
+#include "vmc_model.hpp"
+#include "vmc_thread_pool.hpp"
+
+// glm
+#include <glm/glm.hpp>
+
+// std
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace vae {
+	/*
+		Many agents following one spline, each with its own time offset, preset speed curve (SINE, LINEAR or PARABOLIC)
+		and lateral offset in the rotation minimizing frame of the curve. Agents are stored as structure of arrays
+		and evaluated in batches without touching game objects: distance along the curve from the speed curve table, t from the
+		inverse arc length table, points and tangents with the SSE batches of SplineCoefficients and normals from the frames,
+		one small block of agents after the other.
+		The transforms are written as one stream per component, which is the layout of the instance buffer of the crowd
+		pipeline, so they can go straight into mapped memory.
+	*/
+	class SplineCrowd
+	{
+	public:
+		enum Stream {
+			POSITION_X, POSITION_Y, POSITION_Z,
+			FORWARD_X, FORWARD_Y, FORWARD_Z,	// Local z, along the curve
+			NORMAL_X, NORMAL_Y, NORMAL_Z,		// Local y, local x is normal x forward
+			STREAM_COUNT
+		};
+		// One float per agent in each stream
+		using Streams = std::array<float*, STREAM_COUNT>;
+
+		static constexpr size_t AGENTS_PER_JOB = 8192;
+		// Agents that go through all steps of the evaluation together, their data stays in the L1 cache in between
+		static constexpr size_t AGENTS_PER_BLOCK = 256;
+
+		// lateralOffset is along local x and y of the frame
+		void addAgent(float timeOffset, int speedControl, glm::vec2 lateralOffset);
+		// Random time offsets in [0, duration), speed control functions and lateral offsets in [-lateralSpread, lateralSpread]
+		void spawnAgents(size_t count, float duration, float lateralSpread, uint32_t seed);
+		void clear();
+		size_t getAgentCount() const { return timeOffsets.size(); };
+
+		// Transforms of all agents time seconds into the animation, one lap over the spline takes duration seconds.
+		// Blocks of AGENTS_PER_JOB agents run on the workers when there are any.
+		void evaluate(Spline& spline, float time, float duration, const Streams& out, VmcThreadPool* workers = nullptr) const;
+
+		// How the agents are drawn
+		std::shared_ptr<VmcModel> model;
+		glm::vec3 color{ 1.0f, 1.0f, 1.0f };
+		float scale = 0.2f;
+
+	private:
+		void evaluateAgents(const Spline& spline, float time, float duration, const Streams& out, size_t first, size_t last) const;
+
+		std::vector<float> timeOffsets;
+		std::vector<uint8_t> speedControls;
+		std::vector<float> lateralX;
+		std::vector<float> lateralY;
+	};
+}
@@ -20,12 +20,13 @@ namespace vae {
 		void updateStoryBoardDuration();
 
 		bool containsAnimatable(Animatable* animatable);
+		float getDuration() const { return storyBoardDuration; };
 
 		std::vector<Animatable*> animatables;
 	private:
-		bool animationRunning;
-		float timePassed;
-		float storyBoardDuration;
+		bool animationRunning = false;
+		float timePassed = 0.0f;
+		float storyBoardDuration = 0.0f;
 	};
 
 }
@@ -3,12 +3,15 @@
 #include "vmc_buffer.hpp"
 
 // std
+#include <algorithm>
 #include <cassert>
 #include <stdexcept>
 #include <array>
 #include <iostream>
 #include <chrono>
 #include <filesystem>
+#include <cmath>
+#include <cstdio>
 
 // libs
 #define GLM_FORCE_RADIANS
@@ -30,7 +33,24 @@ namespace vae {
 		alignas(16) glm::mat4 view{ 1.0f };
 	};
 
-	VmcApp::VmcApp()
+	VmcApp::VmcApp() :
+		vmcWindow{ std::make_unique<VmcWindow>(WIDTH, HEIGHT, "Vulkan Animation Engine - Jente Vandersanden") },
+		vmcDevice{ *vmcWindow },
+		vmcRenderer{ *vmcWindow, vmcDevice }
+	{
+		init();
+	}
+
+	VmcApp::VmcApp(const HeadlessSettings& settings) :
+		headlessSettings{ settings },
+		vmcDevice{},
+		vmcRenderer{ vmcDevice, { settings.width, settings.height } }
+	{
+		cameraMode = settings.cameraMode;
+		init();
+	}
+
+	void VmcApp::init()
 	{
 		loadTextures();
 
@@ -41,7 +61,10 @@ namespace vae {
 			.build();
 		initDescriptorsAndUBOs();
 
-		initImgui();
+		if (vmcWindow)
+		{
+			initImgui();
+		}
 		loadGameObjects();
 		initCollidables();
 		viewerObject = std::make_unique<VmcGameObject>(VmcGameObject::createGameObject());
@@ -53,12 +76,29 @@ namespace vae {
 
 	void VmcApp::run()
 	{
-
+		auto pipelineStart = std::chrono::high_resolution_clock::now();
 		simpleRenderSystem = std::make_unique<SimpleRenderSystem>(
 			vmcDevice, 
 			vmcRenderer.getSwapChainRenderPass(),
 			vmcRenderer.getSwapChainRenderPass(),
 			globalSetLayout->getDescriptorSetLayout());
+
+		// Everything loaded so far goes to the GPU as one batch. Models show up once their data arrived, but the textures
+		// are referenced by the descriptor sets and have to be there before the first frame.
+		VmcUploadQueue& uploadQueue = vmcDevice.getUploadQueue();
+		uploadQueue.flush();
+		uploadQueue.wait(std::max(testTexture->getUploadTicket(), skyboxTexture->getUploadTicket()));
+
+		auto startupEnd = std::chrono::high_resolution_clock::now();
+		std::cout << "Startup took " << std::chrono::duration<float, std::chrono::milliseconds::period>(startupEnd - startupBegin).count() << " ms"
+			<< " (pipelines " << std::chrono::duration<float, std::chrono::milliseconds::period>(startupEnd - pipelineStart).count() << " ms, "
+			<< (vmcDevice.isPipelineCacheWarm() ? "warm" : "cold") << " pipeline cache)" << std::endl;
+
+		if (!vmcWindow)
+		{
+			runHeadless();
+			return;
+		}
 	
         auto currentTime = std::chrono::high_resolution_clock::now();
 
@@ -67,7 +107,7 @@ namespace vae {
 		bool show_another_window = false;
 		ImVec4 clear_color = ImVec4(0.45f, 0.55f, 0.60f, 1.00f);
 
-		while (!vmcWindow.shouldClose())
+		while (!vmcWindow->shouldClose())
 		{
 			glfwPollEvents();
 
@@ -92,54 +132,30 @@ namespace vae {
 			if (gameObjects.size() > deformationIndex)
 			{
 				if (gameObjects[deformationIndex].deformationEnabled)
-					ffdController.updateDeformationGrid(vmcWindow.getGLFWwindow(), frameTime, gameObjects[deformationIndex]);
+					ffdController.updateDeformationGrid(vmcWindow->getGLFWwindow(), frameTime, gameObjects[deformationIndex]);
 			}
 
-			// Update rigid bodies
-			for (auto& rigid : rigidBodies)
+			updateScene(frameTime);
+
+			if (frameCapture)
 			{
-				rigid.updateState(frameTime);
+				auto extent = vmcRenderer.getExtent();
+				if (extent.width != frameCapture->getExtent().width || extent.height != frameCapture->getExtent().height)
+					stopFrameCapture();
+				else
+					frameCapture->collectFinishedFrames();
 			}
-			updateCamera(frameTime);
-			checkRigidBodyCollisions();
-			updateParticleSystems();
-			storyboard.updateAnimatables(frameTime);
+
+			// Submit the uploads queued since the last frame, e.g. by loading a model from the UI
+			uploadQueue.flush();
 
 			// Render loop
 			if (auto commandBuffer = vmcRenderer.beginFrame()) {
-				int frameIndex = vmcRenderer.getFrameIndex();
-				
-				// Update phase
-				GlobalUbo ubo{};
-				ubo.projection = camera.getProjection();
-				ubo.view = camera.getView();
-				uboBuffers[frameIndex]->writeToBuffer(&ubo);
-				uboBuffers[frameIndex]->flush();
-
-				ubo.projection = camera.getProjection();;
-				ubo.view = camera.getView();
-				ubo.view[3] = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
-				skyboxUbos[frameIndex]->writeToBuffer(&ubo);
-				skyboxUbos[frameIndex]->flush();
-
-				// Render phase
-				vmcRenderer.beginSwapChainRenderPass(commandBuffer);
-				simpleRenderSystem->renderGameObjects(
-					commandBuffer, 
-					globalDescriptorSets[frameIndex], 
-					skyboxDescriptorSets[frameIndex],
-					skyboxObjects,
-					gameObjects, 
-					animators, 
-					Lsystems, 
-					skeletons, 
-					rigidBodies, 
-					collidables,
-					camera, 
-					frameTime,
-					sphereModel,
-					viewerObject.get());
-				vmcRenderer.endSwapChainRenderPass(commandBuffer);
+				renderScene(commandBuffer, frameTime);
+
+				// Capture the scene without the UI, the image is still a color attachment here
+				if (frameCapture)
+					frameCapture->recordCopy(commandBuffer, vmcRenderer.getCurrentImage(), VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
 
 				// Draw ImGui stuff
 				vmcRenderer.beginImGuiRenderPass(commandBuffer);
@@ -147,14 +163,182 @@ namespace vae {
 				vmcRenderer.endImGuiRenderPass(commandBuffer);
 
 				vmcRenderer.endFrame();
+				if (frameCapture)
+					frameCapture->submitFence();
 			}
 		}
 		vkDeviceWaitIdle(vmcDevice.device());
+		stopFrameCapture();
 		ImGui_ImplVulkan_Shutdown();
 		ImGui_ImplGlfw_Shutdown();
 		ImGui::DestroyContext();
 	}
 
+	/* Renders the scene (and its storyboard) frame by frame with a fixed time step and writes every frame to disk */
+	void VmcApp::runHeadless()
+	{
+		if (!headlessSettings.sceneFile.empty())
+		{
+			loadSceneFromFile(headlessSettings.sceneFile.c_str());
+		}
+
+		// Play everything that can be animated, as if it was added to the storyboard in the UI
+		for (auto& a : animators)
+			storyboard.addAnimatable(&a);
+		for (auto& obj : gameObjects)
+			if (obj.deformationEnabled)
+				storyboard.addAnimatable(&obj.deformationSystem);
+		for (auto& p : particleSystems)
+			storyboard.addAnimatable(&p);
+		for (auto& s : skeletons)
+			storyboard.addAnimatable(&s);
+		storyboard.startStoryBoardAnimation();
+
+		// Every frame has to show the complete scene
+		vmcDevice.getUploadQueue().waitIdle();
+
+		float frameTime = 1.0f / glm::max(headlessSettings.framesPerSecond, 1.0f);
+		int frameCount = headlessSettings.frameCount;
+		if (frameCount <= 0)
+		{
+			frameCount = glm::max(1, static_cast<int>(std::ceil(storyboard.getDuration() / frameTime)));
+		}
+
+		std::filesystem::create_directories(headlessSettings.outputDirectory);
+		VkExtent2D extent = vmcRenderer.getExtent();
+		std::vector<uint8_t> pixels;
+		float totalRenderTime = 0.0f;
+		uint64_t totalTriangles = 0;
+		uint64_t totalFullDetailTriangles = 0;
+
+		for (int frame = 0; frame < frameCount; frame++)
+		{
+			updateScene(frameTime);
+
+			auto frameStart = std::chrono::high_resolution_clock::now();
+			if (auto commandBuffer = vmcRenderer.beginFrame()) {
+				renderScene(commandBuffer, frameTime);
+				vmcRenderer.endFrame();
+			}
+			vmcRenderer.readLastFrame(pixels);
+			totalRenderTime += std::chrono::duration<float, std::chrono::milliseconds::period>(std::chrono::high_resolution_clock::now() - frameStart).count();
+			totalTriangles += simpleRenderSystem->getTriangleCount();
+			totalFullDetailTriangles += simpleRenderSystem->getFullDetailTriangleCount();
+
+			char frameName[32];
+			snprintf(frameName, sizeof(frameName), "frame_%05d", frame);
+			std::string framePath = headlessSettings.outputDirectory + "/" + frameName + imageFileExtension(headlessSettings.imageFormat);
+			writeImage(framePath, headlessSettings.imageFormat, extent.width, extent.height, pixels);
+		}
+		vkDeviceWaitIdle(vmcDevice.device());
+
+		std::cout << "Rendered " << frameCount << " frames (" << extent.width << "x" << extent.height << ") to " << headlessSettings.outputDirectory
+			<< ", average render + readback time " << totalRenderTime / frameCount << " ms" << std::endl;
+		std::cout << "Average triangles per frame: " << totalTriangles / frameCount << " (" << totalFullDetailTriangles / frameCount
+			<< " without LODs)" << std::endl;
+	}
+
+	void VmcApp::updateScene(float frameTime)
+	{
+		// Update rigid bodies
+		for (auto& rigid : rigidBodies)
+		{
+			rigid.updateState(frameTime);
+		}
+		updateCamera(frameTime);
+		if (chunkManager)
+		{
+			chunkManager->update(viewerObject->transform.translation);
+		}
+		checkRigidBodyCollisions();
+		updateParticleSystems();
+		storyboard.updateAnimatables(frameTime);
+
+		// Update object deformation (uploads vertex data, so this has to happen before recording)
+		for (auto& obj : gameObjects)
+		{
+			if (obj.deformationEnabled)
+			{
+				obj.deformObject();
+			}
+		}
+	}
+
+	void VmcApp::renderScene(VkCommandBuffer commandBuffer, float frameTime)
+	{
+		int frameIndex = vmcRenderer.getFrameIndex();
+
+		// Update phase
+		GlobalUbo ubo{};
+		ubo.projection = camera.getProjection();
+		ubo.view = camera.getView();
+		uboBuffers[frameIndex]->writeToBuffer(&ubo);
+		uboBuffers[frameIndex]->flush();
+
+		ubo.projection = camera.getProjection();;
+		ubo.view = camera.getView();
+		ubo.view[3] = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+		skyboxUbos[frameIndex]->writeToBuffer(&ubo);
+		skyboxUbos[frameIndex]->flush();
+
+		// Render phase
+		auto recordStart = std::chrono::high_resolution_clock::now();
+		vmcRenderer.beginSwapChainRenderPass(commandBuffer, multithreadedRecording ? VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS : VK_SUBPASS_CONTENTS_INLINE);
+		simpleRenderSystem->renderGameObjects(
+			vmcRenderer,
+			commandBuffer, 
+			globalDescriptorSets[frameIndex], 
+			skyboxDescriptorSets[frameIndex],
+			skyboxObjects,
+			gameObjects, 
+			animators, 
+			Lsystems, 
+			skeletons, 
+			rigidBodies, 
+			collidables,
+			chunkManager.get(),
+			camera, 
+			frameTime,
+			sphereModel,
+			viewerObject.get());
+		vmcRenderer.endSwapChainRenderPass(commandBuffer);
+		recordTime = std::chrono::duration<float, std::chrono::milliseconds::period>(std::chrono::high_resolution_clock::now() - recordStart).count();
+	}
+
+	void VmcApp::startFrameCapture()
+	{
+		// Video goes to ../Captures/<name>.y4m, a PNG sequence to the directory ../Captures/<name>/
+		std::string outputPath = std::string("../Captures/") + captureFileName;
+		try
+		{
+			if (captureFormat == CAPTURE_Y4M)
+			{
+				std::filesystem::create_directories("../Captures");
+				outputPath += ".y4m";
+			}
+			else
+			{
+				std::filesystem::create_directories(outputPath);
+			}
+			// The capture plays back at the FPS cap, which is the rate frames are rendered at when the cap is reached
+			frameCapture = std::make_unique<VmcFrameCapture>(vmcDevice, vmcRenderer.getExtent(), vmcRenderer.getImageFormat(),
+				static_cast<VmcCaptureFormat>(captureFormat), outputPath, glm::max(animation_FPS, 2.0f));
+		}
+		catch (const std::exception& e)
+		{
+			std::cout << "Unable to start capture: " << e.what() << std::endl;
+		}
+	}
+
+	void VmcApp::stopFrameCapture()
+	{
+		if (!frameCapture)
+			return;
+
+		std::cout << "Captured " << frameCapture->getCapturedFrameCount() << " frames (" << frameCapture->getDroppedFrameCount() << " dropped)" << std::endl;
+		frameCapture.reset();
+	}
+
 
 	void VmcApp::initImgui()
 	{
@@ -194,12 +378,13 @@ namespace vae {
 		ImGui::StyleColorsDark();
 
 		// Platform/renderer bindings
-		ImGui_ImplGlfw_InitForVulkan(vmcWindow.getGLFWwindow(), true);
+		ImGui_ImplGlfw_InitForVulkan(vmcWindow->getGLFWwindow(), true);
 		ImGui_ImplVulkan_InitInfo init_info = {};
 		init_info.Instance = vmcDevice.getInstance();
 		init_info.PhysicalDevice = vmcDevice.getPhysicalDevice();
 		init_info.Device = vmcDevice.device();
 		init_info.Queue = vmcDevice.graphicsQueue();
+		init_info.PipelineCache = vmcDevice.getPipelineCache();
 		init_info.DescriptorPool = imGuiPool;
 		init_info.MinImageCount = VmcSwapChain::MAX_FRAMES_IN_FLIGHT;
 		init_info.ImageCount = VmcSwapChain::MAX_FRAMES_IN_FLIGHT;
@@ -219,8 +404,11 @@ namespace vae {
 	/* Loads scene from a .vaescene file */
 	void VmcApp::loadSceneFromFile(const char* fileName)
 	{
-		std::shared_ptr<VmcModel> sphereModel = VmcModel::createModelFromFile(vmcDevice, "../Models/sphere.obj");
-		std::shared_ptr<VmcModel> waterDropModel = VmcModel::createModelFromFile(vmcDevice, "../Models/cube.obj");
+		auto loadBegin = std::chrono::high_resolution_clock::now();
+		VmcMemoryStatistics memoryBefore = vmcDevice.getAllocator().getStatistics();
+		VmcModelRegistryStatistics modelsBefore = modelRegistry.getStatistics();
+
+		std::shared_ptr<VmcModel> waterDropModel = modelRegistry.getModel("../Models/cube.obj", vertexFormat());
 		std::string objPath = std::string("../Scenes/") + std::string(fileName);
 
 		// Read from the text file
@@ -249,8 +437,8 @@ namespace vae {
 					glm::vec3 color = { std::stof(tokens[11]), std::stof(tokens[12]), std::stof(tokens[13]) };
 					bool deformationEnabled = std::stoi(tokens[14]);
 
-					// Load in game object
-					std::shared_ptr<VmcModel> model = VmcModel::createModelFromFile(vmcDevice, objFileName);
+					// Load in game object, deformed objects write into their vertex buffer and can't share it
+					std::shared_ptr<VmcModel> model = deformationEnabled ? modelRegistry.createUniqueModel(objFileName) : modelRegistry.getModel(objFileName, vertexFormat());
 					auto newObj = VmcGameObject::createGameObject(id);	// Make sure that the id of the gameobjects is the same as in the saved file, otherwise animatables that refer to this ID might lose their reference
 					newObj.modelPath = std::string(objFileName);
 					newObj.model = model;
@@ -299,6 +487,19 @@ namespace vae {
 					glm::vec3 endOr = { std::stof(tokens[6]), std::stof(tokens[7]), std::stof(tokens[8]) };
 					float startTime = std::stof(tokens[9]);
 					float animationTime = std::stof(tokens[10]);
+					bool orientAlongPath = tokens.size() > 11 && std::stoi(tokens[11]);
+					int speedControl = tokens.size() > 12 ? std::stoi(tokens[12]) : SINE;
+					int amountSpeedKeys = tokens.size() > 13 ? std::stoi(tokens[13]) : 0;
+
+					// Keys of the custom speed curve
+					std::vector<SpeedCurve::Key> speedKeys{};
+					for (int j = 0; j < amountSpeedKeys; j++)
+					{
+						std::getline(readFile, buffer);
+						lineString = &buffer[0];
+						std::vector<char*> tokens = split(lineString, " ");
+						speedKeys.push_back({ std::stof(tokens[0]), std::stof(tokens[1]), std::stof(tokens[2]) });
+					}
 
 					// Amount CPs
 					std::getline(readFile, buffer);
@@ -315,6 +516,9 @@ namespace vae {
 
 					SplineAnimator splineAnimator{ pos, startOr, endOr, controlPoints, animationTime, startTime };
 					splineAnimator.getSpline().generateSplineSegments();
+					splineAnimator.orientAlongPath = orientAlongPath;
+					splineAnimator.speedControl = speedControl;
+					if (amountSpeedKeys > 0) splineAnimator.customSpeedCurve.setKeys(speedKeys);
 					animators.push_back(std::move(splineAnimator));
 
 					// Build forward differencing table based on curve points
@@ -438,6 +642,14 @@ namespace vae {
 			}
 			// Close the file
 			readFile.close();
+
+			modelRegistry.collectGarbage();
+			float loadTime = std::chrono::duration<float, std::chrono::milliseconds::period>(std::chrono::high_resolution_clock::now() - loadBegin).count();
+			VmcMemoryStatistics memoryAfter = vmcDevice.getAllocator().getStatistics();
+			VmcModelRegistryStatistics modelsAfter = modelRegistry.getStatistics();
+			std::cout << "Loaded scene '" << fileName << "' in " << loadTime << " ms: "
+				<< modelsAfter.loads - modelsBefore.loads << " models loaded, " << modelsAfter.hits - modelsBefore.hits << " shared, "
+				<< (static_cast<int64_t>(memoryAfter.usedBytes) - static_cast<int64_t>(memoryBefore.usedBytes)) / 1024 << " KiB of GPU memory added" << std::endl;
 		}
 		else std::cout << "Unable to open file '" << fileName << "'.";
 	}
@@ -481,7 +693,9 @@ namespace vae {
 				
 			}
 
-			// ANIMATOR FILE FORMAT: <posX> <posY> <posZ> <startOrX> <startOrY> <startOrZ> <endOrX> <endOrY> <endOrZ> <startTime> <animationTime> \n
+			// ANIMATOR FILE FORMAT: <posX> <posY> <posZ> <startOrX> <startOrY> <startOrZ> <endOrX> <endOrY> <endOrZ> <startTime> <animationTime> <orientAlongPath> <speedControl> <amountSpeedKeys> \n
+			//						for each speed key:
+			//							<time> <distance> <slope> \n
 			//						<amountCPs> \n
 			//						for each CP:
 			//							<posCPX> <posCPY> <posCPZ> \n
@@ -490,7 +704,14 @@ namespace vae {
 			{
 				saveFile << a.getPosition().x << " " << a.getPosition().y << " " << a.getPosition().z << " " << a.getStartOrientation().x << " "
 					<< a.getStartOrientation().y << " " << a.getStartOrientation().z << " " << a.getEndOrientation().x << " "
-					<< a.getEndOrientation().y << " " << a.getEndOrientation().z << " " << a.getStartTime() << " " << a.getAnimationDuration() << std::endl;
+					<< a.getEndOrientation().y << " " << a.getEndOrientation().z << " " << a.getStartTime() << " " << a.getAnimationDuration() << " " << a.orientAlongPath << " "
+					<< a.speedControl << " " << a.customSpeedCurve.getKeys().size() << std::endl;
+
+				// Keys of the custom speed curve
+				for (auto& key : a.customSpeedCurve.getKeys())
+				{
+					saveFile << key.time << " " << key.distance << " " << key.slope << std::endl;
+				}
 
 				// Amount CPs
 				saveFile << a.getControlPoints().size() << std::endl;
@@ -583,7 +804,7 @@ namespace vae {
 			return;
 		}
 
-		std::shared_ptr<VmcModel> model = VmcModel::createModelFromFile(vmcDevice, objPath.c_str());
+		std::shared_ptr<VmcModel> model = modelRegistry.getModel(objPath, vertexFormat());
 		auto newObj = VmcGameObject::createGameObject();
 		newObj.modelPath = objPath;
 		newObj.model = model;
@@ -597,7 +818,7 @@ namespace vae {
 	void VmcApp::loadSkeleton(const char* fileName)
 	{
 		std::string objPath = std::string("../Misc/") + std::string(fileName);
-		std::shared_ptr<VmcModel> boneModel = VmcModel::createModelFromFile(vmcDevice, "../Models/bone.obj");
+		std::shared_ptr<VmcModel> boneModel = modelRegistry.getModel("../Models/bone.obj", vertexFormat());
 
 		Skeleton2 skeleton{ boneModel, fileName };
 
@@ -644,7 +865,7 @@ namespace vae {
 	void VmcApp::loadGameObjects()
     {
 		// Skybox model
-		std::shared_ptr<VmcModel> skyboxModel = VmcModel::createModelFromFile(vmcDevice, "../Models/skybox.obj");
+		std::shared_ptr<VmcModel> skyboxModel = modelRegistry.getModel("../Models/skybox.obj");
 		auto skybox = VmcGameObject::createGameObject();
 		skybox.modelPath = std::string("../Models/skybox.obj");
 		skybox.model = skyboxModel;
@@ -740,6 +961,89 @@ namespace vae {
 
 		ImGui::InputFloat("FPS cap ", &animation_FPS);
 		ImGui::Checkbox("Skybox ", &simpleRenderSystem->shouldRenderSkybox());
+		ImGui::Checkbox("Multithreaded recording ", &multithreadedRecording);
+		ImGui::Checkbox("Pack vertices of new models ", &packVertices);
+		ImGui::Checkbox("Mesh LODs ", &simpleRenderSystem->shouldUseLods());
+		ImGui::Text("Draw calls: %zu (recorded in %.2f ms)", simpleRenderSystem->getDrawCallCount(), recordTime);
+		ImGui::Text("Triangles: %llu (%llu without LODs)", static_cast<unsigned long long>(simpleRenderSystem->getTriangleCount()),
+			static_cast<unsigned long long>(simpleRenderSystem->getFullDetailTriangleCount()));
+		ImGui::Text("Crowds: %zu agents (evaluated in %.2f ms)", simpleRenderSystem->getCrowdAgentCount(), simpleRenderSystem->getCrowdEvaluationTime());
+		ImGui::InputInt("Crowd size ", &crowdSize);
+		ImGui::DragFloat("Crowd spread ", &crowdSpread, 0.05f, 0.0f, 10.0f);
+		bool voxelWorld = chunkManager != nullptr;
+		if (ImGui::Checkbox("Voxel world ", &voxelWorld))
+		{
+			if (voxelWorld)
+				chunkManager = std::make_unique<VmcChunkManager>(vmcDevice, worldRadius, VmcTerrainGenerator{ static_cast<uint32_t>(worldSeed) }, worldDirectory());
+			else
+				chunkManager.reset();
+		}
+		if (chunkManager)
+		{
+			if (ImGui::SliderInt("Chunk radius ", &worldRadius, 1, 16))
+				chunkManager->setRadius(worldRadius);
+			if (ImGui::InputInt("World seed ", &worldSeed))
+			{
+				// Every chunk changes, so the old manager has to finish its jobs and go first
+				chunkManager.reset();
+				chunkManager = std::make_unique<VmcChunkManager>(vmcDevice, worldRadius, VmcTerrainGenerator{ static_cast<uint32_t>(worldSeed) }, worldDirectory());
+			}
+			VmcChunkManagerStatistics worldStatistics = chunkManager->getStatistics();
+			ImGui::Text("Chunks: %u loaded, %u pending, %u evicted", worldStatistics.loadedChunks, worldStatistics.pendingChunks, worldStatistics.evictedChunks);
+			ImGui::Text("Chunks read from %s: %u", worldDirectory().c_str(), worldStatistics.diskLoads);
+			ImGui::Text("Streaming: %.2f ms (max %.2f ms)", worldStatistics.updateTime, worldStatistics.maxUpdateTime);
+			ImGui::Text("Remeshing edits: %.3f ms", worldStatistics.remeshTime);
+			// Block picking: the first solid block the camera looks at
+			VmcVoxelCollider voxels{ *chunkManager };
+			VoxelRayHit target;
+			if (voxels.raycast(viewerObject->transform.translation, camera.getViewDirection(), PICK_DISTANCE, target))
+			{
+				ImGui::Text("Target block: %d %d %d", target.block.x, target.block.y, target.block.z);
+				if (ImGui::Button("Remove target"))
+					chunkManager->setBlock(target.block, BlockType::air);
+				ImGui::SameLine();
+				if (ImGui::Button("Place stone") && target.normal != glm::ivec3{ 0 })
+					chunkManager->setBlock(target.block + target.normal, BlockType::stone);
+			}
+			else ImGui::Text("Target block: none");
+			if (ImGui::Button("Dig below camera"))
+			{
+				// Clears the highest solid blocks of the 3 x 3 columns under the camera, +y points down
+				glm::ivec3 cameraBlock = glm::ivec3(glm::floor(viewerObject->transform.translation + 0.5f));
+				for (int dz = -1; dz <= 1; dz++)
+				{
+					for (int dx = -1; dx <= 1; dx++)
+					{
+						for (int y = cameraBlock.y; y < VmcChunkManager::CHUNK_HEIGHT - VmcChunkManager::SURFACE_LEVEL; y++)
+						{
+							glm::ivec3 block{ cameraBlock.x + dx, y, cameraBlock.z + dz };
+							if (chunkManager->getBlock(block) == BlockType::air) continue;
+							chunkManager->setBlock(block, BlockType::air);
+							break;
+						}
+					}
+				}
+			}
+		}
+		VmcMemoryStatistics memoryStatistics = vmcDevice.getAllocator().getStatistics();
+		ImGui::Text("GPU memory: %u allocations in %u device allocations", memoryStatistics.allocationCount, memoryStatistics.deviceMemoryCount);
+		ImGui::SameLine();
+		if (ImGui::Button("Dump", ImVec2(50, 20)))
+			vmcDevice.getAllocator().printStatistics();
+		if (frameCapture)
+		{
+			ImGui::Text("Capturing: %u frames, %u dropped", frameCapture->getCapturedFrameCount(), frameCapture->getDroppedFrameCount());
+			if (ImGui::Button("Stop capture", ImVec2(100, 25)))
+				stopFrameCapture();
+		}
+		else
+		{
+			ImGui::RadioButton("Y4M video", &captureFormat, CAPTURE_Y4M); ImGui::SameLine();
+			ImGui::RadioButton("PNG sequence", &captureFormat, CAPTURE_PNG_SEQUENCE);
+			ImGui::InputText("Capture name ", captureFileName, 50 * sizeof(char));
+			if (ImGui::Button("Start capture", ImVec2(100, 25)))
+				startFrameCapture();
+		}
 
 
 		ImGui::Text("Camera Mode:");
@@ -1041,6 +1345,9 @@ namespace vae {
 
 			std::string drawCurveLabel = "Draw curve (";
 			ImGui::Checkbox((drawCurveLabel + std::to_string(i) + ") ").c_str(), &animators[i].drawCurve);
+			ImGui::SameLine();
+			std::string orientLabel = "Orient along path (";
+			ImGui::Checkbox((orientLabel + std::to_string(i) + ") ").c_str(), &animators[i].orientAlongPath);
 
 			// Select game object to animate over the path
 			std::string objSelectTitle = "Animated object (";
@@ -1093,7 +1400,82 @@ namespace vae {
 
 			ImGui::RadioButton((sineLabel + std::to_string(i) + ")").c_str(), &animators[i].speedControl, 0); ImGui::SameLine();
 			ImGui::RadioButton((linLabel + std::to_string(i) + ")").c_str(), &animators[i].speedControl, 1); ImGui::SameLine();
-			ImGui::RadioButton((parabolicLabel + std::to_string(i) + ")").c_str(), &animators[i].speedControl, 2);
+			ImGui::RadioButton((parabolicLabel + std::to_string(i) + ")").c_str(), &animators[i].speedControl, 2); ImGui::SameLine();
+			std::string customLabel = "Custom (";
+			ImGui::RadioButton((customLabel + std::to_string(i) + ")").c_str(), &animators[i].speedControl, 3);
+
+			std::string speedCurveLabel = "Distance over time (";
+			ImGui::PlotLines((speedCurveLabel + std::to_string(i) + ")").c_str(), animators[i].getSpeedCurve().getTable(), SpeedCurve::TABLE_SIZE + 1, 0, nullptr, 0.0f, 1.0f, ImVec2(0.0f, 60.0f));
+
+			// Keys of the custom curve as (time, distance) and slope, the curve is tabulated again after every edit.
+			// Keys keep their place while they are dragged and are sorted by time once the drag ends
+			if (animators[i].speedControl == CUSTOM)
+			{
+				std::vector<SpeedCurve::Key> keys = animators[i].customSpeedCurve.getKeys();
+				bool keysChanged = false;
+				bool sortKeys = false;
+				for (int k = 0; k < keys.size(); k++)
+				{
+					std::string keyLabel = "Key ";
+					if (ImGui::DragFloat2((keyLabel + std::to_string(i) + "." + std::to_string(k)).c_str(), &keys[k].time, 0.01f, 0.0f, 1.0f))
+					{
+						keysChanged = true;
+					}
+					if (ImGui::IsItemDeactivatedAfterEdit())
+					{
+						sortKeys = true;
+					}
+					ImGui::SameLine();
+					std::string slopeLabel = "Slope ";
+					if (ImGui::DragFloat((slopeLabel + std::to_string(i) + "." + std::to_string(k)).c_str(), &keys[k].slope, 0.01f, 0.0f, 10.0f))
+					{
+						keysChanged = true;
+					}
+					ImGui::SameLine();
+					std::string removeKeyLabel = "DEL key (";
+					if (ImGui::Button((removeKeyLabel + std::to_string(i) + "." + std::to_string(k) + ")").c_str()))
+					{
+						keys.erase(keys.begin() + k);
+						keysChanged = true;
+						break;
+					}
+				}
+				std::string addKeyLabel = "ADD key (anim ";
+				if (ImGui::Button((addKeyLabel + std::to_string(i) + ")").c_str()))
+				{
+					// Halfway through the curve, on it
+					keys.push_back({ 0.5f, animators[i].customSpeedCurve.distanceAt(0.5f), 1.0f });
+					keysChanged = true;
+					sortKeys = true;
+				}
+				if (sortKeys)
+				{
+					std::stable_sort(keys.begin(), keys.end(), [](const SpeedCurve::Key& a, const SpeedCurve::Key& b) { return a.time < b.time; });
+					keysChanged = true;
+				}
+				if (keysChanged)
+				{
+					animators[i].customSpeedCurve.setKeys(keys);
+				}
+			}
+
+			// Agents following the curve on their own, with all speed control functions
+			SplineCrowd& crowd = animators[i].crowd;
+			ImGui::Text("Crowd: %zu agents", crowd.getAgentCount()); ImGui::SameLine();
+			std::string spawnCrowdLabel = "Spawn crowd (";
+			if (ImGui::Button((spawnCrowdLabel + std::to_string(i) + ")").c_str()))
+			{
+				crowd.clear();
+				crowd.spawnAgents(static_cast<size_t>(std::max(crowdSize, 0)), animators[i].getAnimationDuration(), crowdSpread, static_cast<uint32_t>(i + 1));
+				crowd.model = sphereModel;
+				crowd.color = { 0.9f, 0.55f, 0.1f };
+			}
+			ImGui::SameLine();
+			std::string clearCrowdLabel = "Clear crowd (";
+			if (ImGui::Button((clearCrowdLabel + std::to_string(i) + ")").c_str()))
+			{
+				crowd.clear();
+			}
 
 			std::string animatorMoveLabel = "Pos anim ";
 			if (ImGui::DragFloat3((animatorMoveLabel + std::to_string(i)).c_str(), glm::value_ptr(animators[i].getPosition()), 1.0f, -20.0f, 20.0f))
@@ -1125,8 +1507,7 @@ namespace vae {
 				std::string cpLabel = "CP ";
 				if (ImGui::DragFloat3((cpLabel + std::to_string(i) + "." + std::to_string(j)).c_str(), glm::value_ptr(CPs[j].transform.translation), 1.0f, -50.0f, 50.0f)) {
 					animators[i].getSpline().updateControlPointsRelativePositions();
-					animators[i].getSpline().generateSplineSegments();
-					animators[i].buildForwardDifferencingTable();
+					animators[i].getSpline().updateSegmentsAround(j);
 				};
 
 				ImGui::SameLine();
@@ -1168,12 +1549,16 @@ namespace vae {
 			{
 				if (obj.deformationEnabled)
 				{
+					// Deformation writes into the vertex buffer, don't deform the model of every object that shares it
+					if (modelRegistry.isShared(obj.model.get()))
+						obj.model = modelRegistry.createUniqueModel(obj.modelPath);
 					obj.initDeformationSystem();
 					obj.setPosition(obj.transform.translation);
 				}
 				else {
 					obj.resetObjectForm();
 					obj.disableDeformationSystem();
+					obj.model = modelRegistry.getModel(obj.modelPath, vertexFormat());
 				}
 			}
 
@@ -1403,7 +1788,7 @@ namespace vae {
 	void VmcApp::addSplineAnimator()
 	{
 		// Initialize animators
-		std::shared_ptr<VmcModel> sphereModel = VmcModel::createModelFromFile(vmcDevice, "../Models/sphere.obj");
+		std::shared_ptr<VmcModel> sphereModel = modelRegistry.getModel("../Models/sphere.obj", vertexFormat());
 
 		std::vector<ControlPoint> controlPoints{};
 		controlPoints.push_back({ { 0.0f, 3.0f, 2.5f }, { 0.0f, 0.0f, 1.0f }, sphereModel });
@@ -1426,7 +1811,7 @@ namespace vae {
 	/* Add particle system to scene */
 	void VmcApp::addParticleSystem()
 	{
-		std::shared_ptr<VmcModel> waterDropModel = VmcModel::createModelFromFile(vmcDevice, "../Models/cube.obj");
+		std::shared_ptr<VmcModel> waterDropModel = modelRegistry.getModel("../Models/cube.obj", vertexFormat());
 
 		ParticleSystem hose{ {0.0f, 0.0f, 0.0f}, waterDropModel };
 		particleSystems.push_back(hose);
@@ -1460,13 +1845,13 @@ namespace vae {
 		std::vector<std::pair<glm::vec3, float>> massPoints1;
 		massPoints1.push_back(std::make_pair(glm::vec3{ 1.0f, 0.0f, 0.0f }, 1.0f));
 
-		std::shared_ptr<VmcModel> groundModel = VmcModel::createModelFromFile(vmcDevice, "../Models/ground.obj");
+		std::shared_ptr<VmcModel> groundModel = modelRegistry.getModel("../Models/ground.obj", vertexFormat());
 		RigidBody ground{ massPoints1, false, groundModel, {1.0f, 1.0f, 1.0f} };
 		ground.S.pos = { 0.0f, 5.0f, 0.0f };
 		collidables.push_back(ground);
 	}
 
-	/* Check if any collidables collide with rigid bodies */
+	/* Check if any collidables (and the blocks of the voxel world) collide with rigid bodies */
 	void VmcApp::checkRigidBodyCollisions()
 	{
 		for (auto& rigid : rigidBodies)
@@ -1477,6 +1862,16 @@ namespace vae {
 				rigid.detectCollision(collidable, col);
 			}
 		}
+
+		if (chunkManager)
+		{
+			VmcVoxelCollider voxels{ *chunkManager };
+			for (auto& rigid : rigidBodies)
+			{
+				CollisionInfo col{};
+				rigid.detectCollision(voxels, col);
+			}
+		}
 	}
 
 	/* Generate new particles for each particle system */
@@ -1504,8 +1899,11 @@ namespace vae {
 		
 		// ROAM MODE
 		case 1:
-			// Update camera model (game object that contains camera
-			cameraController.moveInPlaneXZ(vmcWindow.getGLFWwindow(), frameTime, *viewerObject);
+			// Update camera model (game object that contains camera, needs keyboard input)
+			if (vmcWindow)
+			{
+				cameraController.moveInPlaneXZ(vmcWindow->getGLFWwindow(), frameTime, *viewerObject);
+			}
 			// Update camera view matrix
 			camera.setViewYXZ(viewerObject->transform.translation, viewerObject->transform.rotation);
 			camera.setPerspectiveProjection(glm::radians(50.f), aspect, 0.1f, 1000.f);
@@ -6,10 +6,16 @@
 #include "vmc_descriptors.hpp"
 #include "vmc_camera.hpp"
 #include "vmc_texture.hpp"
+#include "vmc_model_registry.hpp"
+#include "vmc_image_writer.hpp"
+#include "vmc_frame_capture.hpp"
 #include "keyboard_movement_controller.hpp"
 #include "ffd_keyboard_controller.hpp"
 #include "particle_system.hpp"
 #include "simple_render_system.hpp"
+#include "vmc_chunk_manager.hpp"
+#include "vmc_terrain_generator.hpp"
+#include "vmc_voxel_collider.hpp"
 #include "story_board.hpp"
 
 #include "animator.hpp"
@@ -20,19 +26,35 @@
 #include "rigid_body.hpp"
 
 // std 
+#include <chrono>
 #include <memory>
 #include <vector>
 #include <fstream>
+#include <string>
 
 namespace vae {
+	// Rendering without a window: every frame is read back and written to outputDirectory
+	struct HeadlessSettings {
+		std::string sceneFile{};	// .vaescene in ../Scenes/, the default scene is rendered when empty
+		std::string outputDirectory{ "../Renders" };
+		int frameCount = 0;			// 0 renders the full storyboard of the scene
+		float framesPerSecond = 30.0f;
+		uint32_t width = 1000;
+		uint32_t height = 700;
+		int cameraMode = 0;
+		VmcImageFileFormat imageFormat = IMAGE_PNG;
+	};
+
 	class VmcApp
 	{
 	public:
 		const float MAX_FRAME_TIME = .1f;
 		static constexpr int WIDTH = 1000;
 		static constexpr int HEIGHT = 700;
+		static constexpr float PICK_DISTANCE = 64.0f;	// Blocks further away from the camera can't be targeted
 
 		VmcApp();
+		VmcApp(const HeadlessSettings& settings);
 		~VmcApp();
 
 		VmcApp(const VmcApp&) = delete;
@@ -42,6 +64,13 @@ namespace vae {
 		void initImgui();
 
 	private:
+		void init();
+		void runHeadless();
+		void updateScene(float frameTime);
+		void renderScene(VkCommandBuffer commandBuffer, float frameTime);
+		void startFrameCapture();
+		void stopFrameCapture();
+
 		void loadSceneFromFile(const char* fileName);
 		void saveSceneToFile(const char* fileName);
 		void loadGameObject(const char * objName);
@@ -72,17 +101,25 @@ namespace vae {
 		void updateCamera(float frameTime);
 
 		std::vector<char*> split(char* stringToSplit, const char* separator);
-
-		VmcWindow vmcWindow{ WIDTH, HEIGHT, "Vulkan Animation Engine - Jente Vandersanden" };
-		VmcDevice vmcDevice{ vmcWindow };
-		VmcRenderer vmcRenderer{ vmcWindow, vmcDevice };
+		VmcModel::VertexFormat vertexFormat() const { return packVertices ? VmcModel::VERTEX_FORMAT_PACKED : VmcModel::VERTEX_FORMAT_FULL; };
+		// Region files of the voxel world, every seed is a world of its own
+		std::string worldDirectory() const { return "../Worlds/seed-" + std::to_string(worldSeed); };
+
+		std::chrono::high_resolution_clock::time_point startupBegin = std::chrono::high_resolution_clock::now();	// first member, so it is set before anything is created
+		HeadlessSettings headlessSettings{};
+		std::unique_ptr<VmcWindow> vmcWindow;	// nullptr when running headless
+		VmcDevice vmcDevice;
+		VmcRenderer vmcRenderer;
+		VmcModelRegistry modelRegistry{ vmcDevice };
+		std::unique_ptr<VmcFrameCapture> frameCapture;	// nullptr when not capturing
 		VmcCamera camera;
 		std::unique_ptr<SimpleRenderSystem> simpleRenderSystem;
 		std::unique_ptr<VmcGameObject> viewerObject{};
+		std::unique_ptr<VmcChunkManager> chunkManager;	// nullptr while the voxel world is off
 
 		// Order of declarations matter!
 		std::unique_ptr<VmcDescriptorPool> globalPool{};
-		VkDescriptorPool imGuiPool;	 // TODO: make use of VmcDescriptorPool class!
+		VkDescriptorPool imGuiPool = VK_NULL_HANDLE;	 // TODO: make use of VmcDescriptorPool class!
 
 		std::unique_ptr<VmcTexture> testTexture;
 		std::vector<std::unique_ptr<VmcBuffer>> uboBuffers;
@@ -110,12 +147,21 @@ namespace vae {
 
 		int cameraMode = 0;
 		float animation_FPS = 120.0f;
+		bool multithreadedRecording = true;
+		bool packVertices = true;	// Quantize models that are loaded from now on and never deformed
+		float recordTime = 0.0f;
+		int worldRadius = 4;
+		int worldSeed = 1;
+		int crowdSize = 10000;			// Agents the spline animators spawn
+		float crowdSpread = 0.5f;		// Largest lateral offset of the agents from the curve
+		int captureFormat = CAPTURE_Y4M;
+		char captureFileName[50] = "capture";
 		int UI_Tab = 0;
 		int deformationIndex = 0;
 		char fileNameBuffer[50] = "Your file name";
 		char saveLoadFileName[50] = "Your file name";
 		char skeletonFileName[50] = "Your file name";
-		std::shared_ptr<VmcModel> sphereModel = VmcModel::createModelFromFile(vmcDevice, "../Models/sphere.obj");
+		std::shared_ptr<VmcModel> sphereModel = modelRegistry.getModel("../Models/sphere.obj", vertexFormat());
 	};
 }
 
@@ -43,13 +43,12 @@ namespace vae {
         memoryPropertyFlags{ memoryPropertyFlags } {
         alignmentSize = getAlignment(instanceSize, minOffsetAlignment);
         bufferSize = alignmentSize * instanceCount;
-        device.createBuffer(bufferSize, usageFlags, memoryPropertyFlags, buffer, memory);
+        device.createBuffer(bufferSize, usageFlags, memoryPropertyFlags, buffer, allocation);
     }
 
     VmcBuffer::~VmcBuffer() {
         unmap();
-        vkDestroyBuffer(vaeDevice.device(), buffer, nullptr);
-        vkFreeMemory(vaeDevice.device(), memory, nullptr);
+        vaeDevice.destroyBuffer(buffer, allocation);
     }
 
     /**
@@ -62,20 +61,22 @@ namespace vae {
      * @return VkResult of the buffer mapping call
      */
     VkResult VmcBuffer::map(VkDeviceSize size, VkDeviceSize offset) {
-        assert(buffer && memory && "Called map on buffer before create");
-        return vkMapMemory(vaeDevice.device(), memory, offset, size, 0, &mapped);
+        assert(buffer && allocation.memory && "Called map on buffer before create");
+        // Host visible memory blocks stay mapped for their whole lifetime, so mapping only hands out a pointer
+        if (!allocation.mapped) {
+            return VK_ERROR_MEMORY_MAP_FAILED;
+        }
+        mapped = static_cast<char*>(allocation.mapped) + offset;
+        return VK_SUCCESS;
     }
 
     /**
      * Unmap a mapped memory range
      *
-     * @note Does not return a result as vkUnmapMemory can't fail
+     * @note The underlying memory block stays mapped, this only drops the pointer
      */
     void VmcBuffer::unmap() {
-        if (mapped) {
-            vkUnmapMemory(vaeDevice.device(), memory);
-            mapped = nullptr;
-        }
+        mapped = nullptr;
     }
 
     /**
@@ -114,9 +115,9 @@ namespace vae {
     VkResult VmcBuffer::flush(VkDeviceSize size, VkDeviceSize offset) {
         VkMappedMemoryRange mappedRange = {};
         mappedRange.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
-        mappedRange.memory = memory;
-        mappedRange.offset = offset;
-        mappedRange.size = size;
+        mappedRange.memory = allocation.memory;
+        mappedRange.offset = allocation.offset + offset;
+        mappedRange.size = size == VK_WHOLE_SIZE ? allocation.size - offset : size;
         return vkFlushMappedMemoryRanges(vaeDevice.device(), 1, &mappedRange);
     }
 
@@ -134,9 +135,9 @@ namespace vae {
     VkResult VmcBuffer::invalidate(VkDeviceSize size, VkDeviceSize offset) {
         VkMappedMemoryRange mappedRange = {};
         mappedRange.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
-        mappedRange.memory = memory;
-        mappedRange.offset = offset;
-        mappedRange.size = size;
+        mappedRange.memory = allocation.memory;
+        mappedRange.offset = allocation.offset + offset;
+        mappedRange.size = size == VK_WHOLE_SIZE ? allocation.size - offset : size;
         return vkInvalidateMappedMemoryRanges(vaeDevice.device(), 1, &mappedRange);
     }
 
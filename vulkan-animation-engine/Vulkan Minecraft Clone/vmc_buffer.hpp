@@ -45,7 +45,7 @@ namespace vae {
         VmcDevice& vaeDevice;
         void* mapped = nullptr;
         VkBuffer buffer = VK_NULL_HANDLE;
-        VkDeviceMemory memory = VK_NULL_HANDLE;
+        VmcAllocation allocation{};
 
         VkDeviceSize bufferSize;
         uint32_t instanceCount;
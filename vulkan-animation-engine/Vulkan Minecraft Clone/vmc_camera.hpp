@@ -18,6 +18,8 @@ namespace vae {
 
 		const glm::mat4& getProjection() const { return projectionMatrix; };
 		const glm::mat4& getView() const { return viewMatrix; };
+		// Unit vector the camera looks along in world space
+		glm::vec3 getViewDirection() const { return { viewMatrix[0][2], viewMatrix[1][2], viewMatrix[2][2] }; };
 
 	private:
 		glm::mat4 projectionMatrix{ 1.f };
@@ -0,0 +1,337 @@
+#include "vmc_chunk_manager.hpp"
+#include "vmc_swap_chain.hpp"
+#include "vmc_utils.hpp"
+#include "simple_render_system.hpp"
+#include "vmc_region_file.hpp"
+
+// libs
+#include <glm/gtc/matrix_transform.hpp>
+
+// std
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+namespace vae {
+
+	size_t VmcChunkCoordHash::operator()(const VmcChunkCoord& coord) const
+	{
+		size_t seed = 0;
+		hashCombine(seed, coord.x, coord.z);
+		return seed;
+	}
+
+	VmcChunkManager::VmcChunkManager(VmcDevice& device, int radius, Generator generator, const std::string& worldDirectory) :
+		vmcDevice{ device }, generator{ std::move(generator) }, radius{ radius }
+	{
+		if (!worldDirectory.empty())
+			storage = std::make_unique<VmcChunkStorage>(worldDirectory, CHUNK_WIDTH, CHUNK_HEIGHT);
+
+		// Leave one hardware thread to the render loop
+		uint32_t threadCount = std::max(2u, std::thread::hardware_concurrency()) - 1;
+		workers = std::make_unique<VmcThreadPool>(threadCount);
+	}
+
+	VmcChunkManager::~VmcChunkManager()
+	{
+		// Queued jobs still run when the pool shuts down, cancelled ones return right away
+		for (auto& job : pendingJobs)
+		{
+			job.second->cancelled = true;
+		}
+		workers.reset();
+		vkDeviceWaitIdle(vmcDevice.device());
+
+		if (storage)
+		{
+			for (auto& entry : chunks)
+			{
+				saveChunk(entry.first, entry.second);
+			}
+			storage->flush();
+		}
+	}
+
+	void VmcChunkManager::setRadius(int newRadius)
+	{
+		radius = std::clamp(newRadius, 1, 32);
+		centerValid = false;
+	}
+
+	VmcChunkManagerStatistics VmcChunkManager::getStatistics() const
+	{
+		VmcChunkManagerStatistics statistics{};
+		statistics.loadedChunks = static_cast<uint32_t>(chunks.size());
+		statistics.pendingChunks = static_cast<uint32_t>(pendingJobs.size());
+		statistics.evictedChunks = evictedChunks;
+		statistics.diskLoads = diskLoads;
+		statistics.updateTime = updateTime;
+		statistics.maxUpdateTime = maxUpdateTime;
+		statistics.remeshTime = remeshTime;
+		return statistics;
+	}
+
+	void VmcChunkManager::update(const glm::vec3& cameraPosition)
+	{
+		auto updateBegin = std::chrono::high_resolution_clock::now();
+		frame++;
+
+		// The set of wanted chunks only changes when the camera crosses a chunk border
+		VmcChunkCoord cameraChunk = chunkAt(cameraPosition);
+		if (!centerValid || cameraChunk != center)
+		{
+			center = cameraChunk;
+			centerValid = true;
+			evictChunks();
+			requestChunks();
+		}
+
+		remeshEditedChunks();
+		uploadFinishedChunks(updateBegin);
+		destroyRetiredMeshes();
+
+		updateTime = std::chrono::duration<float, std::chrono::milliseconds::period>(std::chrono::high_resolution_clock::now() - updateBegin).count();
+		maxUpdateTime = std::max(maxUpdateTime, updateTime);
+	}
+
+	void VmcChunkManager::collectDrawCalls(std::vector<DrawCall>& drawCalls) const
+	{
+		DrawCall drawCall{};
+		drawCall.push.color = { 1.0f, 1.0f, 1.0f };
+		for (auto& entry : chunks)
+		{
+			if (entry.second.mesh->isEmpty()) continue;	// Only air
+
+			drawCall.model = entry.second.mesh->getModel();
+			drawCall.push.modelMatrix = glm::translate(glm::mat4{ 1.0f }, chunkOrigin(entry.first));
+			drawCalls.push_back(drawCall);
+		}
+	}
+
+	bool VmcChunkManager::setBlock(const glm::ivec3& block, BlockType type)
+	{
+		VmcChunkCoord coord;
+		glm::ivec3 local;
+		if (!locateBlock(block, coord, local)) return false;
+		auto it = chunks.find(coord);
+		if (it == chunks.end()) return false;
+
+		// The mesh catches up in the next update()
+		it->second.blocks->editBlock(local.x, local.y, local.z, type);
+		it->second.saved = false;
+		return true;
+	}
+
+	BlockType VmcChunkManager::getBlock(const glm::ivec3& block) const
+	{
+		VmcChunkCoord coord;
+		glm::ivec3 local;
+		if (!locateBlock(block, coord, local)) return BlockType::air;
+		auto it = chunks.find(coord);
+		return it != chunks.end() ? it->second.blocks->getBlock(local.x, local.y, local.z) : BlockType::air;
+	}
+
+	const ChunkComponent* VmcChunkManager::findChunk(VmcChunkCoord coord) const
+	{
+		auto it = chunks.find(coord);
+		return it != chunks.end() ? it->second.blocks.get() : nullptr;
+	}
+
+	VmcChunkCoord VmcChunkManager::chunkAt(const glm::vec3& worldPosition)
+	{
+		return { static_cast<int>(std::floor(worldPosition.x / CHUNK_WIDTH)), static_cast<int>(std::floor(worldPosition.z / CHUNK_WIDTH)) };
+	}
+
+	glm::vec3 VmcChunkManager::chunkOrigin(VmcChunkCoord coord)
+	{
+		return { coord.x * CHUNK_WIDTH, -SURFACE_LEVEL, coord.z * CHUNK_WIDTH };
+	}
+
+	void VmcChunkManager::generateHills(ChunkComponent& chunk, VmcChunkCoord coord)
+	{
+		// y grows downwards: grass on top, a few layers of dirt, stone below
+		for (int z = 0; z < chunk.getWidth(); z++)
+		{
+			for (int x = 0; x < chunk.getWidth(); x++)
+			{
+				float worldX = static_cast<float>(coord.x * CHUNK_WIDTH + x);
+				float worldZ = static_cast<float>(coord.z * CHUNK_WIDTH + z);
+				int surface = SURFACE_LEVEL + static_cast<int>(6.0f * std::sin(worldX * 0.07f) + 4.0f * std::cos(worldZ * 0.11f) + 2.0f * std::sin((worldX + worldZ) * 0.23f));
+				surface = std::clamp(surface, 0, chunk.getHeight() - 1);
+
+				for (int y = 0; y < chunk.getHeight(); y++)
+				{
+					BlockType type = y < surface ? BlockType::air : y == surface ? BlockType::grass : y < surface + 4 ? BlockType::dirt : BlockType::stone;
+					chunk.setBlock(x, y, z, type);
+				}
+			}
+		}
+	}
+
+	bool VmcChunkManager::isInRange(VmcChunkCoord coord, int range) const
+	{
+		int dx = coord.x - center.x;
+		int dz = coord.z - center.z;
+		return dx * dx + dz * dz <= range * range;
+	}
+
+	bool VmcChunkManager::locateBlock(const glm::ivec3& block, VmcChunkCoord& coord, glm::ivec3& local)
+	{
+		coord = { static_cast<int>(std::floor(block.x / static_cast<float>(CHUNK_WIDTH))), static_cast<int>(std::floor(block.z / static_cast<float>(CHUNK_WIDTH))) };
+		local = { block.x - coord.x * CHUNK_WIDTH, block.y + SURFACE_LEVEL, block.z - coord.z * CHUNK_WIDTH };
+		return local.y >= 0 && local.y < CHUNK_HEIGHT;
+	}
+
+	void VmcChunkManager::requestChunks()
+	{
+		std::vector<VmcChunkCoord> missing;
+		for (int dz = -radius; dz <= radius; dz++)
+		{
+			for (int dx = -radius; dx <= radius; dx++)
+			{
+				VmcChunkCoord coord{ center.x + dx, center.z + dz };
+				if (isInRange(coord, radius) && chunks.find(coord) == chunks.end() && pendingJobs.find(coord) == pendingJobs.end())
+					missing.push_back(coord);
+			}
+		}
+
+		// The pool runs jobs in submission order, so the chunks next to the camera come first
+		auto distance = [&](VmcChunkCoord coord) { return (coord.x - center.x) * (coord.x - center.x) + (coord.z - center.z) * (coord.z - center.z); };
+		std::sort(missing.begin(), missing.end(), [&](VmcChunkCoord a, VmcChunkCoord b) { return distance(a) < distance(b); });
+
+		for (VmcChunkCoord coord : missing)
+		{
+			auto job = std::make_shared<ChunkJob>();
+			job->coord = coord;
+			pendingJobs[coord] = job;
+
+			workers->addJob([this, job]() {
+				if (job->cancelled) return;
+				job->chunk = std::make_unique<ChunkComponent>(CHUNK_WIDTH, CHUNK_HEIGHT, BlockType::air);
+				job->loaded = storage && storage->load(job->coord, *job->chunk);
+				if (!job->loaded)
+					generator(*job->chunk, job->coord);
+				if (job->cancelled) return;
+				job->sections = VmcChunkMesh::meshSections(*job->chunk);
+
+				std::lock_guard<std::mutex> lock{ finishedMutex };
+				finishedJobs.push_back(job);
+			});
+		}
+	}
+
+	void VmcChunkManager::evictChunks()
+	{
+		const int keepRange = radius + 1;
+		for (auto it = chunks.begin(); it != chunks.end();)
+		{
+			if (isInRange(it->first, keepRange))
+			{
+				++it;
+				continue;
+			}
+
+			saveChunk(it->first, it->second);
+			// Frames that are still in flight may draw the model
+			retiredMeshes.push_back({ std::move(it->second.mesh), frame });
+			it = chunks.erase(it);
+			evictedChunks++;
+		}
+
+		for (auto it = pendingJobs.begin(); it != pendingJobs.end();)
+		{
+			if (isInRange(it->first, keepRange))
+			{
+				++it;
+				continue;
+			}
+			it->second->cancelled = true;
+			it = pendingJobs.erase(it);
+		}
+		queueFlush();
+	}
+
+	void VmcChunkManager::saveChunk(VmcChunkCoord coord, Chunk& chunk)
+	{
+		if (!storage || chunk.saved) return;
+
+		// Encoded right away on the main thread, so a job that loads the chunk again already finds the new blocks
+		storage->save(coord, *chunk.blocks);
+		chunk.saved = true;
+	}
+
+	void VmcChunkManager::queueFlush()
+	{
+		if (!storage || !storage->hasPendingSaves() || flushQueued.exchange(true)) return;
+
+		workers->addJob([this]() {
+			// Cleared first, chunks saved while the files are written need another flush
+			flushQueued = false;
+			storage->flush();
+		});
+	}
+
+	void VmcChunkManager::uploadFinishedChunks(std::chrono::high_resolution_clock::time_point updateBegin)
+	{
+		std::vector<std::shared_ptr<ChunkJob>> ready;
+		{
+			std::lock_guard<std::mutex> lock{ finishedMutex };
+			ready.swap(finishedJobs);
+		}
+		if (ready.empty()) return;
+
+		auto distance = [&](VmcChunkCoord coord) { return (coord.x - center.x) * (coord.x - center.x) + (coord.z - center.z) * (coord.z - center.z); };
+		std::sort(ready.begin(), ready.end(), [&](const std::shared_ptr<ChunkJob>& a, const std::shared_ptr<ChunkJob>& b) { return distance(a->coord) < distance(b->coord); });
+
+		size_t uploaded = 0;
+		while (uploaded < ready.size())
+		{
+			std::shared_ptr<ChunkJob>& job = ready[uploaded++];
+
+			// Evicted (and maybe requested again) while it was generated
+			auto pending = pendingJobs.find(job->coord);
+			if (job->cancelled || pending == pendingJobs.end() || pending->second != job) continue;
+			pendingJobs.erase(pending);
+
+			Chunk& chunk = chunks[job->coord];
+			chunk.blocks = std::move(job->chunk);
+			// Also created for chunks that are only air, so blocks can be placed in them
+			chunk.mesh = std::make_unique<VmcChunkMesh>(vmcDevice, job->sections);
+			chunk.saved = job->loaded;
+			if (job->loaded) diskLoads++;
+
+			float elapsed = std::chrono::duration<float, std::chrono::milliseconds::period>(std::chrono::high_resolution_clock::now() - updateBegin).count();
+			if (elapsed >= UPLOAD_BUDGET_MS) break;
+		}
+
+		// Whatever didn't fit into the budget goes first next frame
+		if (uploaded < ready.size())
+		{
+			std::lock_guard<std::mutex> lock{ finishedMutex };
+			finishedJobs.insert(finishedJobs.end(), ready.begin() + uploaded, ready.end());
+		}
+	}
+
+	void VmcChunkManager::remeshEditedChunks()
+	{
+		auto remeshBegin = std::chrono::high_resolution_clock::now();
+		for (auto& entry : chunks)
+		{
+			Chunk& chunk = entry.second;
+			if (chunk.mesh->update(*chunk.blocks, frame)) continue;
+
+			// The edits outgrew the spare room of the buffers, mesh the whole chunk into new ones
+			retiredMeshes.push_back({ std::move(chunk.mesh), frame });
+			chunk.mesh = std::make_unique<VmcChunkMesh>(vmcDevice, VmcChunkMesh::meshSections(*chunk.blocks));
+		}
+		remeshTime = std::chrono::duration<float, std::chrono::milliseconds::period>(std::chrono::high_resolution_clock::now() - remeshBegin).count();
+	}
+
+	void VmcChunkManager::destroyRetiredMeshes()
+	{
+		// The upload into the buffers of a model has to be finished as well before they can be destroyed
+		retiredMeshes.erase(std::remove_if(retiredMeshes.begin(), retiredMeshes.end(), [&](RetiredMesh& retired) {
+			return frame - retired.retireFrame > VmcSwapChain::MAX_FRAMES_IN_FLIGHT && retired.mesh->getModel()->isReady();
+		}), retiredMeshes.end());
+	}
+}
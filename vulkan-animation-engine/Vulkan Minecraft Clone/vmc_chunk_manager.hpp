@@ -0,0 +1,155 @@
+#pragma once
+#include "vmc_device.hpp"
+#include "vmc_chunk_mesh.hpp"
+#include "vmc_thread_pool.hpp"
+#include "chunk_component.hpp"
+
+// libs
+#include <glm/glm.hpp>
+
+// std
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace vae {
+	struct DrawCall;
+	class VmcChunkStorage;
+
+	// Chunk position in chunks, chunk (x, z) covers the world from (x, z) * CHUNK_WIDTH
+	struct VmcChunkCoord {
+		int x;
+		int z;
+
+		bool operator==(const VmcChunkCoord& other) const { return x == other.x && z == other.z; }
+		bool operator!=(const VmcChunkCoord& other) const { return !(*this == other); }
+	};
+
+	struct VmcChunkCoordHash {
+		size_t operator()(const VmcChunkCoord& coord) const;
+	};
+
+	struct VmcChunkManagerStatistics {
+		uint32_t loadedChunks = 0;		// Meshed and uploaded (or uploading)
+		uint32_t pendingChunks = 0;		// Waiting for or being generated on a worker thread
+		uint32_t evictedChunks = 0;		// Since the manager was created
+		uint32_t diskLoads = 0;			// Chunks read from region files instead of generated, since the manager was created
+		float updateTime = 0.0f;		// Main thread time of the last update() in ms
+		float maxUpdateTime = 0.0f;		// Longest update() so far in ms
+		float remeshTime = 0.0f;		// Remeshing edited chunks in the last update() in ms
+	};
+
+	/*
+		Streams a world of chunks around the camera. Chunks within the radius are generated and meshed on worker threads,
+		nearest first. The main thread only turns finished meshes into models, which uploads them through the upload queue,
+		and stops for the frame once UPLOAD_BUDGET_MS is spent, so fast camera motion spreads its uploads over a few frames
+		instead of stalling one. Chunks further away than the radius (plus one chunk, so moving back and forth across a
+		border doesn't reload anything) are evicted. Their models stay alive until no frame in flight can use them anymore.
+		Block edits only remesh the sections of the chunk they touch (see VmcChunkMesh), on the main thread during update().
+		With a world directory, chunks are first looked up in its region files (see VmcChunkStorage) and only generated when
+		they aren't there. Generated and edited chunks are saved when they are evicted and when the manager is destroyed,
+		the region files are written on a worker thread.
+	*/
+	class VmcChunkManager
+	{
+	public:
+		static constexpr int CHUNK_WIDTH = 32;
+		static constexpr int CHUNK_HEIGHT = 64;
+		static constexpr int SURFACE_LEVEL = CHUNK_HEIGHT / 2;	// Chunk layer that is placed at world y = 0
+		static constexpr float UPLOAD_BUDGET_MS = 1.0f;
+
+		// Fills a chunk, runs on worker threads
+		using Generator = std::function<void(ChunkComponent& chunk, VmcChunkCoord coord)>;
+
+		// Without a world directory nothing is saved and every chunk is generated
+		VmcChunkManager(VmcDevice& device, int radius = 4, Generator generator = generateHills, const std::string& worldDirectory = "");
+		~VmcChunkManager();
+
+		VmcChunkManager(const VmcChunkManager&) = delete;
+		VmcChunkManager& operator=(const VmcChunkManager&) = delete;
+
+		int getRadius() const { return radius; };
+		void setRadius(int newRadius);
+		VmcChunkManagerStatistics getStatistics() const;
+
+		// Call once per frame before recording
+		void update(const glm::vec3& cameraPosition);
+		void collectDrawCalls(std::vector<DrawCall>& drawCalls) const;
+
+		// Blocks in world block coordinates, block (x, y, z) is centered on the world position (x, y, z).
+		// Only loaded chunks can be edited, setBlock returns false for blocks outside of them.
+		bool setBlock(const glm::ivec3& block, BlockType type);
+		BlockType getBlock(const glm::ivec3& block) const;
+		// Blocks of a loaded chunk, nullptr when it isn't loaded (yet). Valid until the next update().
+		const ChunkComponent* findChunk(VmcChunkCoord coord) const;
+
+		static VmcChunkCoord chunkAt(const glm::vec3& worldPosition);
+		static glm::vec3 chunkOrigin(VmcChunkCoord coord);
+		// Rolling hills of grass, dirt and stone
+		static void generateHills(ChunkComponent& chunk, VmcChunkCoord coord);
+
+	private:
+		struct ChunkJob {
+			VmcChunkCoord coord;
+			std::atomic<bool> cancelled{ false };
+			bool loaded = false;	// Read from the storage, not generated
+			std::unique_ptr<ChunkComponent> chunk;
+			std::vector<VmcModel::Builder> sections;
+		};
+
+		struct Chunk {
+			std::unique_ptr<ChunkComponent> blocks;
+			std::unique_ptr<VmcChunkMesh> mesh;
+			bool saved = false;	// The storage has the same blocks
+		};
+
+		struct RetiredMesh {
+			std::unique_ptr<VmcChunkMesh> mesh;
+			uint64_t retireFrame;
+		};
+
+		bool isInRange(VmcChunkCoord coord, int range) const;
+		// Chunk that contains the block and the block inside of it, false when the block is above or below every chunk
+		static bool locateBlock(const glm::ivec3& block, VmcChunkCoord& coord, glm::ivec3& local);
+		void requestChunks();
+		void evictChunks();
+		void saveChunk(VmcChunkCoord coord, Chunk& chunk);
+		void queueFlush();
+		void uploadFinishedChunks(std::chrono::high_resolution_clock::time_point updateBegin);
+		void remeshEditedChunks();
+		void destroyRetiredMeshes();
+
+		VmcDevice& vmcDevice;
+		Generator generator;
+		int radius;
+
+		VmcChunkCoord center{ 0, 0 };
+		bool centerValid = false;
+		uint64_t frame = 0;
+
+		std::unordered_map<VmcChunkCoord, Chunk, VmcChunkCoordHash> chunks;
+		std::unordered_map<VmcChunkCoord, std::shared_ptr<ChunkJob>, VmcChunkCoordHash> pendingJobs;
+		std::vector<RetiredMesh> retiredMeshes;
+
+		std::mutex finishedMutex;
+		std::vector<std::shared_ptr<ChunkJob>> finishedJobs;	// Filled by the workers
+
+		uint32_t evictedChunks = 0;
+		uint32_t diskLoads = 0;
+		float updateTime = 0.0f;
+		float maxUpdateTime = 0.0f;
+		float remeshTime = 0.0f;
+
+		std::unique_ptr<VmcChunkStorage> storage;	// nullptr without a world directory
+		std::atomic<bool> flushQueued{ false };
+
+		// Last member: destroyed first, so no job is running while the rest of the manager goes away
+		std::unique_ptr<VmcThreadPool> workers;
+	};
+}
@@ -0,0 +1,161 @@
+#include "vmc_chunk_mesh.hpp"
+#include "vmc_swap_chain.hpp"
+
+// std
+#include <algorithm>
+#include <cassert>
+#include <limits>
+
+namespace vae {
+
+	std::vector<VmcModel::Builder> VmcChunkMesh::meshSections(const ChunkComponent& chunk, VmcModel::ChunkMeshMode mode, VmcModel::VertexFormat format)
+	{
+		std::vector<VmcModel::Builder> sections(chunk.getSectionCount());
+		for (int section = 0; section < chunk.getSectionCount(); section++)
+		{
+			sections[section].updateChunkMesh(&chunk, chunk.getSectionBox(section), mode, format);
+		}
+		return sections;
+	}
+
+	VmcChunkMesh::VmcChunkMesh(VmcDevice& device, const std::vector<VmcModel::Builder>& sectionBuilders, VmcModel::ChunkMeshMode mode, VmcModel::VertexFormat format) :
+		meshMode{ mode }, vertexFormat{ format }
+	{
+		// All sections back to back, the indices of every section stay relative to its first vertex
+		VmcModel::Builder builder{};
+		builder.minX = builder.minY = builder.minZ = std::numeric_limits<float>::max();
+		builder.maxX = builder.maxY = builder.maxZ = std::numeric_limits<float>::lowest();
+		sections.resize(sectionBuilders.size());
+		for (size_t i = 0; i < sectionBuilders.size(); i++)
+		{
+			const VmcModel::Builder& section = sectionBuilders[i];
+			sections[i].vertices = { builder.getVertexCount(), section.getVertexCount() };
+			sections[i].indices = { static_cast<uint32_t>(builder.indices.size()), static_cast<uint32_t>(section.indices.size()) };
+			builder.vertices.insert(builder.vertices.end(), section.vertices.begin(), section.vertices.end());
+			builder.voxelVertices.insert(builder.voxelVertices.end(), section.voxelVertices.begin(), section.voxelVertices.end());
+			builder.indices.insert(builder.indices.end(), section.indices.begin(), section.indices.end());
+
+			// Sections cover their whole box even when they are empty, so these are the bounds of the chunk
+			builder.minX = std::min(builder.minX, section.minX);
+			builder.maxX = std::max(builder.maxX, section.maxX);
+			builder.minY = std::min(builder.minY, section.minY);
+			builder.maxY = std::max(builder.maxY, section.maxY);
+			builder.minZ = std::min(builder.minZ, section.minZ);
+			builder.maxZ = std::max(builder.maxZ, section.maxZ);
+		}
+
+		const uint32_t vertexCount = builder.getVertexCount();
+		const uint32_t indexCount = static_cast<uint32_t>(builder.indices.size());
+		const uint32_t spareVertices = std::max(static_cast<uint32_t>(vertexCount * SPARE_CAPACITY), MIN_SPARE_QUADS * 4);
+		const uint32_t spareIndices = std::max(static_cast<uint32_t>(indexCount * SPARE_CAPACITY), MIN_SPARE_QUADS * 6);
+		model = std::make_unique<VmcModel>(device, builder, vertexCount + spareVertices, indexCount + spareIndices, vertexFormat);
+		freeVertices.release({ vertexCount, spareVertices });
+		freeIndices.release({ indexCount, spareIndices });
+		updateDrawRanges();
+	}
+
+	bool VmcChunkMesh::update(ChunkComponent& chunk, uint64_t frame)
+	{
+		assert(chunk.getSectionCount() == static_cast<int>(sections.size()) && "Mesh of another chunk");
+
+		// Frames in flight may still draw a retired range
+		retiredSections.erase(std::remove_if(retiredSections.begin(), retiredSections.end(), [&](const RetiredSection& retired) {
+			if (frame - retired.retireFrame <= VmcSwapChain::MAX_FRAMES_IN_FLIGHT) return false;
+			releaseSection(retired.section);
+			return true;
+		}), retiredSections.end());
+
+		if (!chunk.hasDirtySections()) return true;
+
+		dirtySections.clear();
+		chunk.takeDirtySections(dirtySections);
+		for (int index : dirtySections)
+		{
+			sectionBuilder.updateChunkMesh(&chunk, chunk.getSectionBox(index), meshMode, vertexFormat);
+			const uint32_t vertexCount = sectionBuilder.getVertexCount();
+			const uint32_t indexCount = static_cast<uint32_t>(sectionBuilder.indices.size());
+
+			Section section{};
+			section.vertices.first = sections[index].vertices.first;
+			section.indices.first = sections[index].indices.first;
+			if (vertexCount > 0)
+			{
+				if (!freeVertices.allocate(vertexCount, section.vertices)) return false;
+				if (!freeIndices.allocate(indexCount, section.indices))
+				{
+					freeVertices.release(section.vertices);
+					return false;
+				}
+				if (vertexFormat == VmcModel::VERTEX_FORMAT_VOXEL)
+					model->writeVertices(section.vertices.first, sectionBuilder.voxelVertices.data(), vertexCount);
+				else
+					model->writeVertices(section.vertices.first, sectionBuilder.vertices.data(), vertexCount);
+				model->writeIndices(section.indices.first, sectionBuilder.indices.data(), indexCount);
+			}
+
+			retiredSections.push_back({ sections[index], frame });
+			sections[index] = section;
+		}
+		updateDrawRanges();
+		return true;
+	}
+
+	void VmcChunkMesh::releaseSection(const Section& section)
+	{
+		if (section.vertices.count > 0) freeVertices.release(section.vertices);
+		if (section.indices.count > 0) freeIndices.release(section.indices);
+	}
+
+	void VmcChunkMesh::updateDrawRanges()
+	{
+		std::vector<VmcModel::DrawRange> ranges;
+		for (const Section& section : sections)
+		{
+			if (section.indices.count == 0) continue;
+			ranges.push_back({ section.indices.first, section.indices.count, static_cast<int32_t>(section.vertices.first) });
+		}
+		drawRangeCount = static_cast<uint32_t>(ranges.size());
+		model->setDrawRanges(std::move(ranges));
+	}
+
+	void VmcChunkMesh::FreeList::release(Range range)
+	{
+		auto next = std::lower_bound(ranges.begin(), ranges.end(), range.first, [](const Range& a, uint32_t first) { return a.first < first; });
+		if (next != ranges.begin())
+		{
+			auto previous = next - 1;
+			assert(previous->first + previous->count <= range.first && "Range released twice");
+			if (previous->first + previous->count == range.first)
+			{
+				previous->count += range.count;
+				if (next != ranges.end() && previous->first + previous->count == next->first)
+				{
+					previous->count += next->count;
+					ranges.erase(next);
+				}
+				return;
+			}
+		}
+		if (next != ranges.end() && range.first + range.count == next->first)
+		{
+			next->first = range.first;
+			next->count += range.count;
+			return;
+		}
+		ranges.insert(next, range);
+	}
+
+	bool VmcChunkMesh::FreeList::allocate(uint32_t count, Range& range)
+	{
+		for (auto it = ranges.begin(); it != ranges.end(); ++it)
+		{
+			if (it->count < count) continue;
+			range = { it->first, count };
+			it->first += count;
+			it->count -= count;
+			if (it->count == 0) ranges.erase(it);
+			return true;
+		}
+		return false;
+	}
+}
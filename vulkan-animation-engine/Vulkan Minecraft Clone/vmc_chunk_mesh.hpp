@@ -0,0 +1,87 @@
+#pragma once
+#include "vmc_device.hpp"
+#include "vmc_model.hpp"
+#include "chunk_component.hpp"
+
+// std
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace vae {
+	/*
+		Mesh of a chunk whose sections (see ChunkComponent) are remeshed on their own when blocks are edited. Every section
+		owns a range of the vertex buffer and a range of the index buffer of one model and is drawn as its own draw range,
+		with indices relative to its first vertex. A remeshed section is written into free ranges, its old ranges only
+		become free again once no frame in flight can draw them anymore, so the GPU never reads a range while it is being
+		overwritten. The buffers are created with spare room for this. Once an edit doesn't fit anymore the whole chunk has
+		to be meshed again.
+	*/
+	class VmcChunkMesh
+	{
+	public:
+		// Spare room relative to the initial mesh, but at least MIN_SPARE_QUADS quads
+		static constexpr float SPARE_CAPACITY = 0.5f;
+		static constexpr uint32_t MIN_SPARE_QUADS = 512;
+
+		// Meshes every section of the chunk, can run on worker threads. format is VERTEX_FORMAT_VOXEL or VERTEX_FORMAT_FULL.
+		static std::vector<VmcModel::Builder> meshSections(const ChunkComponent& chunk, VmcModel::ChunkMeshMode mode = VmcModel::CHUNK_MESH_GREEDY,
+			VmcModel::VertexFormat format = VmcModel::VERTEX_FORMAT_VOXEL);
+
+		// sections as returned by meshSections, edited sections are remeshed with the same mode and format
+		VmcChunkMesh(VmcDevice& device, const std::vector<VmcModel::Builder>& sections, VmcModel::ChunkMeshMode mode = VmcModel::CHUNK_MESH_GREEDY,
+			VmcModel::VertexFormat format = VmcModel::VERTEX_FORMAT_VOXEL);
+
+		VmcChunkMesh(const VmcChunkMesh&) = delete;
+		VmcChunkMesh& operator=(const VmcChunkMesh&) = delete;
+
+		// Call once per frame. Remeshes the dirty sections of the chunk and frees the ranges that frames in flight no
+		// longer use. Returns false when the new sections don't fit, the mesh has to be replaced by a new one then.
+		bool update(ChunkComponent& chunk, uint64_t frame);
+
+		VmcModel* getModel() const { return model.get(); };
+		bool isEmpty() const { return drawRangeCount == 0; };
+
+	private:
+		struct Range {
+			uint32_t first;
+			uint32_t count;
+		};
+
+		// Free parts of a buffer, sorted by first and merged with their neighbours
+		class FreeList {
+		public:
+			void release(Range range);
+			// First fit, false when no free range is large enough
+			bool allocate(uint32_t count, Range& range);
+		private:
+			std::vector<Range> ranges;
+		};
+
+		struct Section {
+			Range vertices{ 0, 0 };
+			Range indices{ 0, 0 };
+		};
+
+		struct RetiredSection {
+			Section section;
+			uint64_t retireFrame;
+		};
+
+		void releaseSection(const Section& section);
+		void updateDrawRanges();
+
+		VmcModel::ChunkMeshMode meshMode;
+		VmcModel::VertexFormat vertexFormat;
+		std::unique_ptr<VmcModel> model;
+		std::vector<Section> sections;
+		std::vector<RetiredSection> retiredSections;
+		FreeList freeVertices;
+		FreeList freeIndices;
+		uint32_t drawRangeCount = 0;
+
+		// Kept between updates so remeshing a section doesn't allocate
+		VmcModel::Builder sectionBuilder{};
+		std::vector<int> dirtySections;
+	};
+}
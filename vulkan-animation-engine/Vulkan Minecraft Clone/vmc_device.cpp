@@ -2,6 +2,8 @@
 
 // std headers
 #include <cstring>
+#include <filesystem>
+#include <fstream>
 #include <iostream>
 #include <set>
 #include <unordered_set>
@@ -47,16 +49,37 @@ void DestroyDebugUtilsMessengerEXT(
 }
 
 // class member functions
-VmcDevice::VmcDevice(VmcWindow &window) : window{window} {
+VmcDevice::VmcDevice(VmcWindow &window) : window{&window} {
   createInstance();
   setupDebugMessenger();
   createSurface();
   pickPhysicalDevice();
   createLogicalDevice();
+  allocator = std::make_unique<VmcMemoryAllocator>(device_, physicalDevice);
   createCommandPool();
+  createPipelineCache();
+  uploadQueue = std::make_unique<VmcUploadQueue>(*this);
+}
+
+VmcDevice::VmcDevice() {
+  // Nothing is presented, so the swap chain extension is not required
+  deviceExtensions.clear();
+
+  createInstance();
+  setupDebugMessenger();
+  pickPhysicalDevice();
+  createLogicalDevice();
+  allocator = std::make_unique<VmcMemoryAllocator>(device_, physicalDevice);
+  createCommandPool();
+  createPipelineCache();
+  uploadQueue = std::make_unique<VmcUploadQueue>(*this);
 }
 
 VmcDevice::~VmcDevice() {
+  uploadQueue.reset();
+  savePipelineCache();
+  vkDestroyPipelineCache(device_, pipelineCache, nullptr);
+  allocator.reset();
   vkDestroyCommandPool(device_, commandPool, nullptr);
   vkDestroyDevice(device_, nullptr);
 
@@ -64,7 +87,9 @@ VmcDevice::~VmcDevice() {
     DestroyDebugUtilsMessengerEXT(instance, debugMessenger, nullptr);
   }
 
-  vkDestroySurfaceKHR(instance, surface_, nullptr);
+  if (surface_ != VK_NULL_HANDLE) {
+    vkDestroySurfaceKHR(instance, surface_, nullptr);
+  }
   vkDestroyInstance(instance, nullptr);
 }
 
@@ -138,6 +163,9 @@ void VmcDevice::createLogicalDevice() {
 
   std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
   std::set<uint32_t> uniqueQueueFamilies = {indices.graphicsFamily, indices.presentFamily};
+  if (indices.transferFamilyHasValue) {
+    uniqueQueueFamilies.insert(indices.transferFamily);
+  }
 
   float queuePriority = 1.0f;
   for (uint32_t queueFamily : uniqueQueueFamilies) {
@@ -177,6 +205,9 @@ void VmcDevice::createLogicalDevice() {
 
   vkGetDeviceQueue(device_, indices.graphicsFamily, 0, &graphicsQueue_);
   vkGetDeviceQueue(device_, indices.presentFamily, 0, &presentQueue_);
+  if (indices.transferFamilyHasValue) {
+    vkGetDeviceQueue(device_, indices.transferFamily, 0, &transferQueue_);
+  }
 }
 
 void VmcDevice::createCommandPool() {
@@ -195,15 +226,77 @@ void VmcDevice::createCommandPool() {
 
 
 
-void VmcDevice::createSurface() { window.createWindowSurface(instance, &surface_); }
+void VmcDevice::createPipelineCache() {
+  std::vector<char> cacheData = loadPipelineCacheData();
+  pipelineCacheWarm = !cacheData.empty();
+
+  VkPipelineCacheCreateInfo cacheInfo = {};
+  cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+  cacheInfo.initialDataSize = cacheData.size();
+  cacheInfo.pInitialData = cacheData.empty() ? nullptr : cacheData.data();
+
+  if (vkCreatePipelineCache(device_, &cacheInfo, nullptr, &pipelineCache) != VK_SUCCESS) {
+    throw std::runtime_error("failed to create pipeline cache!");
+  }
+}
+
+// Returns the cached data, or nothing when the file is missing or was written by another driver or GPU
+std::vector<char> VmcDevice::loadPipelineCacheData() {
+  std::ifstream file{PIPELINE_CACHE_FILE, std::ios::ate | std::ios::binary};
+  if (!file.is_open()) {
+    return {};
+  }
+
+  size_t fileSize = static_cast<size_t>(file.tellg());
+  if (fileSize < sizeof(VkPipelineCacheHeaderVersionOne)) {
+    return {};
+  }
+  std::vector<char> data(fileSize);
+  file.seekg(0);
+  file.read(data.data(), fileSize);
+
+  VkPipelineCacheHeaderVersionOne header;
+  memcpy(&header, data.data(), sizeof(header));
+  if (header.headerSize < sizeof(header) ||
+      header.headerVersion != VK_PIPELINE_CACHE_HEADER_VERSION_ONE ||
+      header.vendorID != properties.vendorID || header.deviceID != properties.deviceID ||
+      memcmp(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE) != 0) {
+    std::cout << "Pipeline cache does not match this device, rebuilding it" << std::endl;
+    return {};
+  }
+  return data;
+}
+
+void VmcDevice::savePipelineCache() {
+  size_t dataSize = 0;
+  if (vkGetPipelineCacheData(device_, pipelineCache, &dataSize, nullptr) != VK_SUCCESS || dataSize == 0) {
+    return;
+  }
+  std::vector<char> data(dataSize);
+  if (vkGetPipelineCacheData(device_, pipelineCache, &dataSize, data.data()) != VK_SUCCESS) {
+    return;
+  }
+
+  std::filesystem::path cachePath{PIPELINE_CACHE_FILE};
+  std::error_code error;
+  std::filesystem::create_directories(cachePath.parent_path(), error);
+  std::ofstream file{cachePath, std::ios::binary};
+  if (!file.is_open()) {
+    std::cout << "Unable to write pipeline cache to " << PIPELINE_CACHE_FILE << std::endl;
+    return;
+  }
+  file.write(data.data(), dataSize);
+}
+
+void VmcDevice::createSurface() { window->createWindowSurface(instance, &surface_); }
 
 bool VmcDevice::isDeviceSuitable(VkPhysicalDevice device) {
   QueueFamilyIndices indices = findQueueFamilies(device);
 
   bool extensionsSupported = checkDeviceExtensionSupport(device);
 
-  bool swapChainAdequate = false;
-  if (extensionsSupported) {
+  bool swapChainAdequate = isHeadless();
+  if (extensionsSupported && !isHeadless()) {
     SwapChainSupportDetails swapChainSupport = querySwapChainSupport(device);
     swapChainAdequate = !swapChainSupport.formats.empty() && !swapChainSupport.presentModes.empty();
   }
@@ -263,11 +356,13 @@ bool VmcDevice::checkValidationLayerSupport() {
 }
 
 std::vector<const char *> VmcDevice::getRequiredExtensions() {
-  uint32_t glfwExtensionCount = 0;
-  const char **glfwExtensions;
-  glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
-
-  std::vector<const char *> extensions(glfwExtensions, glfwExtensions + glfwExtensionCount);
+  std::vector<const char *> extensions;
+  if (!isHeadless()) {
+    uint32_t glfwExtensionCount = 0;
+    const char **glfwExtensions;
+    glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+    extensions.assign(glfwExtensions, glfwExtensions + glfwExtensionCount);
+  }
 
   if (enableValidationLayers) {
     extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
@@ -335,7 +430,12 @@ QueueFamilyIndices VmcDevice::findQueueFamilies(VkPhysicalDevice device) {
       indices.graphicsFamilyHasValue = true;
     }
     VkBool32 presentSupport = false;
-    vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface_, &presentSupport);
+    if (isHeadless()) {
+      // No presentation, the graphics family doubles as present family
+      presentSupport = (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) ? VK_TRUE : VK_FALSE;
+    } else {
+      vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface_, &presentSupport);
+    }
     if (queueFamily.queueCount > 0 && presentSupport) {
       indices.presentFamily = i;
       indices.presentFamilyHasValue = true;
@@ -347,6 +447,17 @@ QueueFamilyIndices VmcDevice::findQueueFamilies(VkPhysicalDevice device) {
     i++;
   }
 
+  // A family that can transfer but not draw usually maps to a separate DMA engine
+  for (uint32_t family = 0; family < queueFamilyCount; family++) {
+    VkQueueFlags flags = queueFamilies[family].queueFlags;
+    if (queueFamilies[family].queueCount > 0 && (flags & VK_QUEUE_TRANSFER_BIT) &&
+        !(flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT))) {
+      indices.transferFamily = family;
+      indices.transferFamilyHasValue = true;
+      break;
+    }
+  }
+
   return indices;
 }
 
@@ -436,6 +547,34 @@ void VmcDevice::createBuffer(
   vkBindBufferMemory(device_, buffer, bufferMemory, 0);
 }
 
+void VmcDevice::createBuffer(
+    VkDeviceSize size,
+    VkBufferUsageFlags usage,
+    VkMemoryPropertyFlags properties,
+    VkBuffer &buffer,
+    VmcAllocation &allocation) {
+  VkBufferCreateInfo bufferInfo{};
+  bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+  bufferInfo.size = size;
+  bufferInfo.usage = usage;
+  bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+  if (vkCreateBuffer(device_, &bufferInfo, nullptr, &buffer) != VK_SUCCESS) {
+    throw std::runtime_error("failed to create buffer!");
+  }
+
+  VkMemoryRequirements memRequirements;
+  vkGetBufferMemoryRequirements(device_, buffer, &memRequirements);
+
+  allocation = allocator->allocate(memRequirements, properties, VmcMemoryAllocator::RESOURCE_LINEAR);
+  vkBindBufferMemory(device_, buffer, allocation.memory, allocation.offset);
+}
+
+void VmcDevice::destroyBuffer(VkBuffer buffer, VmcAllocation &allocation) {
+  vkDestroyBuffer(device_, buffer, nullptr);
+  allocator->free(allocation);
+}
+
 VkCommandBuffer VmcDevice::beginSingleTimeCommands() {
   VkCommandBufferAllocateInfo allocInfo{};
   allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
@@ -533,6 +672,32 @@ void VmcDevice::createImageWithInfo(
   }
 }
 
+void VmcDevice::createImageWithInfo(
+    const VkImageCreateInfo &imageInfo,
+    VkMemoryPropertyFlags properties,
+    VkImage &image,
+    VmcAllocation &allocation) {
+  if (vkCreateImage(device_, &imageInfo, nullptr, &image) != VK_SUCCESS) {
+    throw std::runtime_error("failed to create image!");
+  }
+
+  VkMemoryRequirements memRequirements;
+  vkGetImageMemoryRequirements(device_, image, &memRequirements);
+
+  auto kind = imageInfo.tiling == VK_IMAGE_TILING_OPTIMAL ? VmcMemoryAllocator::RESOURCE_OPTIMAL
+                                                          : VmcMemoryAllocator::RESOURCE_LINEAR;
+  allocation = allocator->allocate(memRequirements, properties, kind);
+
+  if (vkBindImageMemory(device_, image, allocation.memory, allocation.offset) != VK_SUCCESS) {
+    throw std::runtime_error("failed to bind image memory!");
+  }
+}
+
+void VmcDevice::destroyImage(VkImage image, VmcAllocation &allocation) {
+  vkDestroyImage(device_, image, nullptr);
+  allocator->free(allocation);
+}
+
 void VmcDevice::transitionImageLayout(VkImage image,
     VkImageLayout oldLayout,
     VkImageLayout newLayout,
@@ -1,8 +1,11 @@
 #pragma once
 
 #include "vmc_window.hpp"
+#include "vmc_memory_allocator.hpp"
+#include "vmc_upload_queue.hpp"
 
 // std lib headers
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -17,13 +20,17 @@ namespace vae {
     struct QueueFamilyIndices {
       uint32_t graphicsFamily;
       uint32_t presentFamily;
+      uint32_t transferFamily;  // Transfer-only family, used for uploads when present
       bool graphicsFamilyHasValue = false;
       bool presentFamilyHasValue = false;
+      bool transferFamilyHasValue = false;
       bool isComplete() { return graphicsFamilyHasValue && presentFamilyHasValue; }
     };
 
     class VmcDevice {
      public:
+      static constexpr const char *PIPELINE_CACHE_FILE = "../Cache/pipeline_cache.bin";
+
     #ifdef NDEBUG
       const bool enableValidationLayers = false;
     #else
@@ -31,6 +38,8 @@ namespace vae {
     #endif
 
       VmcDevice(VmcWindow &window);
+      // Headless device: no window, surface or swap chain extension, for offscreen rendering only
+      VmcDevice();
       ~VmcDevice();
 
       // Not copyable or movable
@@ -42,8 +51,15 @@ namespace vae {
       VkSurfaceKHR surface() { return surface_; }
       VkQueue graphicsQueue() { return graphicsQueue_; }
       VkQueue presentQueue() { return presentQueue_; }
+      VkQueue transferQueue() { return transferQueue_; }
       VkInstance getInstance() { return instance; }
       VkPhysicalDevice getPhysicalDevice() { return physicalDevice; }
+      VkPipelineCache getPipelineCache() { return pipelineCache; }
+      VmcMemoryAllocator &getAllocator() { return *allocator; }
+      VmcUploadQueue &getUploadQueue() { return *uploadQueue; }
+      // True when the pipeline cache was loaded from disk and matches this device
+      bool isPipelineCacheWarm() const { return pipelineCacheWarm; }
+      bool isHeadless() const { return window == nullptr; }
 
       SwapChainSupportDetails getSwapChainSupport() { return querySwapChainSupport(physicalDevice); }
       uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties);
@@ -58,6 +74,14 @@ namespace vae {
           VkMemoryPropertyFlags properties,
           VkBuffer &buffer,
           VkDeviceMemory &bufferMemory);
+      // Same as above, but sub-allocated from the memory allocator
+      void createBuffer(
+          VkDeviceSize size,
+          VkBufferUsageFlags usage,
+          VkMemoryPropertyFlags properties,
+          VkBuffer &buffer,
+          VmcAllocation &allocation);
+      void destroyBuffer(VkBuffer buffer, VmcAllocation &allocation);
       VkCommandBuffer beginSingleTimeCommands();
       void endSingleTimeCommands(VkCommandBuffer commandBuffer);
       void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size);
@@ -69,6 +93,12 @@ namespace vae {
           VkMemoryPropertyFlags properties,
           VkImage &image,
           VkDeviceMemory &imageMemory);
+      void createImageWithInfo(
+          const VkImageCreateInfo &imageInfo,
+          VkMemoryPropertyFlags properties,
+          VkImage &image,
+          VmcAllocation &allocation);
+      void destroyImage(VkImage image, VmcAllocation &allocation);
 
       void transitionImageLayout(VkImage image, 
           VkImageLayout oldLayout, 
@@ -88,6 +118,9 @@ namespace vae {
       void pickPhysicalDevice();
       void createLogicalDevice();
       void createCommandPool();
+      void createPipelineCache();
+      void savePipelineCache();
+      std::vector<char> loadPipelineCacheData();
 
       // helper functions
       bool isDeviceSuitable(VkPhysicalDevice device);
@@ -102,16 +135,21 @@ namespace vae {
       VkInstance instance;
       VkDebugUtilsMessengerEXT debugMessenger;
       VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
-      VmcWindow &window;
+      VmcWindow *window = nullptr;
       VkCommandPool commandPool;
+      VkPipelineCache pipelineCache = VK_NULL_HANDLE;
+      std::unique_ptr<VmcMemoryAllocator> allocator;
+      std::unique_ptr<VmcUploadQueue> uploadQueue;
+      bool pipelineCacheWarm = false;
 
       VkDevice device_;
-      VkSurfaceKHR surface_;
+      VkSurfaceKHR surface_ = VK_NULL_HANDLE;
       VkQueue graphicsQueue_;
       VkQueue presentQueue_;
+      VkQueue transferQueue_ = VK_NULL_HANDLE;
 
       std::vector<const char *> validationLayers = {"VK_LAYER_KHRONOS_validation", "VK_LAYER_LUNARG_monitor"};
-      const std::vector<const char *> deviceExtensions = {VK_KHR_SWAPCHAIN_EXTENSION_NAME};
+      std::vector<const char *> deviceExtensions = {VK_KHR_SWAPCHAIN_EXTENSION_NAME};
     };
 
 }  // namespace vmc
\ No newline at end of file
@@ -0,0 +1,277 @@
+#include "vmc_frame_capture.hpp"
+#include "vmc_image_writer.hpp"
+
+// std
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+
+namespace vae {
+
+	VmcFrameCapture::VmcFrameCapture(VmcDevice& device, VkExtent2D extent, VkFormat imageFormat, VmcCaptureFormat captureFormat,
+		const std::string& outputPath, float framesPerSecond, uint32_t ringSize)
+		: vmcDevice{ device }, extent{ extent }, captureFormat{ captureFormat }, outputPath{ outputPath }
+	{
+		assert(ringSize > 0 && "Frame capture needs at least one readback buffer!");
+		if (!supportsFormat(imageFormat))
+		{
+			throw std::runtime_error("Frame capture does not support the swap chain image format!");
+		}
+		swizzleBGRA = imageFormat == VK_FORMAT_B8G8R8A8_SRGB || imageFormat == VK_FORMAT_B8G8R8A8_UNORM;
+
+		if (captureFormat == CAPTURE_Y4M)
+		{
+			videoFile.open(outputPath, std::ios::binary);
+			if (!videoFile.is_open())
+			{
+				throw std::runtime_error("Failed to open video file for writing: " + outputPath);
+			}
+			uint32_t rate = static_cast<uint32_t>(std::lround(framesPerSecond * 1000.0f));
+			videoFile << "YUV4MPEG2 W" << extent.width << " H" << extent.height << " F" << rate << ":1000"
+				<< " Ip A1:1 C444 XCOLORRANGE=FULL\n";
+		}
+
+		VkDeviceSize size = static_cast<VkDeviceSize>(extent.width) * extent.height * 4;
+		VkFenceCreateInfo fenceInfo{};
+		fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+		slots.reserve(ringSize);
+		for (uint32_t i = 0; i < ringSize; i++)
+		{
+			auto slot = std::make_unique<ReadbackSlot>();
+			vmcDevice.createBuffer(
+				size,
+				VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+				slot->buffer,
+				slot->memory);
+			// Stays mapped for the lifetime of the capture, the writer thread reads straight from it
+			vkMapMemory(vmcDevice.device(), slot->memory, 0, size, 0, &slot->mapped);
+			if (vkCreateFence(vmcDevice.device(), &fenceInfo, nullptr, &slot->fence) != VK_SUCCESS)
+			{
+				throw std::runtime_error("failed to create frame capture fence!");
+			}
+			slots.push_back(std::move(slot));
+		}
+	}
+
+	VmcFrameCapture::~VmcFrameCapture()
+	{
+		// A copy that was recorded but whose fence was never submitted still has to be waited on before freeing
+		if (recordedSlot != nullptr)
+		{
+			submitFence();
+		}
+
+		// Finish everything that is still in flight, blocking is fine here
+		for (ReadbackSlot* slot : slotsInFlight)
+		{
+			vkWaitForFences(vmcDevice.device(), 1, &slot->fence, VK_TRUE, std::numeric_limits<uint64_t>::max());
+		}
+		collectFinishedFrames();
+
+		try
+		{
+			writer.wait();
+		}
+		catch (const std::exception& e)
+		{
+			std::cerr << "Frame capture failed: " << e.what() << '\n';
+		}
+
+		for (auto& slot : slots)
+		{
+			vkUnmapMemory(vmcDevice.device(), slot->memory);
+			vkDestroyBuffer(vmcDevice.device(), slot->buffer, nullptr);
+			vkFreeMemory(vmcDevice.device(), slot->memory, nullptr);
+			vkDestroyFence(vmcDevice.device(), slot->fence, nullptr);
+		}
+	}
+
+	bool VmcFrameCapture::supportsFormat(VkFormat imageFormat)
+	{
+		return imageFormat == VK_FORMAT_B8G8R8A8_SRGB || imageFormat == VK_FORMAT_B8G8R8A8_UNORM ||
+			imageFormat == VK_FORMAT_R8G8B8A8_SRGB || imageFormat == VK_FORMAT_R8G8B8A8_UNORM;
+	}
+
+	void VmcFrameCapture::collectFinishedFrames()
+	{
+		// Fences are submitted in capture order, so the first unfinished one ends the search
+		while (!slotsInFlight.empty() && vkGetFenceStatus(vmcDevice.device(), slotsInFlight.front()->fence) == VK_SUCCESS)
+		{
+			ReadbackSlot* slot = slotsInFlight.front();
+			slotsInFlight.pop_front();
+			slot->state = SLOT_WRITING;
+			writer.addJob([this, slot]() {
+				try
+				{
+					writeFrame(*slot);
+				}
+				catch (...)
+				{
+					slot->state = SLOT_FREE;
+					throw;
+				}
+				slot->state = SLOT_FREE;
+			});
+		}
+	}
+
+	bool VmcFrameCapture::recordCopy(VkCommandBuffer commandBuffer, VkImage image, VkImageLayout layout)
+	{
+		assert(recordedSlot == nullptr && "Previous capture was not followed by submitFence!");
+
+		auto freeSlot = std::find_if(slots.begin(), slots.end(),
+			[](const std::unique_ptr<ReadbackSlot>& slot) { return slot->state == SLOT_FREE; });
+		if (freeSlot == slots.end())
+		{
+			// Never wait for the GPU or the writer, just skip this frame
+			droppedFrames++;
+			return false;
+		}
+		ReadbackSlot* slot = freeSlot->get();
+
+		VkImageMemoryBarrier imageBarrier{};
+		imageBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		imageBarrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+		imageBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+		imageBarrier.oldLayout = layout;
+		imageBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+		imageBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		imageBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		imageBarrier.image = image;
+		imageBarrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		imageBarrier.subresourceRange.baseMipLevel = 0;
+		imageBarrier.subresourceRange.levelCount = 1;
+		imageBarrier.subresourceRange.baseArrayLayer = 0;
+		imageBarrier.subresourceRange.layerCount = 1;
+
+		vkCmdPipelineBarrier(commandBuffer,
+			VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+			0, 0, nullptr, 0, nullptr, 1, &imageBarrier);
+
+		VkBufferImageCopy region{};
+		region.bufferOffset = 0;
+		region.bufferRowLength = 0;
+		region.bufferImageHeight = 0;
+		region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		region.imageSubresource.mipLevel = 0;
+		region.imageSubresource.baseArrayLayer = 0;
+		region.imageSubresource.layerCount = 1;
+		region.imageOffset = { 0, 0, 0 };
+		region.imageExtent = { extent.width, extent.height, 1 };
+
+		vkCmdCopyImageToBuffer(commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, slot->buffer, 1, &region);
+
+		// Give the image back in the layout the caller expects, either to keep drawing into it or to present it
+		bool keepsDrawing = layout == VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+		VkPipelineStageFlags dstStage = keepsDrawing ? VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT : VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+		imageBarrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+		imageBarrier.dstAccessMask = keepsDrawing ? VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT : 0;
+		imageBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+		imageBarrier.newLayout = layout;
+
+		VkBufferMemoryBarrier bufferBarrier{};
+		bufferBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+		bufferBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		bufferBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+		bufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		bufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		bufferBarrier.buffer = slot->buffer;
+		bufferBarrier.offset = 0;
+		bufferBarrier.size = VK_WHOLE_SIZE;
+
+		vkCmdPipelineBarrier(commandBuffer,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, dstStage | VK_PIPELINE_STAGE_HOST_BIT,
+			0, 0, nullptr, 1, &bufferBarrier, 1, &imageBarrier);
+
+		slot->frameNumber = capturedFrames++;
+		slot->state = SLOT_RECORDED;
+		recordedSlot = slot;
+		return true;
+	}
+
+	void VmcFrameCapture::submitFence()
+	{
+		if (recordedSlot == nullptr)
+		{
+			return;
+		}
+
+		// An empty submission signals its fence once all previously submitted work on the queue is done
+		vkResetFences(vmcDevice.device(), 1, &recordedSlot->fence);
+		if (vkQueueSubmit(vmcDevice.graphicsQueue(), 0, nullptr, recordedSlot->fence) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to submit frame capture fence!");
+		}
+		recordedSlot->state = SLOT_IN_FLIGHT;
+		slotsInFlight.push_back(recordedSlot);
+		recordedSlot = nullptr;
+	}
+
+	void VmcFrameCapture::writeFrame(const ReadbackSlot& slot)
+	{
+		const uint8_t* pixels = static_cast<const uint8_t*>(slot.mapped);
+		if (captureFormat == CAPTURE_Y4M)
+		{
+			writeY4MFrame(pixels);
+			return;
+		}
+
+		size_t pixelCount = static_cast<size_t>(extent.width) * extent.height;
+		rgbaFrame.resize(pixelCount * 4);
+		for (size_t i = 0; i < pixelCount; i++)
+		{
+			const uint8_t* src = pixels + i * 4;
+			uint8_t* dst = rgbaFrame.data() + i * 4;
+			dst[0] = swizzleBGRA ? src[2] : src[0];
+			dst[1] = src[1];
+			dst[2] = swizzleBGRA ? src[0] : src[2];
+			dst[3] = 255;
+		}
+
+		char fileName[32];
+		std::snprintf(fileName, sizeof(fileName), "/frame_%05u.png", slot.frameNumber);
+		writeImagePNG(outputPath + fileName, extent.width, extent.height, rgbaFrame);
+	}
+
+	// Full range BT.601 conversion to planar 4:4:4, so no chroma subsampling is needed
+	void VmcFrameCapture::writeY4MFrame(const uint8_t* pixels)
+	{
+		size_t pixelCount = static_cast<size_t>(extent.width) * extent.height;
+		yuvFrame.resize(pixelCount * 3);
+		uint8_t* yPlane = yuvFrame.data();
+		uint8_t* uPlane = yPlane + pixelCount;
+		uint8_t* vPlane = uPlane + pixelCount;
+
+		int redOffset = swizzleBGRA ? 2 : 0;
+		int blueOffset = swizzleBGRA ? 0 : 2;
+		for (size_t i = 0; i < pixelCount; i++)
+		{
+			const uint8_t* src = pixels + i * 4;
+			int r = src[redOffset];
+			int g = src[1];
+			int b = src[blueOffset];
+
+			// 16.16 fixed point coefficients
+			int y = (19595 * r + 38470 * g + 7471 * b + 32768) >> 16;
+			int u = ((-11059 * r - 21709 * g + 32768 * b + 32768) >> 16) + 128;
+			int v = ((32768 * r - 27439 * g - 5329 * b + 32768) >> 16) + 128;
+
+			yPlane[i] = static_cast<uint8_t>(std::clamp(y, 0, 255));
+			uPlane[i] = static_cast<uint8_t>(std::clamp(u, 0, 255));
+			vPlane[i] = static_cast<uint8_t>(std::clamp(v, 0, 255));
+		}
+
+		videoFile << "FRAME\n";
+		videoFile.write(reinterpret_cast<const char*>(yuvFrame.data()), yuvFrame.size());
+		if (!videoFile)
+		{
+			throw std::runtime_error("Failed to write frame to video file: " + outputPath);
+		}
+	}
+}
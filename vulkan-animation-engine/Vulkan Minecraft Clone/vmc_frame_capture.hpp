@@ -0,0 +1,90 @@
+#pragma once
+#include "vmc_device.hpp"
+#include "vmc_thread_pool.hpp"
+
+// std
+#include <atomic>
+#include <deque>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace vae {
+	enum VmcCaptureFormat {
+		CAPTURE_Y4M,
+		CAPTURE_PNG_SEQUENCE
+	};
+
+	/*
+		Captures rendered frames without stalling the render loop.
+		Every captured frame is copied into one of a ring of host visible readback buffers. A few frames later,
+		once the fence submitted after that frame has signaled, the buffer is handed to a background thread that
+		encodes it (Y4M video or PNG sequence) and frees it again. When all buffers are still busy the frame is dropped.
+	*/
+	class VmcFrameCapture
+	{
+	public:
+		static constexpr uint32_t DEFAULT_RING_SIZE = 4;
+
+		VmcFrameCapture(VmcDevice& device, VkExtent2D extent, VkFormat imageFormat, VmcCaptureFormat captureFormat,
+			const std::string& outputPath, float framesPerSecond, uint32_t ringSize = DEFAULT_RING_SIZE);
+		~VmcFrameCapture();
+
+		VmcFrameCapture(const VmcFrameCapture&) = delete;
+		VmcFrameCapture& operator=(const VmcFrameCapture&) = delete;
+
+		static bool supportsFormat(VkFormat imageFormat);
+
+		VkExtent2D getExtent() const { return extent; };
+		uint32_t getCapturedFrameCount() const { return capturedFrames; };
+		uint32_t getDroppedFrameCount() const { return droppedFrames; };
+
+		// Call once per frame before recording: hands every readback that finished on the GPU to the writer thread
+		void collectFinishedFrames();
+		// Records the copy of image (currently in layout, which it is returned to) into a free readback buffer
+		bool recordCopy(VkCommandBuffer commandBuffer, VkImage image, VkImageLayout layout);
+		// Call after the command buffer containing the copy has been submitted
+		void submitFence();
+
+	private:
+		enum SlotState {
+			SLOT_FREE,
+			SLOT_RECORDED,
+			SLOT_IN_FLIGHT,
+			SLOT_WRITING
+		};
+
+		struct ReadbackSlot {
+			VkBuffer buffer;
+			VkDeviceMemory memory;
+			void* mapped;
+			VkFence fence;
+			uint32_t frameNumber;
+			std::atomic<SlotState> state{ SLOT_FREE };
+		};
+
+		void writeFrame(const ReadbackSlot& slot);
+		void writeY4MFrame(const uint8_t* pixels);
+
+		VmcDevice& vmcDevice;
+		VkExtent2D extent;
+		VmcCaptureFormat captureFormat;
+		std::string outputPath;
+		bool swizzleBGRA;
+
+		std::vector<std::unique_ptr<ReadbackSlot>> slots;
+		std::deque<ReadbackSlot*> slotsInFlight;
+		ReadbackSlot* recordedSlot = nullptr;
+		uint32_t capturedFrames = 0;
+		uint32_t droppedFrames = 0;
+
+		// Only touched by the writer thread
+		std::ofstream videoFile;
+		std::vector<uint8_t> rgbaFrame;
+		std::vector<uint8_t> yuvFrame;
+
+		// Single worker, so frames are written in the order they were captured
+		VmcThreadPool writer{ 1 };
+	};
+}
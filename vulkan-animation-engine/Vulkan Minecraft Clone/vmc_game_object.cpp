@@ -71,6 +71,30 @@ namespace vae {
         };
     }
 
+    glm::quat TransformComponent::quaternionFromRotation(const glm::vec3& rotation)
+    {
+        return glm::angleAxis(rotation.y, glm::vec3{ 0.f, 1.f, 0.f })
+            * glm::angleAxis(rotation.x, glm::vec3{ 1.f, 0.f, 0.f })
+            * glm::angleAxis(rotation.z, glm::vec3{ 0.f, 0.f, 1.f });
+    }
+
+    /**
+    Inverse of the rotation part of mat4(): m[2][1] = -s2, m[0][1] = c2 * s3 and m[1][1] = c2 * c3 (so their length is c2),
+    m[2][0] / m[2][2] = s1 / c1 and m[0][1] / m[1][1] = s3 / c3.
+    When c2 is 0 (gimbal lock) only y + z or y - z are defined, rotation.z is 0 then.
+    */
+    glm::vec3 TransformComponent::rotationFromQuaternion(const glm::quat& quaternion)
+    {
+        const glm::mat3 m = glm::mat3_cast(quaternion);
+        const float c2 = glm::sqrt(m[0][1] * m[0][1] + m[1][1] * m[1][1]);
+        const float x = glm::atan(-m[2][1], c2);
+        if (c2 > 1e-6f)
+        {
+            return { x, glm::atan(m[2][0], m[2][2]), glm::atan(m[0][1], m[1][1]) };
+        }
+        return { x, glm::atan(-m[0][2], m[0][0]), 0.f };
+    }
+
     void VmcGameObject::setPosition(glm::vec3 newPosition)
     {
         glm::vec3 transVec = newPosition - prevPos;
@@ -5,6 +5,7 @@
 
 // libs
 #include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
 
 // std 
 #include <memory>
@@ -22,6 +23,10 @@ namespace vae {
 
         glm::mat4 mat4();
         glm::mat3 normalMatrix();
+
+        // Conversions between a rotation and the euler angles of mat4() (rotation.y * rotation.x * rotation.z)
+        static glm::quat quaternionFromRotation(const glm::vec3& rotation);
+        static glm::vec3 rotationFromQuaternion(const glm::quat& quaternion);
     };
      
     class VmcGameObject {
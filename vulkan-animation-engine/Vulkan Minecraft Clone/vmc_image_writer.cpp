@@ -0,0 +1,156 @@
+#include "vmc_image_writer.hpp"
+
+// std
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <fstream>
+#include <stdexcept>
+
+namespace vae {
+
+	namespace {
+		// Largest payload of a stored (uncompressed) deflate block
+		constexpr uint32_t MAX_STORED_BLOCK_SIZE = 65535;
+
+		const std::array<uint32_t, 256>& crcTable()
+		{
+			static const std::array<uint32_t, 256> table = []() {
+				std::array<uint32_t, 256> t{};
+				for (uint32_t n = 0; n < 256; n++)
+				{
+					uint32_t c = n;
+					for (int k = 0; k < 8; k++)
+					{
+						c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+					}
+					t[n] = c;
+				}
+				return t;
+			}();
+			return table;
+		}
+
+		uint32_t updateCrc(uint32_t crc, const uint8_t* data, size_t size)
+		{
+			const auto& table = crcTable();
+			for (size_t i = 0; i < size; i++)
+			{
+				crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+			}
+			return crc;
+		}
+
+		void appendBigEndian(std::vector<uint8_t>& out, uint32_t value)
+		{
+			out.push_back(static_cast<uint8_t>(value >> 24));
+			out.push_back(static_cast<uint8_t>(value >> 16));
+			out.push_back(static_cast<uint8_t>(value >> 8));
+			out.push_back(static_cast<uint8_t>(value));
+		}
+
+		void appendChunk(std::vector<uint8_t>& out, const char* type, const std::vector<uint8_t>& data)
+		{
+			appendBigEndian(out, static_cast<uint32_t>(data.size()));
+			size_t typeStart = out.size();
+			out.insert(out.end(), type, type + 4);
+			out.insert(out.end(), data.begin(), data.end());
+			uint32_t crc = updateCrc(0xFFFFFFFFu, out.data() + typeStart, out.size() - typeStart) ^ 0xFFFFFFFFu;
+			appendBigEndian(out, crc);
+		}
+
+		void writeFile(const std::string& path, const uint8_t* data, size_t size)
+		{
+			std::ofstream file{ path, std::ios::binary };
+			if (!file.is_open())
+			{
+				throw std::runtime_error("Failed to open image file for writing: " + path);
+			}
+			file.write(reinterpret_cast<const char*>(data), size);
+		}
+	}
+
+	void writeImagePNG(const std::string& path, uint32_t width, uint32_t height, const std::vector<uint8_t>& rgba)
+	{
+		assert(rgba.size() >= static_cast<size_t>(width) * height * 4 && "Not enough pixel data for the image size!");
+
+		// Scanlines prefixed with filter type 0 (none)
+		size_t rowSize = static_cast<size_t>(width) * 4;
+		std::vector<uint8_t> scanlines;
+		scanlines.reserve((rowSize + 1) * height);
+		for (uint32_t y = 0; y < height; y++)
+		{
+			scanlines.push_back(0);
+			scanlines.insert(scanlines.end(), rgba.begin() + y * rowSize, rgba.begin() + (y + 1) * rowSize);
+		}
+
+		// zlib stream made of stored deflate blocks
+		std::vector<uint8_t> zlib;
+		zlib.reserve(scanlines.size() + (scanlines.size() / MAX_STORED_BLOCK_SIZE + 1) * 5 + 6);
+		zlib.push_back(0x78);
+		zlib.push_back(0x01);
+		size_t offset = 0;
+		do
+		{
+			uint32_t blockSize = static_cast<uint32_t>(std::min<size_t>(MAX_STORED_BLOCK_SIZE, scanlines.size() - offset));
+			bool lastBlock = offset + blockSize == scanlines.size();
+			zlib.push_back(lastBlock ? 1 : 0);
+			zlib.push_back(static_cast<uint8_t>(blockSize));
+			zlib.push_back(static_cast<uint8_t>(blockSize >> 8));
+			zlib.push_back(static_cast<uint8_t>(~blockSize));
+			zlib.push_back(static_cast<uint8_t>(~blockSize >> 8));
+			zlib.insert(zlib.end(), scanlines.begin() + offset, scanlines.begin() + offset + blockSize);
+			offset += blockSize;
+		} while (offset < scanlines.size());
+
+		uint32_t a = 1;
+		uint32_t b = 0;
+		for (uint8_t byte : scanlines)
+		{
+			a = (a + byte) % 65521;
+			b = (b + a) % 65521;
+		}
+		appendBigEndian(zlib, (b << 16) | a);
+
+		std::vector<uint8_t> header;
+		appendBigEndian(header, width);
+		appendBigEndian(header, height);
+		header.push_back(8);	// bit depth
+		header.push_back(6);	// color type RGBA
+		header.push_back(0);	// compression
+		header.push_back(0);	// filter
+		header.push_back(0);	// no interlace
+
+		std::vector<uint8_t> png = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+		png.reserve(zlib.size() + 64);
+		appendChunk(png, "IHDR", header);
+		appendChunk(png, "IDAT", zlib);
+		appendChunk(png, "IEND", {});
+
+		writeFile(path, png.data(), png.size());
+	}
+
+	void writeImageRaw(const std::string& path, uint32_t width, uint32_t height, const std::vector<uint8_t>& rgba)
+	{
+		assert(rgba.size() >= static_cast<size_t>(width) * height * 4 && "Not enough pixel data for the image size!");
+		writeFile(path, rgba.data(), static_cast<size_t>(width) * height * 4);
+	}
+
+	void writeImage(const std::string& path, VmcImageFileFormat format, uint32_t width, uint32_t height, const std::vector<uint8_t>& rgba)
+	{
+		switch (format)
+		{
+		case IMAGE_PNG:
+			writeImagePNG(path, width, height, rgba);
+			break;
+		case IMAGE_RAW:
+			writeImageRaw(path, width, height, rgba);
+			break;
+		}
+	}
+
+	const char* imageFileExtension(VmcImageFileFormat format)
+	{
+		return format == IMAGE_PNG ? ".png" : ".rgba";
+	}
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+// std
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace vae {
+	enum VmcImageFileFormat {
+		IMAGE_PNG,
+		IMAGE_RAW
+	};
+
+	// Writers for tightly packed 8-bit RGBA pixels (rows top to bottom).
+	// PNG files use uncompressed deflate blocks: writing stays cheap and needs no external library.
+	// RAW files contain the pixel bytes only, without a header.
+	void writeImagePNG(const std::string& path, uint32_t width, uint32_t height, const std::vector<uint8_t>& rgba);
+	void writeImageRaw(const std::string& path, uint32_t width, uint32_t height, const std::vector<uint8_t>& rgba);
+	void writeImage(const std::string& path, VmcImageFileFormat format, uint32_t width, uint32_t height, const std::vector<uint8_t>& rgba);
+
+	const char* imageFileExtension(VmcImageFileFormat format);
+}
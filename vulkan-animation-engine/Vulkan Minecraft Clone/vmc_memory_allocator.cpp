@@ -0,0 +1,349 @@
+#include "vmc_memory_allocator.hpp"
+
+// std
+#include <algorithm>
+#include <cassert>
+#include <iostream>
+#include <set>
+#include <stdexcept>
+
+namespace vae {
+
+	struct VmcMemoryBlock {
+		VkDeviceMemory memory = VK_NULL_HANDLE;
+		void* mapped = nullptr;
+		VkDeviceSize size = 0;
+		uint32_t poolIndex = 0;
+		// freeLists[level] holds the offsets of free nodes of size (size >> level), level 0 is the whole block
+		std::vector<std::set<VkDeviceSize>> freeLists;
+		VkDeviceSize usedBytes = 0;
+		uint32_t allocationCount = 0;
+
+		VkDeviceSize nodeSize(uint32_t level) const { return size >> level; }
+		bool allocate(uint32_t level, VkDeviceSize& offset);
+		void free(uint32_t level, VkDeviceSize offset);
+		VkDeviceSize largestFreeNode() const;
+	};
+
+	namespace {
+		VkDeviceSize nextPowerOfTwo(VkDeviceSize value)
+		{
+			VkDeviceSize power = 1;
+			while (power < value)
+				power <<= 1;
+			return power;
+		}
+
+		VkDeviceSize previousPowerOfTwo(VkDeviceSize value)
+		{
+			VkDeviceSize power = 1;
+			while (power <= value / 2)
+				power <<= 1;
+			return power;
+		}
+
+		float toMiB(VkDeviceSize bytes)
+		{
+			return static_cast<float>(bytes) / (1024.0f * 1024.0f);
+		}
+	}
+
+	bool VmcMemoryBlock::allocate(uint32_t level, VkDeviceSize& offset)
+	{
+		// Smallest free node that is at least as large as requested
+		int freeLevel = static_cast<int>(level);
+		while (freeLevel >= 0 && freeLists[freeLevel].empty())
+			freeLevel--;
+		if (freeLevel < 0)
+			return false;
+
+		offset = *freeLists[freeLevel].begin();
+		freeLists[freeLevel].erase(freeLists[freeLevel].begin());
+
+		// Split it down, keeping the left halves and freeing the right buddies
+		for (uint32_t l = static_cast<uint32_t>(freeLevel); l < level; l++)
+		{
+			freeLists[l + 1].insert(offset + nodeSize(l + 1));
+		}
+
+		usedBytes += nodeSize(level);
+		allocationCount++;
+		return true;
+	}
+
+	void VmcMemoryBlock::free(uint32_t level, VkDeviceSize offset)
+	{
+		usedBytes -= nodeSize(level);
+		allocationCount--;
+
+		// Merge with the buddy for as long as it is free as well
+		while (level > 0)
+		{
+			VkDeviceSize buddy = offset ^ nodeSize(level);
+			if (freeLists[level].erase(buddy) == 0)
+				break;
+			offset = std::min(offset, buddy);
+			level--;
+		}
+		freeLists[level].insert(offset);
+	}
+
+	VkDeviceSize VmcMemoryBlock::largestFreeNode() const
+	{
+		for (uint32_t level = 0; level < freeLists.size(); level++)
+		{
+			if (!freeLists[level].empty())
+				return nodeSize(level);
+		}
+		return 0;
+	}
+
+	VmcMemoryAllocator::VmcMemoryAllocator(VkDevice device, VkPhysicalDevice physicalDevice) : device{ device }
+	{
+		vkGetPhysicalDeviceProperties(physicalDevice, &deviceProperties);
+		vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+
+		pools.resize(memoryProperties.memoryTypeCount * 2);
+		for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++)
+		{
+			// Never reserve more than an eighth of a (small) heap in one go
+			VkDeviceSize heapSize = memoryProperties.memoryHeaps[memoryProperties.memoryTypes[i].heapIndex].size;
+			VkDeviceSize blockSize = std::max(std::min(DEFAULT_BLOCK_SIZE, previousPowerOfTwo(heapSize / 8)), MIN_ALLOCATION_SIZE);
+
+			pools[i * 2 + RESOURCE_LINEAR] = { i, RESOURCE_LINEAR, blockSize, {} };
+			pools[i * 2 + RESOURCE_OPTIMAL] = { i, RESOURCE_OPTIMAL, blockSize, {} };
+		}
+	}
+
+	VmcMemoryAllocator::~VmcMemoryAllocator()
+	{
+		for (auto& pool : pools)
+		{
+			for (auto& block : pool.blocks)
+			{
+				assert(block->allocationCount == 0 && "Device memory is still in use while destroying the allocator!");
+				freeDeviceMemory(block->memory);
+			}
+		}
+		if (dedicatedCount > 0)
+		{
+			std::cout << "Memory allocator destroyed with " << dedicatedCount << " dedicated allocations still alive" << std::endl;
+		}
+	}
+
+	VmcAllocation VmcMemoryAllocator::allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties, ResourceKind kind)
+	{
+		std::lock_guard<std::mutex> lock{ allocatorMutex };
+
+		VmcAllocation allocation{};
+		allocation.memoryTypeIndex = findMemoryType(requirements.memoryTypeBits, properties);
+
+		// Flushes of non coherent memory work on nonCoherentAtomSize granularity, keep neighbours out of each other's atoms
+		VkDeviceSize alignment = std::max<VkDeviceSize>(requirements.alignment, 1);
+		if (isHostVisible(allocation.memoryTypeIndex))
+		{
+			alignment = std::max(alignment, deviceProperties.limits.nonCoherentAtomSize);
+		}
+
+		uint32_t poolIndex = allocation.memoryTypeIndex * 2 + kind;
+		Pool& pool = pools[poolIndex];
+		VkDeviceSize nodeSize = std::max({ nextPowerOfTwo(requirements.size), nextPowerOfTwo(alignment), MIN_ALLOCATION_SIZE });
+
+		if (nodeSize > pool.blockSize / 2)
+		{
+			allocation.memory = allocateDeviceMemory(requirements.size, allocation.memoryTypeIndex, &allocation.mapped);
+			allocation.size = requirements.size;
+			dedicatedCount++;
+			dedicatedBytes += requirements.size;
+			return allocation;
+		}
+
+		uint32_t level = 0;
+		while ((pool.blockSize >> level) > nodeSize)
+			level++;
+
+		VmcMemoryBlock* block = nullptr;
+		for (auto& candidate : pool.blocks)
+		{
+			if (candidate->allocate(level, allocation.offset))
+			{
+				block = candidate.get();
+				break;
+			}
+		}
+		if (block == nullptr)
+		{
+			block = &createBlock(pool, poolIndex);
+			bool allocated = block->allocate(level, allocation.offset);
+			assert(allocated && "Fresh memory block could not fit the allocation!");
+		}
+
+		allocation.memory = block->memory;
+		allocation.size = nodeSize;
+		allocation.block = block;
+		allocation.level = level;
+		if (block->mapped != nullptr)
+		{
+			allocation.mapped = static_cast<char*>(block->mapped) + allocation.offset;
+		}
+		return allocation;
+	}
+
+	void VmcMemoryAllocator::free(VmcAllocation& allocation)
+	{
+		if (allocation.memory == VK_NULL_HANDLE)
+			return;
+
+		std::lock_guard<std::mutex> lock{ allocatorMutex };
+		if (allocation.block == nullptr)
+		{
+			freeDeviceMemory(allocation.memory);
+			dedicatedCount--;
+			dedicatedBytes -= allocation.size;
+		}
+		else
+		{
+			allocation.block->free(allocation.level, allocation.offset);
+			if (allocation.block->allocationCount == 0)
+			{
+				releaseEmptyBlocks(pools[allocation.block->poolIndex]);
+			}
+		}
+		allocation = VmcAllocation{};
+	}
+
+	VmcMemoryStatistics VmcMemoryAllocator::getStatistics()
+	{
+		std::lock_guard<std::mutex> lock{ allocatorMutex };
+
+		VmcMemoryStatistics statistics{};
+		statistics.deviceMemoryCount = deviceMemoryCount;
+		statistics.dedicatedCount = dedicatedCount;
+		statistics.allocationCount = dedicatedCount;
+		statistics.reservedBytes = dedicatedBytes;
+		statistics.usedBytes = dedicatedBytes;
+		for (const auto& pool : pools)
+		{
+			for (const auto& block : pool.blocks)
+			{
+				statistics.blockCount++;
+				statistics.allocationCount += block->allocationCount;
+				statistics.reservedBytes += block->size;
+				statistics.usedBytes += block->usedBytes;
+			}
+		}
+		return statistics;
+	}
+
+	void VmcMemoryAllocator::printStatistics()
+	{
+		VmcMemoryStatistics total = getStatistics();
+
+		std::lock_guard<std::mutex> lock{ allocatorMutex };
+		std::cout << "GPU memory: " << total.allocationCount << " allocations in " << total.deviceMemoryCount << " device memory objects (limit "
+			<< deviceProperties.limits.maxMemoryAllocationCount << "), " << toMiB(total.usedBytes) << " / " << toMiB(total.reservedBytes) << " MiB used" << std::endl;
+		for (const auto& pool : pools)
+		{
+			if (pool.blocks.empty())
+				continue;
+
+			std::cout << "  memory type " << pool.memoryTypeIndex << (pool.kind == RESOURCE_LINEAR ? " (buffers)" : " (images)")
+				<< ", flags 0x" << std::hex << memoryProperties.memoryTypes[pool.memoryTypeIndex].propertyFlags << std::dec << ":" << std::endl;
+			for (size_t i = 0; i < pool.blocks.size(); i++)
+			{
+				const auto& block = pool.blocks[i];
+				std::cout << "    block " << i << ": " << block->allocationCount << " allocations, " << toMiB(block->usedBytes) << " / "
+					<< toMiB(block->size) << " MiB used, largest free range " << toMiB(block->largestFreeNode()) << " MiB" << std::endl;
+			}
+		}
+		if (dedicatedCount > 0)
+		{
+			std::cout << "  dedicated: " << dedicatedCount << " allocations, " << toMiB(dedicatedBytes) << " MiB" << std::endl;
+		}
+	}
+
+	uint32_t VmcMemoryAllocator::findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) const
+	{
+		for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++)
+		{
+			if ((typeFilter & (1 << i)) && (memoryProperties.memoryTypes[i].propertyFlags & properties) == properties)
+				return i;
+		}
+		throw std::runtime_error("failed to find suitable memory type!");
+	}
+
+	bool VmcMemoryAllocator::isHostVisible(uint32_t memoryTypeIndex) const
+	{
+		return memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+	}
+
+	VkDeviceMemory VmcMemoryAllocator::allocateDeviceMemory(VkDeviceSize size, uint32_t memoryTypeIndex, void** mapped)
+	{
+		VkMemoryAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+		allocInfo.allocationSize = size;
+		allocInfo.memoryTypeIndex = memoryTypeIndex;
+
+		VkDeviceMemory memory;
+		if (vkAllocateMemory(device, &allocInfo, nullptr, &memory) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to allocate device memory!");
+		}
+		deviceMemoryCount++;
+
+		*mapped = nullptr;
+		if (isHostVisible(memoryTypeIndex) && vkMapMemory(device, memory, 0, VK_WHOLE_SIZE, 0, mapped) != VK_SUCCESS)
+		{
+			freeDeviceMemory(memory);
+			throw std::runtime_error("failed to map device memory!");
+		}
+		return memory;
+	}
+
+	void VmcMemoryAllocator::freeDeviceMemory(VkDeviceMemory memory)
+	{
+		// Freeing implicitly unmaps
+		vkFreeMemory(device, memory, nullptr);
+		deviceMemoryCount--;
+	}
+
+	VmcMemoryBlock& VmcMemoryAllocator::createBlock(Pool& pool, uint32_t poolIndex)
+	{
+		auto block = std::make_unique<VmcMemoryBlock>();
+		block->memory = allocateDeviceMemory(pool.blockSize, pool.memoryTypeIndex, &block->mapped);
+		block->size = pool.blockSize;
+		block->poolIndex = poolIndex;
+
+		uint32_t levelCount = 1;
+		while ((pool.blockSize >> levelCount) >= MIN_ALLOCATION_SIZE)
+			levelCount++;
+		block->freeLists.resize(levelCount);
+		block->freeLists[0].insert(0);
+
+		pool.blocks.push_back(std::move(block));
+		return *pool.blocks.back();
+	}
+
+	// Keeps a single empty block per pool around, so allocating and freeing in a loop does not hit the driver
+	void VmcMemoryAllocator::releaseEmptyBlocks(Pool& pool)
+	{
+		bool keptEmptyBlock = false;
+		for (auto it = pool.blocks.begin(); it != pool.blocks.end();)
+		{
+			if ((*it)->allocationCount == 0)
+			{
+				if (!keptEmptyBlock)
+				{
+					keptEmptyBlock = true;
+				}
+				else
+				{
+					freeDeviceMemory((*it)->memory);
+					it = pool.blocks.erase(it);
+					continue;
+				}
+			}
+			++it;
+		}
+	}
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+// libs
+#include <vulkan/vulkan.h>
+
+// std
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace vae {
+	struct VmcMemoryBlock;
+
+	// Range of device memory handed out by VmcMemoryAllocator. Bind resources at memory + offset.
+	struct VmcAllocation {
+		VkDeviceMemory memory = VK_NULL_HANDLE;
+		VkDeviceSize offset = 0;
+		VkDeviceSize size = 0;
+		void* mapped = nullptr;				// Persistently mapped pointer to offset, only for host visible memory
+		uint32_t memoryTypeIndex = 0;
+		VmcMemoryBlock* block = nullptr;	// nullptr for dedicated allocations
+		uint32_t level = 0;					// Buddy level inside the block
+	};
+
+	struct VmcMemoryStatistics {
+		uint32_t deviceMemoryCount = 0;		// Live vkAllocateMemory allocations
+		uint32_t blockCount = 0;
+		uint32_t dedicatedCount = 0;
+		uint32_t allocationCount = 0;
+		VkDeviceSize reservedBytes = 0;		// Total size of all device memory objects
+		VkDeviceSize usedBytes = 0;			// Rounded up sizes of the live allocations
+	};
+
+	/*
+		Sub-allocates buffers and images out of large per-memory-type blocks to stay far below maxMemoryAllocationCount.
+		Every block is managed as a buddy allocator: allocation sizes are rounded up to a power of two, which also
+		satisfies the (power of two) alignment Vulkan asks for. Buffers and optimal tiled images never share a block,
+		so bufferImageGranularity can be ignored. Requests larger than half a block get a dedicated allocation.
+		Host visible blocks are mapped once when created, since a VkDeviceMemory can only be mapped once at a time.
+	*/
+	class VmcMemoryAllocator
+	{
+	public:
+		static constexpr VkDeviceSize DEFAULT_BLOCK_SIZE = 64ull * 1024 * 1024;
+		static constexpr VkDeviceSize MIN_ALLOCATION_SIZE = 256;
+
+		enum ResourceKind {
+			RESOURCE_LINEAR,	// Buffers and linear tiled images
+			RESOURCE_OPTIMAL,	// Optimal tiled images
+		};
+
+		VmcMemoryAllocator(VkDevice device, VkPhysicalDevice physicalDevice);
+		~VmcMemoryAllocator();
+
+		VmcMemoryAllocator(const VmcMemoryAllocator&) = delete;
+		VmcMemoryAllocator& operator=(const VmcMemoryAllocator&) = delete;
+
+		VmcAllocation allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties, ResourceKind kind);
+		void free(VmcAllocation& allocation);
+
+		VmcMemoryStatistics getStatistics();
+		void printStatistics();
+
+	private:
+		struct Pool {
+			uint32_t memoryTypeIndex;
+			ResourceKind kind;
+			VkDeviceSize blockSize;
+			std::vector<std::unique_ptr<VmcMemoryBlock>> blocks;
+		};
+
+		uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) const;
+		bool isHostVisible(uint32_t memoryTypeIndex) const;
+		VkDeviceMemory allocateDeviceMemory(VkDeviceSize size, uint32_t memoryTypeIndex, void** mapped);
+		void freeDeviceMemory(VkDeviceMemory memory);
+		VmcMemoryBlock& createBlock(Pool& pool, uint32_t poolIndex);
+		void releaseEmptyBlocks(Pool& pool);
+
+		VkDevice device;
+		VkPhysicalDeviceProperties deviceProperties;
+		VkPhysicalDeviceMemoryProperties memoryProperties;
+
+		std::mutex allocatorMutex;
+		std::vector<Pool> pools;	// Indexed by memoryTypeIndex * 2 + kind
+		uint32_t deviceMemoryCount = 0;
+		uint32_t dedicatedCount = 0;
+		VkDeviceSize dedicatedBytes = 0;
+	};
+}
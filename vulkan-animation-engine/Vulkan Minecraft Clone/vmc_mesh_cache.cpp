@@ -0,0 +1,229 @@
+#include "vmc_mesh_cache.hpp"
+#include "vmc_model_registry.hpp"
+
+// std
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <type_traits>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace vae {
+	static_assert(std::is_trivially_copyable<VmcModel::Vertex>::value, "Vertices are stored in the cache as raw bytes");
+	static_assert(std::is_trivially_copyable<VmcMeshCacheHeader>::value, "The header is stored in the cache as raw bytes");
+	static_assert(std::is_trivially_copyable<VmcModel::Lod>::value, "LODs are stored in the cache as raw bytes");
+
+	static constexpr char MESH_CACHE_MAGIC[4] = { 'V', 'M', 'S', 'H' };
+
+	// 64 bit FNV-1a
+	static uint64_t hashBytes(const uint8_t* data, size_t size)
+	{
+		uint64_t hash = 14695981039346656037ull;
+		for (size_t i = 0; i < size; i++)
+		{
+			hash ^= data[i];
+			hash *= 1099511628211ull;
+		}
+		return hash;
+	}
+
+	static uint64_t hashFile(const std::string& filePath)
+	{
+		VmcMappedFile file{ filePath };
+		return file.isOpen() ? hashBytes(file.getData(), file.getSize()) : 0;
+	}
+
+	static int64_t writeTime(const std::string& filePath)
+	{
+		std::error_code error;
+		auto time = std::filesystem::last_write_time(filePath, error);
+		return error ? 0 : static_cast<int64_t>(time.time_since_epoch().count());
+	}
+
+	// ========================
+	// VmcMappedFile
+	// ========================
+
+#ifdef _WIN32
+	VmcMappedFile::VmcMappedFile(const std::string& filePath)
+	{
+		HANDLE file = CreateFileW(std::filesystem::path(filePath).c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (file == INVALID_HANDLE_VALUE) return;
+		fileHandle = file;
+
+		LARGE_INTEGER fileSize;
+		if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) return;
+
+		HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (mapping == nullptr) return;
+		mappingHandle = mapping;
+
+		data = static_cast<const uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+		if (data != nullptr) size = static_cast<size_t>(fileSize.QuadPart);
+	}
+
+	VmcMappedFile::~VmcMappedFile()
+	{
+		if (data != nullptr) UnmapViewOfFile(data);
+		if (mappingHandle != nullptr) CloseHandle(mappingHandle);
+		if (fileHandle != nullptr) CloseHandle(fileHandle);
+	}
+#else
+	VmcMappedFile::VmcMappedFile(const std::string& filePath)
+	{
+		fileDescriptor = open(filePath.c_str(), O_RDONLY);
+		if (fileDescriptor < 0) return;
+
+		struct stat fileStat;
+		if (fstat(fileDescriptor, &fileStat) != 0 || fileStat.st_size == 0) return;
+
+		void* mapping = mmap(nullptr, static_cast<size_t>(fileStat.st_size), PROT_READ, MAP_PRIVATE, fileDescriptor, 0);
+		if (mapping == MAP_FAILED) return;
+		data = static_cast<const uint8_t*>(mapping);
+		size = static_cast<size_t>(fileStat.st_size);
+	}
+
+	VmcMappedFile::~VmcMappedFile()
+	{
+		if (data != nullptr) munmap(const_cast<uint8_t*>(data), size);
+		if (fileDescriptor >= 0) close(fileDescriptor);
+	}
+#endif
+
+	// ========================
+	// VmcCachedMesh
+	// ========================
+
+	std::string VmcCachedMesh::cachePath(const std::string& objPath)
+	{
+		// Name of the model for readability, hash of the full path so models with the same name don't collide
+		std::string canonical = VmcModelRegistry::canonicalPath(objPath);
+		uint64_t pathHash = hashBytes(reinterpret_cast<const uint8_t*>(canonical.data()), canonical.size());
+
+		char hashString[17];
+		std::snprintf(hashString, sizeof(hashString), "%016llx", static_cast<unsigned long long>(pathHash));
+		std::string fileName = std::filesystem::path(objPath).stem().string() + "-" + hashString + ".vmesh";
+		return (std::filesystem::path(CACHE_DIRECTORY) / fileName).string();
+	}
+
+	std::unique_ptr<VmcCachedMesh> VmcCachedMesh::load(const std::string& objPath)
+	{
+		std::unique_ptr<VmcCachedMesh> mesh{ new VmcCachedMesh(cachePath(objPath)) };
+		if (!mesh->isValid(objPath)) return nullptr;
+		return mesh;
+	}
+
+	bool VmcCachedMesh::isValid(const std::string& objPath) const
+	{
+		if (!file.isOpen() || file.getSize() < sizeof(VmcMeshCacheHeader)) return false;
+
+		const VmcMeshCacheHeader& header = getHeader();
+		if (std::memcmp(header.magic, MESH_CACHE_MAGIC, sizeof(MESH_CACHE_MAGIC)) != 0
+			|| header.version != FORMAT_VERSION
+			|| header.vertexStride != sizeof(VmcModel::Vertex))
+			return false;
+
+		// The blobs have to lie completely inside the file and be aligned for direct access
+		if (header.vertexOffset % alignof(VmcModel::Vertex) != 0 || header.indexOffset % alignof(uint32_t) != 0 || header.lodOffset % alignof(VmcModel::Lod) != 0
+			|| header.vertexOffset + static_cast<uint64_t>(header.vertexCount) * sizeof(VmcModel::Vertex) > file.getSize()
+			|| header.indexOffset + static_cast<uint64_t>(header.indexCount) * sizeof(uint32_t) > file.getSize()
+			|| header.lodOffset + static_cast<uint64_t>(header.lodCount) * sizeof(VmcModel::Lod) > file.getSize()
+			|| header.lodCount == 0)
+			return false;
+
+		for (uint32_t i = 0; i < header.lodCount; i++)
+		{
+			const VmcModel::Lod& lod = getLods()[i];
+			if (static_cast<uint64_t>(lod.firstIndex) + lod.indexCount > header.indexCount) return false;
+		}
+
+		std::error_code error;
+		uint64_t sourceSize = std::filesystem::file_size(objPath, error);
+		if (error || sourceSize != header.sourceSize) return false;
+
+		// Checking out or copying a file changes its write time but not its contents
+		if (writeTime(objPath) == header.sourceWriteTime) return true;
+		return hashFile(objPath) == header.sourceHash;
+	}
+
+	void VmcCachedMesh::store(const std::string& objPath, const VmcModel::Builder& builder)
+	{
+		VmcMeshCacheHeader header{};
+		std::memcpy(header.magic, MESH_CACHE_MAGIC, sizeof(MESH_CACHE_MAGIC));
+		header.version = FORMAT_VERSION;
+		header.vertexStride = sizeof(VmcModel::Vertex);
+		header.vertexCount = static_cast<uint32_t>(builder.vertices.size());
+		header.indexCount = static_cast<uint32_t>(builder.indices.size());
+
+		std::vector<VmcModel::Lod> lods = builder.lods;
+		if (lods.empty()) lods.push_back({ 0, header.indexCount, 0.0f });
+		header.lodCount = static_cast<uint32_t>(lods.size());
+
+		std::error_code error;
+		header.sourceSize = std::filesystem::file_size(objPath, error);
+		if (error) return;
+		header.sourceWriteTime = writeTime(objPath);
+		header.sourceHash = hashFile(objPath);
+
+		auto alignUp = [](uint64_t offset, uint64_t alignment) { return (offset + alignment - 1) / alignment * alignment; };
+		header.vertexOffset = alignUp(sizeof(VmcMeshCacheHeader), 16);
+		header.indexOffset = alignUp(header.vertexOffset + static_cast<uint64_t>(header.vertexCount) * sizeof(VmcModel::Vertex), 16);
+		header.lodOffset = alignUp(header.indexOffset + static_cast<uint64_t>(header.indexCount) * sizeof(uint32_t), 16);
+
+		header.bounds[0] = builder.minX;
+		header.bounds[1] = builder.maxX;
+		header.bounds[2] = builder.minY;
+		header.bounds[3] = builder.maxY;
+		header.bounds[4] = builder.minZ;
+		header.bounds[5] = builder.maxZ;
+
+		std::string path = cachePath(objPath);
+		std::filesystem::create_directories(CACHE_DIRECTORY, error);
+
+		// Written next to the cache file and renamed, so a crash never leaves a half written cache behind
+		std::string tempPath = path + ".tmp";
+		{
+			std::ofstream out{ tempPath, std::ios::binary | std::ios::trunc };
+			if (!out.is_open())
+			{
+				std::cout << "Unable to write mesh cache to " << path << std::endl;
+				return;
+			}
+
+			static const char padding[16] = {};
+			out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+			out.write(padding, header.vertexOffset - sizeof(header));
+			out.write(reinterpret_cast<const char*>(builder.vertices.data()), header.vertexCount * sizeof(VmcModel::Vertex));
+			out.write(padding, header.indexOffset - (header.vertexOffset + header.vertexCount * sizeof(VmcModel::Vertex)));
+			out.write(reinterpret_cast<const char*>(builder.indices.data()), header.indexCount * sizeof(uint32_t));
+			out.write(padding, header.lodOffset - (header.indexOffset + header.indexCount * sizeof(uint32_t)));
+			out.write(reinterpret_cast<const char*>(lods.data()), header.lodCount * sizeof(VmcModel::Lod));
+			if (!out.good())
+			{
+				out.close();
+				std::filesystem::remove(tempPath, error);
+				std::cout << "Unable to write mesh cache to " << path << std::endl;
+				return;
+			}
+		}
+
+		std::filesystem::rename(tempPath, path, error);
+		if (error)
+		{
+			std::filesystem::remove(tempPath, error);
+			std::cout << "Unable to write mesh cache to " << path << std::endl;
+		}
+	}
+}
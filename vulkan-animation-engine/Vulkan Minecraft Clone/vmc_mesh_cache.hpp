@@ -0,0 +1,88 @@
+#pragma once
+#include "vmc_model.hpp"
+
+// std
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace vae {
+	// Read only memory mapping of a whole file
+	class VmcMappedFile
+	{
+	public:
+		VmcMappedFile(const std::string& filePath);
+		~VmcMappedFile();
+
+		VmcMappedFile(const VmcMappedFile&) = delete;
+		VmcMappedFile& operator=(const VmcMappedFile&) = delete;
+
+		bool isOpen() const { return data != nullptr; };
+		const uint8_t* getData() const { return data; };
+		size_t getSize() const { return size; };
+
+	private:
+		const uint8_t* data = nullptr;
+		size_t size = 0;
+#ifdef _WIN32
+		void* fileHandle = nullptr;
+		void* mappingHandle = nullptr;
+#else
+		int fileDescriptor = -1;
+#endif
+	};
+
+	// Layout of a .vmesh file: this header, then vertexCount vertices at vertexOffset, indexCount indices at indexOffset
+	// and lodCount LODs (ranges of the indices) at lodOffset
+	struct VmcMeshCacheHeader {
+		char magic[4];
+		uint32_t version;
+		uint32_t vertexStride;			// sizeof(VmcModel::Vertex) when the file was written
+		uint32_t vertexCount;
+		uint32_t indexCount;
+		uint32_t lodCount;
+		uint64_t sourceSize;			// Size, write time and contents of the .obj the mesh was compiled from
+		int64_t sourceWriteTime;
+		uint64_t sourceHash;
+		uint64_t vertexOffset;
+		uint64_t indexOffset;
+		uint64_t lodOffset;
+		float bounds[6];				// minX, maxX, minY, maxY, minZ, maxZ
+	};
+
+	/*
+		Compiled version of an .obj file, stored in ../Cache/Meshes/. The file is memory mapped, so the vertex and index
+		data can be copied straight into a staging buffer without any parsing.
+		A cache file is used as long as the .obj it was compiled from has the same size and either the same write time
+		or the same contents, anything else (including a different FORMAT_VERSION) recompiles it.
+	*/
+	class VmcCachedMesh
+	{
+	public:
+		static constexpr uint32_t FORMAT_VERSION = 3;	// 2: meshes are stored optimized, 3: LODs
+		static constexpr const char* CACHE_DIRECTORY = "../Cache/Meshes";
+
+		// Returns nullptr when there is no up to date cache file for objPath
+		static std::unique_ptr<VmcCachedMesh> load(const std::string& objPath);
+		static void store(const std::string& objPath, const VmcModel::Builder& builder);
+		static std::string cachePath(const std::string& objPath);
+
+		VmcCachedMesh(const VmcCachedMesh&) = delete;
+		VmcCachedMesh& operator=(const VmcCachedMesh&) = delete;
+
+		const VmcMeshCacheHeader& getHeader() const { return *reinterpret_cast<const VmcMeshCacheHeader*>(file.getData()); };
+		const VmcModel::Vertex* getVertices() const { return reinterpret_cast<const VmcModel::Vertex*>(file.getData() + getHeader().vertexOffset); };
+		const uint32_t* getIndices() const { return reinterpret_cast<const uint32_t*>(file.getData() + getHeader().indexOffset); };
+		uint32_t getVertexCount() const { return getHeader().vertexCount; };
+		uint32_t getIndexCount() const { return getHeader().indexCount; };
+		const VmcModel::Lod* getLods() const { return reinterpret_cast<const VmcModel::Lod*>(file.getData() + getHeader().lodOffset); };
+		uint32_t getLodCount() const { return getHeader().lodCount; };
+
+	private:
+		VmcCachedMesh(const std::string& filePath) : file{ filePath } {};
+		bool isValid(const std::string& objPath) const;
+
+		VmcMappedFile file;
+	};
+}
@@ -0,0 +1,454 @@
+#include "vmc_mesh_optimizer.hpp"
+
+// libs
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/packing.hpp>
+#define GLM_ENABLE_EXPERIMENTAL
+#include <glm/gtx/hash.hpp>
+
+// std
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <queue>
+#include <unordered_map>
+
+namespace vae {
+
+	float VmcMeshOptimizer::computeACMR(const std::vector<uint32_t>& indices, size_t vertexCount, uint32_t cacheSize)
+	{
+		if (indices.size() < 3) return 0.0f;
+
+		// A vertex is still cached when less than cacheSize misses happened since it was loaded
+		const uint64_t NEVER = std::numeric_limits<uint64_t>::max();
+		std::vector<uint64_t> loadedAt(vertexCount, NEVER);
+		uint64_t misses = 0;
+		for (uint32_t index : indices)
+		{
+			if (loadedAt[index] == NEVER || misses - loadedAt[index] >= cacheSize)
+			{
+				loadedAt[index] = misses;
+				misses++;
+			}
+		}
+		return static_cast<float>(misses) / static_cast<float>(indices.size() / 3);
+	}
+
+	void VmcMeshOptimizer::optimizeVertexCache(std::vector<uint32_t>& indices, size_t vertexCount, uint32_t cacheSize)
+	{
+		const size_t triangleCount = indices.size() / 3;
+		if (triangleCount == 0 || indices.size() % 3 != 0) return;
+
+		// Triangles around every vertex
+		std::vector<uint32_t> adjacencyOffsets(vertexCount + 1, 0);
+		for (uint32_t index : indices) adjacencyOffsets[index + 1]++;
+		for (size_t v = 0; v < vertexCount; v++) adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+		std::vector<uint32_t> adjacency(indices.size());
+		std::vector<uint32_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+		for (size_t i = 0; i < indices.size(); i++) adjacency[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+
+		std::vector<uint32_t> liveTriangles(vertexCount);
+		for (size_t v = 0; v < vertexCount; v++) liveTriangles[v] = adjacencyOffsets[v + 1] - adjacencyOffsets[v];
+
+		std::vector<uint32_t> cacheTime(vertexCount, 0);
+		std::vector<bool> emitted(triangleCount, false);
+		std::vector<uint32_t> deadEnds;
+		std::vector<uint32_t> candidates;
+		std::vector<uint32_t> output;
+		output.reserve(indices.size());
+
+		uint32_t timeStamp = cacheSize + 1;
+		size_t cursor = 0;
+		int64_t fanning = 0;
+		while (fanning >= 0)
+		{
+			// Emit every remaining triangle around the fanning vertex
+			candidates.clear();
+			uint32_t f = static_cast<uint32_t>(fanning);
+			for (uint32_t a = adjacencyOffsets[f]; a < adjacencyOffsets[f + 1]; a++)
+			{
+				uint32_t triangle = adjacency[a];
+				if (emitted[triangle]) continue;
+
+				for (int corner = 0; corner < 3; corner++)
+				{
+					uint32_t v = indices[3 * triangle + corner];
+					output.push_back(v);
+					deadEnds.push_back(v);
+					candidates.push_back(v);
+					liveTriangles[v]--;
+					if (timeStamp - cacheTime[v] > cacheSize)
+					{
+						cacheTime[v] = timeStamp++;
+					}
+				}
+				emitted[triangle] = true;
+			}
+
+			// Next fanning vertex: the candidate that stays in the cache the longest while it still has triangles left
+			fanning = -1;
+			int64_t bestPriority = -1;
+			for (uint32_t v : candidates)
+			{
+				if (liveTriangles[v] == 0) continue;
+				int64_t priority = 0;
+				if (timeStamp - cacheTime[v] + 2 * liveTriangles[v] <= cacheSize)
+				{
+					priority = timeStamp - cacheTime[v];
+				}
+				if (priority > bestPriority)
+				{
+					bestPriority = priority;
+					fanning = v;
+				}
+			}
+
+			// Dead end: go back to a recently used vertex, otherwise continue with the next vertex in order
+			while (fanning < 0 && !deadEnds.empty())
+			{
+				uint32_t v = deadEnds.back();
+				deadEnds.pop_back();
+				if (liveTriangles[v] > 0) fanning = v;
+			}
+			while (fanning < 0 && cursor < vertexCount)
+			{
+				if (liveTriangles[cursor] > 0) fanning = static_cast<int64_t>(cursor);
+				cursor++;
+			}
+		}
+
+		indices.swap(output);
+	}
+
+	void VmcMeshOptimizer::optimizeVertexFetch(std::vector<VmcModel::Vertex>& vertices, std::vector<uint32_t>& indices)
+	{
+		const uint32_t UNUSED = std::numeric_limits<uint32_t>::max();
+		std::vector<uint32_t> remap(vertices.size(), UNUSED);
+		std::vector<VmcModel::Vertex> reordered;
+		reordered.reserve(vertices.size());
+
+		for (uint32_t& index : indices)
+		{
+			if (remap[index] == UNUSED)
+			{
+				remap[index] = static_cast<uint32_t>(reordered.size());
+				reordered.push_back(vertices[index]);
+			}
+			index = remap[index];
+		}
+		vertices.swap(reordered);
+	}
+
+	namespace {
+		// Symmetric 4x4 error quadric of Garland and Heckbert, squared distance to a set of planes
+		struct Quadric {
+			double a2 = 0, ab = 0, ac = 0, ad = 0, b2 = 0, bc = 0, bd = 0, c2 = 0, cd = 0, d2 = 0;
+
+			static Quadric fromPlane(glm::dvec3 normal, double d, double weight) {
+				Quadric q;
+				q.a2 = weight * normal.x * normal.x; q.ab = weight * normal.x * normal.y; q.ac = weight * normal.x * normal.z; q.ad = weight * normal.x * d;
+				q.b2 = weight * normal.y * normal.y; q.bc = weight * normal.y * normal.z; q.bd = weight * normal.y * d;
+				q.c2 = weight * normal.z * normal.z; q.cd = weight * normal.z * d;
+				q.d2 = weight * d * d;
+				return q;
+			}
+
+			void add(const Quadric& o) {
+				a2 += o.a2; ab += o.ab; ac += o.ac; ad += o.ad; b2 += o.b2; bc += o.bc; bd += o.bd; c2 += o.c2; cd += o.cd; d2 += o.d2;
+			}
+
+			double evaluate(const glm::vec3& p) const {
+				double x = p.x, y = p.y, z = p.z;
+				double error = a2 * x * x + 2 * ab * x * y + 2 * ac * x * z + 2 * ad * x
+					+ b2 * y * y + 2 * bc * y * z + 2 * bd * y
+					+ c2 * z * z + 2 * cd * z
+					+ d2;
+				return std::max(error, 0.0);
+			}
+		};
+
+		struct Collapse {
+			double cost;
+			uint32_t from;
+			uint32_t to;
+			uint32_t fromVersion;
+			uint32_t toVersion;
+
+			bool operator>(const Collapse& other) const { return cost > other.cost; }
+		};
+
+		constexpr double BOUNDARY_WEIGHT = 10.0;
+	}
+
+	void VmcMeshOptimizer::generateLods(VmcModel::Builder& builder)
+	{
+		builder.lods.clear();
+		const uint32_t fullIndexCount = static_cast<uint32_t>(builder.indices.size());
+		builder.lods.push_back({ 0, fullIndexCount, 0.0f });
+		if (fullIndexCount < 3 * MIN_LOD_TRIANGLES || fullIndexCount % 3 != 0) return;
+
+		// Simplification works on positions, vertices split by normal or uv seams are welded together
+		std::unordered_map<glm::vec3, uint32_t> positionIds;
+		std::vector<uint32_t> positionOf(builder.vertices.size());
+		std::vector<uint32_t> representative;	// A vertex at every position
+		std::vector<glm::vec3> positions;
+		for (size_t v = 0; v < builder.vertices.size(); v++)
+		{
+			auto inserted = positionIds.emplace(builder.vertices[v].position, static_cast<uint32_t>(positions.size()));
+			if (inserted.second)
+			{
+				positions.push_back(builder.vertices[v].position);
+				representative.push_back(static_cast<uint32_t>(v));
+			}
+			positionOf[v] = inserted.first->second;
+		}
+		const size_t positionCount = positions.size();
+
+		glm::vec3 minimum{ std::numeric_limits<float>::max() };
+		glm::vec3 maximum{ std::numeric_limits<float>::lowest() };
+		for (const glm::vec3& p : positions)
+		{
+			minimum = glm::min(minimum, p);
+			maximum = glm::max(maximum, p);
+		}
+		const double maxError = MAX_LOD_ERROR * glm::length(maximum - minimum) * 0.5;
+
+		// Triangles keep the vertices of their corners, so attributes survive wherever the position survives
+		std::vector<std::array<uint32_t, 3>> triangles(fullIndexCount / 3);
+		std::vector<bool> alive(triangles.size(), true);
+		std::vector<std::vector<uint32_t>> trianglesAround(positionCount);
+		size_t aliveCount = 0;
+		auto cornerPosition = [&](size_t t, int corner) { return positionOf[triangles[t][corner]]; };
+		for (size_t t = 0; t < triangles.size(); t++)
+		{
+			triangles[t] = { builder.indices[3 * t], builder.indices[3 * t + 1], builder.indices[3 * t + 2] };
+			uint32_t a = cornerPosition(t, 0), b = cornerPosition(t, 1), c = cornerPosition(t, 2);
+			if (a == b || b == c || a == c)
+			{
+				alive[t] = false;
+				continue;
+			}
+			aliveCount++;
+			trianglesAround[a].push_back(static_cast<uint32_t>(t));
+			trianglesAround[b].push_back(static_cast<uint32_t>(t));
+			trianglesAround[c].push_back(static_cast<uint32_t>(t));
+		}
+
+		// Plane quadrics of the triangles, boundary edges get a perpendicular plane so the outline is kept
+		std::vector<Quadric> quadrics(positionCount);
+		std::map<std::pair<uint32_t, uint32_t>, std::pair<uint32_t, uint32_t>> edgeUse;	// Edge -> use count, triangle
+		for (size_t t = 0; t < triangles.size(); t++)
+		{
+			if (!alive[t]) continue;
+			glm::dvec3 p0 = positions[cornerPosition(t, 0)], p1 = positions[cornerPosition(t, 1)], p2 = positions[cornerPosition(t, 2)];
+			glm::dvec3 normal = glm::cross(p1 - p0, p2 - p0);
+			double length = glm::length(normal);
+			if (length <= 0.0) continue;
+			normal /= length;
+			Quadric plane = Quadric::fromPlane(normal, -glm::dot(normal, p0), 1.0);
+			for (int corner = 0; corner < 3; corner++)
+			{
+				quadrics[cornerPosition(t, corner)].add(plane);
+				uint32_t a = cornerPosition(t, corner), b = cornerPosition(t, (corner + 1) % 3);
+				auto& use = edgeUse[{ std::min(a, b), std::max(a, b) }];
+				use.first++;
+				use.second = static_cast<uint32_t>(t);
+			}
+		}
+		for (auto& edge : edgeUse)
+		{
+			if (edge.second.first != 1) continue;
+			size_t t = edge.second.second;
+			glm::dvec3 p0 = positions[cornerPosition(t, 0)], p1 = positions[cornerPosition(t, 1)], p2 = positions[cornerPosition(t, 2)];
+			glm::dvec3 faceNormal = glm::cross(p1 - p0, p2 - p0);
+			glm::dvec3 a = positions[edge.first.first], b = positions[edge.first.second];
+			glm::dvec3 normal = glm::cross(b - a, faceNormal);
+			double length = glm::length(normal);
+			if (length <= 0.0) continue;
+			normal /= length;
+			Quadric plane = Quadric::fromPlane(normal, -glm::dot(normal, a), BOUNDARY_WEIGHT);
+			quadrics[edge.first.first].add(plane);
+			quadrics[edge.first.second].add(plane);
+		}
+
+		std::vector<uint32_t> versions(positionCount, 0);
+		std::vector<bool> removed(positionCount, false);
+		std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse>> collapses;
+		auto pushEdge = [&](uint32_t a, uint32_t b) {
+			Quadric combined = quadrics[a];
+			combined.add(quadrics[b]);
+			double costAB = combined.evaluate(positions[b]);
+			double costBA = combined.evaluate(positions[a]);
+			if (costAB <= costBA) collapses.push({ costAB, a, b, versions[a], versions[b] });
+			else collapses.push({ costBA, b, a, versions[b], versions[a] });
+		};
+		for (auto& edge : edgeUse) pushEdge(edge.first.first, edge.first.second);
+
+		// Moving from onto to may not flip any of the remaining triangles around from
+		auto flipsTriangles = [&](uint32_t from, uint32_t to) {
+			for (uint32_t t : trianglesAround[from])
+			{
+				if (!alive[t]) continue;
+				glm::vec3 before[3], after[3];
+				bool containsTo = false;
+				for (int corner = 0; corner < 3; corner++)
+				{
+					uint32_t p = cornerPosition(t, corner);
+					containsTo |= p == to;
+					before[corner] = positions[p];
+					after[corner] = p == from ? positions[to] : positions[p];
+				}
+				if (containsTo) continue;
+				glm::vec3 normalBefore = glm::cross(before[1] - before[0], before[2] - before[0]);
+				glm::vec3 normalAfter = glm::cross(after[1] - after[0], after[2] - after[0]);
+				if (glm::dot(normalBefore, normalAfter) <= 0.25f * glm::length(normalBefore) * glm::length(normalAfter)) return true;
+			}
+			return false;
+		};
+
+		size_t targetCount = aliveCount / 2;
+		double lodError = 0.0;
+		while (!collapses.empty() && builder.lods.size() < MAX_LODS)
+		{
+			Collapse collapse = collapses.top();
+			collapses.pop();
+			if (removed[collapse.from] || removed[collapse.to] || versions[collapse.from] != collapse.fromVersion || versions[collapse.to] != collapse.toVersion)
+				continue;
+			if (collapse.cost > maxError * maxError) break;
+			if (flipsTriangles(collapse.from, collapse.to)) continue;
+
+			lodError = std::max(lodError, collapse.cost);
+			quadrics[collapse.to].add(quadrics[collapse.from]);
+			for (uint32_t t : trianglesAround[collapse.from])
+			{
+				if (!alive[t]) continue;
+				bool containsTo = false;
+				for (int corner = 0; corner < 3; corner++) containsTo |= cornerPosition(t, corner) == collapse.to;
+				if (containsTo)
+				{
+					alive[t] = false;
+					aliveCount--;
+					continue;
+				}
+				for (int corner = 0; corner < 3; corner++)
+				{
+					if (cornerPosition(t, corner) == collapse.from) triangles[t][corner] = representative[collapse.to];
+				}
+				trianglesAround[collapse.to].push_back(t);
+			}
+			trianglesAround[collapse.from].clear();
+			removed[collapse.from] = true;
+			versions[collapse.from]++;
+			versions[collapse.to]++;
+
+			// The cost of every edge around the merged position changed
+			std::vector<uint32_t>& around = trianglesAround[collapse.to];
+			around.erase(std::remove_if(around.begin(), around.end(), [&](uint32_t t) { return !alive[t]; }), around.end());
+			for (uint32_t t : around)
+			{
+				for (int corner = 0; corner < 3; corner++)
+				{
+					uint32_t p = cornerPosition(t, corner);
+					if (p != collapse.to) pushEdge(collapse.to, p);
+				}
+			}
+
+			if (aliveCount <= targetCount)
+			{
+				VmcModel::Lod lod{ static_cast<uint32_t>(builder.indices.size()), 0, static_cast<float>(std::sqrt(lodError)) };
+				for (size_t t = 0; t < triangles.size(); t++)
+				{
+					if (!alive[t]) continue;
+					builder.indices.insert(builder.indices.end(), triangles[t].begin(), triangles[t].end());
+				}
+				lod.indexCount = static_cast<uint32_t>(builder.indices.size()) - lod.firstIndex;
+				builder.lods.push_back(lod);
+				targetCount = aliveCount / 2;
+				if (aliveCount < MIN_LOD_TRIANGLES) break;
+			}
+		}
+	}
+
+	void VmcMeshOptimizer::optimize(VmcModel::Builder& builder)
+	{
+		float acmrBefore = computeACMR(builder.indices, builder.vertices.size());
+		generateLods(builder);
+
+		// Every LOD is drawn on its own, so every LOD is ordered for the cache on its own
+		for (const VmcModel::Lod& lod : builder.lods)
+		{
+			auto first = builder.indices.begin() + lod.firstIndex;
+			std::vector<uint32_t> lodIndices(first, first + lod.indexCount);
+			optimizeVertexCache(lodIndices, builder.vertices.size());
+			std::copy(lodIndices.begin(), lodIndices.end(), first);
+		}
+		optimizeVertexFetch(builder.vertices, builder.indices);
+
+		std::vector<uint32_t> fullIndices(builder.indices.begin(), builder.indices.begin() + builder.lods[0].indexCount);
+		float acmrAfter = computeACMR(fullIndices, builder.vertices.size());
+		std::cout << "Optimized mesh: ACMR " << acmrBefore << " -> " << acmrAfter << ", LOD triangles:";
+		for (const VmcModel::Lod& lod : builder.lods)
+		{
+			std::cout << " " << lod.indexCount / 3;
+		}
+		std::cout << std::endl;
+	}
+
+	std::vector<VmcModel::PackedVertex> VmcMeshOptimizer::packVertices(const VmcModel::Vertex* vertices, size_t vertexCount, glm::mat4& dequantization)
+	{
+		glm::vec3 minimum{ std::numeric_limits<float>::max() };
+		glm::vec3 maximum{ std::numeric_limits<float>::lowest() };
+		for (size_t i = 0; i < vertexCount; i++)
+		{
+			minimum = glm::min(minimum, vertices[i].position);
+			maximum = glm::max(maximum, vertices[i].position);
+		}
+
+		// Positions are stored as snorm in [-1, 1] around the center of the bounding box
+		glm::vec3 center = (minimum + maximum) * 0.5f;
+		glm::vec3 halfExtent = (maximum - minimum) * 0.5f;
+		for (int axis = 0; axis < 3; axis++)
+		{
+			if (halfExtent[axis] <= 0.0f) halfExtent[axis] = 1.0f;
+		}
+		dequantization = glm::scale(glm::translate(glm::mat4{ 1.0f }, center), halfExtent);
+
+		auto snorm16 = [](float value) { return static_cast<int16_t>(std::lround(std::clamp(value, -1.0f, 1.0f) * 32767.0f)); };
+		auto snorm8 = [](float value) { return static_cast<int8_t>(std::lround(std::clamp(value, -1.0f, 1.0f) * 127.0f)); };
+		auto unorm8 = [](float value) { return static_cast<uint8_t>(std::lround(std::clamp(value, 0.0f, 1.0f) * 255.0f)); };
+
+		std::vector<VmcModel::PackedVertex> packed(vertexCount);
+		for (size_t i = 0; i < vertexCount; i++)
+		{
+			const VmcModel::Vertex& vertex = vertices[i];
+			VmcModel::PackedVertex& out = packed[i];
+
+			glm::vec3 position = (vertex.position - center) / halfExtent;
+			out.position[0] = snorm16(position.x);
+			out.position[1] = snorm16(position.y);
+			out.position[2] = snorm16(position.z);
+			out.position[3] = 0;
+
+			// The shader normalizes after transforming, only the direction matters
+			float length = glm::length(vertex.normal);
+			glm::vec3 normal = length > 0.0f ? vertex.normal / length : vertex.normal;
+			out.normal[0] = snorm8(normal.x);
+			out.normal[1] = snorm8(normal.y);
+			out.normal[2] = snorm8(normal.z);
+			out.normal[3] = 0;
+
+			out.color[0] = unorm8(vertex.color.r);
+			out.color[1] = unorm8(vertex.color.g);
+			out.color[2] = unorm8(vertex.color.b);
+			out.color[3] = 255;
+
+			out.uv[0] = glm::packHalf1x16(vertex.uv.x);
+			out.uv[1] = glm::packHalf1x16(vertex.uv.y);
+		}
+		return packed;
+	}
+}
@@ -0,0 +1,36 @@
+#pragma once
+#include "vmc_model.hpp"
+
+// std
+#include <vector>
+
+namespace vae {
+	/*
+		Import time optimizations of indexed triangle meshes. Reordering is lossless and keeps the exact same triangles.
+		ACMR (average cache miss ratio) is the number of vertex shader invocations per triangle for a FIFO post-transform
+		cache, between 0.5 for ideal meshes and 3 for a mesh without any reuse.
+	*/
+	class VmcMeshOptimizer
+	{
+	public:
+		static constexpr uint32_t CACHE_SIZE = 16;
+		static constexpr size_t MAX_LODS = 4;				// Including the full mesh
+		static constexpr size_t MIN_LOD_TRIANGLES = 16;
+		static constexpr double MAX_LOD_ERROR = 0.25;		// Largest simplification error, relative to the bounding sphere radius
+
+		static float computeACMR(const std::vector<uint32_t>& indices, size_t vertexCount, uint32_t cacheSize = CACHE_SIZE);
+
+		// Reorders the triangles for post-transform vertex cache locality (Tipsify, Sander et al. 2007)
+		static void optimizeVertexCache(std::vector<uint32_t>& indices, size_t vertexCount, uint32_t cacheSize = CACHE_SIZE);
+		// Reorders the vertices in the order the index buffer first references them, for vertex fetch locality
+		static void optimizeVertexFetch(std::vector<VmcModel::Vertex>& vertices, std::vector<uint32_t>& indices);
+		// Appends simplified versions of the mesh to the index buffer, each with about half the triangles of the previous one.
+		// Quadric error metric edge collapse (Garland and Heckbert 1997) onto existing vertices, so no vertices are added.
+		static void generateLods(VmcModel::Builder& builder);
+		// All of the above, prints the ACMR before and after
+		static void optimize(VmcModel::Builder& builder);
+
+		// Quantizes vertices relative to their bounding box, dequantization maps the packed positions back to model space
+		static std::vector<VmcModel::PackedVertex> packVertices(const VmcModel::Vertex* vertices, size_t vertexCount, glm::mat4& dequantization);
+	};
+}
@@ -1,6 +1,9 @@
 #include "vmc_model.hpp"
 #include "vmc_utils.hpp"
 #include "block_model.hpp"
+#include "vmc_mesh_cache.hpp"
+#include "vmc_mesh_optimizer.hpp"
+#include "vmc_thread_pool.hpp"
 
 // libs
 #define TINYOBJLOADER_IMPLEMENTATION
@@ -9,9 +12,11 @@
 #include <glm/gtx/hash.hpp>
 
 // std
+#include <algorithm>
 #include <cassert>
 #include <cstring>
 #include <iostream>
+#include <limits>
 #include <vector>
 #include <unordered_map>
 
@@ -29,12 +34,67 @@ namespace std {
 
 namespace vae {
 
-    VmcModel::VmcModel(VmcDevice& device, const VmcModel::Builder &builder) : vmcDevice{ device } {
-        og_vertex_data = builder.vertices;
-        old_vertex_data = builder.vertices;
-        new_vertex_data = builder.vertices;
-        createVertexBuffers(builder.vertices);
-        createIndexBuffers(builder.indices);
+    VmcModel::VmcModel(VmcDevice& device, const VmcModel::Builder &builder, VertexFormat format) : vmcDevice{ device }, vertexFormat{ format } {
+        if (vertexFormat == VERTEX_FORMAT_FULL) {
+            og_vertex_data = builder.vertices;
+            old_vertex_data = builder.vertices;
+            new_vertex_data = builder.vertices;
+        }
+        if (vertexFormat == VERTEX_FORMAT_VOXEL) {
+            const uint32_t count = static_cast<uint32_t>(builder.voxelVertices.size());
+            createVertexBuffers(builder.voxelVertices.data(), sizeof(VoxelVertex), count, count);
+        } else {
+            createVertexBuffers(builder.vertices.data(), static_cast<uint32_t>(builder.vertices.size()), static_cast<uint32_t>(builder.vertices.size()));
+        }
+        createIndexBuffers(builder.indices.data(), static_cast<uint32_t>(builder.indices.size()), static_cast<uint32_t>(builder.indices.size()));
+        lods = builder.lods;
+        if (lods.empty()) {
+            // Non-indexed models draw their vertices as triangles
+            lods.push_back({ 0, hasIndexBuffer ? indexCount : vertexCount, 0.0f });
+        }
+
+        minX = builder.minX;
+        maxX = builder.maxX;
+        minY = builder.minY;
+        maxY = builder.maxY;
+        minZ = builder.minZ;
+        maxZ = builder.maxZ;
+    }
+
+    VmcModel::VmcModel(VmcDevice& device, const VmcCachedMesh& mesh, VertexFormat format) : vmcDevice{ device }, vertexFormat{ format } {
+        // Straight from the mapped file into the staging buffers
+        createVertexBuffers(mesh.getVertices(), mesh.getVertexCount(), mesh.getVertexCount());
+        createIndexBuffers(mesh.getIndices(), mesh.getIndexCount(), mesh.getIndexCount());
+        lods.assign(mesh.getLods(), mesh.getLods() + mesh.getLodCount());
+
+        if (vertexFormat == VERTEX_FORMAT_FULL) {
+            og_vertex_data.assign(mesh.getVertices(), mesh.getVertices() + mesh.getVertexCount());
+            old_vertex_data = og_vertex_data;
+            new_vertex_data = og_vertex_data;
+        }
+
+        const float* bounds = mesh.getHeader().bounds;
+        minX = bounds[0];
+        maxX = bounds[1];
+        minY = bounds[2];
+        maxY = bounds[3];
+        minZ = bounds[4];
+        maxZ = bounds[5];
+    }
+
+    VmcModel::VmcModel(VmcDevice& device, const VmcModel::Builder& builder, uint32_t vertexCapacity, uint32_t indexCapacity, VertexFormat format) : vmcDevice{ device }, vertexFormat{ format } {
+        assert(format != VERTEX_FORMAT_PACKED && "Packed vertices can't be written in parts");
+        assert(builder.getVertexCount() <= vertexCapacity && builder.indices.size() <= indexCapacity && "Builder doesn't fit into the capacity");
+        if (vertexFormat == VERTEX_FORMAT_VOXEL) {
+            createVertexBuffers(builder.voxelVertices.data(), sizeof(VoxelVertex), static_cast<uint32_t>(builder.voxelVertices.size()), vertexCapacity);
+        } else {
+            createVertexBuffers(builder.vertices.data(), static_cast<uint32_t>(builder.vertices.size()), vertexCapacity);
+        }
+        createIndexBuffers(builder.indices.data(), static_cast<uint32_t>(builder.indices.size()), indexCapacity);
+        lods = builder.lods;
+        if (lods.empty()) {
+            lods.push_back({ 0, indexCount, 0.0f });
+        }
 
         minX = builder.minX;
         maxX = builder.maxX;
@@ -44,92 +104,171 @@ namespace vae {
         maxZ = builder.maxZ;
     }
 
-    VmcModel::~VmcModel() {}
+    VmcModel::~VmcModel() {
+        // The buffers may not be destroyed while the copies into them are still running
+        if (!isReady()) {
+            vmcDevice.getUploadQueue().wait(uploadTicket);
+        }
+        if (!vmcDevice.getUploadQueue().isComplete(writeTicket)) {
+            vmcDevice.getUploadQueue().wait(writeTicket);
+        }
+    }
+
+    bool VmcModel::isReady() {
+        if (!uploaded) {
+            uploaded = vmcDevice.getUploadQueue().isComplete(uploadTicket);
+        }
+        return uploaded;
+    }
 
-    std::unique_ptr<VmcModel> VmcModel::createModelFromFile(VmcDevice& device, const std::string& filePath)
+    std::unique_ptr<VmcModel> VmcModel::createModelFromFile(VmcDevice& device, const std::string& filePath, VertexFormat format)
     {
+        if (std::unique_ptr<VmcCachedMesh> cachedMesh = VmcCachedMesh::load(filePath)) {
+            std::cout << "Loaded cached model with " << cachedMesh->getVertexCount() << " vertices." << std::endl;
+            return std::make_unique<VmcModel>(device, *cachedMesh, format);
+        }
+
+        // The cache stores the optimized mesh, so this only runs on the first import
         Builder builder{};
         builder.loadModel(filePath);
+        VmcMeshOptimizer::optimize(builder);
+        VmcCachedMesh::store(filePath, builder);
         std::cout << "Successfully loaded model with " << builder.vertices.size() << " vertices." << std::endl;
         std::cout << "Min X: " << builder.minX << " Max X: " << builder.maxX << "Min Y: " << builder.minY << " Max Y: " << builder.maxY << "Min Z: " << builder.minZ << " Max Z: " << builder.maxZ << std::endl;
-        return std::make_unique<VmcModel>(device, builder);
+        return std::make_unique<VmcModel>(device, builder, format);
     }
 
-    std::unique_ptr<VmcModel> VmcModel::createChunkModelMesh(VmcDevice& device, const ChunkComponent* chunk)
+    std::unique_ptr<VmcModel> VmcModel::createChunkModelMesh(VmcDevice& device, const ChunkComponent* chunk, ChunkMeshMode mode)
     {
         Builder builder{};
-        builder.updateChunkMesh(chunk);
+        builder.updateChunkMesh(chunk, mode);
         std::cout << "Successfully built chunk model with " << builder.vertices.size() << " vertices." << std::endl;
         return std::make_unique<VmcModel>(device, builder);
     }
 
 
-    void VmcModel::createVertexBuffers(const std::vector<Vertex>& vertices) {
-        vertexCount = static_cast<uint32_t>(vertices.size());
-        assert(vertexCount >= 3 && "Vertex count must be at least 3");
-        VkDeviceSize bufferSize = sizeof(vertices[0]) * vertexCount;
-        uint32_t vertexSize = sizeof(vertices[0]);
-
-        VmcBuffer stagingBuffer{
-            vmcDevice,
-            vertexSize,
-            vertexCount,
-            VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-        };
+    void VmcModel::createVertexBuffers(const Vertex* vertices, uint32_t count, uint32_t capacity) {
+        if (vertexFormat == VERTEX_FORMAT_PACKED) {
+            std::vector<PackedVertex> packedVertices = VmcMeshOptimizer::packVertices(vertices, count, positionDequantization);
+            std::cout << "Packed " << count << " vertices: " << sizeof(Vertex) * count / 1024 << " KiB -> "
+                << sizeof(PackedVertex) * count / 1024 << " KiB" << std::endl;
+            createVertexBuffers(packedVertices.data(), sizeof(PackedVertex), count, capacity);
+        } else {
+            createVertexBuffers(vertices, sizeof(Vertex), count, capacity);
+        }
+    }
 
-        stagingBuffer.map();
-        stagingBuffer.writeToBuffer((void*)vertices.data());
+    void VmcModel::createVertexBuffers(const void* vertexData, uint32_t vertexSize, uint32_t count, uint32_t capacity) {
+        vertexCount = count;
+        vertexCapacity = capacity;
+        assert((vertexCount >= 3 || vertexCapacity > vertexCount) && "Vertex count must be at least 3");
+        VkDeviceSize bufferSize = static_cast<VkDeviceSize>(vertexSize) * vertexCount;
 
         vertexBuffer = std::make_unique<VmcBuffer>(
             vmcDevice,
             vertexSize,
-            vertexCount,
+            vertexCapacity,
             VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
             VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
             );
 
-        vmcDevice.copyBuffer(stagingBuffer.getBuffer(), vertexBuffer->getBuffer(), bufferSize);
+        if (vertexCount == 0) return;
+        uploadTicket = vmcDevice.getUploadQueue().uploadBuffer(
+            vertexBuffer->getBuffer(),
+            vertexData,
+            bufferSize,
+            VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT,
+            VK_PIPELINE_STAGE_VERTEX_INPUT_BIT);
     }
 
-    void VmcModel::createIndexBuffers(const std::vector<uint32_t>& indices) {
-        indexCount = static_cast<uint32_t>(indices.size());
-        hasIndexBuffer = indexCount > 0;
+    void VmcModel::createIndexBuffers(const uint32_t* indices, uint32_t count, uint32_t capacity) {
+        indexCount = count;
+        indexCapacity = capacity;
+        hasIndexBuffer = indexCapacity > 0;
         if (!hasIndexBuffer) return;
 
-        VkDeviceSize bufferSize = sizeof(indices[0]) * indexCount;
-        uint32_t indexSize = sizeof(indices[0]);
+        VkDeviceSize bufferSize = sizeof(uint32_t) * indexCount;
+        uint32_t indexSize = sizeof(uint32_t);
         
-        VmcBuffer stagingBuffer{
-            vmcDevice,
-            indexSize,
-            indexCount,
-            VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
-        };
-
-        stagingBuffer.map();
-        stagingBuffer.writeToBuffer((void*)indices.data());
-
         indexBuffer = std::make_unique<VmcBuffer>(
             vmcDevice,
             indexSize,
-            indexCount,
+            indexCapacity,
             VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
             VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
             );
 
-        vmcDevice.copyBuffer(stagingBuffer.getBuffer(), indexBuffer->getBuffer(), bufferSize);
+        // Same batch as the vertex buffer unless that one triggered an automatic flush
+        if (indexCount == 0) return;
+        uploadTicket = std::max(uploadTicket, vmcDevice.getUploadQueue().uploadBuffer(
+            indexBuffer->getBuffer(),
+            indices,
+            bufferSize,
+            VK_ACCESS_INDEX_READ_BIT,
+            VK_PIPELINE_STAGE_VERTEX_INPUT_BIT));
     }
 
-    void VmcModel::draw(VkCommandBuffer commandBuffer) {
-        if (hasIndexBuffer) {
-            vkCmdDrawIndexed(commandBuffer, indexCount, 1, 0, 0, 0);
+    uint32_t VmcModel::selectLod(float pixelsPerUnit) const {
+        uint32_t lod = 0;
+        while (lod + 1 < lods.size() && lods[lod + 1].error * pixelsPerUnit <= LOD_PIXEL_ERROR) {
+            lod++;
+        }
+        return lod;
+    }
+
+    void VmcModel::draw(VkCommandBuffer commandBuffer, uint32_t lod, uint32_t instanceCount) {
+        if (hasDrawRanges) {
+            for (const DrawRange& range : drawRanges) {
+                vkCmdDrawIndexed(commandBuffer, range.indexCount, instanceCount, range.firstIndex, range.vertexOffset, 0);
+            }
+        } else if (hasIndexBuffer) {
+            vkCmdDrawIndexed(commandBuffer, lods[lod].indexCount, instanceCount, lods[lod].firstIndex, 0, 0);
         } else {
-            vkCmdDraw(commandBuffer, vertexCount, 1, 0, 0);
+            vkCmdDraw(commandBuffer, vertexCount, instanceCount, 0, 0);
         }
     }
 
+    void VmcModel::writeVertices(uint32_t firstVertex, const Vertex* vertices, uint32_t count) {
+        assert(og_vertex_data.empty() && "Deformable models keep their own copy of the vertices");
+        assert(vertexFormat == VERTEX_FORMAT_FULL && "Vertices of another format");
+        writeVertexData(firstVertex, vertices, sizeof(Vertex), count);
+    }
+
+    void VmcModel::writeVertices(uint32_t firstVertex, const VoxelVertex* vertices, uint32_t count) {
+        assert(vertexFormat == VERTEX_FORMAT_VOXEL && "Vertices of another format");
+        writeVertexData(firstVertex, vertices, sizeof(VoxelVertex), count);
+    }
+
+    void VmcModel::writeVertexData(uint32_t firstVertex, const void* vertices, uint32_t vertexSize, uint32_t count) {
+        assert(firstVertex + count <= vertexCapacity && "Vertices outside of the buffer");
+        if (count == 0) return;
+        writeTicket = std::max(writeTicket, vmcDevice.getUploadQueue().uploadBuffer(
+            vertexBuffer->getBuffer(),
+            vertices,
+            static_cast<VkDeviceSize>(vertexSize) * count,
+            VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT,
+            VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+            static_cast<VkDeviceSize>(vertexSize) * firstVertex));
+    }
+
+    void VmcModel::writeIndices(uint32_t firstIndex, const uint32_t* indices, uint32_t count) {
+        assert(firstIndex + count <= indexCapacity && "Indices outside of the buffer");
+        if (count == 0) return;
+        writeTicket = std::max(writeTicket, vmcDevice.getUploadQueue().uploadBuffer(
+            indexBuffer->getBuffer(),
+            indices,
+            sizeof(uint32_t) * count,
+            VK_ACCESS_INDEX_READ_BIT,
+            VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+            sizeof(uint32_t) * firstIndex));
+    }
+
+    void VmcModel::setDrawRanges(std::vector<DrawRange> ranges) {
+        assert(hasIndexBuffer && "Draw ranges need an index buffer");
+        drawRanges = std::move(ranges);
+        hasDrawRanges = true;
+    }
+
     void VmcModel::bind(VkCommandBuffer commandBuffer) {
         VkBuffer buffers[] = { vertexBuffer->getBuffer() };
         VkDeviceSize offsets[] = { 0 };
@@ -160,11 +299,17 @@ namespace vae {
 
     void VmcModel::updateVertexBuffers()
     {
+        assert(vertexFormat == VERTEX_FORMAT_FULL && "Packed models can't be deformed");
         vertexCount = static_cast<uint32_t>(new_vertex_data.size());
         assert(vertexCount >= 3 && "Vertex count must be at least 3");
         VkDeviceSize bufferSize = sizeof(Vertex) * vertexCount;
         uint32_t vertexSize = sizeof(Vertex);
 
+        // The initial upload has to land before it can be overwritten
+        if (!isReady()) {
+            vmcDevice.getUploadQueue().wait(uploadTicket);
+        }
+
         VmcBuffer stagingBuffer{
             vmcDevice,
             vertexSize,
@@ -224,7 +369,282 @@ namespace vae {
         return attributeDescriptions;
     }
 
-    void VmcModel::Builder::loadModel(const std::string& filePath)
+    std::vector<VkVertexInputBindingDescription> VmcModel::PackedVertex::getBindingDescriptions() {
+        std::vector<VkVertexInputBindingDescription> bindingDescriptions(1);
+        bindingDescriptions[0].binding = 0;
+        bindingDescriptions[0].stride = sizeof(PackedVertex);
+        bindingDescriptions[0].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+        return bindingDescriptions;
+    }
+
+    // Same locations as Vertex, the formats expand to floats so the same shaders can be used
+    std::vector<VkVertexInputAttributeDescription> VmcModel::PackedVertex::getAttributeDescriptions() {
+        std::vector<VkVertexInputAttributeDescription> attributeDescriptions(4);
+
+        // vertex position
+        attributeDescriptions[0].binding = 0;
+        attributeDescriptions[0].location = 0;
+        attributeDescriptions[0].format = VK_FORMAT_R16G16B16A16_SNORM;
+        attributeDescriptions[0].offset = offsetof(PackedVertex, position);
+
+        // vertex color
+        attributeDescriptions[1].binding = 0;
+        attributeDescriptions[1].location = 1;
+        attributeDescriptions[1].format = VK_FORMAT_R8G8B8A8_UNORM;
+        attributeDescriptions[1].offset = offsetof(PackedVertex, color);
+
+        // normal
+        attributeDescriptions[2].binding = 0;
+        attributeDescriptions[2].location = 2;
+        attributeDescriptions[2].format = VK_FORMAT_R8G8B8A8_SNORM;
+        attributeDescriptions[2].offset = offsetof(PackedVertex, normal);
+
+        // uv
+        attributeDescriptions[3].binding = 0;
+        attributeDescriptions[3].location = 3;
+        attributeDescriptions[3].format = VK_FORMAT_R16G16_SFLOAT;
+        attributeDescriptions[3].offset = offsetof(PackedVertex, uv);
+        return attributeDescriptions;
+    }
+
+    std::vector<VkVertexInputBindingDescription> VmcModel::VoxelVertex::getBindingDescriptions() {
+        std::vector<VkVertexInputBindingDescription> bindingDescriptions(1);
+        bindingDescriptions[0].binding = 0;
+        bindingDescriptions[0].stride = sizeof(VoxelVertex);
+        bindingDescriptions[0].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+        return bindingDescriptions;
+    }
+
+    // One uint, the shader unpacks the fields
+    std::vector<VkVertexInputAttributeDescription> VmcModel::VoxelVertex::getAttributeDescriptions() {
+        std::vector<VkVertexInputAttributeDescription> attributeDescriptions(1);
+        attributeDescriptions[0].binding = 0;
+        attributeDescriptions[0].location = 0;
+        attributeDescriptions[0].format = VK_FORMAT_R32_UINT;
+        attributeDescriptions[0].offset = offsetof(VoxelVertex, data);
+        return attributeDescriptions;
+    }
+
+    namespace {
+        // Imports with fewer corners than this are not worth starting threads for
+        constexpr size_t PARALLEL_IMPORT_THRESHOLD = 1 << 16;
+        constexpr uint32_t IMPORT_SHARD_BITS = 6;
+        constexpr uint32_t NO_CORNER = std::numeric_limits<uint32_t>::max();
+
+        struct Bounds {
+            float minX = std::numeric_limits<float>::max();
+            float minY = std::numeric_limits<float>::max();
+            float minZ = std::numeric_limits<float>::max();
+            float maxX = std::numeric_limits<float>::min();
+            float maxY = std::numeric_limits<float>::min();
+            float maxZ = std::numeric_limits<float>::min();
+        };
+
+        VmcModel::Vertex buildVertex(const tinyobj::attrib_t& attrib, const tinyobj::index_t& index, Bounds& bounds) {
+            VmcModel::Vertex vertex{};
+
+            // Reading vertex position
+            if (index.vertex_index >= 0) {
+                vertex.position = {
+                    attrib.vertices[3 * index.vertex_index + 0],
+                    attrib.vertices[3 * index.vertex_index + 1],
+                    attrib.vertices[3 * index.vertex_index + 2],
+                };
+
+                // Object boundaries
+                bounds.minX = std::min(bounds.minX, vertex.position.x);
+                bounds.maxX = std::max(bounds.maxX, vertex.position.x);
+                bounds.minY = std::min(bounds.minY, vertex.position.y);
+                bounds.maxY = std::max(bounds.maxY, vertex.position.y);
+                bounds.minZ = std::min(bounds.minZ, vertex.position.z);
+                bounds.maxZ = std::max(bounds.maxZ, vertex.position.z);
+
+                // Vertex color expansion (not supported in .OBJ by default, but tinyobjloader supports it)
+                // The vertex RGB color appears in the .OBJ file right after the vertex position.
+                vertex.color = {
+                        attrib.colors[3 * index.vertex_index + 0],
+                        attrib.colors[3 * index.vertex_index + 1],
+                        attrib.colors[3 * index.vertex_index + 2],
+                };
+            }
+
+            // Reading normal
+            if (index.normal_index >= 0) {
+                vertex.normal = {
+                    attrib.normals[3 * index.normal_index + 0],
+                    attrib.normals[3 * index.normal_index + 1],
+                    attrib.normals[3 * index.normal_index + 2],
+                };
+            }
+
+            // Reading UV coords
+            if (index.texcoord_index >= 0) {
+                vertex.uv = {
+                    attrib.texcoords[3 * index.texcoord_index + 0],
+                    attrib.texcoords[3 * index.texcoord_index + 1],
+                };
+            }
+            return vertex;
+        }
+
+        void deduplicateSequential(const tinyobj::attrib_t& attrib, const std::vector<tinyobj::index_t>& corners,
+            std::vector<VmcModel::Vertex>& vertices, std::vector<uint32_t>& indices, Bounds& bounds) {
+            // We avoid vertex duplication by using an index buffer 
+            // (unordered map checks whether a vertex has already been referenced before)
+            std::unordered_map<VmcModel::Vertex, uint32_t> uniqueVertices{};
+            indices.reserve(corners.size());
+            for (const auto& corner : corners) {
+                VmcModel::Vertex vertex = buildVertex(attrib, corner, bounds);
+                auto inserted = uniqueVertices.emplace(vertex, static_cast<uint32_t>(vertices.size()));
+                if (inserted.second) {
+                    vertices.push_back(vertex);
+                }
+                indices.push_back(inserted.first->second);
+            }
+        }
+
+        /*
+            Same result as deduplicateSequential, built in four parallel passes:
+            1. every chunk of corners builds and hashes its vertices and sorts the corner numbers into shards by hash
+            2. every shard finds, with its own open addressing table, the first corner with an equal vertex for each corner.
+               Shards are filled in corner order, so the first corner inserted into a slot is the first occurrence.
+            3. every chunk numbers its first occurrences, offset by the count of all earlier chunks
+            4. every chunk looks up the number of the first occurrence of each of its corners
+        */
+        void deduplicateParallel(const tinyobj::attrib_t& attrib, const std::vector<tinyobj::index_t>& corners,
+            std::vector<VmcModel::Vertex>& vertices, std::vector<uint32_t>& indices, Bounds& bounds) {
+            VmcThreadPool pool{};
+            const size_t cornerCount = corners.size();
+            const size_t chunkCount = std::min<size_t>(pool.getThreadCount() * 4, cornerCount);
+            const size_t chunkSize = (cornerCount + chunkCount - 1) / chunkCount;
+            const uint32_t shardCount = 1u << IMPORT_SHARD_BITS;
+
+            auto forEachChunk = [&](auto&& job) {
+                for (size_t c = 0; c < chunkCount; c++) {
+                    size_t begin = c * chunkSize;
+                    size_t end = std::min(begin + chunkSize, cornerCount);
+                    pool.addJob([&job, c, begin, end]() { job(c, begin, end); });
+                }
+                pool.wait();
+            };
+
+            // Pass 1
+            std::vector<VmcModel::Vertex> cornerVertices(cornerCount);
+            std::vector<uint64_t> cornerHashes(cornerCount);
+            std::vector<Bounds> chunkBounds(chunkCount);
+            std::vector<uint32_t> shardCounts(chunkCount * shardCount, 0);
+            forEachChunk([&](size_t c, size_t begin, size_t end) {
+                std::hash<VmcModel::Vertex> hasher{};
+                for (size_t i = begin; i < end; i++) {
+                    cornerVertices[i] = buildVertex(attrib, corners[i], chunkBounds[c]);
+                    // Spread the bits, the shard is taken from the top and the table slot from the bottom
+                    cornerHashes[i] = static_cast<uint64_t>(hasher(cornerVertices[i])) * 0x9e3779b97f4a7c15ull;
+                    shardCounts[c * shardCount + (cornerHashes[i] >> (64 - IMPORT_SHARD_BITS))]++;
+                }
+            });
+
+            std::vector<uint32_t> shardStarts(shardCount + 1, 0);
+            std::vector<uint32_t> scatterOffsets(chunkCount * shardCount);
+            uint32_t offset = 0;
+            for (uint32_t s = 0; s < shardCount; s++) {
+                shardStarts[s] = offset;
+                for (size_t c = 0; c < chunkCount; c++) {
+                    scatterOffsets[c * shardCount + s] = offset;
+                    offset += shardCounts[c * shardCount + s];
+                }
+            }
+            shardStarts[shardCount] = offset;
+
+            std::vector<uint32_t> shardCorners(cornerCount);
+            forEachChunk([&](size_t c, size_t begin, size_t end) {
+                uint32_t* chunkOffsets = &scatterOffsets[c * shardCount];
+                for (size_t i = begin; i < end; i++) {
+                    shardCorners[chunkOffsets[cornerHashes[i] >> (64 - IMPORT_SHARD_BITS)]++] = static_cast<uint32_t>(i);
+                }
+            });
+
+            // Pass 2
+            std::vector<uint32_t> firstOccurrence(cornerCount);
+            for (uint32_t s = 0; s < shardCount; s++) {
+                pool.addJob([&, s]() {
+                    uint32_t begin = shardStarts[s];
+                    uint32_t end = shardStarts[s + 1];
+                    size_t tableSize = 16;
+                    while (tableSize < 2 * static_cast<size_t>(end - begin)) tableSize *= 2;
+                    std::vector<uint32_t> table(tableSize, NO_CORNER);
+                    const size_t mask = tableSize - 1;
+
+                    for (uint32_t k = begin; k < end; k++) {
+                        uint32_t corner = shardCorners[k];
+                        uint64_t hash = cornerHashes[corner];
+                        size_t slot = static_cast<size_t>(hash ^ (hash >> 32)) & mask;
+                        while (true) {
+                            uint32_t existing = table[slot];
+                            if (existing == NO_CORNER) {
+                                table[slot] = corner;
+                                firstOccurrence[corner] = corner;
+                                break;
+                            }
+                            if (cornerHashes[existing] == hash && cornerVertices[existing] == cornerVertices[corner]) {
+                                firstOccurrence[corner] = existing;
+                                break;
+                            }
+                            slot = (slot + 1) & mask;
+                        }
+                    }
+                });
+            }
+            pool.wait();
+
+            // Pass 3
+            std::vector<uint32_t> chunkUniqueCounts(chunkCount, 0);
+            forEachChunk([&](size_t c, size_t begin, size_t end) {
+                for (size_t i = begin; i < end; i++) {
+                    if (firstOccurrence[i] == i) chunkUniqueCounts[c]++;
+                }
+            });
+
+            std::vector<uint32_t> chunkUniqueStarts(chunkCount);
+            uint32_t uniqueCount = 0;
+            for (size_t c = 0; c < chunkCount; c++) {
+                chunkUniqueStarts[c] = uniqueCount;
+                uniqueCount += chunkUniqueCounts[c];
+            }
+
+            // Number of the unique vertex, only valid for first occurrences
+            std::vector<uint32_t> vertexNumbers(cornerCount);
+            vertices.resize(uniqueCount);
+            forEachChunk([&](size_t c, size_t begin, size_t end) {
+                uint32_t number = chunkUniqueStarts[c];
+                for (size_t i = begin; i < end; i++) {
+                    if (firstOccurrence[i] == i) {
+                        vertexNumbers[i] = number;
+                        vertices[number] = cornerVertices[i];
+                        number++;
+                    }
+                }
+            });
+
+            // Pass 4
+            indices.resize(cornerCount);
+            forEachChunk([&](size_t c, size_t begin, size_t end) {
+                for (size_t i = begin; i < end; i++) {
+                    indices[i] = vertexNumbers[firstOccurrence[i]];
+                }
+            });
+
+            for (const Bounds& chunk : chunkBounds) {
+                bounds.minX = std::min(bounds.minX, chunk.minX);
+                bounds.maxX = std::max(bounds.maxX, chunk.maxX);
+                bounds.minY = std::min(bounds.minY, chunk.minY);
+                bounds.maxY = std::max(bounds.maxY, chunk.maxY);
+                bounds.minZ = std::min(bounds.minZ, chunk.minZ);
+                bounds.maxZ = std::max(bounds.maxZ, chunk.maxZ);
+            }
+        }
+    }
+
+    void VmcModel::Builder::loadModel(const std::string& filePath, ImportMode mode)
     {
         tinyobj::attrib_t attrib;
         std::vector<tinyobj::shape_t> shapes;
@@ -238,160 +658,251 @@ namespace vae {
         vertices.clear();
         indices.clear();
 
-        std::unordered_map<Vertex, uint32_t> uniqueVertices{};
+        // All shapes end up in one mesh, so their index streams are handled as one
+        std::vector<tinyobj::index_t> corners;
+        size_t cornerCount = 0;
+        for (const auto& shape : shapes) {
+            cornerCount += shape.mesh.indices.size();
+        }
+        if (cornerCount >= std::numeric_limits<uint32_t>::max()) {
+            throw std::runtime_error("Model has too many indices: " + filePath);
+        }
+        corners.reserve(cornerCount);
+        for (const auto& shape : shapes) {
+            corners.insert(corners.end(), shape.mesh.indices.begin(), shape.mesh.indices.end());
+        }
 
-        minX = std::numeric_limits<float>::max();
-        minY = std::numeric_limits<float>::max();
-        minZ = std::numeric_limits<float>::max();
+        if (mode == IMPORT_AUTOMATIC) {
+            mode = cornerCount >= PARALLEL_IMPORT_THRESHOLD ? IMPORT_PARALLEL : IMPORT_SEQUENTIAL;
+        }
 
-        maxX = std::numeric_limits<float>::min();
-        maxY = std::numeric_limits<float>::min();
-        maxZ = std::numeric_limits<float>::min();
-        
-        for (const auto& shape : shapes) {
-            for (const auto& index : shape.mesh.indices) {
-                Vertex vertex{};
-
-                // Reading vertex position
-                if (index.vertex_index >= 0) {
-                    vertex.position = {
-                        attrib.vertices[3 * index.vertex_index + 0],
-                        attrib.vertices[3 * index.vertex_index + 1],
-                        attrib.vertices[3 * index.vertex_index + 2], 
-                    };
-
-                    // Object boundaries
-                    if (attrib.vertices[3 * index.vertex_index + 0] < minX) {
-                        minX = attrib.vertices[3 * index.vertex_index + 0];
-                    }
-                    if (attrib.vertices[3 * index.vertex_index + 0] > maxX) {
-                        maxX = attrib.vertices[3 * index.vertex_index + 0];
-                    }
-                    if (attrib.vertices[3 * index.vertex_index + 1] < minY) {
-                        minY = attrib.vertices[3 * index.vertex_index + 1];
-                    }
-                    if (attrib.vertices[3 * index.vertex_index + 1] > maxY) {
-                        maxY = attrib.vertices[3 * index.vertex_index + 1];
-                    }
-                    if (attrib.vertices[3 * index.vertex_index + 2] < minZ) {
-                        minZ = attrib.vertices[3 * index.vertex_index + 2];
-                    }
-                    if (attrib.vertices[3 * index.vertex_index + 2] > maxZ) {
-                        maxZ = attrib.vertices[3 * index.vertex_index + 2];
+        Bounds bounds{};
+        if (mode == IMPORT_PARALLEL && cornerCount > 0) {
+            deduplicateParallel(attrib, corners, vertices, indices, bounds);
+        } else {
+            deduplicateSequential(attrib, corners, vertices, indices, bounds);
+        }
+
+        minX = bounds.minX;
+        maxX = bounds.maxX;
+        minY = bounds.minY;
+        maxY = bounds.maxY;
+        minZ = bounds.minZ;
+        maxZ = bounds.maxZ;
+    }
+
+    namespace {
+        // Writes block faces as indexed quads. A quad covers the faces of a box of blocks, the box is one block thick
+        // along the normal of the face. UVs repeat once per block. Voxel vertices also get ambient occlusion.
+        class ChunkQuadWriter {
+        public:
+            static constexpr uint32_t UNOCCLUDED = 0xff;   // NO_OCCLUSION in all 4 corners
+
+            ChunkQuadWriter(const ChunkComponent& chunk, VmcModel::Builder& builder, VmcModel::VertexFormat format) :
+                chunk{ chunk }, builder{ builder }, voxel{ format == VmcModel::VERTEX_FORMAT_VOXEL } {
+                assert(format == VmcModel::VERTEX_FORMAT_FULL || format == VmcModel::VERTEX_FORMAT_VOXEL);
+                // Indexed by BlockFace
+                const std::vector<glm::vec3>* corners[6] = { &block.neg_y_face, &block.pos_y_face, &block.neg_x_face, &block.pos_x_face, &block.neg_z_face, &block.pos_z_face };
+                const glm::vec3 normals[6] = { block.normals[4], block.normals[1], block.normals[3], block.normals[0], block.normals[5], block.normals[2] };
+                const glm::vec3 colors[6] = {
+                    { 0.f, 1.f, 1.f },  // up, cyan
+                    { 1.f, 1.f, 0.f },  // down, yellow
+                    { 1.f, 0.f, 1.f },  // left, purple
+                    { 0.f, 0.f, 1.f },  // right, blue
+                    { 0.f, 1.f, 0.f },  // front, green
+                    { 1.f, 0.f, 0.f },  // back, red
+                };
+
+                // The block model lists every face as two triangles, corners 0, 1, 2 and 4 are the distinct ones
+                const int quadCorners[4] = { 0, 1, 2, 4 };
+                for (int f = 0; f < 6; f++) {
+                    FaceGeometry& geometry = faces[f];
+                    for (int c = 0; c < 4; c++) {
+                        geometry.corners[c] = (*corners[f])[quadCorners[c]];
+                        geometry.uvs[c] = block.uvs[quadCorners[c]];
                     }
+                    geometry.normal = normals[f];
+                    geometry.direction = glm::ivec3(normals[f]);
+                    geometry.color = colors[f];
+                    // u changes between corners 1 and 2 of the block model, v between corners 0 and 1
+                    geometry.uAxis = changingAxis((*corners[f])[1], (*corners[f])[2]);
+                    geometry.vAxis = changingAxis((*corners[f])[0], (*corners[f])[1]);
+                }
+            }
 
-                    // Vertex color expansion (not supported in .OBJ by default, but tinyobjloader supports it)
-                    // The vertex RGB color appears in the .OBJ file right after the vertex position.
-                    vertex.color = {
-                            attrib.colors[3 * index.vertex_index + 0],
-                            attrib.colors[3 * index.vertex_index + 1],
-                            attrib.colors[3 * index.vertex_index + 2],
-                    };
+            bool hasAmbientOcclusion() const { return voxel; }
+
+            // 2 bits per corner of the face of the block. Every solid block in front of the face that touches the corner
+            // darkens it, a corner between two solid sides is fully dark no matter what is diagonal to it.
+            uint32_t computeAmbientOcclusion(int face, const glm::ivec3& position) const {
+                const FaceGeometry& geometry = faces[face];
+                const glm::ivec3 front = position + geometry.direction;
+                uint32_t occlusion = 0;
+                for (int c = 0; c < 4; c++) {
+                    glm::ivec3 sideU = front;
+                    glm::ivec3 sideV = front;
+                    sideU[geometry.uAxis] += geometry.corners[c][geometry.uAxis] > 0.0f ? 1 : -1;
+                    sideV[geometry.vAxis] += geometry.corners[c][geometry.vAxis] > 0.0f ? 1 : -1;
+                    const glm::ivec3 diagonal = sideU + sideV - front;
+
+                    const int solidSides = isSolid(sideU) + isSolid(sideV);
+                    const uint32_t level = solidSides == 2 ? 0 : VmcModel::VoxelVertex::NO_OCCLUSION - solidSides - isSolid(diagonal);
+                    occlusion |= level << (2 * c);
                 }
+                return occlusion;
+            }
+
+            // first and last are the block coordinates of opposite corners of the box
+            void writeQuad(int face, const glm::ivec3& first, const glm::ivec3& last, BlockType type, uint32_t occlusion = UNOCCLUDED) {
+                const FaceGeometry& geometry = faces[face];
+                const uint32_t firstVertex = builder.getVertexCount();
+                if (voxel) {
+                    // The corners of the box, the shader moves them back by half a block
+                    static_assert(BLOCK_X_OFFSET == 1 && BLOCK_Y_OFFSET == 1 && BLOCK_Z_OFFSET == 1, "Voxel vertices are on the block grid");
+                    assert(last.x < (1 << VmcModel::VoxelVertex::X_BITS) - 1 && last.y < (1 << VmcModel::VoxelVertex::Y_BITS) - 1
+                        && last.z < (1 << VmcModel::VoxelVertex::Z_BITS) - 1 && "Chunk too large for voxel vertices");
+                    for (int c = 0; c < 4; c++) {
+                        glm::ivec3 corner;
+                        for (int axis = 0; axis < 3; axis++) {
+                            corner[axis] = geometry.corners[c][axis] > 0.0f ? last[axis] + 1 : first[axis];
+                        }
+                        builder.voxelVertices.push_back(VmcModel::VoxelVertex::encode(corner.x, corner.y, corner.z,
+                            static_cast<BlockFace>(face), type, (occlusion >> (2 * c)) & 3));
+                    }
+                } else {
+                    const glm::vec3 blockOffset{ BLOCK_X_OFFSET, BLOCK_Y_OFFSET, BLOCK_Z_OFFSET };
+                    const glm::ivec3 size = last - first + glm::ivec3{ 1 };
+                    const glm::vec2 uvScale{ size[geometry.uAxis], size[geometry.vAxis] };
 
-                // Reading normal
-                if (index.normal_index >= 0) {
-                    vertex.normal = {
-                        attrib.normals[3 * index.normal_index + 0],
-                        attrib.normals[3 * index.normal_index + 1],
-                        attrib.normals[3 * index.normal_index + 2],
-                    };
+                    VmcModel::Vertex vertex{};
+                    vertex.normal = geometry.normal;
+                    vertex.color = geometry.color;
+                    for (int c = 0; c < 4; c++) {
+                        const glm::vec3& corner = geometry.corners[c];
+                        for (int axis = 0; axis < 3; axis++) {
+                            vertex.position[axis] = corner[axis] + blockOffset[axis] * (corner[axis] > 0.0f ? last[axis] : first[axis]);
+                        }
+                        vertex.uv = geometry.uvs[c] * uvScale;
+                        builder.vertices.push_back(vertex);
+                    }
                 }
 
-                // Reading UV coords
-                if (index.texcoord_index >= 0) {
-                    vertex.uv = {
-                        attrib.texcoords[3 * index.texcoord_index + 0],
-                        attrib.texcoords[3 * index.texcoord_index + 1],
-                    };
+                // Occlusion is interpolated across the triangles, splitting along the brighter diagonal keeps a dark
+                // corner from bleeding into both of them
+                const uint32_t quadIndices[6] = { 0, 1, 2, 2, 3, 0 };
+                const uint32_t flippedIndices[6] = { 1, 2, 3, 3, 0, 1 };
+                const bool flip = (occlusion & 3) + (occlusion >> 4 & 3) < (occlusion >> 2 & 3) + (occlusion >> 6 & 3);
+                for (uint32_t index : flip ? flippedIndices : quadIndices) {
+                    builder.indices.push_back(firstVertex + index);
                 }
+            }
 
-                // We avoid vertex duplication by using an index buffer 
-                // (unordered map checks whether a vertex has already been referenced before)
-                if (uniqueVertices.count(vertex) == 0) {
-                    uniqueVertices[vertex] = static_cast<uint32_t>(vertices.size());
-                    vertices.push_back(vertex);
-               }
-                indices.push_back(uniqueVertices[vertex]);
+        private:
+            struct FaceGeometry {
+                glm::vec3 corners[4];
+                glm::vec2 uvs[4];
+                glm::vec3 normal;
+                glm::ivec3 direction;   // To the block in front of the face
+                glm::vec3 color;
+                int uAxis;
+                int vAxis;
+            };
+
+            static int changingAxis(const glm::vec3& a, const glm::vec3& b) {
+                return a.x != b.x ? 0 : (a.y != b.y ? 1 : 2);
             }
-        }
-    }
 
-    void VmcModel::Builder::updateChunkMesh(const ChunkComponent* chunk)
-    {
-        BlockModel block;
+            // The padding of the chunk is air, so this also works for the blocks right outside of it
+            bool isSolid(const glm::ivec3& position) const {
+                return chunk.isSolid(position.x, position.y, position.z);
+            }
 
-        for (int i = 0; i < chunk->getHeight(); i++) {
-            for (int j = 0; j < chunk->getWidth(); j++) {
-                for (int k = 0; k < chunk->getWidth(); k++) {
-                    std::vector<BlockFace> visibleFaces = chunk->getVisibleBlockFaces(k, i, j);
-                    VmcModel::Vertex vertex{};
+            BlockModel block;
+            FaceGeometry faces[6];
+            const ChunkComponent& chunk;
+            VmcModel::Builder& builder;
+            bool voxel;
+        };
 
-                    for (BlockFace face : visibleFaces) {
-                        switch (face)
-                        {
-                        case vae::BlockFace::up:
-                            for (int s = 0; s < 6; s++)
-                            {
-                                vertex.position = { block.neg_y_face[s].x + BLOCK_X_OFFSET * k, block.neg_y_face[s].y + BLOCK_Y_OFFSET * i, block.neg_y_face[s].z * BLOCK_Z_OFFSET * j };
-                                vertex.normal = block.normals[4];
-                                vertex.color = { 0.f, 1.f, 1.f };   // Cyan
-                                vertex.uv = block.uvs[s];
-                                vertices.push_back(vertex);
-                            }
-                            break;
-                        case vae::BlockFace::down:
-                            for (int s = 0; s < 6; s++)
-                            {
-                                vertex.position = { block.pos_y_face[s].x + BLOCK_X_OFFSET * k, block.pos_y_face[s].y + BLOCK_Y_OFFSET * i, block.pos_y_face[s].z * BLOCK_Z_OFFSET * j };
-                                vertex.normal = block.normals[1];
-                                vertex.color = { 1.f, 1.f, 0.f };   // Yellow
-                                vertex.uv = block.uvs[s];
-                                vertices.push_back(vertex);
-                            }
-                            break;
-                        case vae::BlockFace::left:
-                            for (int s = 0; s < 6; s++)
-                            {
-                                vertex.position = { block.neg_x_face[s].x + BLOCK_X_OFFSET * k, block.neg_x_face[s].y + BLOCK_Y_OFFSET * i, block.neg_x_face[s].z * BLOCK_Z_OFFSET * j };
-                                vertex.normal = block.normals[3];
-                                vertex.color = { 1.f, 0.f, 1.f };   // Purple
-                                vertex.uv = block.uvs[s];
-                                vertices.push_back(vertex);
-                            }
-                            break;
-                        case vae::BlockFace::right:
-                            for (int s = 0; s < 6; s++)
-                            {
-                                vertex.position = { block.pos_x_face[s].x + BLOCK_X_OFFSET * k, block.pos_x_face[s].y + BLOCK_Y_OFFSET * i, block.pos_x_face[s].z * BLOCK_Z_OFFSET * j };
-                                vertex.normal = block.normals[0];
-                                vertex.color = { 0.f, 0.f, 1.f };   // Blue
-                                vertex.uv = block.uvs[s];
-                                vertices.push_back(vertex);
-                            }
-                            break;
-                        case vae::BlockFace::front:
-                            for (int s = 0; s < 6; s++)
-                            {
-                                vertex.position = { block.neg_z_face[s].x + BLOCK_X_OFFSET * k, block.neg_z_face[s].y + BLOCK_Y_OFFSET * i, block.neg_z_face[s].z * BLOCK_Z_OFFSET * chunk->getWidth() - j + 0.5f};
-                                vertex.normal = block.normals[5];
-                                vertex.color = { 0.f, 1.f, 0.f };   // Green
-                                vertex.uv = block.uvs[s];
-                                vertices.push_back(vertex);
+        void meshChunkFaces(const ChunkComponent& chunk, const ChunkBox& box, const ChunkFaceMasks& faces, ChunkQuadWriter& writer) {
+            for (int f = 0; f < 6; f++) {
+                for (size_t row = 0; row < faces[f].size(); row++) {
+                    const int y = box.firstY + static_cast<int>(row / box.sizeZ);
+                    const int z = box.firstZ + static_cast<int>(row % box.sizeZ);
+                    // One iteration per visible face, the lowest set bit is the next block
+                    for (uint64_t bits = faces[f][row]; bits != 0; bits &= bits - 1) {
+                        const glm::ivec3 position{ box.firstX + lowestBit(bits), y, z };
+                        const uint32_t occlusion = writer.hasAmbientOcclusion() ? writer.computeAmbientOcclusion(f, position) : ChunkQuadWriter::UNOCCLUDED;
+                        writer.writeQuad(f, position, position, chunk.getBlock(position.x, position.y, position.z), occlusion);
+                    }
+                }
+            }
+        }
+
+        /*
+            Every face direction is cut into slices along its normal. The visible faces of each slice and block type are
+            sorted into rows of bits along u (x, or z for faces facing along x, so a row always fits in 64 bits), then
+            merged: the run of bits at the start of a row is grown over the following rows for as long as they contain the
+            whole run, and the rectangle is cleared from the rows. Coordinates are relative to the box until the quad is written.
+            With ambient occlusion only faces without any occluded corner are merged, the others are written on their own.
+        */
+        void meshChunkGreedy(const ChunkComponent& chunk, const ChunkBox& box, const ChunkFaceMasks& faces, ChunkQuadWriter& writer) {
+            const glm::ivec3 boxFirst{ box.firstX, box.firstY, box.firstZ };
+            const int extents[3] = { box.sizeX, box.sizeY, box.sizeZ };
+            const int typeCount = static_cast<int>(BlockType::air);    // Every block type before air is solid
+            std::vector<uint64_t> rows;
+
+            for (int f = 0; f < 6; f++) {
+                // Normal, u and v axis of the face
+                const BlockFace face = static_cast<BlockFace>(f);
+                const int normalAxis = (face == BlockFace::left || face == BlockFace::right) ? 0 : (face == BlockFace::up || face == BlockFace::down) ? 1 : 2;
+                const int uAxis = normalAxis == 0 ? 2 : 0;
+                const int vAxis = normalAxis == 1 ? 2 : 1;
+                const size_t sliceSize = extents[vAxis];
+                const size_t typeSize = sliceSize * extents[normalAxis];
+
+                rows.assign(typeSize * typeCount, 0);
+                for (size_t row = 0; row < faces[f].size(); row++) {
+                    glm::ivec3 position{ 0, static_cast<int>(row / box.sizeZ), static_cast<int>(row % box.sizeZ) };
+                    for (uint64_t bits = faces[f][row]; bits != 0; bits &= bits - 1) {
+                        position.x = lowestBit(bits);
+                        const BlockType type = chunk.getBlock(box.firstX + position.x, box.firstY + position.y, box.firstZ + position.z);
+                        if (writer.hasAmbientOcclusion()) {
+                            const uint32_t occlusion = writer.computeAmbientOcclusion(f, boxFirst + position);
+                            if (occlusion != ChunkQuadWriter::UNOCCLUDED) {
+                                writer.writeQuad(f, boxFirst + position, boxFirst + position, type, occlusion);
+                                continue;
                             }
-                            break;
-                        case vae::BlockFace::back:
-                            for (int s = 0; s < 6; s++)
-                            {
-                                vertex.position = { block.pos_z_face[s].x + BLOCK_X_OFFSET * k, block.pos_z_face[s].y + BLOCK_Y_OFFSET * i, block.pos_z_face[s].z * BLOCK_Z_OFFSET * j };
-                                vertex.normal = block.normals[2];
-                                vertex.color = { 1.f, 0.f, 0.f };   // Red
-                                vertex.uv = block.uvs[s];
-                                vertices.push_back(vertex);
+                        }
+                        rows[static_cast<int>(type) * typeSize + position[normalAxis] * sliceSize + position[vAxis]] |= uint64_t{ 1 } << position[uAxis];
+                    }
+                }
+
+                for (int type = 0; type < typeCount; type++) {
+                    for (int slice = 0; slice < extents[normalAxis]; slice++) {
+                        uint64_t* sliceRows = &rows[type * typeSize + slice * sliceSize];
+                        for (int v = 0; v < static_cast<int>(sliceSize); v++) {
+                            while (sliceRows[v] != 0) {
+                                // Rows hold at most 62 bits, so the inverted run always ends in a set bit
+                                const int u = lowestBit(sliceRows[v]);
+                                const int length = lowestBit(~(sliceRows[v] >> u));
+                                const uint64_t run = ((uint64_t{ 1 } << length) - 1) << u;
+
+                                int lastV = v;
+                                while (lastV + 1 < static_cast<int>(sliceSize) && (sliceRows[lastV + 1] & run) == run) {
+                                    lastV++;
+                                    sliceRows[lastV] &= ~run;
+                                }
+                                sliceRows[v] &= ~run;
+
+                                glm::ivec3 first, last;
+                                first[normalAxis] = last[normalAxis] = slice;
+                                first[uAxis] = u;
+                                last[uAxis] = u + length - 1;
+                                first[vAxis] = v;
+                                last[vAxis] = lastV;
+                                writer.writeQuad(f, boxFirst + first, boxFirst + last, static_cast<BlockType>(type));
                             }
-                            break;
-                        default:
-                            break;
                         }
                     }
                 }
@@ -399,4 +910,45 @@ namespace vae {
         }
     }
 
+    void VmcModel::Builder::updateChunkMesh(const ChunkComponent* chunk, ChunkMeshMode mode, VertexFormat format)
+    {
+        updateChunkMesh(chunk, chunk->getBox(), mode, format);
+    }
+
+    void VmcModel::Builder::updateChunkMesh(const ChunkComponent* chunk, const ChunkBox& box, ChunkMeshMode mode, VertexFormat format)
+    {
+        ChunkFaceMasks faces;
+        chunk->computeVisibleFaces(faces, box);
+
+        size_t faceCount = 0;
+        for (const auto& face : faces) {
+            for (uint64_t row : face) faceCount += countBits(row);
+        }
+        vertices.clear();
+        voxelVertices.clear();
+        indices.clear();
+        lods.clear();
+        // Enough for one quad per face, greedy meshing needs less
+        if (format == VERTEX_FORMAT_VOXEL) {
+            voxelVertices.reserve(faceCount * 4);
+        } else {
+            vertices.reserve(faceCount * 4);
+        }
+        indices.reserve(faceCount * 6);
+
+        ChunkQuadWriter writer{ *chunk, *this, format };
+        if (mode == CHUNK_MESH_GREEDY) {
+            meshChunkGreedy(*chunk, box, faces, writer);
+        } else {
+            meshChunkFaces(*chunk, box, faces, writer);
+        }
+
+        minX = BLOCK_X_OFFSET * box.firstX - 0.5f;
+        maxX = BLOCK_X_OFFSET * (box.firstX + box.sizeX - 1) + 0.5f;
+        minY = BLOCK_Y_OFFSET * box.firstY - 0.5f;
+        maxY = BLOCK_Y_OFFSET * (box.firstY + box.sizeY - 1) + 0.5f;
+        minZ = BLOCK_Z_OFFSET * box.firstZ - 0.5f;
+        maxZ = BLOCK_Z_OFFSET * (box.firstZ + box.sizeZ - 1) + 0.5f;
+    }
+
 }
\ No newline at end of file
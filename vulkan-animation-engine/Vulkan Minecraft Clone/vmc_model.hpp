@@ -14,9 +14,13 @@
 #include <vector>
 
 namespace vae {
+	class VmcCachedMesh;
+
 	class VmcModel
 	{
 	public:
+		static constexpr float LOD_PIXEL_ERROR = 1.0f;
+
 		struct Vertex {
 			glm::vec3 position{};
 			glm::vec3 color{};
@@ -31,9 +35,77 @@ namespace vae {
 			}
 		};
 
+		enum ImportMode {
+			IMPORT_AUTOMATIC,	// Parallel for large models
+			IMPORT_SEQUENTIAL,
+			IMPORT_PARALLEL,
+		};
+
+		enum ChunkMeshMode {
+			CHUNK_MESH_FACES,	// One quad per visible block face
+			CHUNK_MESH_GREEDY,	// Coplanar neighbouring faces of the same block type merged into rectangles
+		};
+
+		// Quantized vertex for models that are never deformed: 20 instead of 44 bytes
+		struct PackedVertex {
+			int16_t position[4];	// snorm, relative to the bounding box (see getPositionDequantization)
+			int8_t normal[4];		// snorm
+			uint8_t color[4];		// unorm
+			uint16_t uv[2];			// half float
+
+			static std::vector<VkVertexInputBindingDescription> getBindingDescriptions();
+			static std::vector<VkVertexInputAttributeDescription> getAttributeDescriptions();
+		};
+
+		// Chunk mesh vertex in 32 bits, decoded by the VOXEL_VERTEX variant of simple_shader.vert. Positions are the block
+		// corners in the chunk (the vertex is at the corner minus half a block), the normal follows from the BlockFace.
+		struct VoxelVertex {
+			static constexpr int X_BITS = 6;
+			static constexpr int Y_BITS = 9;
+			static constexpr int Z_BITS = 6;
+			static constexpr int FACE_BITS = 3;
+			static constexpr int TYPE_BITS = 6;
+			static constexpr int OCCLUSION_BITS = 2;
+			static constexpr uint32_t NO_OCCLUSION = 3;	// Ambient occlusion from 0 (three solid neighbours) to 3
+
+			uint32_t data;
+
+			static VoxelVertex encode(int x, int y, int z, BlockFace face, BlockType type, uint32_t occlusion) {
+				return { static_cast<uint32_t>(x) | static_cast<uint32_t>(y) << X_BITS | static_cast<uint32_t>(z) << (X_BITS + Y_BITS)
+					| static_cast<uint32_t>(face) << (X_BITS + Y_BITS + Z_BITS) | static_cast<uint32_t>(type) << (X_BITS + Y_BITS + Z_BITS + FACE_BITS)
+					| occlusion << (X_BITS + Y_BITS + Z_BITS + FACE_BITS + TYPE_BITS) };
+			}
+
+			static std::vector<VkVertexInputBindingDescription> getBindingDescriptions();
+			static std::vector<VkVertexInputAttributeDescription> getAttributeDescriptions();
+		};
+		static_assert(VoxelVertex::X_BITS + VoxelVertex::Y_BITS + VoxelVertex::Z_BITS + VoxelVertex::FACE_BITS + VoxelVertex::TYPE_BITS + VoxelVertex::OCCLUSION_BITS == 32, "VoxelVertex has 32 bits");
+
+		// Range of the index buffer that draws one level of detail, error is the simplification error in model space
+		struct Lod {
+			uint32_t firstIndex;
+			uint32_t indexCount;
+			float error;
+		};
+
+		// Index range with its own vertex offset, for models whose parts are replaced separately
+		struct DrawRange {
+			uint32_t firstIndex;
+			uint32_t indexCount;
+			int32_t vertexOffset;
+		};
+
+		enum VertexFormat {
+			VERTEX_FORMAT_FULL,		// Vertex, required for deformation
+			VERTEX_FORMAT_PACKED,	// PackedVertex
+			VERTEX_FORMAT_VOXEL,	// VoxelVertex, only for chunk meshes
+		};
+
 		struct Builder {
 			std::vector<Vertex> vertices{};
+			std::vector<VoxelVertex> voxelVertices{};	// Instead of vertices for chunk meshes in VERTEX_FORMAT_VOXEL
 			std::vector<uint32_t> indices{};
+			std::vector<Lod> lods{};	// Empty: all indices are one LOD
 			float minX;
 			float maxX;
 			float minY;
@@ -41,11 +113,20 @@ namespace vae {
 			float minZ;
 			float maxZ;
 
-			void loadModel(const std::string& filePath);
-			void updateChunkMesh(const ChunkComponent* chunk);
+			// Both import modes produce exactly the same vertices and indices
+			void loadModel(const std::string& filePath, ImportMode mode = IMPORT_AUTOMATIC);
+			// format is VERTEX_FORMAT_FULL or VERTEX_FORMAT_VOXEL, only voxel vertices carry ambient occlusion
+			void updateChunkMesh(const ChunkComponent* chunk, ChunkMeshMode mode = CHUNK_MESH_GREEDY, VertexFormat format = VERTEX_FORMAT_FULL);
+			// Only the faces of the blocks inside box, positions stay relative to the chunk
+			void updateChunkMesh(const ChunkComponent* chunk, const ChunkBox& box, ChunkMeshMode mode = CHUNK_MESH_GREEDY, VertexFormat format = VERTEX_FORMAT_FULL);
+			uint32_t getVertexCount() const { return static_cast<uint32_t>(vertices.size() + voxelVertices.size()); };
 		};
 
-		VmcModel(VmcDevice &device, const VmcModel::Builder &builder);
+		VmcModel(VmcDevice &device, const VmcModel::Builder &builder, VertexFormat format = VERTEX_FORMAT_FULL);
+		VmcModel(VmcDevice& device, const VmcCachedMesh& mesh, VertexFormat format = VERTEX_FORMAT_FULL);
+		// Buffers with room for vertexCapacity vertices and indexCapacity indices, the builder fills the start of them.
+		// The rest is written with writeVertices and writeIndices. These models can't be deformed.
+		VmcModel(VmcDevice& device, const VmcModel::Builder& builder, uint32_t vertexCapacity, uint32_t indexCapacity, VertexFormat format = VERTEX_FORMAT_FULL);
 		~VmcModel();
 
 		VmcModel(const VmcModel&) = delete;
@@ -59,11 +140,35 @@ namespace vae {
 		float maximumZ() { return maxZ; };
 		std::vector<Vertex>& getVertices() { return old_vertex_data; };
 
-		static std::unique_ptr<VmcModel> createModelFromFile(VmcDevice& device, const std::string& filePath);
-		static std::unique_ptr<VmcModel> createChunkModelMesh(VmcDevice& device, const ChunkComponent* chunk);
+		VertexFormat getVertexFormat() const { return vertexFormat; };
+		// Maps packed positions to model space, has to be applied after the model matrix of packed models
+		const glm::mat4& getPositionDequantization() const { return positionDequantization; };
+
+		static std::unique_ptr<VmcModel> createModelFromFile(VmcDevice& device, const std::string& filePath, VertexFormat format = VERTEX_FORMAT_FULL);
+		static std::unique_ptr<VmcModel> createChunkModelMesh(VmcDevice& device, const ChunkComponent* chunk, ChunkMeshMode mode = CHUNK_MESH_GREEDY);
+
+		// Buffers are uploaded asynchronously, the model can only be drawn once this returns true
+		bool isReady();
+		VmcUploadTicket getUploadTicket() const { return uploadTicket; };
+
+		const std::vector<Lod>& getLods() const { return lods; };
+		// Coarsest LOD whose error covers at most LOD_PIXEL_ERROR pixels, given how many pixels one model space unit covers
+		uint32_t selectLod(float pixelsPerUnit) const;
+		glm::vec3 getBoundingCenter() const { return { (minX + maxX) * 0.5f, (minY + maxY) * 0.5f, (minZ + maxZ) * 0.5f }; };
+		float getBoundingRadius() const { return glm::length(glm::vec3{ maxX - minX, maxY - minY, maxZ - minZ }) * 0.5f; };
 
 		void bind(VkCommandBuffer commandBuffer);
-		void draw(VkCommandBuffer commandBuffer);
+		// Draws instanceCount instances of the LOD, or of all draw ranges once setDrawRanges was called
+		void draw(VkCommandBuffer commandBuffer, uint32_t lod = 0, uint32_t instanceCount = 1);
+
+		// Copy into part of the buffers through the upload queue. The copy runs before the next frame that is submitted,
+		// frames that are still in flight must not use the range anymore.
+		void writeVertices(uint32_t firstVertex, const Vertex* vertices, uint32_t count);
+		void writeVertices(uint32_t firstVertex, const VoxelVertex* vertices, uint32_t count);
+		void writeIndices(uint32_t firstIndex, const uint32_t* indices, uint32_t count);
+		void setDrawRanges(std::vector<DrawRange> ranges);
+		uint32_t getVertexCapacity() const { return vertexCapacity; };
+		uint32_t getIndexCapacity() const { return indexCapacity; };
 
 		void updateVertices(std::vector<glm::vec3>& newPositions);
 		void confirmModelDeformation();
@@ -71,8 +176,10 @@ namespace vae {
 		void resetModel();
 
 	private:
-		void createVertexBuffers(const std::vector<Vertex> &vertices);
-		void createIndexBuffers(const std::vector<uint32_t> &indices);
+		void createVertexBuffers(const Vertex* vertices, uint32_t count, uint32_t capacity);
+		void createVertexBuffers(const void* vertices, uint32_t vertexSize, uint32_t count, uint32_t capacity);
+		void writeVertexData(uint32_t firstVertex, const void* vertices, uint32_t vertexSize, uint32_t count);
+		void createIndexBuffers(const uint32_t* indices, uint32_t count, uint32_t capacity);
 
 		float minX;
 		float maxX;
@@ -82,17 +189,29 @@ namespace vae {
 		float maxZ;
 
 		VmcDevice& vmcDevice;
+		VertexFormat vertexFormat;
+		glm::mat4 positionDequantization{ 1.0f };
 
+		// Only kept for VERTEX_FORMAT_FULL models without spare capacity
 		std::vector<Vertex> og_vertex_data;
 		std::vector<Vertex> old_vertex_data;
 		std::vector<Vertex> new_vertex_data;
 
 		std::unique_ptr<VmcBuffer> vertexBuffer;
 		uint32_t vertexCount;
+		uint32_t vertexCapacity;
 
 		bool hasIndexBuffer = false;
 		std::unique_ptr<VmcBuffer> indexBuffer;
+		std::vector<Lod> lods;
+		bool hasDrawRanges = false;
+		std::vector<DrawRange> drawRanges;
 
 		uint32_t indexCount;
+		uint32_t indexCapacity;
+
+		VmcUploadTicket uploadTicket = 0;
+		bool uploaded = false;
+		VmcUploadTicket writeTicket = 0;	// Of the last writeVertices or writeIndices, doesn't hold back drawing
 	};
 }
@@ -0,0 +1,87 @@
+#include "vmc_model_registry.hpp"
+
+// std
+#include <filesystem>
+
+namespace vae {
+
+	VmcModelRegistry::VmcModelRegistry(VmcDevice& device) : vmcDevice{ device } {}
+
+	std::shared_ptr<VmcModel> VmcModelRegistry::getModel(const std::string& filePath, VmcModel::VertexFormat format)
+	{
+		std::string key = canonicalPath(filePath);
+		if (format == VmcModel::VERTEX_FORMAT_PACKED) key += "|packed";
+
+		std::lock_guard<std::mutex> lock{ registryMutex };
+		auto it = models.find(key);
+		if (it != models.end())
+		{
+			if (std::shared_ptr<VmcModel> model = it->second.lock())
+			{
+				hits++;
+				return model;
+			}
+		}
+
+		std::shared_ptr<VmcModel> model = VmcModel::createModelFromFile(vmcDevice, filePath, format);
+		models[key] = model;
+		loads++;
+		return model;
+	}
+
+	std::shared_ptr<VmcModel> VmcModelRegistry::createUniqueModel(const std::string& filePath)
+	{
+		std::shared_ptr<VmcModel> model = VmcModel::createModelFromFile(vmcDevice, filePath);
+
+		std::lock_guard<std::mutex> lock{ registryMutex };
+		loads++;
+		return model;
+	}
+
+	bool VmcModelRegistry::isShared(const VmcModel* model)
+	{
+		std::lock_guard<std::mutex> lock{ registryMutex };
+		for (auto& entry : models)
+		{
+			std::shared_ptr<VmcModel> shared = entry.second.lock();
+			if (shared && shared.get() == model)
+				return true;
+		}
+		return false;
+	}
+
+	void VmcModelRegistry::collectGarbage()
+	{
+		std::lock_guard<std::mutex> lock{ registryMutex };
+		for (auto it = models.begin(); it != models.end();)
+		{
+			if (it->second.expired())
+				it = models.erase(it);
+			else
+				++it;
+		}
+	}
+
+	VmcModelRegistryStatistics VmcModelRegistry::getStatistics()
+	{
+		std::lock_guard<std::mutex> lock{ registryMutex };
+		VmcModelRegistryStatistics statistics{};
+		for (auto& entry : models)
+		{
+			if (!entry.second.expired())
+				statistics.liveModels++;
+		}
+		statistics.loads = loads;
+		statistics.hits = hits;
+		return statistics;
+	}
+
+	std::string VmcModelRegistry::canonicalPath(const std::string& filePath)
+	{
+		std::error_code error;
+		std::filesystem::path path = std::filesystem::weakly_canonical(filePath, error);
+		if (error)
+			path = std::filesystem::path(filePath).lexically_normal();
+		return path.make_preferred().string();
+	}
+}
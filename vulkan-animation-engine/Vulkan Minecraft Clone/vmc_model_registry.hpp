@@ -0,0 +1,50 @@
+#pragma once
+#include "vmc_model.hpp"
+
+// std
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace vae {
+	struct VmcModelRegistryStatistics {
+		uint32_t liveModels = 0;	// Shared models that are still referenced
+		uint32_t loads = 0;			// Times an .obj file was actually parsed and uploaded
+		uint32_t hits = 0;			// Requests answered with an already loaded model
+	};
+
+	/*
+		Hands out one shared VmcModel per .obj file and vertex format, keyed by the canonical path so "../Models/a.obj" and
+		"..\Models\a.obj" end up with the same model. The registry only keeps weak references: a model is
+		evicted as soon as the last object using it lets go of it.
+		Deformation writes into the vertex buffer of a model, deformed objects need their own copy (createUniqueModel).
+	*/
+	class VmcModelRegistry
+	{
+	public:
+		VmcModelRegistry(VmcDevice& device);
+
+		VmcModelRegistry(const VmcModelRegistry&) = delete;
+		VmcModelRegistry& operator=(const VmcModelRegistry&) = delete;
+
+		std::shared_ptr<VmcModel> getModel(const std::string& filePath, VmcModel::VertexFormat format = VmcModel::VERTEX_FORMAT_FULL);
+		// Private copy of the model that is never handed out to anyone else
+		std::shared_ptr<VmcModel> createUniqueModel(const std::string& filePath);
+		bool isShared(const VmcModel* model);
+
+		// Drops the entries of models that have been evicted
+		void collectGarbage();
+		VmcModelRegistryStatistics getStatistics();
+
+		static std::string canonicalPath(const std::string& filePath);
+
+	private:
+		VmcDevice& vmcDevice;
+
+		std::mutex registryMutex;
+		std::unordered_map<std::string, std::weak_ptr<VmcModel>> models;
+		uint32_t loads = 0;
+		uint32_t hits = 0;
+	};
+}
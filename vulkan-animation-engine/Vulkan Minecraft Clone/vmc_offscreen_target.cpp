@@ -0,0 +1,337 @@
+#include "vmc_offscreen_target.hpp"
+
+// std
+#include <array>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+namespace vae {
+
+VmcOffscreenTarget::VmcOffscreenTarget(VmcDevice &deviceRef, VkExtent2D extent)
+    : device{deviceRef}, extent{extent} {
+  createColorResources();
+  createRenderPass();
+  createDepthResources();
+  createFramebuffers();
+  createReadbackBuffers();
+  createSyncObjects();
+}
+
+VmcOffscreenTarget::~VmcOffscreenTarget() {
+  for (int i = 0; i < IMAGE_COUNT; i++) {
+    vkDestroyFramebuffer(device.device(), framebuffers[i], nullptr);
+
+    vkDestroyImageView(device.device(), colorImageViews[i], nullptr);
+    vkDestroyImage(device.device(), colorImages[i], nullptr);
+    vkFreeMemory(device.device(), colorImageMemorys[i], nullptr);
+
+    vkDestroyImageView(device.device(), depthImageViews[i], nullptr);
+    vkDestroyImage(device.device(), depthImages[i], nullptr);
+    vkFreeMemory(device.device(), depthImageMemorys[i], nullptr);
+
+    vkDestroyBuffer(device.device(), readbackBuffers[i], nullptr);
+    vkFreeMemory(device.device(), readbackBufferMemorys[i], nullptr);
+
+    vkDestroyFence(device.device(), inFlightFences[i], nullptr);
+  }
+
+  vkDestroyRenderPass(device.device(), renderPass, nullptr);
+}
+
+VkResult VmcOffscreenTarget::acquireNextImage(uint32_t *imageIndex) {
+  // Images are used round robin, one per frame in flight
+  vkWaitForFences(
+      device.device(),
+      1,
+      &inFlightFences[currentFrame],
+      VK_TRUE,
+      std::numeric_limits<uint64_t>::max());
+
+  *imageIndex = static_cast<uint32_t>(currentFrame);
+  return VK_SUCCESS;
+}
+
+void VmcOffscreenTarget::recordReadback(VkCommandBuffer commandBuffer, uint32_t imageIndex) {
+  // The render pass leaves the color image in TRANSFER_SRC_OPTIMAL
+  VkBufferImageCopy region{};
+  region.bufferOffset = 0;
+  region.bufferRowLength = 0;
+  region.bufferImageHeight = 0;
+  region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  region.imageSubresource.mipLevel = 0;
+  region.imageSubresource.baseArrayLayer = 0;
+  region.imageSubresource.layerCount = 1;
+  region.imageOffset = {0, 0, 0};
+  region.imageExtent = {extent.width, extent.height, 1};
+
+  vkCmdCopyImageToBuffer(
+      commandBuffer,
+      colorImages[imageIndex],
+      VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+      readbackBuffers[imageIndex],
+      1,
+      &region);
+
+  VkBufferMemoryBarrier barrier{};
+  barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+  barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.buffer = readbackBuffers[imageIndex];
+  barrier.offset = 0;
+  barrier.size = VK_WHOLE_SIZE;
+
+  vkCmdPipelineBarrier(
+      commandBuffer,
+      VK_PIPELINE_STAGE_TRANSFER_BIT,
+      VK_PIPELINE_STAGE_HOST_BIT,
+      0,
+      0,
+      nullptr,
+      1,
+      &barrier,
+      0,
+      nullptr);
+}
+
+VkResult VmcOffscreenTarget::submitCommandBuffers(
+    const VkCommandBuffer *buffers, uint32_t *imageIndex) {
+  VkSubmitInfo submitInfo = {};
+  submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+  submitInfo.commandBufferCount = 1;
+  submitInfo.pCommandBuffers = buffers;
+
+  vkResetFences(device.device(), 1, &inFlightFences[*imageIndex]);
+  VkResult result = vkQueueSubmit(device.graphicsQueue(), 1, &submitInfo, inFlightFences[*imageIndex]);
+
+  currentFrame = (currentFrame + 1) % IMAGE_COUNT;
+  return result;
+}
+
+// Blocks until the frame rendered into imageIndex has finished and copies its pixels (RGBA, top row first).
+void VmcOffscreenTarget::readPixels(uint32_t imageIndex, std::vector<uint8_t> &rgba) {
+  vkWaitForFences(
+      device.device(),
+      1,
+      &inFlightFences[imageIndex],
+      VK_TRUE,
+      std::numeric_limits<uint64_t>::max());
+
+  VkDeviceSize size = static_cast<VkDeviceSize>(extent.width) * extent.height * 4;
+  rgba.resize(static_cast<size_t>(size));
+
+  void *data;
+  vkMapMemory(device.device(), readbackBufferMemorys[imageIndex], 0, size, 0, &data);
+  memcpy(rgba.data(), data, static_cast<size_t>(size));
+  vkUnmapMemory(device.device(), readbackBufferMemorys[imageIndex]);
+}
+
+void VmcOffscreenTarget::createColorResources() {
+  colorImages.resize(IMAGE_COUNT);
+  colorImageMemorys.resize(IMAGE_COUNT);
+  colorImageViews.resize(IMAGE_COUNT);
+
+  for (int i = 0; i < IMAGE_COUNT; i++) {
+    VkImageCreateInfo imageInfo{};
+    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.extent.width = extent.width;
+    imageInfo.extent.height = extent.height;
+    imageInfo.extent.depth = 1;
+    imageInfo.mipLevels = 1;
+    imageInfo.arrayLayers = 1;
+    imageInfo.format = COLOR_FORMAT;
+    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    imageInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+    imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    imageInfo.flags = 0;
+
+    device.createImageWithInfo(
+        imageInfo,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        colorImages[i],
+        colorImageMemorys[i]);
+
+    colorImageViews[i] = device.createImageView(colorImages[i], COLOR_FORMAT, VK_IMAGE_VIEW_TYPE_2D, 1);
+  }
+}
+
+void VmcOffscreenTarget::createDepthResources() {
+  VkFormat depthFormat = findDepthFormat();
+
+  depthImages.resize(IMAGE_COUNT);
+  depthImageMemorys.resize(IMAGE_COUNT);
+  depthImageViews.resize(IMAGE_COUNT);
+
+  for (int i = 0; i < IMAGE_COUNT; i++) {
+    VkImageCreateInfo imageInfo{};
+    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.extent.width = extent.width;
+    imageInfo.extent.height = extent.height;
+    imageInfo.extent.depth = 1;
+    imageInfo.mipLevels = 1;
+    imageInfo.arrayLayers = 1;
+    imageInfo.format = depthFormat;
+    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    imageInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+    imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    imageInfo.flags = 0;
+
+    device.createImageWithInfo(
+        imageInfo,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        depthImages[i],
+        depthImageMemorys[i]);
+
+    VkImageViewCreateInfo viewInfo{};
+    viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    viewInfo.image = depthImages[i];
+    viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    viewInfo.format = depthFormat;
+    viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+    viewInfo.subresourceRange.baseMipLevel = 0;
+    viewInfo.subresourceRange.levelCount = 1;
+    viewInfo.subresourceRange.baseArrayLayer = 0;
+    viewInfo.subresourceRange.layerCount = 1;
+
+    if (vkCreateImageView(device.device(), &viewInfo, nullptr, &depthImageViews[i]) != VK_SUCCESS) {
+      throw std::runtime_error("failed to create depth image view!");
+    }
+  }
+}
+
+// Same attachments and subpass as the swap chain render pass, except that the color attachment
+// ends in TRANSFER_SRC_OPTIMAL so it can be copied out after the pass.
+void VmcOffscreenTarget::createRenderPass() {
+  VkAttachmentDescription depthAttachment{};
+  depthAttachment.format = findDepthFormat();
+  depthAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+  depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+  depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+  depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+  depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+  depthAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+  VkAttachmentReference depthAttachmentRef{};
+  depthAttachmentRef.attachment = 1;
+  depthAttachmentRef.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+  VkAttachmentDescription colorAttachment = {};
+  colorAttachment.format = COLOR_FORMAT;
+  colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+  colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+  colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+  colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+  colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+  colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  colorAttachment.finalLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+
+  VkAttachmentReference colorAttachmentRef = {};
+  colorAttachmentRef.attachment = 0;
+  colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+  VkSubpassDescription subpass = {};
+  subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+  subpass.colorAttachmentCount = 1;
+  subpass.pColorAttachments = &colorAttachmentRef;
+  subpass.pDepthStencilAttachment = &depthAttachmentRef;
+
+  std::array<VkSubpassDependency, 2> dependencies{};
+  dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+  dependencies[0].srcAccessMask = 0;
+  dependencies[0].srcStageMask =
+      VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+  dependencies[0].dstSubpass = 0;
+  dependencies[0].dstStageMask =
+      VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+  dependencies[0].dstAccessMask =
+      VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+  // Color writes have to be finished before the readback copy
+  dependencies[1].srcSubpass = 0;
+  dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+  dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+  dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+  dependencies[1].dstStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+  dependencies[1].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+  std::array<VkAttachmentDescription, 2> attachments = {colorAttachment, depthAttachment};
+  VkRenderPassCreateInfo renderPassInfo = {};
+  renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+  renderPassInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+  renderPassInfo.pAttachments = attachments.data();
+  renderPassInfo.subpassCount = 1;
+  renderPassInfo.pSubpasses = &subpass;
+  renderPassInfo.dependencyCount = static_cast<uint32_t>(dependencies.size());
+  renderPassInfo.pDependencies = dependencies.data();
+
+  if (vkCreateRenderPass(device.device(), &renderPassInfo, nullptr, &renderPass) != VK_SUCCESS) {
+    throw std::runtime_error("failed to create offscreen render pass!");
+  }
+}
+
+void VmcOffscreenTarget::createFramebuffers() {
+  framebuffers.resize(IMAGE_COUNT);
+  for (int i = 0; i < IMAGE_COUNT; i++) {
+    std::array<VkImageView, 2> attachments = {colorImageViews[i], depthImageViews[i]};
+
+    VkFramebufferCreateInfo framebufferInfo = {};
+    framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+    framebufferInfo.renderPass = renderPass;
+    framebufferInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+    framebufferInfo.pAttachments = attachments.data();
+    framebufferInfo.width = extent.width;
+    framebufferInfo.height = extent.height;
+    framebufferInfo.layers = 1;
+
+    if (vkCreateFramebuffer(device.device(), &framebufferInfo, nullptr, &framebuffers[i]) != VK_SUCCESS) {
+      throw std::runtime_error("failed to create offscreen framebuffer!");
+    }
+  }
+}
+
+void VmcOffscreenTarget::createReadbackBuffers() {
+  readbackBuffers.resize(IMAGE_COUNT);
+  readbackBufferMemorys.resize(IMAGE_COUNT);
+
+  VkDeviceSize size = static_cast<VkDeviceSize>(extent.width) * extent.height * 4;
+  for (int i = 0; i < IMAGE_COUNT; i++) {
+    device.createBuffer(
+        size,
+        VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        readbackBuffers[i],
+        readbackBufferMemorys[i]);
+  }
+}
+
+void VmcOffscreenTarget::createSyncObjects() {
+  inFlightFences.resize(IMAGE_COUNT);
+
+  VkFenceCreateInfo fenceInfo = {};
+  fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+  fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+
+  for (int i = 0; i < IMAGE_COUNT; i++) {
+    if (vkCreateFence(device.device(), &fenceInfo, nullptr, &inFlightFences[i]) != VK_SUCCESS) {
+      throw std::runtime_error("failed to create synchronization objects for an offscreen frame!");
+    }
+  }
+}
+
+VkFormat VmcOffscreenTarget::findDepthFormat() {
+  return device.findSupportedFormat(
+      {VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT},
+      VK_IMAGE_TILING_OPTIMAL,
+      VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT);
+}
+
+}  // namespace vae
@@ -0,0 +1,74 @@
+#pragma once
+
+#include "vmc_device.hpp"
+#include "vmc_swap_chain.hpp"
+
+// vulkan headers
+#include <vulkan/vulkan.h>
+
+// std lib headers
+#include <cstdint>
+#include <vector>
+
+namespace vae {
+
+// Headless replacement for VmcSwapChain: renders into offscreen color and depth images using the same
+// attachment setup as the swap chain render pass, and copies every frame into a host visible buffer for readback.
+class VmcOffscreenTarget {
+ public:
+  static constexpr int IMAGE_COUNT = VmcSwapChain::MAX_FRAMES_IN_FLIGHT;
+  static constexpr VkFormat COLOR_FORMAT = VK_FORMAT_R8G8B8A8_SRGB;
+
+  VmcOffscreenTarget(VmcDevice &deviceRef, VkExtent2D extent);
+  ~VmcOffscreenTarget();
+
+  VmcOffscreenTarget(const VmcOffscreenTarget &) = delete;
+  VmcOffscreenTarget &operator=(const VmcOffscreenTarget &) = delete;
+
+  VkFramebuffer getFrameBuffer(int index) { return framebuffers[index]; }
+  VkRenderPass getRenderPass() { return renderPass; }
+  VkImage getColorImage(int index) { return colorImages[index]; }
+  VkFormat getImageFormat() { return COLOR_FORMAT; }
+  VkExtent2D getExtent() { return extent; }
+  uint32_t width() { return extent.width; }
+  uint32_t height() { return extent.height; }
+
+  float extentAspectRatio() {
+    return static_cast<float>(extent.width) / static_cast<float>(extent.height);
+  }
+  VkFormat findDepthFormat();
+
+  VkResult acquireNextImage(uint32_t *imageIndex);
+  void recordReadback(VkCommandBuffer commandBuffer, uint32_t imageIndex);
+  VkResult submitCommandBuffers(const VkCommandBuffer *buffers, uint32_t *imageIndex);
+  void readPixels(uint32_t imageIndex, std::vector<uint8_t> &rgba);
+
+ private:
+  void createColorResources();
+  void createDepthResources();
+  void createRenderPass();
+  void createFramebuffers();
+  void createReadbackBuffers();
+  void createSyncObjects();
+
+  VmcDevice &device;
+  VkExtent2D extent;
+
+  VkRenderPass renderPass;
+  std::vector<VkFramebuffer> framebuffers;
+
+  std::vector<VkImage> colorImages;
+  std::vector<VkDeviceMemory> colorImageMemorys;
+  std::vector<VkImageView> colorImageViews;
+  std::vector<VkImage> depthImages;
+  std::vector<VkDeviceMemory> depthImageMemorys;
+  std::vector<VkImageView> depthImageViews;
+
+  std::vector<VkBuffer> readbackBuffers;
+  std::vector<VkDeviceMemory> readbackBufferMemorys;
+
+  std::vector<VkFence> inFlightFences;
+  size_t currentFrame = 0;
+};
+
+}  // namespace vae
@@ -68,8 +68,8 @@ namespace vae {
 		shaderStages[1].pNext = nullptr;
 		shaderStages[1].pSpecializationInfo = nullptr;
 
-		auto bindingDescriptions = VmcModel::Vertex::getBindingDescriptions();
-		auto attributeDescriptions = VmcModel::Vertex::getAttributeDescriptions();
+		auto& bindingDescriptions = configInfo.bindingDescriptions;
+		auto& attributeDescriptions = configInfo.attributeDescriptions;
 		VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
 		vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
 		vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size());
@@ -101,7 +101,7 @@ namespace vae {
 
 		if (vkCreateGraphicsPipelines(
 			vmcDevice.device(),
-			VK_NULL_HANDLE,
+			vmcDevice.getPipelineCache(),
 			1,
 			&pipelineInfo,
 			nullptr,
@@ -198,6 +198,9 @@ namespace vae {
 		configInfo.dynamicStateInfo.dynamicStateCount =
 			static_cast<uint32_t>(configInfo.dynamicStateEnables.size());
 		configInfo.dynamicStateInfo.flags = 0;
+
+		configInfo.bindingDescriptions = VmcModel::Vertex::getBindingDescriptions();
+		configInfo.attributeDescriptions = VmcModel::Vertex::getAttributeDescriptions();
 	}
 
 	void VmcPipeline::skyboxPipelineConfigInfo(PipelineConfigInfo& configInfo)
@@ -270,6 +273,9 @@ namespace vae {
 		configInfo.dynamicStateInfo.dynamicStateCount =
 			static_cast<uint32_t>(configInfo.dynamicStateEnables.size());
 		configInfo.dynamicStateInfo.flags = 0;
+
+		configInfo.bindingDescriptions = VmcModel::Vertex::getBindingDescriptions();
+		configInfo.attributeDescriptions = VmcModel::Vertex::getAttributeDescriptions();
 	}
 
 }
\ No newline at end of file
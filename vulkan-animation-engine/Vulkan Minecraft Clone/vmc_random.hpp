@@ -0,0 +1,25 @@
+#pragma once
+
+// std
+#include <cstdint>
+
+namespace vae {
+	// Linear congruential generator (the Numerical Recipes constants), the same sequence on every platform.
+	// Cheap and reproducible for benchmarks and spawning, not for anything that needs good randomness.
+	class VmcRandom
+	{
+	public:
+		explicit VmcRandom(uint32_t seed) : state{ seed } {};
+
+		uint32_t nextUint()
+		{
+			state = state * 1664525u + 1013904223u;
+			return state;
+		};
+		// In [0, 1), from the upper 24 bits, which are the most random ones
+		float nextFloat() { return static_cast<float>(nextUint() >> 8) / 16777216.0f; };
+
+	private:
+		uint32_t state;
+	};
+}
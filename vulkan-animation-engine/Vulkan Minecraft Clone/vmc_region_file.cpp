@@ -0,0 +1,403 @@
+#include "vmc_region_file.hpp"
+
+// std
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <type_traits>
+
+namespace vae {
+	static_assert(std::is_trivially_copyable<VmcRegionHeader>::value, "The header is stored in the region file as raw bytes");
+
+	static constexpr char REGION_MAGIC[4] = { 'V', 'R', 'G', 'N' };
+	static constexpr int BLOCK_TYPE_COUNT = static_cast<int>(BlockType::air) + 1;
+
+	// First byte of an encoded chunk, followed by the palette size, the palette and the blocks
+	enum ChunkEncoding : uint8_t {
+		CHUNK_BIT_PACKED,	// bits per block = log2 of the palette size rounded up, blocks don't straddle words
+		CHUNK_RUNS,			// Palette index and length - 1 as a LEB128 varint per run
+	};
+
+	static void writeVarint(std::vector<uint8_t>& out, uint32_t value)
+	{
+		while (value >= 0x80)
+		{
+			out.push_back(static_cast<uint8_t>(value | 0x80));
+			value >>= 7;
+		}
+		out.push_back(static_cast<uint8_t>(value));
+	}
+
+	static bool readVarint(const uint8_t*& data, const uint8_t* end, uint32_t& value)
+	{
+		value = 0;
+		for (int shift = 0; shift < 35 && data < end; shift += 7)
+		{
+			uint8_t byte = *data++;
+			value |= static_cast<uint32_t>(byte & 0x7f) << shift;
+			if ((byte & 0x80) == 0) return true;
+		}
+		return false;
+	}
+
+	// ========================
+	// VmcRegionFile
+	// ========================
+
+	VmcRegionFile::VmcRegionFile(const std::string& filePath, int chunkWidth, int chunkHeight) : file{ filePath }
+	{
+		if (!file.isOpen() || file.getSize() < sizeof(VmcRegionHeader)) return;
+
+		const VmcRegionHeader& header = getHeader();
+		if (std::memcmp(header.magic, REGION_MAGIC, sizeof(REGION_MAGIC)) != 0
+			|| header.version != FORMAT_VERSION
+			|| header.chunkWidth != static_cast<uint32_t>(chunkWidth)
+			|| header.chunkHeight != static_cast<uint32_t>(chunkHeight))
+			return;
+
+		for (const VmcRegionEntry& entry : header.entries)
+		{
+			if (entry.size > 0 && (entry.offset < sizeof(VmcRegionHeader) || static_cast<uint64_t>(entry.offset) + entry.size > file.getSize())) return;
+		}
+		valid = true;
+	}
+
+	const uint8_t* VmcRegionFile::findChunk(int localX, int localZ, size_t& size) const
+	{
+		if (!valid) return nullptr;
+		const VmcRegionEntry& entry = getHeader().entries[localZ * REGION_SIZE + localX];
+		size = entry.size;
+		return entry.size > 0 ? file.getData() + entry.offset : nullptr;
+	}
+
+	void VmcRegionFile::encodeChunk(const ChunkComponent& chunk, std::vector<uint8_t>& out)
+	{
+		// Palette in order of appearance, the blocks as palette indices
+		uint8_t paletteIndex[BLOCK_TYPE_COUNT];
+		std::memset(paletteIndex, 0xff, sizeof(paletteIndex));
+		std::vector<uint8_t> palette;
+		std::vector<uint8_t> indices;
+		indices.reserve(static_cast<size_t>(chunk.getWidth()) * chunk.getWidth() * chunk.getHeight());
+		for (int y = 0; y < chunk.getHeight(); y++)
+		{
+			for (int z = 0; z < chunk.getWidth(); z++)
+			{
+				for (int x = 0; x < chunk.getWidth(); x++)
+				{
+					int type = static_cast<int>(chunk.getBlock(x, y, z));
+					if (paletteIndex[type] == 0xff)
+					{
+						paletteIndex[type] = static_cast<uint8_t>(palette.size());
+						palette.push_back(static_cast<uint8_t>(type));
+					}
+					indices.push_back(paletteIndex[type]);
+				}
+			}
+		}
+
+		std::vector<uint8_t> runs;
+		for (size_t first = 0; first < indices.size();)
+		{
+			size_t last = first + 1;
+			while (last < indices.size() && indices[last] == indices[first]) last++;
+			runs.push_back(indices[first]);
+			writeVarint(runs, static_cast<uint32_t>(last - first - 1));
+			first = last;
+		}
+
+		int bits = 0;
+		while ((size_t{ 1 } << bits) < palette.size()) bits++;
+		const size_t blocksPerWord = bits > 0 ? 64 / bits : 0;
+		const size_t wordCount = bits > 0 ? (indices.size() + blocksPerWord - 1) / blocksPerWord : 0;
+
+		out.clear();
+		out.push_back(runs.size() < wordCount * sizeof(uint64_t) ? CHUNK_RUNS : CHUNK_BIT_PACKED);
+		out.push_back(static_cast<uint8_t>(palette.size()));
+		out.insert(out.end(), palette.begin(), palette.end());
+		if (out[0] == CHUNK_RUNS)
+		{
+			out.insert(out.end(), runs.begin(), runs.end());
+			return;
+		}
+
+		// A single block type needs no data at all
+		for (size_t word = 0; word < wordCount; word++)
+		{
+			uint64_t packed = 0;
+			for (size_t i = 0; i < blocksPerWord && word * blocksPerWord + i < indices.size(); i++)
+			{
+				packed |= static_cast<uint64_t>(indices[word * blocksPerWord + i]) << (i * bits);
+			}
+			uint8_t bytes[sizeof(uint64_t)];
+			for (size_t b = 0; b < sizeof(uint64_t); b++) bytes[b] = static_cast<uint8_t>(packed >> (8 * b));
+			out.insert(out.end(), bytes, bytes + sizeof(uint64_t));
+		}
+	}
+
+	bool VmcRegionFile::decodeChunk(const uint8_t* data, size_t size, ChunkComponent& chunk)
+	{
+		const uint8_t* end = data + size;
+		if (size < 2) return false;
+		const uint8_t encoding = data[0];
+		const uint8_t paletteSize = data[1];
+		data += 2;
+		if (paletteSize == 0 || paletteSize > BLOCK_TYPE_COUNT || static_cast<size_t>(end - data) < paletteSize) return false;
+
+		BlockType palette[BLOCK_TYPE_COUNT];
+		for (int i = 0; i < paletteSize; i++)
+		{
+			if (data[i] >= BLOCK_TYPE_COUNT) return false;
+			palette[i] = static_cast<BlockType>(data[i]);
+		}
+		data += paletteSize;
+
+		// Blocks in the order they were encoded, collected into rows along x
+		const int width = chunk.getWidth();
+		const size_t blockCount = static_cast<size_t>(width) * width * chunk.getHeight();
+		std::vector<BlockType> row(width);
+		int x = 0;
+		int rowIndex = 0;	// y * width + z
+		auto place = [&](BlockType type, size_t count) {
+			while (count > 0)
+			{
+				int blocks = static_cast<int>(std::min<size_t>(count, width - x));
+				std::fill(row.begin() + x, row.begin() + x + blocks, type);
+				x += blocks;
+				count -= blocks;
+				if (x < width) return;
+				chunk.setRow(rowIndex / width, rowIndex % width, row.data());
+				x = 0;
+				rowIndex++;
+			}
+		};
+
+		if (encoding == CHUNK_RUNS)
+		{
+			size_t placed = 0;
+			while (data < end)
+			{
+				uint8_t index = *data++;
+				uint32_t length;
+				if (index >= paletteSize || !readVarint(data, end, length) || placed + length + 1 > blockCount) return false;
+				place(palette[index], static_cast<size_t>(length) + 1);
+				placed += static_cast<size_t>(length) + 1;
+			}
+			return placed == blockCount;
+		}
+		if (encoding != CHUNK_BIT_PACKED) return false;
+
+		int bits = 0;
+		while ((1 << bits) < paletteSize) bits++;
+		if (bits == 0)
+		{
+			place(palette[0], blockCount);
+			return data == end;
+		}
+
+		const size_t blocksPerWord = 64 / bits;
+		const size_t wordCount = (blockCount + blocksPerWord - 1) / blocksPerWord;
+		if (static_cast<size_t>(end - data) != wordCount * sizeof(uint64_t)) return false;
+		const uint64_t mask = (uint64_t{ 1 } << bits) - 1;
+		for (size_t word = 0, block = 0; word < wordCount; word++, data += sizeof(uint64_t))
+		{
+			uint64_t packed = 0;
+			for (size_t b = 0; b < sizeof(uint64_t); b++) packed |= static_cast<uint64_t>(data[b]) << (8 * b);
+			for (size_t i = 0; i < blocksPerWord && block < blockCount; i++, block++)
+			{
+				uint64_t index = (packed >> (i * bits)) & mask;
+				if (index >= paletteSize) return false;
+				place(palette[index], 1);
+			}
+		}
+		return true;
+	}
+
+	bool VmcRegionFile::write(const std::string& filePath, int chunkWidth, int chunkHeight, const std::vector<const std::vector<uint8_t>*>& chunks)
+	{
+		VmcRegionHeader header{};
+		std::memcpy(header.magic, REGION_MAGIC, sizeof(REGION_MAGIC));
+		header.version = FORMAT_VERSION;
+		header.chunkWidth = static_cast<uint32_t>(chunkWidth);
+		header.chunkHeight = static_cast<uint32_t>(chunkHeight);
+
+		uint64_t offset = sizeof(VmcRegionHeader);
+		for (size_t i = 0; i < chunks.size() && i < REGION_SIZE * REGION_SIZE; i++)
+		{
+			if (chunks[i] == nullptr || chunks[i]->empty()) continue;
+			header.entries[i] = { static_cast<uint32_t>(offset), static_cast<uint32_t>(chunks[i]->size()) };
+			offset += chunks[i]->size();
+		}
+		if (offset > UINT32_MAX) return false;
+
+		// Written next to the region file and renamed, so a crash never leaves a half written region behind
+		std::string tempPath = filePath + ".tmp";
+		std::error_code error;
+		{
+			std::ofstream out{ tempPath, std::ios::binary | std::ios::trunc };
+			if (!out.is_open()) return false;
+
+			out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+			for (size_t i = 0; i < chunks.size() && i < REGION_SIZE * REGION_SIZE; i++)
+			{
+				if (header.entries[i].size > 0) out.write(reinterpret_cast<const char*>(chunks[i]->data()), chunks[i]->size());
+			}
+			if (!out.good())
+			{
+				out.close();
+				std::filesystem::remove(tempPath, error);
+				return false;
+			}
+		}
+
+		std::filesystem::rename(tempPath, filePath, error);
+		if (error)
+		{
+			std::filesystem::remove(tempPath, error);
+			return false;
+		}
+		return true;
+	}
+
+	// ========================
+	// VmcChunkStorage
+	// ========================
+
+	VmcChunkStorage::VmcChunkStorage(const std::string& directory, int chunkWidth, int chunkHeight) :
+		directory{ directory }, chunkWidth{ chunkWidth }, chunkHeight{ chunkHeight }
+	{
+		std::error_code error;
+		std::filesystem::create_directories(directory, error);
+	}
+
+	VmcChunkStorage::~VmcChunkStorage()
+	{
+		flush();
+	}
+
+	VmcChunkCoord VmcChunkStorage::regionOf(VmcChunkCoord coord)
+	{
+		auto floorDivide = [](int value) { return value >= 0 ? value / REGION_SIZE : (value + 1) / REGION_SIZE - 1; };
+		return { floorDivide(coord.x), floorDivide(coord.z) };
+	}
+
+	bool VmcChunkStorage::load(VmcChunkCoord coord, ChunkComponent& chunk)
+	{
+		assert(chunk.getWidth() == chunkWidth && chunk.getHeight() == chunkHeight && "Chunk of another size");
+
+		// Region mappings are only closed by flush(), which waits for this lock
+		std::shared_lock<std::shared_mutex> fileLock{ fileMutex };
+		std::shared_ptr<const std::vector<uint8_t>> pending;
+		const VmcRegionFile* regionFile = nullptr;
+		VmcChunkCoord region = regionOf(coord);
+		{
+			std::lock_guard<std::mutex> lock{ stateMutex };
+			auto it = pendingChunks.find(coord);
+			if (it != pendingChunks.end()) pending = it->second;
+			else regionFile = &openRegion(region);
+		}
+		if (pending) return VmcRegionFile::decodeChunk(pending->data(), pending->size(), chunk);
+
+		size_t size = 0;
+		const uint8_t* data = regionFile->findChunk(coord.x - region.x * REGION_SIZE, coord.z - region.z * REGION_SIZE, size);
+		return data != nullptr && VmcRegionFile::decodeChunk(data, size, chunk);
+	}
+
+	void VmcChunkStorage::save(VmcChunkCoord coord, const ChunkComponent& chunk)
+	{
+		assert(chunk.getWidth() == chunkWidth && chunk.getHeight() == chunkHeight && "Chunk of another size");
+		auto data = std::make_shared<std::vector<uint8_t>>();
+		VmcRegionFile::encodeChunk(chunk, *data);
+
+		std::lock_guard<std::mutex> lock{ stateMutex };
+		pendingChunks[coord] = std::move(data);
+	}
+
+	bool VmcChunkStorage::hasPendingSaves()
+	{
+		std::lock_guard<std::mutex> lock{ stateMutex };
+		return !pendingChunks.empty();
+	}
+
+	void VmcChunkStorage::flush()
+	{
+		// Loads wait for the files to be replaced, saves only wait for the pending chunks to be taken
+		std::unique_lock<std::shared_mutex> fileLock{ fileMutex };
+		std::unordered_map<VmcChunkCoord, std::shared_ptr<const std::vector<uint8_t>>, VmcChunkCoordHash> flushedChunks;
+		{
+			std::lock_guard<std::mutex> lock{ stateMutex };
+			flushedChunks.swap(pendingChunks);
+		}
+		if (flushedChunks.empty()) return;
+
+		// Every region with saved chunks is written completely, the chunks that weren't saved again come from the old file
+		std::unordered_map<VmcChunkCoord, std::vector<std::shared_ptr<const std::vector<uint8_t>>>, VmcChunkCoordHash> changedRegions;
+		for (auto& entry : flushedChunks)
+		{
+			VmcChunkCoord region = regionOf(entry.first);
+			auto& chunks = changedRegions[region];
+			if (chunks.empty())
+			{
+				chunks.resize(REGION_SIZE * REGION_SIZE);
+				const VmcRegionFile* regionFile;
+				{
+					std::lock_guard<std::mutex> lock{ stateMutex };
+					regionFile = &openRegion(region);
+				}
+				// The mapping stays open while fileMutex is held
+				for (int localZ = 0; localZ < REGION_SIZE; localZ++)
+				{
+					for (int localX = 0; localX < REGION_SIZE; localX++)
+					{
+						size_t size = 0;
+						const uint8_t* data = regionFile->findChunk(localX, localZ, size);
+						if (data != nullptr) chunks[localZ * REGION_SIZE + localX] = std::make_shared<const std::vector<uint8_t>>(data, data + size);
+					}
+				}
+			}
+			chunks[(entry.first.z - region.z * REGION_SIZE) * REGION_SIZE + entry.first.x - region.x * REGION_SIZE] = entry.second;
+		}
+
+		for (auto& entry : changedRegions)
+		{
+			// The mapping has to be closed before the file can be replaced
+			{
+				std::lock_guard<std::mutex> lock{ stateMutex };
+				regions.erase(entry.first);
+			}
+
+			std::vector<const std::vector<uint8_t>*> chunks(entry.second.size());
+			for (size_t i = 0; i < chunks.size(); i++) chunks[i] = entry.second[i].get();
+			std::string path = regionPath(entry.first);
+			if (!VmcRegionFile::write(path, chunkWidth, chunkHeight, chunks))
+			{
+				// Pending again unless the chunks were saved once more in the meantime, the next flush tries again
+				std::cout << "Unable to write region file " << path << std::endl;
+				std::lock_guard<std::mutex> lock{ stateMutex };
+				for (auto& chunk : flushedChunks)
+				{
+					if (regionOf(chunk.first) == entry.first) pendingChunks.emplace(chunk.first, chunk.second);
+				}
+			}
+		}
+	}
+
+	std::string VmcChunkStorage::regionPath(VmcChunkCoord region) const
+	{
+		std::string fileName = "r." + std::to_string(region.x) + "." + std::to_string(region.z) + ".vregion";
+		return (std::filesystem::path(directory) / fileName).string();
+	}
+
+	const VmcRegionFile& VmcChunkStorage::openRegion(VmcChunkCoord region)
+	{
+		std::unique_ptr<VmcRegionFile>& regionFile = regions[region];
+		if (!regionFile)
+		{
+			// Also kept when the file doesn't exist, so missing chunks don't try to open it again
+			regionFile = std::make_unique<VmcRegionFile>(regionPath(region), chunkWidth, chunkHeight);
+		}
+		return *regionFile;
+	}
+}
@@ -0,0 +1,105 @@
+#pragma once
+#include "chunk_component.hpp"
+#include "vmc_chunk_manager.hpp"
+#include "vmc_mesh_cache.hpp"
+
+// std
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace vae {
+	static constexpr int REGION_SIZE = 32;	// Chunks along x and z of a region file
+
+	// Where the chunk at (localX, localZ) of the region is stored, size 0 when it isn't
+	struct VmcRegionEntry {
+		uint32_t offset;
+		uint32_t size;
+	};
+
+	// Layout of a .vregion file: this header, then the encoded chunks at the offsets of the table
+	struct VmcRegionHeader {
+		char magic[4];
+		uint32_t version;
+		uint32_t chunkWidth;
+		uint32_t chunkHeight;
+		VmcRegionEntry entries[REGION_SIZE * REGION_SIZE];	// Index localZ * REGION_SIZE + localX
+	};
+
+	/*
+		Region of REGION_SIZE x REGION_SIZE chunks in one memory mapped file, every chunk can be decoded on its own.
+		A chunk is stored as the palette of its block types followed by the blocks in the order of ChunkComponent (x, then
+		z, then y), either as palette indices bit packed into 64 bit words or as runs of the same index, whichever is
+		smaller. Terrain is mostly horizontal layers, so runs usually win by far.
+		Region files are only ever replaced as a whole (written next to it and renamed), never changed in place.
+	*/
+	class VmcRegionFile
+	{
+	public:
+		static constexpr uint32_t FORMAT_VERSION = 1;
+
+		VmcRegionFile(const std::string& filePath, int chunkWidth, int chunkHeight);
+
+		VmcRegionFile(const VmcRegionFile&) = delete;
+		VmcRegionFile& operator=(const VmcRegionFile&) = delete;
+
+		// False when the file doesn't exist, is damaged or stores chunks of another size
+		bool isValid() const { return valid; };
+		// Encoded chunk, nullptr when the region doesn't contain it
+		const uint8_t* findChunk(int localX, int localZ, size_t& size) const;
+
+		static void encodeChunk(const ChunkComponent& chunk, std::vector<uint8_t>& out);
+		// Overwrites every block of the chunk, false (with the chunk in an unknown state) when the data is damaged
+		static bool decodeChunk(const uint8_t* data, size_t size, ChunkComponent& chunk);
+		// chunks[i] is written as entry i, nullptr isn't stored. Returns false when the file can't be written.
+		static bool write(const std::string& filePath, int chunkWidth, int chunkHeight, const std::vector<const std::vector<uint8_t>*>& chunks);
+
+	private:
+		const VmcRegionHeader& getHeader() const { return *reinterpret_cast<const VmcRegionHeader*>(file.getData()); };
+
+		VmcMappedFile file;
+		bool valid = false;
+	};
+
+	/*
+		Chunks of a world saved as region files in one directory. load() can be called by any number of worker threads.
+		Saved chunks are encoded right away and kept in memory until flush() writes them, together with all the other
+		chunks of their region, into a new region file. Loads wait while a flush replaces files.
+	*/
+	class VmcChunkStorage
+	{
+	public:
+		VmcChunkStorage(const std::string& directory, int chunkWidth, int chunkHeight);
+		~VmcChunkStorage();
+
+		VmcChunkStorage(const VmcChunkStorage&) = delete;
+		VmcChunkStorage& operator=(const VmcChunkStorage&) = delete;
+
+		// False when the chunk was never saved (or its data is damaged), chunk has to be generated then
+		bool load(VmcChunkCoord coord, ChunkComponent& chunk);
+		void save(VmcChunkCoord coord, const ChunkComponent& chunk);
+		bool hasPendingSaves();
+		void flush();
+
+		static VmcChunkCoord regionOf(VmcChunkCoord coord);
+
+	private:
+		std::string regionPath(VmcChunkCoord region) const;
+		// Opens the region on first use, call with stateMutex locked
+		const VmcRegionFile& openRegion(VmcChunkCoord region);
+
+		std::string directory;
+		int chunkWidth;
+		int chunkHeight;
+
+		std::shared_mutex fileMutex;	// Shared while a mapping is read, exclusive while region files are replaced
+		std::mutex stateMutex;			// Guards the maps below
+		std::unordered_map<VmcChunkCoord, std::unique_ptr<VmcRegionFile>, VmcChunkCoordHash> regions;
+		std::unordered_map<VmcChunkCoord, std::shared_ptr<const std::vector<uint8_t>>, VmcChunkCoordHash> pendingChunks;
+	};
+}
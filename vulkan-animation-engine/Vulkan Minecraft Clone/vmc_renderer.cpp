@@ -7,25 +7,34 @@
 
 namespace vae {
 
-	VmcRenderer::VmcRenderer(VmcWindow & window, VmcDevice & device) : vmcWindow{window}, vmcDevice{device}
+	VmcRenderer::VmcRenderer(VmcWindow & window, VmcDevice & device) : vmcWindow{&window}, vmcDevice{device}
 	{
 		recreateSwapchain();
 		createCommandBuffers();
+		createSecondaryCommandBuffers();
+	}
+
+	VmcRenderer::VmcRenderer(VmcDevice& device, VkExtent2D extent) : vmcDevice{ device }
+	{
+		offscreenTarget = std::make_unique<VmcOffscreenTarget>(vmcDevice, extent);
+		createCommandBuffers();
+		createSecondaryCommandBuffers();
 	}
 
 	VmcRenderer::~VmcRenderer()
 	{
+		freeSecondaryCommandBuffers();
 		freeCommandBuffers();
 	}
 
 
 	void VmcRenderer::recreateSwapchain()
 	{
-		auto extent = vmcWindow.getExtent();
+		auto extent = vmcWindow->getExtent();
 		while (extent.width == 0 || extent.height == 0)
 		{
 			// Let the program pause and wait when at least 1 dimension is 0.
-			extent = vmcWindow.getExtent();
+			extent = vmcWindow->getExtent();
 			glfwWaitEvents();
 		}
 		vkDeviceWaitIdle(vmcDevice.device());
@@ -64,12 +73,61 @@ namespace vae {
 		commandBuffers.clear();
 	}
 
+	void VmcRenderer::createSecondaryCommandBuffers()
+	{
+		uint32_t threadCount = recordingPool.getThreadCount();
+		secondaryCommandPools.resize(VmcSwapChain::MAX_FRAMES_IN_FLIGHT);
+		secondaryCommandBuffers.resize(VmcSwapChain::MAX_FRAMES_IN_FLIGHT);
+
+		for (int frame = 0; frame < VmcSwapChain::MAX_FRAMES_IN_FLIGHT; frame++)
+		{
+			secondaryCommandPools[frame].resize(threadCount);
+			secondaryCommandBuffers[frame].resize(threadCount);
+
+			for (uint32_t thread = 0; thread < threadCount; thread++)
+			{
+				VkCommandPoolCreateInfo poolInfo{};
+				poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+				poolInfo.queueFamilyIndex = vmcDevice.findPhysicalQueueFamilies().graphicsFamily;
+				poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+
+				if (vkCreateCommandPool(vmcDevice.device(), &poolInfo, nullptr, &secondaryCommandPools[frame][thread]) != VK_SUCCESS) {
+					throw std::runtime_error("failed to create secondary command pool!");
+				}
+
+				VkCommandBufferAllocateInfo allocInfo{};
+				allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+				allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+				allocInfo.commandPool = secondaryCommandPools[frame][thread];
+				allocInfo.commandBufferCount = 1;
+
+				if (vkAllocateCommandBuffers(vmcDevice.device(), &allocInfo, &secondaryCommandBuffers[frame][thread]) != VK_SUCCESS) {
+					throw std::runtime_error("failed to allocate secondary command buffers!");
+				}
+			}
+		}
+	}
+
+	void VmcRenderer::freeSecondaryCommandBuffers()
+	{
+		// Destroying a pool frees the command buffers allocated from it
+		for (auto& framePools : secondaryCommandPools)
+		{
+			for (auto pool : framePools)
+			{
+				vkDestroyCommandPool(vmcDevice.device(), pool, nullptr);
+			}
+		}
+		secondaryCommandPools.clear();
+		secondaryCommandBuffers.clear();
+	}
+
 
 	VkCommandBuffer VmcRenderer::beginFrame()
 	{
 		assert(!isFrameStarted && "Cannot call beginFrame when frame has already started!");
 
-		auto result = vmcSwapChain->acquireNextImage(&currentImageIndex);
+		auto result = isHeadless() ? offscreenTarget->acquireNextImage(&currentImageIndex) : vmcSwapChain->acquireNextImage(&currentImageIndex);
 		if (result == VK_ERROR_OUT_OF_DATE_KHR) {
 			recreateSwapchain();
 			return nullptr;
@@ -81,6 +139,12 @@ namespace vae {
 		isFrameStarted = true;
 		auto commandBuffer = getCurrentCommandBuffer();
 
+		// The fence of this frame was waited on in acquireNextImage, so its secondary command buffers are no longer in use
+		for (auto pool : secondaryCommandPools[currentFrameIndex])
+		{
+			vkResetCommandPool(vmcDevice.device(), pool, 0);
+		}
+
 		VkCommandBufferBeginInfo beginInfo{};
 		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
 
@@ -95,34 +159,48 @@ namespace vae {
 	{
 		assert(isFrameStarted && "Cannot end the frame when there is no current frame in progress!");
 		auto commandBuffer = getCurrentCommandBuffer();
+		if (isHeadless())
+		{
+			offscreenTarget->recordReadback(commandBuffer, currentImageIndex);
+		}
 		if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
 			throw std::runtime_error("failed to record command buffer!");
 		}
 
-		auto result = vmcSwapChain->submitCommandBuffers(&commandBuffer, &currentImageIndex);
-		if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || vmcWindow.wasWindowResized()) {
-			vmcWindow.resetWindowResizedFlag();
-			recreateSwapchain();
+		if (isHeadless())
+		{
+			if (offscreenTarget->submitCommandBuffers(&commandBuffer, &currentImageIndex) != VK_SUCCESS) {
+				throw std::runtime_error("failed to submit offscreen frame!");
+			}
 		}
-		else if (result != VK_SUCCESS) {
-			throw std::runtime_error("failed to present swap chain image!");
+		else
+		{
+			auto result = vmcSwapChain->submitCommandBuffers(&commandBuffer, &currentImageIndex);
+			if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || vmcWindow->wasWindowResized()) {
+				vmcWindow->resetWindowResizedFlag();
+				recreateSwapchain();
+			}
+			else if (result != VK_SUCCESS) {
+				throw std::runtime_error("failed to present swap chain image!");
+			}
 		}
+		lastImageIndex = currentImageIndex;
 		isFrameStarted = false;
 		currentFrameIndex = (currentFrameIndex + 1) % VmcSwapChain::MAX_FRAMES_IN_FLIGHT;
 	}
 
-	void VmcRenderer::beginSwapChainRenderPass(VkCommandBuffer commandBuffer)
+	void VmcRenderer::beginSwapChainRenderPass(VkCommandBuffer commandBuffer, VkSubpassContents contents)
 	{
 		assert(isFrameStarted && "Cannot begin the render pass when there is no current frame in progress!");
 		assert(commandBuffer == getCurrentCommandBuffer() && "Cannot begin render pass on command buffer from a different frame!");
 
 		VkRenderPassBeginInfo renderPassInfo{};
 		renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-		renderPassInfo.renderPass = vmcSwapChain->getRenderPass();
-		renderPassInfo.framebuffer = vmcSwapChain->getFrameBuffer(currentImageIndex);
+		renderPassInfo.renderPass = getSwapChainRenderPass();
+		renderPassInfo.framebuffer = getCurrentFrameBuffer();
 
 		renderPassInfo.renderArea.offset = { 0, 0 };
-		renderPassInfo.renderArea.extent = vmcSwapChain->getSwapChainExtent();
+		renderPassInfo.renderArea.extent = getExtent();
 
 		std::array<VkClearValue, 2> clearValues{};
 		clearValues[0].color = { 0.01f, 0.01f, 0.01f, 1.0f };
@@ -130,16 +208,22 @@ namespace vae {
 		renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
 		renderPassInfo.pClearValues = clearValues.data();
 
-		vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+		vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, contents);
+		currentSubpassContents = contents;
+		if (contents == VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS)
+		{
+			// Only vkCmdExecuteCommands is allowed in this subpass, the secondary buffers set their own dynamic state
+			return;
+		}
 
 		VkViewport viewport{};
 		viewport.x = 0.0f;
 		viewport.y = 0.0f;
-		viewport.width = static_cast<float>(vmcSwapChain->getSwapChainExtent().width);
-		viewport.height = static_cast<float>(vmcSwapChain->getSwapChainExtent().height);
+		viewport.width = static_cast<float>(getExtent().width);
+		viewport.height = static_cast<float>(getExtent().height);
 		viewport.minDepth = 0.0f;
 		viewport.maxDepth = 1.0f;
-		VkRect2D scissor{ {0, 0}, vmcSwapChain->getSwapChainExtent() };
+		VkRect2D scissor{ {0, 0}, getExtent() };
 		vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
 		vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
 	}
@@ -149,10 +233,84 @@ namespace vae {
 		assert(isFrameStarted && "Cannot end the render pass when there is no current frame in progress!");
 		assert(commandBuffer == getCurrentCommandBuffer() && "Cannot end render pass on command buffer from a different frame!");
 		vkCmdEndRenderPass(commandBuffer);
+		currentSubpassContents = VK_SUBPASS_CONTENTS_INLINE;
+	}
+
+	// Records sliceCount secondary command buffers in parallel, one per recording thread, and executes them in slice order.
+	// recordSlice receives a secondary buffer that already inherits the scene render pass and has its viewport and scissor set.
+	void VmcRenderer::recordSecondaryCommandBuffers(VkCommandBuffer commandBuffer, uint32_t sliceCount, const std::function<void(VkCommandBuffer, uint32_t)>& recordSlice)
+	{
+		assert(isFrameStarted && "Cannot record secondary command buffers when there is no current frame in progress!");
+		assert(currentSubpassContents == VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS && "Render pass was not begun with secondary command buffer contents!");
+		assert(sliceCount <= getMaxSecondaryCommandBuffers() && "More slices requested than there are recording threads!");
+
+		if (sliceCount == 0)
+		{
+			return;
+		}
+
+		VkCommandBufferInheritanceInfo inheritanceInfo{};
+		inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+		inheritanceInfo.renderPass = getSwapChainRenderPass();
+		inheritanceInfo.subpass = 0;
+		inheritanceInfo.framebuffer = getCurrentFrameBuffer();
+
+		VkViewport viewport{};
+		viewport.x = 0.0f;
+		viewport.y = 0.0f;
+		viewport.width = static_cast<float>(getExtent().width);
+		viewport.height = static_cast<float>(getExtent().height);
+		viewport.minDepth = 0.0f;
+		viewport.maxDepth = 1.0f;
+		VkRect2D scissor{ {0, 0}, getExtent() };
+
+		std::vector<VkCommandBuffer>& frameSecondaries = secondaryCommandBuffers[currentFrameIndex];
+		for (uint32_t slice = 0; slice < sliceCount; slice++)
+		{
+			recordingPool.addJob([&, slice]() {
+				VkCommandBuffer secondary = frameSecondaries[slice];
+
+				VkCommandBufferBeginInfo beginInfo{};
+				beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+				beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+				beginInfo.pInheritanceInfo = &inheritanceInfo;
+
+				if (vkBeginCommandBuffer(secondary, &beginInfo) != VK_SUCCESS) {
+					throw std::runtime_error("failed to begin recording secondary command buffer!");
+				}
+
+				// Dynamic state is not inherited from the primary command buffer
+				vkCmdSetViewport(secondary, 0, 1, &viewport);
+				vkCmdSetScissor(secondary, 0, 1, &scissor);
+
+				recordSlice(secondary, slice);
+
+				if (vkEndCommandBuffer(secondary) != VK_SUCCESS) {
+					throw std::runtime_error("failed to record secondary command buffer!");
+				}
+			});
+		}
+		recordingPool.wait();
+
+		vkCmdExecuteCommands(commandBuffer, sliceCount, frameSecondaries.data());
+	}
+
+	// Headless only: waits for the most recently submitted frame and copies out its pixels
+	void VmcRenderer::readLastFrame(std::vector<uint8_t>& rgba)
+	{
+		assert(isHeadless() && "Frames can only be read back from a headless renderer!");
+		assert(!isFrameStarted && "Cannot read back a frame while another frame is being recorded!");
+		offscreenTarget->readPixels(lastImageIndex, rgba);
+	}
+
+	VkFramebuffer VmcRenderer::getCurrentFrameBuffer() const
+	{
+		return isHeadless() ? offscreenTarget->getFrameBuffer(currentImageIndex) : vmcSwapChain->getFrameBuffer(currentImageIndex);
 	}
 
 	void VmcRenderer::beginImGuiRenderPass(VkCommandBuffer commandBuffer)
 	{
+		assert(!isHeadless() && "Headless renderer has no ImGui render pass!");
 		assert(isFrameStarted && "Cannot begin the render pass when there is no current frame in progress!");
 		assert(commandBuffer == getCurrentCommandBuffer() && "Cannot begin render pass on command buffer from a different frame!");
 
@@ -1,13 +1,16 @@
 #pragma once
 #include "vmc_swap_chain.hpp"
+#include "vmc_offscreen_target.hpp"
 #include "vmc_pipeline.hpp"
 #include "vmc_device.hpp"
 #include "vmc_window.hpp"
 #include "vmc_game_object.hpp"
+#include "vmc_thread_pool.hpp"
 
 // std 
 #include <memory>
 #include <cassert>
+#include <functional>
 
 namespace vae {
 	class VmcRenderer
@@ -15,14 +18,26 @@ namespace vae {
 	public:
 
 		VmcRenderer(VmcWindow& window, VmcDevice& device);
+		// Headless renderer: frames go to an offscreen target of the given size instead of a swap chain
+		VmcRenderer(VmcDevice& device, VkExtent2D extent);
 		~VmcRenderer();
 
 		VmcRenderer(const VmcRenderer&) = delete;
 		VmcRenderer& operator=(const VmcRenderer&) = delete;
 
-		VkRenderPass getSwapChainRenderPass() const { return vmcSwapChain->getRenderPass(); };
-		VkRenderPass getImGuiRenderPass() const { return vmcSwapChain->getImGuiRenderPass(); };
-		float getAspectRatio() const { return vmcSwapChain->extentAspectRatio(); };
+		bool isHeadless() const { return offscreenTarget != nullptr; };
+		VkRenderPass getSwapChainRenderPass() const { return isHeadless() ? offscreenTarget->getRenderPass() : vmcSwapChain->getRenderPass(); };
+		VkRenderPass getImGuiRenderPass() const {
+			assert(!isHeadless() && "Headless renderer has no ImGui render pass!");
+			return vmcSwapChain->getImGuiRenderPass();
+		};
+		float getAspectRatio() const { return isHeadless() ? offscreenTarget->extentAspectRatio() : vmcSwapChain->extentAspectRatio(); };
+		VkExtent2D getExtent() const { return isHeadless() ? offscreenTarget->getExtent() : vmcSwapChain->getSwapChainExtent(); };
+		VkFormat getImageFormat() const { return isHeadless() ? offscreenTarget->getImageFormat() : vmcSwapChain->getSwapChainImageFormat(); };
+		VkImage getCurrentImage() const {
+			assert(isFrameStarted && "Cannot access the frame image when frame not in progress!");
+			return isHeadless() ? offscreenTarget->getColorImage(currentImageIndex) : vmcSwapChain->getImage(currentImageIndex);
+		};
 		bool isFrameInProgress() const { return isFrameStarted; };
 		VkCommandBuffer getCurrentCommandBuffer() const {
 			assert(isFrameStarted && "Cannot access command buffer when frame not in progress!");
@@ -32,11 +47,17 @@ namespace vae {
 			assert(isFrameStarted && "Cannot access frame index when frame not in progress!");
 			return currentFrameIndex;
 		};
+		VkSubpassContents getSubpassContents() const { return currentSubpassContents; };
+		uint32_t getMaxSecondaryCommandBuffers() const { return recordingPool.getThreadCount(); };
+		// The recording threads are idle outside of recordSecondaryCommandBuffers, work before recording can use them
+		VmcThreadPool& getWorkerPool() { return recordingPool; };
 
 		VkCommandBuffer beginFrame();
 		void endFrame();
-		void beginSwapChainRenderPass(VkCommandBuffer commandBuffer);
+		void beginSwapChainRenderPass(VkCommandBuffer commandBuffer, VkSubpassContents contents = VK_SUBPASS_CONTENTS_INLINE);
 		void endSwapChainRenderPass(VkCommandBuffer commandBuffer);
+		void recordSecondaryCommandBuffers(VkCommandBuffer commandBuffer, uint32_t sliceCount, const std::function<void(VkCommandBuffer, uint32_t)>& recordSlice);
+		void readLastFrame(std::vector<uint8_t>& rgba);
 		void beginImGuiRenderPass(VkCommandBuffer commandBuffer);
 		void endImGuiRenderPass(VkCommandBuffer commandBuffer);
 
@@ -45,17 +66,29 @@ namespace vae {
 
 		void createCommandBuffers();
 		void freeCommandBuffers();
+		void createSecondaryCommandBuffers();
+		void freeSecondaryCommandBuffers();
 		void recreateSwapchain();
+		VkFramebuffer getCurrentFrameBuffer() const;
 
 
-		VmcWindow& vmcWindow;
+		VmcWindow* vmcWindow = nullptr;
 		VmcDevice& vmcDevice;
 		std::unique_ptr<VmcSwapChain> vmcSwapChain;
+		std::unique_ptr<VmcOffscreenTarget> offscreenTarget;
 		std::vector<VkCommandBuffer> commandBuffers;
 
+		// One command pool per recording thread per frame in flight, so threads never share a pool
+		// and a frame's pools can be reset as a whole once its fence has been waited on.
+		VmcThreadPool recordingPool;
+		std::vector<std::vector<VkCommandPool>> secondaryCommandPools;
+		std::vector<std::vector<VkCommandBuffer>> secondaryCommandBuffers;
+
 		uint32_t currentImageIndex;
-		int currentFrameIndex;
-		bool isFrameStarted;
+		uint32_t lastImageIndex = 0;
+		int currentFrameIndex = 0;
+		bool isFrameStarted = false;
+		VkSubpassContents currentSubpassContents = VK_SUBPASS_CONTENTS_INLINE;
 	};
 }
 
@@ -27,6 +27,7 @@ class VmcSwapChain {
   VkRenderPass getRenderPass() { return renderPass; }
   VkRenderPass getImGuiRenderPass() { return imGuiRenderPass; }
   VkImageView getImageView(int index) { return swapChainImageViews[index]; }
+  VkImage getImage(int index) { return swapChainImages[index]; }
   size_t imageCount() { return swapChainImages.size(); }
   VkFormat getSwapChainImageFormat() { return swapChainImageFormat; }
   VkExtent2D getSwapChainExtent() { return swapChainExtent; }
@@ -0,0 +1,345 @@
+#include "vmc_terrain_generator.hpp"
+
+// std
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <vector>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define VAE_NOISE_AVX2
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define VAE_TARGET_AVX2
+#else
+#define VAE_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+namespace vae {
+
+	namespace {
+		constexpr uint32_t PRIME_X = 501125321u;
+		constexpr uint32_t PRIME_Y = 1136930381u;
+		constexpr uint32_t PRIME_Z = 1720413743u;
+		constexpr uint32_t HASH_MULTIPLIER = 0x27d4eb2du;
+
+		const VmcTerrainGenerator::NoiseLayer CONTINENTAL_LAYER{ 1.0f / 320.0f, 1.0f, 1.0f / 320.0f, 2, 1 };
+		const VmcTerrainGenerator::NoiseLayer MOISTURE_LAYER{ 1.0f / 256.0f, 1.0f, 1.0f / 256.0f, 2, 2 };
+		const VmcTerrainGenerator::NoiseLayer HEIGHT_LAYER{ 1.0f / 72.0f, 1.0f, 1.0f / 72.0f, 4, 3 };
+		const VmcTerrainGenerator::NoiseLayer CAVE_LAYER{ 1.0f / 24.0f, 1.0f / 16.0f, 1.0f / 24.0f, 2, 4 };
+		// Columns sample the 2D layers halfway between two lattice planes, on a plane the noise of y gradients is 0
+		constexpr float COLUMN_Y = 0.5f;
+
+		uint32_t octaveSeed(uint32_t seed, const VmcTerrainGenerator::NoiseLayer& layer, int octave)
+		{
+			return (seed + layer.seedOffset) * 0x9e3779b9u + static_cast<uint32_t>(octave) * 0x85ebca6bu;
+		}
+
+		float smoothStep(float edge0, float edge1, float x)
+		{
+			float t = std::clamp((x - edge0) / (edge1 - edge0), 0.0f, 1.0f);
+			return t * t * (3.0f - 2.0f * t);
+		}
+
+		// ========================
+		// Scalar noise
+		// ========================
+
+		inline float fade(float t) { return t * t * t * (t * (t * 6.0f - 15.0f) + 10.0f); }
+		inline float lerp(float a, float b, float t) { return a + t * (b - a); }
+
+		inline uint32_t hashCorner(uint32_t seed, uint32_t px, uint32_t py, uint32_t pz)
+		{
+			uint32_t hash = (seed ^ px ^ py ^ pz) * HASH_MULTIPLIER;
+			return (hash ^ (hash >> 15)) & 15;
+		}
+
+		// The 12 gradients to the edge midpoints of a cube, 4 of them twice (Perlin 2002)
+		inline float gradient(uint32_t hash, float x, float y, float z)
+		{
+			float u = hash < 8 ? x : y;
+			float v = hash < 4 ? y : (hash == 12 || hash == 14 ? x : z);
+			return ((hash & 1) ? -u : u) + ((hash & 2) ? -v : v);
+		}
+
+		float gradientNoise(float x, float y, float z, uint32_t seed)
+		{
+			const float floorX = std::floor(x);
+			const float floorY = std::floor(y);
+			const float floorZ = std::floor(z);
+			const uint32_t px0 = static_cast<uint32_t>(static_cast<int32_t>(floorX)) * PRIME_X;
+			const uint32_t py0 = static_cast<uint32_t>(static_cast<int32_t>(floorY)) * PRIME_Y;
+			const uint32_t pz0 = static_cast<uint32_t>(static_cast<int32_t>(floorZ)) * PRIME_Z;
+			const uint32_t px1 = px0 + PRIME_X;
+			const uint32_t py1 = py0 + PRIME_Y;
+			const uint32_t pz1 = pz0 + PRIME_Z;
+
+			const float x0 = x - floorX;
+			const float y0 = y - floorY;
+			const float z0 = z - floorZ;
+			const float x1 = x0 - 1.0f;
+			const float y1 = y0 - 1.0f;
+			const float z1 = z0 - 1.0f;
+			const float u = fade(x0);
+			const float v = fade(y0);
+			const float w = fade(z0);
+
+			const float n00 = lerp(gradient(hashCorner(seed, px0, py0, pz0), x0, y0, z0), gradient(hashCorner(seed, px1, py0, pz0), x1, y0, z0), u);
+			const float n10 = lerp(gradient(hashCorner(seed, px0, py1, pz0), x0, y1, z0), gradient(hashCorner(seed, px1, py1, pz0), x1, y1, z0), u);
+			const float n01 = lerp(gradient(hashCorner(seed, px0, py0, pz1), x0, y0, z1), gradient(hashCorner(seed, px1, py0, pz1), x1, y0, z1), u);
+			const float n11 = lerp(gradient(hashCorner(seed, px0, py1, pz1), x0, y1, z1), gradient(hashCorner(seed, px1, py1, pz1), x1, y1, z1), u);
+			return lerp(lerp(n00, n10, v), lerp(n01, n11, v), w);
+		}
+
+		void fractalNoiseScalar(uint32_t seed, const VmcTerrainGenerator::NoiseLayer& layer, const float* x, const float* y, const float* z, float* out, size_t count)
+		{
+			float normalization = 0.0f;
+			for (int octave = 0; octave < layer.octaves; octave++) normalization += 1.0f / static_cast<float>(1 << octave);
+			const float inverseNormalization = 1.0f / normalization;
+
+			for (size_t i = 0; i < count; i++)
+			{
+				const float sampleX = x[i] * layer.frequencyX;
+				const float sampleY = y[i] * layer.frequencyY;
+				const float sampleZ = z[i] * layer.frequencyZ;
+				float sum = 0.0f;
+				float amplitude = 1.0f;
+				float frequency = 1.0f;
+				for (int octave = 0; octave < layer.octaves; octave++)
+				{
+					sum = sum + amplitude * gradientNoise(sampleX * frequency, sampleY * frequency, sampleZ * frequency, octaveSeed(seed, layer, octave));
+					amplitude *= 0.5f;
+					frequency *= 2.0f;
+				}
+				out[i] = sum * inverseNormalization;
+			}
+		}
+
+		// ========================
+		// AVX2 noise, the same operations as the scalar noise on 8 samples
+		// ========================
+
+#ifdef VAE_NOISE_AVX2
+		VAE_TARGET_AVX2 inline __m256 fade8(__m256 t)
+		{
+			__m256 inner = _mm256_add_ps(_mm256_mul_ps(t, _mm256_sub_ps(_mm256_mul_ps(t, _mm256_set1_ps(6.0f)), _mm256_set1_ps(15.0f))), _mm256_set1_ps(10.0f));
+			return _mm256_mul_ps(_mm256_mul_ps(_mm256_mul_ps(t, t), t), inner);
+		}
+
+		VAE_TARGET_AVX2 inline __m256 lerp8(__m256 a, __m256 b, __m256 t)
+		{
+			return _mm256_add_ps(a, _mm256_mul_ps(t, _mm256_sub_ps(b, a)));
+		}
+
+		VAE_TARGET_AVX2 inline __m256i hashCorner8(__m256i seed, __m256i px, __m256i py, __m256i pz)
+		{
+			__m256i hash = _mm256_mullo_epi32(_mm256_xor_si256(_mm256_xor_si256(seed, px), _mm256_xor_si256(py, pz)), _mm256_set1_epi32(static_cast<int>(HASH_MULTIPLIER)));
+			return _mm256_and_si256(_mm256_xor_si256(hash, _mm256_srli_epi32(hash, 15)), _mm256_set1_epi32(15));
+		}
+
+		VAE_TARGET_AVX2 inline __m256 gradient8(__m256i hash, __m256 x, __m256 y, __m256 z)
+		{
+			// blendv picks its second operand where the mask is set, the sign flips are XORs of the sign bit
+			__m256 u = _mm256_blendv_ps(y, x, _mm256_castsi256_ps(_mm256_cmpgt_epi32(_mm256_set1_epi32(8), hash)));
+			__m256i xMask = _mm256_or_si256(_mm256_cmpeq_epi32(hash, _mm256_set1_epi32(12)), _mm256_cmpeq_epi32(hash, _mm256_set1_epi32(14)));
+			__m256 v = _mm256_blendv_ps(z, x, _mm256_castsi256_ps(xMask));
+			v = _mm256_blendv_ps(v, y, _mm256_castsi256_ps(_mm256_cmpgt_epi32(_mm256_set1_epi32(4), hash)));
+			u = _mm256_xor_ps(u, _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(hash, _mm256_set1_epi32(1)), 31)));
+			v = _mm256_xor_ps(v, _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(hash, _mm256_set1_epi32(2)), 30)));
+			return _mm256_add_ps(u, v);
+		}
+
+		VAE_TARGET_AVX2 __m256 gradientNoise8(__m256 x, __m256 y, __m256 z, __m256i seed)
+		{
+			const __m256 floorX = _mm256_floor_ps(x);
+			const __m256 floorY = _mm256_floor_ps(y);
+			const __m256 floorZ = _mm256_floor_ps(z);
+			const __m256i primeX = _mm256_set1_epi32(static_cast<int>(PRIME_X));
+			const __m256i primeY = _mm256_set1_epi32(static_cast<int>(PRIME_Y));
+			const __m256i primeZ = _mm256_set1_epi32(static_cast<int>(PRIME_Z));
+			const __m256i px0 = _mm256_mullo_epi32(_mm256_cvttps_epi32(floorX), primeX);
+			const __m256i py0 = _mm256_mullo_epi32(_mm256_cvttps_epi32(floorY), primeY);
+			const __m256i pz0 = _mm256_mullo_epi32(_mm256_cvttps_epi32(floorZ), primeZ);
+			const __m256i px1 = _mm256_add_epi32(px0, primeX);
+			const __m256i py1 = _mm256_add_epi32(py0, primeY);
+			const __m256i pz1 = _mm256_add_epi32(pz0, primeZ);
+
+			const __m256 one = _mm256_set1_ps(1.0f);
+			const __m256 x0 = _mm256_sub_ps(x, floorX);
+			const __m256 y0 = _mm256_sub_ps(y, floorY);
+			const __m256 z0 = _mm256_sub_ps(z, floorZ);
+			const __m256 x1 = _mm256_sub_ps(x0, one);
+			const __m256 y1 = _mm256_sub_ps(y0, one);
+			const __m256 z1 = _mm256_sub_ps(z0, one);
+			const __m256 u = fade8(x0);
+			const __m256 v = fade8(y0);
+			const __m256 w = fade8(z0);
+
+			const __m256 n00 = lerp8(gradient8(hashCorner8(seed, px0, py0, pz0), x0, y0, z0), gradient8(hashCorner8(seed, px1, py0, pz0), x1, y0, z0), u);
+			const __m256 n10 = lerp8(gradient8(hashCorner8(seed, px0, py1, pz0), x0, y1, z0), gradient8(hashCorner8(seed, px1, py1, pz0), x1, y1, z0), u);
+			const __m256 n01 = lerp8(gradient8(hashCorner8(seed, px0, py0, pz1), x0, y0, z1), gradient8(hashCorner8(seed, px1, py0, pz1), x1, y0, z1), u);
+			const __m256 n11 = lerp8(gradient8(hashCorner8(seed, px0, py1, pz1), x0, y1, z1), gradient8(hashCorner8(seed, px1, py1, pz1), x1, y1, z1), u);
+			return lerp8(lerp8(n00, n10, v), lerp8(n01, n11, v), w);
+		}
+
+		// Returns how many samples were evaluated, always a multiple of 8
+		VAE_TARGET_AVX2 size_t fractalNoiseAvx2(uint32_t seed, const VmcTerrainGenerator::NoiseLayer& layer, const float* x, const float* y, const float* z, float* out, size_t count)
+		{
+			float normalization = 0.0f;
+			for (int octave = 0; octave < layer.octaves; octave++) normalization += 1.0f / static_cast<float>(1 << octave);
+			const __m256 inverseNormalization = _mm256_set1_ps(1.0f / normalization);
+
+			size_t i = 0;
+			for (; i + 8 <= count; i += 8)
+			{
+				const __m256 sampleX = _mm256_mul_ps(_mm256_loadu_ps(x + i), _mm256_set1_ps(layer.frequencyX));
+				const __m256 sampleY = _mm256_mul_ps(_mm256_loadu_ps(y + i), _mm256_set1_ps(layer.frequencyY));
+				const __m256 sampleZ = _mm256_mul_ps(_mm256_loadu_ps(z + i), _mm256_set1_ps(layer.frequencyZ));
+				__m256 sum = _mm256_setzero_ps();
+				float amplitude = 1.0f;
+				float frequency = 1.0f;
+				for (int octave = 0; octave < layer.octaves; octave++)
+				{
+					const __m256 octaveFrequency = _mm256_set1_ps(frequency);
+					const __m256 noise = gradientNoise8(_mm256_mul_ps(sampleX, octaveFrequency), _mm256_mul_ps(sampleY, octaveFrequency), _mm256_mul_ps(sampleZ, octaveFrequency),
+						_mm256_set1_epi32(static_cast<int>(octaveSeed(seed, layer, octave))));
+					sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_set1_ps(amplitude), noise));
+					amplitude *= 0.5f;
+					frequency *= 2.0f;
+				}
+				_mm256_storeu_ps(out + i, _mm256_mul_ps(sum, inverseNormalization));
+			}
+			return i;
+		}
+#endif
+	}
+
+	VmcTerrainGenerator::VmcTerrainGenerator(uint32_t seed, NoiseMode mode) : seed{ seed }
+	{
+		if (mode == NOISE_AVX2 && !isAvx2Supported())
+		{
+			throw std::runtime_error("AVX2 terrain noise requested, but the CPU doesn't support AVX2!");
+		}
+		avx2 = mode == NOISE_AVX2 || (mode == NOISE_AUTOMATIC && isAvx2Supported());
+	}
+
+	bool VmcTerrainGenerator::isAvx2Supported()
+	{
+#if !defined(VAE_NOISE_AVX2)
+		return false;
+#elif defined(_MSC_VER)
+		static const bool supported = []() {
+			int info[4];
+			__cpuid(info, 0);
+			if (info[0] < 7) return false;
+			// The OS has to save the YMM registers as well
+			__cpuid(info, 1);
+			bool osxsave = (info[2] & (1 << 27)) != 0;
+			bool avx = (info[2] & (1 << 28)) != 0;
+			if (!osxsave || !avx || (_xgetbv(0) & 6) != 6) return false;
+			__cpuidex(info, 7, 0);
+			return (info[1] & (1 << 5)) != 0;
+		}();
+		return supported;
+#else
+		static const bool supported = __builtin_cpu_supports("avx2");
+		return supported;
+#endif
+	}
+
+	void VmcTerrainGenerator::fractalNoise(const NoiseLayer& layer, const float* x, const float* y, const float* z, float* out, size_t count) const
+	{
+		size_t done = 0;
+#ifdef VAE_NOISE_AVX2
+		if (avx2) done = fractalNoiseAvx2(seed, layer, x, y, z, out, count);
+#endif
+		fractalNoiseScalar(seed, layer, x + done, y + done, z + done, out + done, count - done);
+	}
+
+	void VmcTerrainGenerator::generate(ChunkComponent& chunk, VmcChunkCoord coord) const
+	{
+		const int width = chunk.getWidth();
+		const int height = chunk.getHeight();
+		const int columnCount = width * width;
+		const int originX = coord.x * width;
+		const int originZ = coord.z * width;
+
+		// Pass 1: biomes, one sample per column
+		std::vector<float> columnX(columnCount);
+		std::vector<float> columnY(columnCount, COLUMN_Y);
+		std::vector<float> columnZ(columnCount);
+		for (int z = 0; z < width; z++)
+		{
+			for (int x = 0; x < width; x++)
+			{
+				columnX[z * width + x] = static_cast<float>(originX + x);
+				columnZ[z * width + x] = static_cast<float>(originZ + z);
+			}
+		}
+		std::vector<float> continental(columnCount);
+		std::vector<float> moisture(columnCount);
+		std::vector<float> heightNoise(columnCount);
+		fractalNoise(CONTINENTAL_LAYER, columnX.data(), columnY.data(), columnZ.data(), continental.data(), columnCount);
+		fractalNoise(MOISTURE_LAYER, columnX.data(), columnY.data(), columnZ.data(), moisture.data(), columnCount);
+		fractalNoise(HEIGHT_LAYER, columnX.data(), columnY.data(), columnZ.data(), heightNoise.data(), columnCount);
+
+		// Pass 2: height and surface material. y grows downwards, the surface level of the chunk manager is world y = 0.
+		std::vector<int> surfaces(columnCount);
+		for (int z = 0; z < width; z++)
+		{
+			for (int x = 0; x < width; x++)
+			{
+				const int column = z * width + x;
+				const float mountains = smoothStep(0.1f, 0.4f, continental[column]);
+				const float desert = smoothStep(-0.1f, -0.35f, moisture[column]) * (1.0f - mountains);
+				const float amplitude = (5.0f + 20.0f * mountains) * (1.0f - 0.6f * desert);
+				const int surfaceHeight = static_cast<int>(std::lround(2.0f + 8.0f * mountains + amplitude * heightNoise[column]));
+				const int surface = std::clamp(VmcChunkManager::SURFACE_LEVEL - surfaceHeight, 1, height - 2);
+				surfaces[column] = surface;
+
+				BlockType top = BlockType::grass;
+				BlockType below = BlockType::dirt;
+				if (desert > 0.5f)
+				{
+					top = BlockType::sand;
+					below = BlockType::sand;
+				}
+				else if (mountains > 0.5f && surfaceHeight > 16)
+				{
+					top = BlockType::stone;		// Bare rock on the peaks
+					below = BlockType::stone;
+				}
+
+				for (int y = 0; y < height; y++)
+				{
+					BlockType type = y < surface ? BlockType::air : y == surface ? top : y < surface + 4 ? below : BlockType::stone;
+					chunk.setBlock(x, y, z, type);
+				}
+			}
+		}
+
+		// Pass 3: caves, one row of blocks along x at a time. The lowest layer stays solid.
+		std::vector<float> rowX(width);
+		std::vector<float> rowY(width);
+		std::vector<float> rowZ(width);
+		std::vector<float> caveNoise(width);
+		for (int x = 0; x < width; x++) rowX[x] = static_cast<float>(originX + x);
+		for (int z = 0; z < width; z++)
+		{
+			const int rowSurface = *std::min_element(surfaces.begin() + z * width, surfaces.begin() + (z + 1) * width);
+			std::fill(rowZ.begin(), rowZ.end(), static_cast<float>(originZ + z));
+			for (int y = rowSurface + CAVE_MIN_DEPTH; y < height - 1; y++)
+			{
+				std::fill(rowY.begin(), rowY.end(), static_cast<float>(y - VmcChunkManager::SURFACE_LEVEL));
+				fractalNoise(CAVE_LAYER, rowX.data(), rowY.data(), rowZ.data(), caveNoise.data(), width);
+				for (int x = 0; x < width; x++)
+				{
+					if (caveNoise[x] > CAVE_THRESHOLD && y >= surfaces[z * width + x] + CAVE_MIN_DEPTH)
+						chunk.setBlock(x, y, z, BlockType::air);
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,60 @@
+#pragma once
+#include "chunk_component.hpp"
+#include "vmc_chunk_manager.hpp"
+
+// std
+#include <cstddef>
+#include <cstdint>
+
+namespace vae {
+	/*
+		Procedural terrain for VmcChunkManager, deterministic for a seed. Every chunk runs three passes:
+		1. biomes: two low frequency noise fields per column, continentalness (plains to mountains) and moisture (desert),
+		   blended smoothly so biome borders don't form cliffs
+		2. height: fractal noise per column scaled by the biome, filled with the surface material of the biome, a few layers
+		   of dirt (or sand) and stone below
+		3. caves: 3D fractal noise carves out the blocks where it is above CAVE_THRESHOLD, a few blocks below the surface
+		The noise is gradient noise (Perlin 2002) with hashed lattice gradients instead of a permutation table, so 8 samples
+		can be evaluated at once with AVX2 without gathers. Both paths execute the same float operations in the same order
+		and produce bit identical terrain, the AVX2 one is picked at runtime when the CPU supports it.
+		generate() only reads the generator, so one generator can be shared by all worker threads.
+	*/
+	class VmcTerrainGenerator
+	{
+	public:
+		enum NoiseMode {
+			NOISE_AUTOMATIC,	// AVX2 when the CPU supports it
+			NOISE_SCALAR,
+			NOISE_AVX2,
+		};
+
+		// Fractal noise: octaves of gradient noise, every octave has twice the frequency and half the amplitude
+		struct NoiseLayer {
+			float frequencyX;
+			float frequencyY;
+			float frequencyZ;
+			int octaves;
+			uint32_t seedOffset;	// Different layers of the same seed are independent
+		};
+
+		static constexpr float CAVE_THRESHOLD = 0.3f;
+		static constexpr int CAVE_MIN_DEPTH = 3;	// Blocks below the surface before caves can start
+
+		VmcTerrainGenerator(uint32_t seed = 1, NoiseMode mode = NOISE_AUTOMATIC);
+
+		static bool isAvx2Supported();
+		bool usesAvx2() const { return avx2; };
+		uint32_t getSeed() const { return seed; };
+
+		// Fills the whole chunk, so it can be used as a VmcChunkManager::Generator
+		void generate(ChunkComponent& chunk, VmcChunkCoord coord) const;
+		void operator()(ChunkComponent& chunk, VmcChunkCoord coord) const { generate(chunk, coord); };
+
+		// Fractal noise of the layer at count positions in world space, roughly in [-1, 1]
+		void fractalNoise(const NoiseLayer& layer, const float* x, const float* y, const float* z, float* out, size_t count) const;
+
+	private:
+		uint32_t seed;
+		bool avx2;
+	};
+}
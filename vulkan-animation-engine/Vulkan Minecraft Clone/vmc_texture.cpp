@@ -27,10 +27,13 @@ namespace vae {
 
     VmcTexture::~VmcTexture()
     {
+        // The image may not be destroyed while the copy into it is still running
+        if (!isReady()) {
+            device.getUploadQueue().wait(uploadTicket);
+        }
         vkDestroySampler(device.device(), textureSampler, nullptr);
         vkDestroyImageView(device.device(), textureImageView, nullptr);
-        vkDestroyImage(device.device(), textureImage, nullptr);
-        vkFreeMemory(device.device(), textureImageMemory, nullptr);
+        device.destroyImage(textureImage, textureImageAllocation);
     }
 
 	void VmcTexture::createTextureImage(const char * imagePath)
@@ -44,18 +47,6 @@ namespace vae {
             throw std::runtime_error("Failed to load texture image!");
         }
 
-        VkBuffer stagingBuffer;
-        VkDeviceMemory stagingBufferMemory;
-
-        device.createBuffer(imageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
-
-        void* data;
-        vkMapMemory(device.device(), stagingBufferMemory, 0, imageSize, 0, &data);
-        memcpy(data, pixels, static_cast<size_t>(imageSize));
-        vkUnmapMemory(device.device(), stagingBufferMemory);
-
-        stbi_image_free(pixels);
-
         VkImageCreateInfo imageInfo{};
         imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
         imageInfo.imageType = VK_IMAGE_TYPE_2D;
@@ -72,15 +63,9 @@ namespace vae {
         imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
         imageInfo.flags = 0; // Optional
 
-        device.createImageWithInfo(imageInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, textureImage, textureImageMemory);
-        // Transition to layout that is efficient for the image to be written to
-        device.transitionImageLayout(textureImage, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, 1);
-        device.copyBufferToImage(stagingBuffer, textureImage, static_cast<uint32_t>(texWidth), static_cast<uint32_t>(texHeight), 1);
-        // Transition to layout that is efficient for shader to read from
-        device.transitionImageLayout(textureImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, 1, 1);
-
-        vkDestroyBuffer(device.device(), stagingBuffer, nullptr);
-        vkFreeMemory(device.device(), stagingBufferMemory, nullptr);
+        device.createImageWithInfo(imageInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, textureImage, textureImageAllocation);
+        uploadPixels(pixels, imageSize, static_cast<uint32_t>(texWidth), static_cast<uint32_t>(texHeight), 1);
+        stbi_image_free(pixels);
 	}
 
     void VmcTexture::setupCubeMap(const char* imagePath, VkFormat format)
@@ -99,23 +84,6 @@ namespace vae {
         ktx_size_t ktxTextureSize = ktxTexture_GetDataSize(ktxTexture);
 
 
-        VkBuffer stagingBuffer;
-        VkDeviceMemory stagingMemory;
-
-        device.createBuffer(ktxTextureSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingMemory);
-
-
-        VkMemoryRequirements memReqs;
-        vkGetBufferMemoryRequirements(device.device(), stagingBuffer, &memReqs);
-
-        // Copy texture data into staging buffer
-        uint8_t* data;
-        if (vkMapMemory(device.device(), stagingMemory, 0, memReqs.size, 0, (void**)&data) != VK_SUCCESS) {
-            throw std::runtime_error("Failed to map staging buffer memory!");
-        }
-        memcpy(data, ktxTextureData, ktxTextureSize);
-        vkUnmapMemory(device.device(), stagingMemory);
-
         // Create optimal tiled target image
         VkImageCreateInfo imageCreateInfo{};
         imageCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
@@ -133,11 +101,9 @@ namespace vae {
         // This flag is required for cube map images
         imageCreateInfo.flags = VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT;
 
-        device.createImageWithInfo(imageCreateInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, textureImage, textureImageMemory);
+        device.createImageWithInfo(imageCreateInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, textureImage, textureImageAllocation);
 
 
-        VkCommandBuffer copyCmd = device.beginSingleTimeCommands();
-
         // Setup buffer copy regions for each face including all of its miplevels
         std::vector<VkBufferImageCopy> bufferCopyRegions;
         uint32_t offset = 0;
@@ -146,7 +112,7 @@ namespace vae {
         {
             for (uint32_t level = 0; level < mipLevels; level++)
             {
-                // Calculate offset into staging buffer for the current mip level and face
+                // Calculate offset into the texture data for the current mip level and face
                 ktx_size_t offset;
                 KTX_error_code ret = ktxTexture_GetImageOffset(ktxTexture, level, 0, face, &offset);
                 assert(ret == KTX_SUCCESS);
@@ -163,30 +129,16 @@ namespace vae {
             }
         }
 
-        // Image barrier for optimal image (target)
-        // Set initial layout for all array layers (faces) of the optimal (target) tiled texture
+        // All array layers (faces) and mip levels end up in shader read layout after the copy
         VkImageSubresourceRange subresourceRange = {};
         subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
         subresourceRange.baseMipLevel = 0;
         subresourceRange.levelCount = mipLevels;
+        subresourceRange.baseArrayLayer = 0;
         subresourceRange.layerCount = 6;
 
-        device.transitionImageLayout(textureImage, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, mipLevels, 6);
-
-        // Copy the cube map faces from the staging buffer to the optimal tiled image
-        vkCmdCopyBufferToImage(
-            copyCmd,
-            stagingBuffer,
-            textureImage,
-            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-            static_cast<uint32_t>(bufferCopyRegions.size()),
-            bufferCopyRegions.data()
-        );
-
-        // Change texture image layout to shader read after all faces have been copied
-        device.transitionImageLayout(textureImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, mipLevels, 6);
-
-        device.endSingleTimeCommands(copyCmd);
+        // Copy the cube map faces to the optimal tiled image, the upload queue keeps its own staging copy of the data
+        uploadTicket = device.getUploadQueue().uploadImage(textureImage, ktxTextureData, ktxTextureSize, bufferCopyRegions, subresourceRange);
 
         VkPhysicalDeviceProperties properties{};
         vkGetPhysicalDeviceProperties(device.getPhysicalDevice(), &properties);
@@ -230,12 +182,41 @@ namespace vae {
             throw std::runtime_error("failed to create cubemap texture image view!");
         }
 
-        // Clean up staging resources
-        vkFreeMemory(device.device(), stagingMemory, nullptr);
-        vkDestroyBuffer(device.device(), stagingBuffer, nullptr);
         ktxTexture_Destroy(ktxTexture);
     }
 
+    // Queues the copy of tightly packed RGBA pixels into the first layerCount layers of the texture image
+    void VmcTexture::uploadPixels(const void* pixels, VkDeviceSize size, uint32_t width, uint32_t height, uint32_t layerCount)
+    {
+        VkBufferImageCopy region{};
+        region.bufferOffset = 0;
+        region.bufferRowLength = 0;
+        region.bufferImageHeight = 0;
+        region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        region.imageSubresource.mipLevel = 0;
+        region.imageSubresource.baseArrayLayer = 0;
+        region.imageSubresource.layerCount = 1;
+        region.imageOffset = { 0, 0, 0 };
+        region.imageExtent = { width, height, 1 };
+
+        VkImageSubresourceRange range{};
+        range.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        range.baseMipLevel = 0;
+        range.levelCount = 1;
+        range.baseArrayLayer = 0;
+        range.layerCount = layerCount;
+
+        uploadTicket = device.getUploadQueue().uploadImage(textureImage, pixels, size, { region }, range);
+    }
+
+    bool VmcTexture::isReady()
+    {
+        if (!uploaded) {
+            uploaded = device.getUploadQueue().isComplete(uploadTicket);
+        }
+        return uploaded;
+    }
+
     void VmcTexture::createTextureImageView()
     {
         textureImageView = device.createImageView(textureImage, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_VIEW_TYPE_2D, 1);
@@ -252,18 +233,6 @@ namespace vae {
             throw std::runtime_error("Failed to load texture image!");
         }
 
-        VkBuffer stagingBuffer;
-        VkDeviceMemory stagingBufferMemory;
-
-        device.createBuffer(imageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
-
-        void* data;
-        vkMapMemory(device.device(), stagingBufferMemory, 0, imageSize, 0, &data);
-        memcpy(data, pixels, static_cast<size_t>(imageSize));
-        vkUnmapMemory(device.device(), stagingBufferMemory);
-
-        stbi_image_free(pixels);
-
         VkImageCreateInfo imageInfo{};
         imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
         imageInfo.imageType = VK_IMAGE_TYPE_2D;
@@ -280,15 +249,9 @@ namespace vae {
         imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
         imageInfo.flags = VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT;
 
-        device.createImageWithInfo(imageInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, textureImage, textureImageMemory);
-        // Transition to layout that is efficient for the image to be written to
-        device.transitionImageLayout(textureImage, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, 6);
-        device.copyBufferToImage(stagingBuffer, textureImage, static_cast<uint32_t>(texWidth), static_cast<uint32_t>(texHeight), 1);
-        // Transition to layout that is efficient for shader to read from
-        device.transitionImageLayout(textureImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, 1, 6);
-
-        vkDestroyBuffer(device.device(), stagingBuffer, nullptr);
-        vkFreeMemory(device.device(), stagingBufferMemory, nullptr);
+        device.createImageWithInfo(imageInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, textureImage, textureImageAllocation);
+        uploadPixels(pixels, imageSize, static_cast<uint32_t>(texWidth), static_cast<uint32_t>(texHeight), 6);
+        stbi_image_free(pixels);
     }
 
 
@@ -25,7 +25,13 @@ namespace vae {
 		void createTextureSampler(VkSamplerAddressMode addressMode);
 		VkDescriptorImageInfo descriptorInfo();
 
+		// Texture data is uploaded asynchronously, the texture can only be sampled once this returns true
+		bool isReady();
+		VmcUploadTicket getUploadTicket() const { return uploadTicket; };
+
 	private:
+		void uploadPixels(const void* pixels, VkDeviceSize size, uint32_t width, uint32_t height, uint32_t layerCount);
+
 		VmcDevice& device;
 
 		uint32_t width;
@@ -34,7 +40,9 @@ namespace vae {
 
 		VkImage textureImage;
 		VkImageView textureImageView;
-		VkDeviceMemory textureImageMemory;
+		VmcAllocation textureImageAllocation;
 		VkSampler textureSampler;
+		VmcUploadTicket uploadTicket = 0;
+		bool uploaded = false;
 	};
 }
@@ -0,0 +1,100 @@
+#include "vmc_thread_pool.hpp"
+
+// std
+#include <algorithm>
+
+namespace vae {
+
+	// A thread count of 0 uses one worker per hardware thread.
+	VmcThreadPool::VmcThreadPool(uint32_t threadCount)
+	{
+		if (threadCount == 0)
+		{
+			threadCount = std::max(1u, std::thread::hardware_concurrency());
+		}
+
+		workers.reserve(threadCount);
+		for (uint32_t i = 0; i < threadCount; i++)
+		{
+			workers.emplace_back(&VmcThreadPool::workerLoop, this);
+		}
+	}
+
+	VmcThreadPool::~VmcThreadPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(jobMutex);
+			stopping = true;
+		}
+		jobAvailable.notify_all();
+
+		for (auto& worker : workers)
+		{
+			worker.join();
+		}
+	}
+
+	void VmcThreadPool::addJob(std::function<void()> job)
+	{
+		{
+			std::lock_guard<std::mutex> lock(jobMutex);
+			jobs.push(std::move(job));
+			pendingJobs++;
+		}
+		jobAvailable.notify_one();
+	}
+
+	void VmcThreadPool::wait()
+	{
+		std::unique_lock<std::mutex> lock(jobMutex);
+		jobsFinished.wait(lock, [this]() { return pendingJobs == 0; });
+
+		if (firstException)
+		{
+			std::exception_ptr exception = firstException;
+			firstException = nullptr;
+			std::rethrow_exception(exception);
+		}
+	}
+
+	void VmcThreadPool::workerLoop()
+	{
+		while (true)
+		{
+			std::function<void()> job;
+			{
+				std::unique_lock<std::mutex> lock(jobMutex);
+				jobAvailable.wait(lock, [this]() { return stopping || !jobs.empty(); });
+				if (stopping && jobs.empty())
+				{
+					return;
+				}
+				job = std::move(jobs.front());
+				jobs.pop();
+			}
+
+			std::exception_ptr exception;
+			try
+			{
+				job();
+			}
+			catch (...)
+			{
+				exception = std::current_exception();
+			}
+
+			{
+				std::lock_guard<std::mutex> lock(jobMutex);
+				if (exception && !firstException)
+				{
+					firstException = exception;
+				}
+				pendingJobs--;
+				if (pendingJobs == 0)
+				{
+					jobsFinished.notify_all();
+				}
+			}
+		}
+	}
+}
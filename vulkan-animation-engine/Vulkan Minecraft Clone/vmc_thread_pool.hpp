@@ -0,0 +1,41 @@
+#pragma once
+
+// std
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+namespace vae {
+	// Fixed set of worker threads that execute jobs in submission order.
+	// wait() blocks until every submitted job has finished and rethrows the first exception a job threw.
+	class VmcThreadPool
+	{
+	public:
+		VmcThreadPool(uint32_t threadCount = 0);
+		~VmcThreadPool();
+
+		VmcThreadPool(const VmcThreadPool&) = delete;
+		VmcThreadPool& operator=(const VmcThreadPool&) = delete;
+
+		uint32_t getThreadCount() const { return static_cast<uint32_t>(workers.size()); };
+
+		void addJob(std::function<void()> job);
+		void wait();
+
+	private:
+		void workerLoop();
+
+		std::vector<std::thread> workers;
+		std::queue<std::function<void()>> jobs;
+		std::mutex jobMutex;
+		std::condition_variable jobAvailable;
+		std::condition_variable jobsFinished;
+		uint32_t pendingJobs = 0;
+		std::exception_ptr firstException;
+		bool stopping = false;
+	};
+}
@@ -0,0 +1,364 @@
+#include "vmc_upload_queue.hpp"
+#include "vmc_device.hpp"
+
+// std
+#include <cassert>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+namespace vae {
+
+	VmcUploadQueue::VmcUploadQueue(VmcDevice& device) : vmcDevice{ device }
+	{
+		QueueFamilyIndices indices = vmcDevice.findPhysicalQueueFamilies();
+		graphicsFamily = indices.graphicsFamily;
+		transferFamily = indices.transferFamilyHasValue ? indices.transferFamily : indices.graphicsFamily;
+		graphicsQueue = vmcDevice.graphicsQueue();
+		transferQueue = usesTransferQueue() ? vmcDevice.transferQueue() : graphicsQueue;
+
+		VkCommandPoolCreateInfo poolInfo{};
+		poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+		poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+
+		poolInfo.queueFamilyIndex = transferFamily;
+		if (vkCreateCommandPool(vmcDevice.device(), &poolInfo, nullptr, &transferPool) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create upload command pool!");
+		}
+		if (usesTransferQueue())
+		{
+			poolInfo.queueFamilyIndex = graphicsFamily;
+			if (vkCreateCommandPool(vmcDevice.device(), &poolInfo, nullptr, &graphicsPool) != VK_SUCCESS)
+			{
+				throw std::runtime_error("failed to create upload command pool!");
+			}
+		}
+	}
+
+	VmcUploadQueue::~VmcUploadQueue()
+	{
+		waitIdle();
+
+		std::lock_guard<std::mutex> lock{ uploadMutex };
+		if (recordingBatch)
+		{
+			freeBatches.push_back(std::move(recordingBatch));
+		}
+		for (auto& batch : freeBatches)
+		{
+			releaseStaging(*batch);
+			vkDestroyFence(vmcDevice.device(), batch->fence, nullptr);
+			if (batch->transferDone != VK_NULL_HANDLE)
+				vkDestroySemaphore(vmcDevice.device(), batch->transferDone, nullptr);
+		}
+		// Destroying the pools frees their command buffers
+		vkDestroyCommandPool(vmcDevice.device(), transferPool, nullptr);
+		if (graphicsPool != VK_NULL_HANDLE)
+			vkDestroyCommandPool(vmcDevice.device(), graphicsPool, nullptr);
+	}
+
+	VmcUploadTicket VmcUploadQueue::uploadBuffer(VkBuffer dstBuffer, const void* data, VkDeviceSize size,
+		VkAccessFlags dstAccess, VkPipelineStageFlags dstStage, VkDeviceSize dstOffset)
+	{
+		std::lock_guard<std::mutex> lock{ uploadMutex };
+		Batch& batch = getRecordingBatch();
+		Staging& staging = createStaging(batch, data, size);
+
+		VkBufferCopy copyRegion{};
+		copyRegion.srcOffset = 0;
+		copyRegion.dstOffset = dstOffset;
+		copyRegion.size = size;
+		vkCmdCopyBuffer(batch.transferCommands, staging.buffer, dstBuffer, 1, &copyRegion);
+
+		VkBufferMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = dstAccess;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.buffer = dstBuffer;
+		barrier.offset = dstOffset;
+		barrier.size = size;
+
+		if (!usesTransferQueue())
+		{
+			vkCmdPipelineBarrier(batch.transferCommands, VK_PIPELINE_STAGE_TRANSFER_BIT, dstStage, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+		}
+		else
+		{
+			// Release on the transfer queue, acquire on the graphics queue with identical ownership parameters
+			barrier.srcQueueFamilyIndex = transferFamily;
+			barrier.dstQueueFamilyIndex = graphicsFamily;
+			barrier.dstAccessMask = 0;
+			vkCmdPipelineBarrier(batch.transferCommands, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+
+			barrier.srcAccessMask = 0;
+			barrier.dstAccessMask = dstAccess;
+			vkCmdPipelineBarrier(batch.acquireCommands, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, dstStage, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+		}
+
+		VmcUploadTicket ticket = batch.ticket;
+		autoFlush();
+		return ticket;
+	}
+
+	VmcUploadTicket VmcUploadQueue::uploadImage(VkImage dstImage, const void* data, VkDeviceSize size,
+		const std::vector<VkBufferImageCopy>& regions, const VkImageSubresourceRange& range)
+	{
+		std::lock_guard<std::mutex> lock{ uploadMutex };
+		Batch& batch = getRecordingBatch();
+		Staging& staging = createStaging(batch, data, size);
+
+		VkImageMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.srcAccessMask = 0;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.image = dstImage;
+		barrier.subresourceRange = range;
+		vkCmdPipelineBarrier(batch.transferCommands, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+		vkCmdCopyBufferToImage(batch.transferCommands, staging.buffer, dstImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			static_cast<uint32_t>(regions.size()), regions.data());
+
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+		if (!usesTransferQueue())
+		{
+			vkCmdPipelineBarrier(batch.transferCommands, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+		}
+		else
+		{
+			// The layout transition is part of both halves of the ownership transfer and happens once
+			barrier.srcQueueFamilyIndex = transferFamily;
+			barrier.dstQueueFamilyIndex = graphicsFamily;
+			barrier.dstAccessMask = 0;
+			vkCmdPipelineBarrier(batch.transferCommands, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+			barrier.srcAccessMask = 0;
+			barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+			vkCmdPipelineBarrier(batch.acquireCommands, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+		}
+
+		VmcUploadTicket ticket = batch.ticket;
+		autoFlush();
+		return ticket;
+	}
+
+	VmcUploadTicket VmcUploadQueue::flush()
+	{
+		std::lock_guard<std::mutex> lock{ uploadMutex };
+		retireFinishedBatches(false);
+		if (!recordingBatch)
+		{
+			return nextTicket - 1;
+		}
+		VmcUploadTicket ticket = recordingBatch->ticket;
+		submitRecordingBatch();
+		return ticket;
+	}
+
+	bool VmcUploadQueue::isComplete(VmcUploadTicket ticket)
+	{
+		if (ticket <= completedTicket)
+		{
+			return true;
+		}
+		std::lock_guard<std::mutex> lock{ uploadMutex };
+		retireFinishedBatches(false);
+		return ticket <= completedTicket;
+	}
+
+	void VmcUploadQueue::wait(VmcUploadTicket ticket)
+	{
+		std::lock_guard<std::mutex> lock{ uploadMutex };
+		if (recordingBatch && recordingBatch->ticket <= ticket)
+		{
+			submitRecordingBatch();
+		}
+		while (completedTicket < ticket && !submittedBatches.empty())
+		{
+			retireFinishedBatches(true);
+		}
+	}
+
+	void VmcUploadQueue::waitIdle()
+	{
+		wait(nextTicket - 1);
+	}
+
+	VmcUploadQueue::Batch& VmcUploadQueue::getRecordingBatch()
+	{
+		if (recordingBatch)
+		{
+			return *recordingBatch;
+		}
+
+		if (!freeBatches.empty())
+		{
+			recordingBatch = std::move(freeBatches.back());
+			freeBatches.pop_back();
+			vkResetCommandBuffer(recordingBatch->transferCommands, 0);
+			if (usesTransferQueue())
+				vkResetCommandBuffer(recordingBatch->acquireCommands, 0);
+			vkResetFences(vmcDevice.device(), 1, &recordingBatch->fence);
+		}
+		else
+		{
+			recordingBatch = std::make_unique<Batch>();
+
+			VkCommandBufferAllocateInfo allocInfo{};
+			allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+			allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+			allocInfo.commandBufferCount = 1;
+			allocInfo.commandPool = transferPool;
+			if (vkAllocateCommandBuffers(vmcDevice.device(), &allocInfo, &recordingBatch->transferCommands) != VK_SUCCESS)
+			{
+				throw std::runtime_error("failed to allocate upload command buffer!");
+			}
+
+			VkFenceCreateInfo fenceInfo{};
+			fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+			if (vkCreateFence(vmcDevice.device(), &fenceInfo, nullptr, &recordingBatch->fence) != VK_SUCCESS)
+			{
+				throw std::runtime_error("failed to create upload fence!");
+			}
+
+			if (usesTransferQueue())
+			{
+				allocInfo.commandPool = graphicsPool;
+				if (vkAllocateCommandBuffers(vmcDevice.device(), &allocInfo, &recordingBatch->acquireCommands) != VK_SUCCESS)
+				{
+					throw std::runtime_error("failed to allocate upload command buffer!");
+				}
+
+				VkSemaphoreCreateInfo semaphoreInfo{};
+				semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+				if (vkCreateSemaphore(vmcDevice.device(), &semaphoreInfo, nullptr, &recordingBatch->transferDone) != VK_SUCCESS)
+				{
+					throw std::runtime_error("failed to create upload semaphore!");
+				}
+			}
+		}
+
+		VkCommandBufferBeginInfo beginInfo{};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+		vkBeginCommandBuffer(recordingBatch->transferCommands, &beginInfo);
+		if (usesTransferQueue())
+			vkBeginCommandBuffer(recordingBatch->acquireCommands, &beginInfo);
+
+		recordingBatch->ticket = nextTicket++;
+		return *recordingBatch;
+	}
+
+	VmcUploadQueue::Staging& VmcUploadQueue::createStaging(Batch& batch, const void* data, VkDeviceSize size)
+	{
+		Staging staging{};
+		vmcDevice.createBuffer(
+			size,
+			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			staging.buffer,
+			staging.allocation);
+		assert(staging.allocation.mapped && "Staging memory must be host visible!");
+		memcpy(staging.allocation.mapped, data, static_cast<size_t>(size));
+
+		batch.stagingSize += size;
+		batch.stagingBuffers.push_back(staging);
+		return batch.stagingBuffers.back();
+	}
+
+	void VmcUploadQueue::submitRecordingBatch()
+	{
+		Batch& batch = *recordingBatch;
+		vkEndCommandBuffer(batch.transferCommands);
+
+		VkSubmitInfo submitInfo{};
+		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers = &batch.transferCommands;
+
+		if (!usesTransferQueue())
+		{
+			if (vkQueueSubmit(graphicsQueue, 1, &submitInfo, batch.fence) != VK_SUCCESS)
+			{
+				throw std::runtime_error("failed to submit upload batch!");
+			}
+		}
+		else
+		{
+			vkEndCommandBuffer(batch.acquireCommands);
+
+			submitInfo.signalSemaphoreCount = 1;
+			submitInfo.pSignalSemaphores = &batch.transferDone;
+			if (vkQueueSubmit(transferQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS)
+			{
+				throw std::runtime_error("failed to submit upload batch!");
+			}
+
+			VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+			VkSubmitInfo acquireInfo{};
+			acquireInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+			acquireInfo.waitSemaphoreCount = 1;
+			acquireInfo.pWaitSemaphores = &batch.transferDone;
+			acquireInfo.pWaitDstStageMask = &waitStage;
+			acquireInfo.commandBufferCount = 1;
+			acquireInfo.pCommandBuffers = &batch.acquireCommands;
+			if (vkQueueSubmit(graphicsQueue, 1, &acquireInfo, batch.fence) != VK_SUCCESS)
+			{
+				throw std::runtime_error("failed to submit upload ownership transfer!");
+			}
+		}
+
+		submittedBatches.push_back(std::move(recordingBatch));
+	}
+
+	void VmcUploadQueue::retireFinishedBatches(bool block)
+	{
+		// Batches finish in submission order, stop at the first one that is still running
+		while (!submittedBatches.empty())
+		{
+			Batch& batch = *submittedBatches.front();
+			if (block)
+			{
+				vkWaitForFences(vmcDevice.device(), 1, &batch.fence, VK_TRUE, std::numeric_limits<uint64_t>::max());
+				block = false;
+			}
+			else if (vkGetFenceStatus(vmcDevice.device(), batch.fence) != VK_SUCCESS)
+			{
+				break;
+			}
+
+			releaseStaging(batch);
+			completedTicket = batch.ticket;
+			freeBatches.push_back(std::move(submittedBatches.front()));
+			submittedBatches.pop_front();
+		}
+	}
+
+	void VmcUploadQueue::releaseStaging(Batch& batch)
+	{
+		for (auto& staging : batch.stagingBuffers)
+		{
+			vmcDevice.destroyBuffer(staging.buffer, staging.allocation);
+		}
+		batch.stagingBuffers.clear();
+		batch.stagingSize = 0;
+	}
+
+	void VmcUploadQueue::autoFlush()
+	{
+		if (recordingBatch && recordingBatch->stagingSize >= AUTO_FLUSH_SIZE)
+		{
+			submitRecordingBatch();
+		}
+	}
+}
@@ -0,0 +1,93 @@
+#pragma once
+#include "vmc_memory_allocator.hpp"
+
+// libs
+#include <vulkan/vulkan.h>
+
+// std
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace vae {
+	class VmcDevice;
+
+	// Identifies a batch of uploads, tickets complete in increasing order
+	using VmcUploadTicket = uint64_t;
+
+	/*
+		Batches staging copies into a single command buffer instead of one blocking submit per copy.
+		Data is copied into staging memory immediately, the GPU copy runs once the batch is flushed. When the device has a
+		dedicated transfer queue the copies run there and ownership of the resources is handed to the graphics queue
+		afterwards. A fence per batch tells when everything in it is ready to use.
+		Uploading and flushing submit to device queues, so they belong on the thread that submits frames.
+	*/
+	class VmcUploadQueue
+	{
+	public:
+		// Staging memory after which a batch is submitted without waiting for flush()
+		static constexpr VkDeviceSize AUTO_FLUSH_SIZE = 64ull * 1024 * 1024;
+
+		VmcUploadQueue(VmcDevice& device);
+		~VmcUploadQueue();
+
+		VmcUploadQueue(const VmcUploadQueue&) = delete;
+		VmcUploadQueue& operator=(const VmcUploadQueue&) = delete;
+
+		bool usesTransferQueue() const { return transferFamily != graphicsFamily; };
+
+		// Fills dstBuffer (from dstOffset) with size bytes of data. dstAccess/dstStage describe its first use on the graphics queue.
+		VmcUploadTicket uploadBuffer(VkBuffer dstBuffer, const void* data, VkDeviceSize size,
+			VkAccessFlags dstAccess, VkPipelineStageFlags dstStage, VkDeviceSize dstOffset = 0);
+		// Copies regions (buffer offsets relative to data) into dstImage and leaves range in SHADER_READ_ONLY_OPTIMAL
+		VmcUploadTicket uploadImage(VkImage dstImage, const void* data, VkDeviceSize size,
+			const std::vector<VkBufferImageCopy>& regions, const VkImageSubresourceRange& range);
+
+		// Submits everything recorded so far, returns the ticket of the submitted batch
+		VmcUploadTicket flush();
+		bool isComplete(VmcUploadTicket ticket);
+		void wait(VmcUploadTicket ticket);
+		void waitIdle();
+
+	private:
+		struct Staging {
+			VkBuffer buffer;
+			VmcAllocation allocation;
+		};
+
+		struct Batch {
+			VkCommandBuffer transferCommands = VK_NULL_HANDLE;
+			VkCommandBuffer acquireCommands = VK_NULL_HANDLE;	// Graphics queue half of the ownership transfers
+			VkSemaphore transferDone = VK_NULL_HANDLE;
+			VkFence fence = VK_NULL_HANDLE;
+			std::vector<Staging> stagingBuffers;
+			VkDeviceSize stagingSize = 0;
+			VmcUploadTicket ticket = 0;
+		};
+
+		// All private functions expect uploadMutex to be held
+		Batch& getRecordingBatch();
+		Staging& createStaging(Batch& batch, const void* data, VkDeviceSize size);
+		void submitRecordingBatch();
+		void retireFinishedBatches(bool block);
+		void releaseStaging(Batch& batch);
+		void autoFlush();
+
+		VmcDevice& vmcDevice;
+		uint32_t graphicsFamily;
+		uint32_t transferFamily;
+		VkQueue graphicsQueue;
+		VkQueue transferQueue;
+		VkCommandPool graphicsPool = VK_NULL_HANDLE;
+		VkCommandPool transferPool = VK_NULL_HANDLE;
+
+		std::mutex uploadMutex;
+		std::unique_ptr<Batch> recordingBatch;
+		std::deque<std::unique_ptr<Batch>> submittedBatches;
+		std::vector<std::unique_ptr<Batch>> freeBatches;
+		VmcUploadTicket nextTicket = 1;
+		std::atomic<VmcUploadTicket> completedTicket{ 0 };
+	};
+}
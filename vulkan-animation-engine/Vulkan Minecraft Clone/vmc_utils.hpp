@@ -1,8 +1,13 @@
 #pragma once
 
 // std
+#include <cstdint>
 #include <functional>
 
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
 namespace vae {
 	// from: https://stackoverflow.com/a/57595105
 	template <typename T, typename... Rest>
@@ -10,4 +15,23 @@ namespace vae {
 		seed ^= std::hash<T>{}(v)+0x9e3779b9 + (seed << 6) + (seed >> 2);
 		(hashCombine(seed, rest), ...);
 	};
+
+	inline int countBits(uint64_t bits) {
+#ifdef _MSC_VER
+		return static_cast<int>(__popcnt64(bits));
+#else
+		return __builtin_popcountll(bits);
+#endif
+	}
+
+	// Index of the lowest set bit, bits must not be 0
+	inline int lowestBit(uint64_t bits) {
+#ifdef _MSC_VER
+		unsigned long index;
+		_BitScanForward64(&index, bits);
+		return static_cast<int>(index);
+#else
+		return __builtin_ctzll(bits);
+#endif
+	}
 }
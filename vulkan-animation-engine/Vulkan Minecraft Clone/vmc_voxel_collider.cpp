@@ -0,0 +1,220 @@
+#include "vmc_voxel_collider.hpp"
+
+// std
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+
+namespace vae {
+	static constexpr int CHUNK_WIDTH = VmcChunkManager::CHUNK_WIDTH;
+	static constexpr int CHUNK_HEIGHT = VmcChunkManager::CHUNK_HEIGHT;
+	static constexpr int SURFACE_LEVEL = VmcChunkManager::SURFACE_LEVEL;
+	static constexpr float SWEEP_EPSILON = 1e-4f;	// Box faces this close to a block face only touch it
+	static constexpr float PARTICLE_SKIN = 1e-3f;	// Distance particles keep to the face they hit
+
+	static int chunkOfBlock(int block)
+	{
+		return block >= 0 ? block / CHUNK_WIDTH : (block + 1) / CHUNK_WIDTH - 1;
+	}
+
+	VmcVoxelCollider::VmcVoxelCollider(ChunkLookup lookup) : lookup{ std::move(lookup) } {}
+
+	VmcVoxelCollider::VmcVoxelCollider(const VmcChunkManager& world) :
+		lookup{ [&world](VmcChunkCoord coord) { return world.findChunk(coord); } }
+	{
+	}
+
+	bool VmcVoxelCollider::isSolid(const glm::ivec3& block)
+	{
+		int localY = block.y + SURFACE_LEVEL;
+		if (localY < 0 || localY >= CHUNK_HEIGHT) return false;
+
+		VmcChunkCoord coord{ chunkOfBlock(block.x), chunkOfBlock(block.z) };
+		const ChunkComponent* chunk = chunkOf(coord);
+		return chunk != nullptr && chunk->isSolid(block.x - coord.x * CHUNK_WIDTH, localY, block.z - coord.z * CHUNK_WIDTH);
+	}
+
+	bool VmcVoxelCollider::raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, VoxelRayHit& hit)
+	{
+		assert(std::isfinite(maxDistance) && "The ray has to end");
+		float length = glm::length(direction);
+		if (length == 0.0f) return false;
+		glm::vec3 unitDirection = direction / length;
+
+		// Shifted by half a block, so block k spans [k, k + 1) on every axis
+		glm::vec3 start = origin + 0.5f;
+		glm::ivec3 block = glm::ivec3(glm::floor(start));
+		if (isSolid(block))
+		{
+			hit = { block, glm::ivec3{ 0 }, 0.0f };
+			return true;
+		}
+
+		// tMax: distance along the ray to the next block border of each axis, tDelta: distance between two borders
+		glm::ivec3 step;
+		glm::vec3 tMax;
+		glm::vec3 tDelta;
+		for (int axis = 0; axis < 3; axis++)
+		{
+			if (unitDirection[axis] > 0.0f)
+			{
+				step[axis] = 1;
+				tDelta[axis] = 1.0f / unitDirection[axis];
+				tMax[axis] = (block[axis] + 1 - start[axis]) * tDelta[axis];
+			}
+			else if (unitDirection[axis] < 0.0f)
+			{
+				step[axis] = -1;
+				tDelta[axis] = -1.0f / unitDirection[axis];
+				tMax[axis] = (start[axis] - block[axis]) * tDelta[axis];
+			}
+			else
+			{
+				step[axis] = 0;
+				tDelta[axis] = std::numeric_limits<float>::infinity();
+				tMax[axis] = std::numeric_limits<float>::infinity();
+			}
+		}
+
+		while (true)
+		{
+			int axis = tMax.x < tMax.y ? (tMax.x < tMax.z ? 0 : 2) : (tMax.y < tMax.z ? 1 : 2);
+			if (tMax[axis] > maxDistance) return false;
+
+			block[axis] += step[axis];
+			float distance = tMax[axis];
+			tMax[axis] += tDelta[axis];
+
+			// Above or below every chunk and moving further away
+			int localY = block.y + SURFACE_LEVEL;
+			if ((localY < 0 && step.y <= 0) || (localY >= CHUNK_HEIGHT && step.y >= 0)) return false;
+
+			if (isSolid(block))
+			{
+				hit.block = block;
+				hit.normal = glm::ivec3{ 0 };
+				hit.normal[axis] = -step[axis];
+				hit.distance = distance;
+				return true;
+			}
+		}
+	}
+
+	VoxelSweepResult VmcVoxelCollider::sweepBox(const glm::vec3& boxMin, const glm::vec3& boxMax, const glm::vec3& displacement)
+	{
+		VoxelSweepResult result{ glm::vec3{ 0.0f }, glm::bvec3{ false } };
+		glm::vec3 min = boxMin;
+		glm::vec3 max = boxMax;
+		for (int axis : { 1, 0, 2 })
+		{
+			float move = displacement[axis];
+			if (move == 0.0f) continue;
+
+			// Blocks the box overlaps on the other axes, the moving axis is replaced by one layer of blocks at a time
+			glm::ivec3 first = glm::ivec3(glm::floor(min + 0.5f + SWEEP_EPSILON));
+			glm::ivec3 last = glm::ivec3(glm::ceil(max + 0.5f - SWEEP_EPSILON)) - 1;
+			if (move > 0.0f)
+			{
+				// Layers whose near face lies between the leading face of the box and where it ends up
+				int firstLayer = static_cast<int>(std::ceil(max[axis] + 0.5f - SWEEP_EPSILON));
+				int lastLayer = static_cast<int>(std::ceil(max[axis] + move + 0.5f)) - 1;
+				for (int layer = firstLayer; layer <= lastLayer; layer++)
+				{
+					first[axis] = layer;
+					last[axis] = layer;
+					if (!isAnySolid(first, last)) continue;
+					move = std::max(0.0f, layer - 0.5f - max[axis]);
+					result.blocked[axis] = true;
+					break;
+				}
+			}
+			else
+			{
+				int firstLayer = static_cast<int>(std::floor(min[axis] - 0.5f + SWEEP_EPSILON));
+				int lastLayer = static_cast<int>(std::floor(min[axis] + move - 0.5f)) + 1;
+				for (int layer = firstLayer; layer >= lastLayer; layer--)
+				{
+					first[axis] = layer;
+					last[axis] = layer;
+					if (!isAnySolid(first, last)) continue;
+					move = std::min(0.0f, layer + 0.5f - min[axis]);
+					result.blocked[axis] = true;
+					break;
+				}
+			}
+
+			min[axis] += move;
+			max[axis] += move;
+			result.displacement[axis] = move;
+		}
+		return result;
+	}
+
+	size_t VmcVoxelCollider::moveParticles(glm::vec3* positions, glm::vec3* velocities, size_t count, float dt, float restitution)
+	{
+		size_t hits = 0;
+		for (size_t i = 0; i < count; i++)
+		{
+			glm::vec3 move = velocities[i] * dt;
+			glm::vec3 end = positions[i] + move;
+
+			// Most particles stay inside of their (empty) block during a step, those don't need to look at any chunk
+			if (glm::floor(positions[i] + 0.5f) == glm::floor(end + 0.5f))
+			{
+				positions[i] = end;
+				continue;
+			}
+
+			float distance = glm::length(move);
+			VoxelRayHit hit;
+			if (!raycast(positions[i], move, distance, hit))
+			{
+				positions[i] = end;
+				continue;
+			}
+			hits++;
+
+			// Buried by a block that was placed on it
+			if (hit.normal == glm::ivec3{ 0 })
+			{
+				velocities[i] = glm::vec3{ 0.0f };
+				continue;
+			}
+
+			// The rest of the step after the bounce is dropped, it is at most one frame of motion
+			glm::vec3 normal{ hit.normal };
+			positions[i] += move * (hit.distance / distance) + PARTICLE_SKIN * normal;
+			velocities[i] -= (1.0f + restitution) * glm::dot(velocities[i], normal) * normal;
+		}
+		return hits;
+	}
+
+	const ChunkComponent* VmcVoxelCollider::chunkOf(VmcChunkCoord coord)
+	{
+		// Direct mapped on the low bits of the coordinates, neighbouring chunks never share a slot
+		CachedChunk& cached = cache[(coord.z & (CHUNK_CACHE_SIDE - 1)) * CHUNK_CACHE_SIDE + (coord.x & (CHUNK_CACHE_SIDE - 1))];
+		if (!cached.valid || cached.coord != coord)
+		{
+			cached.chunk = lookup(coord);
+			cached.coord = coord;
+			cached.valid = true;
+		}
+		return cached.chunk;
+	}
+
+	bool VmcVoxelCollider::isAnySolid(const glm::ivec3& first, const glm::ivec3& last)
+	{
+		for (int y = first.y; y <= last.y; y++)
+		{
+			for (int z = first.z; z <= last.z; z++)
+			{
+				for (int x = first.x; x <= last.x; x++)
+				{
+					if (isSolid({ x, y, z })) return true;
+				}
+			}
+		}
+		return false;
+	}
+}
@@ -0,0 +1,72 @@
+#pragma once
+#include "chunk_component.hpp"
+#include "vmc_chunk_manager.hpp"
+
+// libs
+#include <glm/glm.hpp>
+
+// std
+#include <array>
+#include <cstddef>
+#include <functional>
+
+namespace vae {
+	struct VoxelRayHit {
+		glm::ivec3 block;	// World block coordinates of the solid block
+		glm::ivec3 normal;	// Face of the block the ray entered through, zero when the ray starts inside of the block
+		float distance;		// Along the ray to the entry point
+	};
+
+	struct VoxelSweepResult {
+		glm::vec3 displacement;	// What was left of the displacement after the box was stopped
+		glm::bvec3 blocked;		// Axes along which the box ran into a block
+	};
+
+	/*
+		Collision queries against the blocks of the chunks in world space, block (x, y, z) fills the unit cube centered
+		on (x, y, z) as in VmcChunkManager. Blocks outside of the chunks the lookup returns are empty.
+		raycast() walks the blocks along the ray with the DDA of Amanatides and Woo ("A Fast Voxel Traversal Algorithm
+		for Ray Tracing", 1987), visiting exactly the blocks the ray passes through. sweepBox() moves a box one axis after
+		the other and stops each axis at the first solid block, so boxes slide along walls and floors and never tunnel
+		through a block however far they move.
+		The collider remembers the chunks it looked up last (one per slot of an 8 x 8 grid of chunks), so queries only go
+		through the lookup when they reach a chunk for the first time. That also means it isn't thread safe and doesn't
+		notice chunks that were loaded or evicted after it looked them up: use one collider per thread and frame.
+	*/
+	class VmcVoxelCollider
+	{
+	public:
+		// nullptr when the chunk isn't loaded
+		using ChunkLookup = std::function<const ChunkComponent*(VmcChunkCoord coord)>;
+
+		VmcVoxelCollider(ChunkLookup lookup);
+		// Collides with the chunks the manager has loaded
+		VmcVoxelCollider(const VmcChunkManager& world);
+
+		bool isSolid(const glm::ivec3& block);
+
+		// First solid block within maxDistance along the ray, direction doesn't need to be normalized
+		bool raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, VoxelRayHit& hit);
+		// Box from boxMin to boxMax moved by displacement, y first (gravity), then x and z
+		VoxelSweepResult sweepBox(const glm::vec3& boxMin, const glm::vec3& boxMax, const glm::vec3& displacement);
+
+		// Moves count point particles by velocity * dt and bounces them off the blocks they hit, keeping
+		// restitution of the velocity along the normal. Returns how many of them hit a block.
+		size_t moveParticles(glm::vec3* positions, glm::vec3* velocities, size_t count, float dt, float restitution);
+
+	private:
+		const ChunkComponent* chunkOf(VmcChunkCoord coord);
+		// Any solid block from first to last (inclusive) on every axis
+		bool isAnySolid(const glm::ivec3& first, const glm::ivec3& last);
+
+		struct CachedChunk {
+			VmcChunkCoord coord{ 0, 0 };
+			const ChunkComponent* chunk = nullptr;
+			bool valid = false;
+		};
+		static constexpr int CHUNK_CACHE_SIDE = 8;	// Power of two
+
+		ChunkLookup lookup;
+		std::array<CachedChunk, CHUNK_CACHE_SIDE * CHUNK_CACHE_SIDE> cache{};
+	};
+}
@@ -1,4 +1,6 @@
 C:\VulkanSDK\1.2.189.1\Bin\glslc.exe Shaders\simple_shader.vert -o Shaders\simple_shader.vert.spv
+C:\VulkanSDK\1.2.189.1\Bin\glslc.exe -DVOXEL_VERTEX Shaders\simple_shader.vert -o Shaders\simple_shader_voxel.vert.spv
+C:\VulkanSDK\1.2.189.1\Bin\glslc.exe -DCROWD_INSTANCE Shaders\simple_shader.vert -o Shaders\simple_shader_crowd.vert.spv
 C:\VulkanSDK\1.2.189.1\Bin\glslc.exe Shaders\simple_shader.frag -o Shaders\simple_shader.frag.spv
 C:\VulkanSDK\1.2.189.1\Bin\glslc.exe Shaders\skybox_shader.vert -o Shaders\skybox_shader.vert.spv
 C:\VulkanSDK\1.2.189.1\Bin\glslc.exe Shaders\skybox_shader.frag -o Shaders\skybox_shader.frag.spv